@@ -9,10 +9,15 @@ using namespace std;
 // Get actions that can be performed by a unit
 vector<Action> getActions(Unit *u) {
     vector<Action> acts;
+    getActions(u, acts);
+    return acts;
+}
+
+void getActions(Unit *u, vector<Action> &acts) {
+    acts.clear();
     if (!u->hasMoved()) acts.push_back(MOVE);
     if (!u->hasAttacked()) acts.push_back(ATTACK);
     acts.push_back(SKIP);
-    return acts;
 }
 
 // Check if there is only skip
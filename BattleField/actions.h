@@ -19,6 +19,8 @@ enum AttackType { CLOSE,
 
 // Get actions that can be performed by a unit
 std::vector<Action> getActions(Unit *u);
+// Same as above, but fill a reused list
+void getActions(Unit *u, std::vector<Action> &acts);
 
 // Check if there is only SKIP
 bool isAllSkip(const std::vector<Action> &acts);
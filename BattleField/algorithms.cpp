@@ -5,19 +5,6 @@
 
 using namespace std;
 
-// Data structure for storing squares during path finding
-struct SearchSquare {
-    SearchSquare(int r, int c, int p) :
-        row(r), col(c), pts(p) {
-    }
-
-    int row;
-    int col;
-    int pts;
-
-    // friend std::ostream& operator<< (std::ostream& out, const SearchSquare& sqr);
-};
-
 /*
 ostream& operator<<(ostream& os, const SearchSquare& sqr)
 {
@@ -49,17 +36,18 @@ int findMaxSquare(const vector<SearchSquare> &squares) {
 }
 
 // Update a reachable square if possible
-void updateSquare(Grid<bool> &reachable, const Grid<int> &costs,
+// costs holds the window of squares starting at (top, left)
+void updateSquare(MarkPlane &reachable, const Grid<int> &costs, int top, int left,
                   int row, int col, int mvPts,
                   vector<SearchSquare> &unvisited) {
     // No need to check a unattainable position
     // or a square already reachable
-    if (!costs.inBounds(row, col)
-        || reachable[row][col])
+    if (!costs.inBounds(row - top, col - left)
+        || reachable.isMarked(row, col))
         return;
 
     // Adjust movement points
-    int cost = costs[row][col];
+    int cost = costs[row - top][col - left];
     mvPts -= cost;
 
     // Update the movement point of unvisited squares
@@ -75,11 +63,25 @@ void updateSquare(Grid<bool> &reachable, const Grid<int> &costs,
 
 // Search for reachable points
 Grid<bool> searchReachable(const Grid<int> &costs, int row, int col, int mvPts) {
-    assert(costs.inBounds(row, col));
+    MarkPlane reachable(costs.numRows(), costs.numCols());
+    vector<SearchSquare> unvisited;
+    searchReachable(costs, row, col, mvPts, reachable, unvisited);
+    return reachable.grid();
+}
 
-    Grid<bool> reachable(costs.numRows(), costs.numCols());
+// Search for reachable points into the scratch plane
+void searchReachable(const Grid<int> &costs, int row, int col, int mvPts,
+                     MarkPlane &reachable, vector<SearchSquare> &unvisited) {
+    searchReachable(costs, 0, 0, row, col, mvPts, reachable, unvisited);
+}
 
-    vector<SearchSquare> unvisited;
+// Search for reachable points with the costs of a window only
+void searchReachable(const Grid<int> &costs, int top, int left, int row, int col, int mvPts,
+                     MarkPlane &reachable, vector<SearchSquare> &unvisited) {
+    assert(costs.inBounds(row - top, col - left));
+
+    reachable.clear();
+    unvisited.clear();
     if (mvPts >= 0)
         unvisited.push_back(SearchSquare(row, col, mvPts));
 
@@ -92,77 +94,97 @@ Grid<bool> searchReachable(const Grid<int> &costs, int row, int col, int mvPts)
         int rMvPts = pt.pts;
         int curRow = pt.row;
         int curCol = pt.col;
-        reachable[curRow][curCol] = true;
+        reachable.mark(curRow, curCol);
 
         // Search four directions
-        updateSquare(reachable, costs, curRow - 1, curCol, rMvPts, unvisited); // North
-        updateSquare(reachable, costs, curRow + 1, curCol, rMvPts, unvisited); // South
-        updateSquare(reachable, costs, curRow, curCol + 1, rMvPts, unvisited); // East
-        updateSquare(reachable, costs, curRow, curCol - 1, rMvPts, unvisited); // West
+        updateSquare(reachable, costs, top, left, curRow - 1, curCol, rMvPts, unvisited); // North
+        updateSquare(reachable, costs, top, left, curRow + 1, curCol, rMvPts, unvisited); // South
+        updateSquare(reachable, costs, top, left, curRow, curCol + 1, rMvPts, unvisited); // East
+        updateSquare(reachable, costs, top, left, curRow, curCol - 1, rMvPts, unvisited); // West
     }
-
-    return reachable;
 }
 
 Grid<bool> searchCloseAttackable(const Field &field, int row, int col) {
-    Grid<bool> attackable(field.getHeight(), field.getWidth(), false);
+    MarkPlane attackable(field.getHeight(), field.getWidth());
+    searchCloseAttackable(field, row, col, attackable);
+    return attackable.grid();
+}
+
+void searchCloseAttackable(const Field &field, int row, int col, MarkPlane &attackable) {
+    assert(attackable.numRows() == field.getHeight() && attackable.numCols() == field.getWidth());
+    attackable.clear();
 
     // Check the adjacent squares
-    if (attackable.inBounds(row - 1, col)) attackable[row - 1][col] = true; // North
-    if (attackable.inBounds(row + 1, col)) attackable[row + 1][col] = true; // South
-    if (attackable.inBounds(row, col + 1)) attackable[row][col + 1] = true; // East
-    if (attackable.inBounds(row, col - 1)) attackable[row][col - 1] = true; // West
-    return attackable;
+    if (attackable.inBounds(row - 1, col)) attackable.mark(row - 1, col); // North
+    if (attackable.inBounds(row + 1, col)) attackable.mark(row + 1, col); // South
+    if (attackable.inBounds(row, col + 1)) attackable.mark(row, col + 1); // East
+    if (attackable.inBounds(row, col - 1)) attackable.mark(row, col - 1); // West
 }
 
 Grid<bool> searchFarAttackable(const Field &field, int row, int col) {
-    Grid<bool> attackable(field.getHeight(), field.getWidth());
+    MarkPlane attackable(field.getHeight(), field.getWidth());
+    searchFarAttackable(field, row, col, attackable);
+    return attackable.grid();
+}
+
+void searchFarAttackable(const Field &field, int row, int col, MarkPlane &attackable) {
+    assert(attackable.numRows() == field.getHeight() && attackable.numCols() == field.getWidth());
+    attackable.clear();
+
+    int height = field.getHeight();
+    int width = field.getWidth();
 
     // Check the attack type and set the attackable squares
-    for (int r = row + 1; r < field.getHeight(); r++) {
-        if (attackable.inBounds(r, col)) {
-            attackable[r][col] = true;
-        }
+    for (int r = row + 1; r < height; r++) {
+        attackable.mark(r, col);
         if (field.getTerrain(r, col).getType() != PLAIN || field.getUnit(r, col) != nullptr) {
             break;
         }
     }
     for (int r = row - 1; r >= 0; r--) {
-        if (attackable.inBounds(r, col)) {
-            attackable[r][col] = true;
-        }
+        attackable.mark(r, col);
         if (field.getTerrain(r, col).getType() != PLAIN || field.getUnit(r, col) != nullptr) {
             break;
         }
     }
-    for (int c = col + 1; c < field.getWidth(); c++) {
-        if (attackable.inBounds(row, c)) {
-            attackable[row][c] = true;
-        }
+    for (int c = col + 1; c < width; c++) {
+        attackable.mark(row, c);
         if (field.getTerrain(row, c).getType() != PLAIN || field.getUnit(row, c) != nullptr) {
             break;
         }
     }
     for (int c = col - 1; c >= 0; c--) {
-        if (attackable.inBounds(row, c)) {
-            attackable[row][c] = true;
-        }
+        attackable.mark(row, c);
         if (field.getTerrain(row, c).getType() != PLAIN || field.getUnit(row, c) != nullptr) {
             break;
         }
     }
-    return attackable;
 }
 
 // 上下左右相邻并且间隔1的格子
 Grid<bool> searchFlightAttackable(const Field &field, int row, int col) {
-    Grid<bool> attackable(field.getHeight(), field.getWidth(), false);
+    MarkPlane attackable(field.getHeight(), field.getWidth());
+    searchFlightAttackable(field, row, col, attackable);
+    return attackable.grid();
+}
+
+void searchFlightAttackable(const Field &field, int row, int col, MarkPlane &attackable) {
+    assert(attackable.numRows() == field.getHeight() && attackable.numCols() == field.getWidth());
+    attackable.clear();
 
     // Check the adjacent squares
-    if (attackable.inBounds(row - 2, col)) attackable[row - 2][col] = true; // North
-    if (attackable.inBounds(row + 2, col)) attackable[row + 2][col] = true; // South
-    if (attackable.inBounds(row, col + 2)) attackable[row][col + 2] = true; // East
-    if (attackable.inBounds(row, col - 2)) attackable[row][col - 2] = true; // West
+    if (attackable.inBounds(row - 2, col)) attackable.mark(row - 2, col); // North
+    if (attackable.inBounds(row + 2, col)) attackable.mark(row + 2, col); // South
+    if (attackable.inBounds(row, col + 2)) attackable.mark(row, col + 2); // East
+    if (attackable.inBounds(row, col - 2)) attackable.mark(row, col - 2); // West
+}
 
-    return attackable;
-}
\ No newline at end of file
+// Pick the attack search by the type of the unit
+void searchAttackable(const Field &field, const Unit *u, MarkPlane &attackable) {
+    if (u->getType() == TANK)
+        searchFarAttackable(field, u->getRow(), u->getCol(), attackable);
+    else if (u->getType() == FLIGHTER)
+        searchFlightAttackable(field, u->getRow(), u->getCol(), attackable);
+    else
+        searchCloseAttackable(field, u->getRow(), u->getCol(), attackable);
+}
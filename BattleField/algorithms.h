@@ -2,17 +2,33 @@
 #define ALGORITHMS_H_INCLUDED
 
 /**** Algorithms for the game ****/
+#include <vector>
 #include "NewGrid.h"
 #include "field.h"
+#include "workspace.h"
 
 /** Path finding algorithm **/
 
 // Given movement points (pts), calculate
 // which squares can be reached starting from (row, col)
 Grid<bool> searchReachable(const Grid<int> &costs, int row, int col, int pts);
+// Same as above, but reuse the plane and the frontier of a workspace
+void searchReachable(const Grid<int> &costs, int row, int col, int pts,
+                     MarkPlane &reachable, std::vector<SearchSquare> &unvisited);
+// Same as above, with costs holding only the window of squares starting
+// at (top, left); the squares reached are marked where they are on the field
+void searchReachable(const Grid<int> &costs, int top, int left, int row, int col, int pts,
+                     MarkPlane &reachable, std::vector<SearchSquare> &unvisited);
 
 Grid<bool> searchCloseAttackable(const Field &field, int row, int col);
 Grid<bool> searchFarAttackable(const Field &field, int row, int col);
 Grid<bool> searchFlightAttackable(const Field &field, int row, int col);
 
+// Attack searches into a reused plane
+void searchCloseAttackable(const Field &field, int row, int col, MarkPlane &attackable);
+void searchFarAttackable(const Field &field, int row, int col, MarkPlane &attackable);
+void searchFlightAttackable(const Field &field, int row, int col, MarkPlane &attackable);
+// Attack search matching the type of unit u
+void searchAttackable(const Field &field, const Unit *u, MarkPlane &attackable);
+
 #endif // ALGORITHMS_H_INCLUDED
@@ -0,0 +1,250 @@
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include "batch.h"
+#include "algorithms.h"
+#include "engine.h"
+#include "workspace.h"
+
+using namespace std;
+
+// Units flooded together, at most one per bit of a word
+static const int LANES = 64;
+
+// A group of units sharing one flood fill
+struct ReachGroup {
+    bool ground;
+    vector<int> members; // indices into the result
+};
+
+// Scratch planes of one flood, local to the bounding box of a group
+struct FloodPlanes {
+    vector<uint64_t> cur;
+    vector<uint64_t> nxt;
+    vector<char> passable;
+};
+
+// Index of the lowest set bit
+static int lowestBit(uint64_t word) {
+#ifdef __GNUC__
+    return __builtin_ctzll(word);
+#else
+    int k = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        k++;
+    }
+    return k;
+#endif
+}
+
+bool isGroundMover(UnitType t) {
+    return t == SOLDIER || t == TANK || t == HYDRAULISK;
+}
+
+bool isPassable(const Field &field, int row, int col, bool ground) {
+    if (field.getUnit(row, col) != nullptr) return false;
+    TerrainType t = field.getTerrain(row, col).getType();
+    if (t == PLAIN) return true;
+    return ground ? t == FOREST : t == OCEAN;
+}
+
+// Flood all units of a group at once
+static void floodGroup(const Field &field, const ReachGroup &group,
+                       vector<UnitReach> &result, FloodPlanes &planes) {
+    int height = field.getHeight();
+    int width = field.getWidth();
+
+    // Bounding box of everything the group can reach
+    int maxPts = 0;
+    int top = height, bottom = -1, left = width, right = -1;
+    for (size_t k = 0; k < group.members.size(); k++) {
+        const Unit *u = result[group.members[k]].unit;
+        maxPts = max(maxPts, u->getMovPoints());
+        top = min(top, u->getRow());
+        bottom = max(bottom, u->getRow());
+        left = min(left, u->getCol());
+        right = max(right, u->getCol());
+    }
+    top = max(0, top - maxPts);
+    bottom = min(height - 1, bottom + maxPts);
+    left = max(0, left - maxPts);
+    right = min(width - 1, right + maxPts);
+    int lh = bottom - top + 1;
+    int lw = right - left + 1;
+
+    // The passability plane is shared by all units of the group
+    planes.cur.assign(size_t(lh) * lw, 0);
+    planes.nxt.assign(size_t(lh) * lw, 0);
+    planes.passable.resize(size_t(lh) * lw);
+    for (int i = 0; i < lh; i++)
+        for (int j = 0; j < lw; j++)
+            planes.passable[i * lw + j] = isPassable(field, top + i, left + j, group.ground);
+
+    for (size_t k = 0; k < group.members.size(); k++) {
+        const Unit *u = result[group.members[k]].unit;
+        planes.cur[(u->getRow() - top) * lw + (u->getCol() - left)] |= uint64_t(1) << k;
+    }
+
+    // Each step moves every lane which still has movement points by one square
+    for (int step = 1; step <= maxPts; step++) {
+        uint64_t alive = 0;
+        for (size_t k = 0; k < group.members.size(); k++)
+            if (result[group.members[k]].unit->getMovPoints() >= step)
+                alive |= uint64_t(1) << k;
+
+        bool changed = false;
+        for (int i = 0; i < lh; i++) {
+            for (int j = 0; j < lw; j++) {
+                int idx = i * lw + j;
+                uint64_t word = planes.cur[idx];
+                if (planes.passable[idx]) {
+                    uint64_t near = 0;
+                    if (i > 0) near |= planes.cur[idx - lw];      // North
+                    if (i < lh - 1) near |= planes.cur[idx + lw]; // South
+                    if (j < lw - 1) near |= planes.cur[idx + 1];  // East
+                    if (j > 0) near |= planes.cur[idx - 1];       // West
+                    word |= near & alive;
+                    changed = changed || word != planes.cur[idx];
+                }
+                planes.nxt[idx] = word;
+            }
+        }
+        planes.cur.swap(planes.nxt);
+        if (!changed) break;
+    }
+
+    // Unpack the lanes, the ids of a huge field do not fit in an int
+    for (size_t k = 0; k < group.members.size(); k++)
+        result[group.members[k]].cells.clear();
+    for (int i = 0; i < lh; i++) {
+        for (int j = 0; j < lw; j++) {
+            uint64_t word = planes.cur[i * lw + j];
+            while (word != 0) {
+                int k = lowestBit(word);
+                word &= word - 1;
+                result[group.members[k]].cells.push_back((long long)(top + i) * width + (left + j));
+            }
+        }
+    }
+}
+
+// Calculate the reachable squares of every unit of one side
+void searchReachableAll(const Field &field, bool side,
+                        vector<UnitReach> &result, int threads) {
+    int width = field.getWidth();
+
+    result.clear();
+    vector<Unit *> all;
+    field.getUnits(all);
+    for (size_t k = 0; k < all.size(); k++) {
+        if (all[k]->getSide() == side) {
+            UnitReach r;
+            r.unit = all[k];
+            result.push_back(r);
+        }
+    }
+
+    // A group never spans two tiles, so that its box stays small
+    // even when the units are scattered over a huge sparse field
+    vector<int> order(result.size());
+    for (size_t k = 0; k < order.size(); k++)
+        order[k] = k;
+    stable_sort(order.begin(), order.end(), [&result](int a, int b) {
+        const Unit *ua = result[a].unit;
+        const Unit *ub = result[b].unit;
+        if (ua->getRow() / TILE_SIZE != ub->getRow() / TILE_SIZE)
+            return ua->getRow() / TILE_SIZE < ub->getRow() / TILE_SIZE;
+        return ua->getCol() / TILE_SIZE < ub->getCol() / TILE_SIZE;
+    });
+
+    vector<ReachGroup> groups;
+    for (int g = 0; g < 2; g++) {
+        bool ground = g == 0;
+        ReachGroup group;
+        group.ground = ground;
+        long long tile = -1;
+        for (size_t o = 0; o < order.size(); o++) {
+            int k = order[o];
+            const Unit *u = result[k].unit;
+            if (isGroundMover(u->getType()) != ground) continue;
+            long long t = (long long)(u->getRow() / TILE_SIZE) * ((width + TILE_SIZE - 1) / TILE_SIZE)
+                        + u->getCol() / TILE_SIZE;
+            if (t != tile && !group.members.empty()) {
+                groups.push_back(group);
+                group.members.clear();
+            }
+            tile = t;
+            group.members.push_back(k);
+            if (group.members.size() == size_t(LANES)) {
+                groups.push_back(group);
+                group.members.clear();
+            }
+        }
+        if (!group.members.empty()) groups.push_back(group);
+    }
+
+    int workers = min(max(threads, 1), int(groups.size()));
+    if (workers <= 1) {
+        FloodPlanes planes;
+        for (size_t g = 0; g < groups.size(); g++)
+            floodGroup(field, groups[g], result, planes);
+        return;
+    }
+
+    // Groups write to disjoint results, so workers only share the counter
+    atomic<size_t> next(0);
+    vector<thread> pool;
+    for (int t = 0; t < workers; t++) {
+        pool.push_back(thread([&]() {
+            FloodPlanes planes;
+            for (size_t g = next++; g < groups.size(); g = next++)
+                floodGroup(field, groups[g], result, planes);
+        }));
+    }
+    for (size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+}
+
+// Compare the batched search with one search per unit
+void benchReachable(const Field &field, ostream &os, int reps, int threads) {
+    typedef chrono::steady_clock Clock;
+    int height = field.getHeight();
+    int width = field.getWidth();
+    reps = max(reps, 1);
+
+    vector<UnitReach> batch;
+    TurnWorkspace ws(height, width);
+    for (int side = 0; side < 2; side++) {
+        // Check that both paths agree
+        searchReachableAll(field, side, batch, threads);
+        int mismatches = 0;
+        for (size_t k = 0; k < batch.size(); k++) {
+            searchUnitReach(field, batch[k].unit, ws);
+            bool same = ws.reachable.count() == batch[k].cells.size();
+            for (size_t c = 0; same && c < batch[k].cells.size(); c++)
+                same = ws.reachable.isMarked(int(batch[k].cells[c] / width), int(batch[k].cells[c] % width));
+            if (!same) mismatches++;
+        }
+
+        Clock::time_point t0 = Clock::now();
+        for (int r = 0; r < reps; r++) {
+            for (size_t k = 0; k < batch.size(); k++)
+                searchUnitReach(field, batch[k].unit, ws);
+        }
+        Clock::time_point t1 = Clock::now();
+        for (int r = 0; r < reps; r++)
+            searchReachableAll(field, side, batch, threads);
+        Clock::time_point t2 = Clock::now();
+
+        double single = chrono::duration<double, milli>(t1 - t0).count() / reps;
+        double batched = chrono::duration<double, milli>(t2 - t1).count() / reps;
+        os << (side ? "player" : "enemy") << ": " << batch.size() << " units, "
+           << "per-unit " << single << " ms, batched " << batched << " ms, "
+           << "speedup " << (batched > 0 ? single / batched : 0) << "x, "
+           << mismatches << " mismatches" << endl;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+
+/**** Reachability of many units at once ****/
+#include <iostream>
+#include <vector>
+#include "field.h"
+
+// Reachable squares of one unit
+struct UnitReach {
+    Unit *unit;
+    std::vector<long long> cells; // row * width + col, in row-major order
+};
+
+// Check if units of type t move like ground units
+// (PLAIN and FOREST are passable) or like flying units (PLAIN and OCEAN)
+bool isGroundMover(UnitType t);
+
+// Check if the square can be entered by a unit of the movement class
+bool isPassable(const Field &field, int row, int col, bool ground);
+
+// Calculate the reachable squares of every unit of one side.
+// Units of the same movement class are flooded together,
+// one unit per bit of a 64-bit word.
+// Groups of units are spread over at most `threads` threads.
+// Units are reported in row-major order of their positions.
+void searchReachableAll(const Field &field, bool side,
+                        std::vector<UnitReach> &result, int threads = 1);
+
+// Compare the batched search with one search per unit and print timings
+void benchReachable(const Field &field, std::ostream &os, int reps, int threads);
+
+#endif // BATCH_H_INCLUDED
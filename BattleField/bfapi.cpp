@@ -0,0 +1,141 @@
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bfapi.h"
+#include "engine.h"
+#include "workspace.h"
+
+using namespace std;
+
+static_assert(int(BF_HYDRAULISK) == int(HYDRAULISK), "unit types must match the engine");
+static_assert(int(BF_FOREST) == int(FOREST), "terrain types must match the engine");
+
+struct bf_game {
+    bf_game(int h, int w) :
+        field(h, w), ws(h, w), session(0), status(BF_RUNNING) {
+    }
+
+    Field field;
+    TurnWorkspace ws;
+    PlaySession session; // no observer, only for the enemy turn
+    int status;
+    vector<Unit *> units;
+    vector<UnitAction> actions;
+};
+
+// Check that every entry of the map is complete and on the board
+// before loadMap, which trusts its input
+static bool checkMap(const string &text, int h, int w) {
+    istringstream is(text);
+    int nt = -1, nu = -1;
+    if (!(is >> nt >> nu) || nt < 0 || nu < 0) return false;
+    for (int i = 0; i < nt + nu; i++) {
+        int row, col;
+        char type;
+        if (!(is >> row >> col >> type)) return false;
+        if (row < 0 || row >= h || col < 0 || col >= w) return false;
+    }
+    return true;
+}
+
+// Start a round and check if the game is over, as the console game does
+static void startRound(bf_game *game) {
+    resetUnits(game->field);
+    countUnits(game->field, game->session.stats);
+    if (game->session.stats.enemyUnits == 0)
+        game->status = BF_WON;
+    else if (game->session.stats.playerUnits == 0)
+        game->status = BF_FAILED;
+    game->ws.beginTurn();
+}
+
+bf_game *bf_create(const char *map, size_t length, int height, int width) {
+    if (map == nullptr || height <= 0 || width <= 0) return nullptr;
+    string text(map, length);
+    if (!checkMap(text, height, width)) return nullptr;
+
+    bf_game *game = new bf_game(height, width);
+    istringstream is(text);
+    loadMap(is, game->field);
+    startRound(game);
+    return game;
+}
+
+void bf_destroy(bf_game *game) {
+    delete game;
+}
+
+int bf_height(const bf_game *game) {
+    return int(game->field.getHeight());
+}
+
+int bf_width(const bf_game *game) {
+    return int(game->field.getWidth());
+}
+
+int bf_round(const bf_game *game) {
+    return game->session.stats.rounds;
+}
+
+int bf_status(const bf_game *game) {
+    return game->status;
+}
+
+size_t bf_units(const bf_game *game, bf_unit *out, size_t capacity) {
+    vector<Unit *> &units = const_cast<bf_game *>(game)->units;
+    game->field.getUnits(units);
+    for (size_t k = 0; k < units.size() && k < capacity; k++) {
+        const Unit *u = units[k];
+        out[k].type = u->getType();
+        out[k].player = u->getSide() ? 1 : 0;
+        out[k].row = u->getRow();
+        out[k].col = u->getCol();
+        out[k].hp = u->getHp();
+        out[k].moved = u->hasMoved() ? 1 : 0;
+        out[k].attacked = u->hasAttacked() ? 1 : 0;
+    }
+    return units.size();
+}
+
+void bf_terrain(const bf_game *game, int *out) {
+    int h = bf_height(game), w = bf_width(game);
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++)
+            out[i * w + j] = game->field.getTerrain(i, j).getType();
+}
+
+size_t bf_legal_actions(bf_game *game, bf_action *out, size_t capacity) {
+    if (game->status != BF_RUNNING) return 0;
+    vector<UnitAction> &actions = game->actions;
+    getLegalActions(game->field, true, game->ws, actions);
+    for (size_t k = 0; k < actions.size() && k < capacity; k++) {
+        out[k].kind = actions[k].act == MOVE ? BF_MOVE : BF_ATTACK;
+        out[k].row = actions[k].row;
+        out[k].col = actions[k].col;
+        out[k].target_row = actions[k].trow;
+        out[k].target_col = actions[k].tcol;
+    }
+    return actions.size();
+}
+
+int bf_apply(bf_game *game, const bf_action *action) {
+    if (game->status != BF_RUNNING || action == nullptr) return BF_ILLEGAL;
+    if (action->kind != BF_MOVE && action->kind != BF_ATTACK) return BF_ILLEGAL;
+    UnitAction a;
+    a.act = action->kind == BF_MOVE ? MOVE : ATTACK;
+    a.row = action->row;
+    a.col = action->col;
+    a.trow = action->target_row;
+    a.tcol = action->target_col;
+    return applyAction(game->field, true, a, game->ws) ? BF_OK : BF_ILLEGAL;
+}
+
+int bf_enemy_step(bf_game *game) {
+    if (game->status != BF_RUNNING) return game->status;
+    playEnemyTurn(game->field, game->session, game->ws);
+    healByForests(game->field);
+    game->ws.endTurn();
+    game->session.stats.rounds++;
+    startRound(game);
+    return game->status;
+}
@@ -0,0 +1,86 @@
+#ifndef BFAPI_H_INCLUDED
+#define BFAPI_H_INCLUDED
+
+/**** The engine as a library, with a plain C interface ****/
+/* A host program creates a game from the text of a map, reads the board
+   into its own arrays, and plays the player side by applying actions and
+   then stepping the enemy turn, exactly as the console game would.
+   Nothing is printed or parsed after bf_create. A game may only be
+   used by one thread at a time; different games are independent. */
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(BF_BUILD_DLL)
+#define BF_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(BF_USE_DLL)
+#define BF_API __declspec(dllimport)
+#else
+#define BF_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bf_game bf_game;
+
+/* Same order as the engine */
+enum bf_unit_type { BF_SOLDIER, BF_TANK, BF_BEE, BF_FLIGHTER, BF_HYDRAULISK };
+enum bf_terrain_type { BF_PLAIN, BF_MOUNTAIN, BF_OCEAN, BF_FOREST };
+
+/* State of a game, checked at the start of every round */
+enum bf_status { BF_RUNNING, BF_WON, BF_FAILED };
+
+enum bf_action_kind { BF_MOVE = 1, BF_ATTACK = 2 };
+
+/* Results of bf_apply */
+enum bf_result { BF_OK = 0, BF_ILLEGAL = -1 };
+
+typedef struct bf_unit {
+    int type;       /* bf_unit_type */
+    int player;     /* 1 for the player side, 0 for the enemy */
+    int row, col;
+    int hp;
+    int moved;      /* 1 if it cannot move any more this round */
+    int attacked;   /* 1 if it cannot attack any more this round */
+} bf_unit;
+
+typedef struct bf_action {
+    int kind;                   /* bf_action_kind */
+    int row, col;               /* the unit */
+    int target_row, target_col; /* destination or target */
+} bf_action;
+
+/* Create a game of height x width from a map in the text format of the
+   console game (terrains, then units). Return NULL if the map is
+   malformed or out of the board. */
+BF_API bf_game *bf_create(const char *map, size_t length, int height, int width);
+BF_API void bf_destroy(bf_game *game);
+
+BF_API int bf_height(const bf_game *game);
+BF_API int bf_width(const bf_game *game);
+/* Rounds completed */
+BF_API int bf_round(const bf_game *game);
+BF_API int bf_status(const bf_game *game);
+
+/* Copy up to capacity units into out, in row-major order.
+   Return the number of units on the board. */
+BF_API size_t bf_units(const bf_game *game, bf_unit *out, size_t capacity);
+/* Copy the height * width terrains into out, row-major */
+BF_API void bf_terrain(const bf_game *game, int *out);
+
+/* Copy up to capacity of the actions the player may take now into out,
+   ordered by unit, then moves before attacks, then target square.
+   Return the number of legal actions; 0 once the game is over. */
+BF_API size_t bf_legal_actions(bf_game *game, bf_action *out, size_t capacity);
+/* Apply one action of the player. Return BF_ILLEGAL, and change nothing,
+   if it is not among the legal actions. */
+BF_API int bf_apply(bf_game *game, const bf_action *action);
+/* End the turn of the player: the enemy units act, the forests heal and
+   the next round starts. Return the new bf_status. */
+BF_API int bf_enemy_step(bf_game *game);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BFAPI_H_INCLUDED */
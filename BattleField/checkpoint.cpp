@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "checkpoint.h"
+
+using namespace std;
+
+static const unsigned char MAGIC[4] = {'B', 'F', 'C', 'P'};
+static const size_t HEADER_SIZE = 4 + 2 + 4 * 3 + 2 + 4;
+static const size_t UNIT_SIZE = 4 * 3 + 2;
+static const size_t CHECKSUM_SIZE = 8;
+static_assert(FOREST < 4, "terrains must fit in 2 bits");
+
+// 64-bit FNV-1a
+static unsigned long long checksum(const unsigned char *data, size_t size) {
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t k = 0; k < size; k++) {
+        h ^= data[k];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static unsigned char *putInt(unsigned char *p, unsigned long long x, int bytes) {
+    for (int k = 0; k < bytes; k++)
+        *p++ = (unsigned char)(x >> (8 * k));
+    return p;
+}
+
+static unsigned long long getInt(const unsigned char *&p, int bytes) {
+    unsigned long long x = 0;
+    for (int k = 0; k < bytes; k++)
+        x |= (unsigned long long)(*p++) << (8 * k);
+    return x;
+}
+
+// Bytes of the terrain plane
+static size_t terrainSize(size_t squares) {
+    return (squares + 3) / 4;
+}
+
+// Player units are the soldiers, tanks and flighters, as in Field::setUnit
+static bool playerType(UnitType t) {
+    return t == SOLDIER || t == TANK || t == FLIGHTER;
+}
+
+void writeCheckpoint(const Field &field, const GameState &state, vector<unsigned char> &buf) {
+    int h = field.getHeight(), w = field.getWidth();
+    vector<Unit *> units;
+    field.getUnits(units);
+    size_t squares = size_t(h) * w;
+    buf.assign(HEADER_SIZE + terrainSize(squares) + units.size() * UNIT_SIZE + CHECKSUM_SIZE, 0);
+
+    unsigned char *p = &buf[0];
+    p = copy(MAGIC, MAGIC + 4, p);
+    p = putInt(p, CHECKPOINT_VERSION, 2);
+    p = putInt(p, h, 4);
+    p = putInt(p, w, 4);
+    p = putInt(p, state.rounds, 4);
+    p = putInt(p, state.phase == PHASE_ENEMY ? 0 : 1, 1);
+    p = putInt(p, state.phase, 1);
+    p = putInt(p, units.size(), 4);
+
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++) {
+            size_t k = size_t(i) * w + j;
+            p[k / 4] |= (unsigned char)(field.getTerrain(i, j).getType() << (2 * (k % 4)));
+        }
+    p += terrainSize(squares);
+
+    for (size_t k = 0; k < units.size(); k++) {
+        const Unit *u = units[k];
+        p = putInt(p, u->getRow(), 4);
+        p = putInt(p, u->getCol(), 4);
+        p = putInt(p, (unsigned)u->getHp(), 4);
+        p = putInt(p, u->getType(), 1);
+        p = putInt(p, (u->hasMoved() ? 1 : 0) | (u->hasAttacked() ? 2 : 0), 1);
+    }
+    putInt(p, checksum(&buf[0], p - &buf[0]), 8);
+}
+
+bool readCheckpoint(const unsigned char *data, size_t size, Field &field, GameState &state) {
+    if (data == nullptr || size < HEADER_SIZE + CHECKSUM_SIZE || !equal(MAGIC, MAGIC + 4, data)) return false;
+    const unsigned char *p = data + 4;
+    if (getInt(p, 2) != (unsigned)CHECKPOINT_VERSION) return false;
+    long long h = getInt(p, 4), w = getInt(p, 4), rounds = getInt(p, 4);
+    int side = int(getInt(p, 1)), phase = int(getInt(p, 1));
+    size_t count = size_t(getInt(p, 4));
+    if (h <= 0 || w <= 0 || h > 1 << 30 || w > 1 << 30 || rounds > 1 << 30) return false;
+    if (phase > PHASE_ENEMY || side != (phase == PHASE_ENEMY ? 0 : 1)) return false;
+    size_t squares = size_t(h) * size_t(w);
+    if (squares / size_t(w) != size_t(h) || count > squares) return false;
+    if (size != HEADER_SIZE + terrainSize(squares) + count * UNIT_SIZE + CHECKSUM_SIZE) return false;
+    const unsigned char *end = data + size - CHECKSUM_SIZE, *sum = end;
+    if (getInt(sum, 8) != checksum(data, end - data)) return false;
+
+    vector<unsigned char> terrain(squares);
+    for (size_t k = 0; k < squares; k++)
+        terrain[k] = (p[k / 4] >> (2 * (k % 4))) & 3;
+    p += terrainSize(squares);
+
+    // The units go straight into the block the field keeps
+    vector<Unit> block;
+    vector<long long> cells;
+    block.reserve(count);
+    cells.reserve(count);
+    for (size_t k = 0; k < count; k++) {
+        long long row = getInt(p, 4), col = getInt(p, 4);
+        int hp = int((unsigned)getInt(p, 4)), type = int(getInt(p, 1)), flags = int(getInt(p, 1));
+        if (row >= h || col >= w || type > HYDRAULISK || hp <= 0 || flags > 3) return false;
+        Unit u(UnitType(type), playerType(UnitType(type)), int(row), int(col));
+        u.receiveDamage(u.getHp() - hp);
+        u.setMoved((flags & 1) != 0);
+        u.setAttacked((flags & 2) != 0);
+        block.push_back(u);
+        cells.push_back(row * w + col);
+    }
+    sort(cells.begin(), cells.end());
+    if (adjacent_find(cells.begin(), cells.end()) != cells.end()) return false;
+
+    field.restore(int(h), int(w), terrain, block);
+    state.rounds = int(rounds);
+    state.phase = TurnPhase(phase);
+    return true;
+}
+
+bool saveCheckpoint(const string &path, const Field &field, const GameState &state) {
+    vector<unsigned char> buf;
+    writeCheckpoint(field, state, buf);
+    ofstream os(path.c_str(), ios::binary);
+    os.write((const char *)&buf[0], buf.size());
+    return bool(os);
+}
+
+bool loadCheckpoint(const string &path, Field &field, GameState &state) {
+    ifstream is(path.c_str(), ios::binary);
+    if (!is) return false;
+    vector<unsigned char> buf((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+    return readCheckpoint(buf.empty() ? nullptr : &buf[0], buf.size(), field, state);
+}
+
+/** Checks **/
+
+// Play the commands from the start, with no output but the text, and return the final board
+static string playCase(Field &f, const string &commands, const PlayOptions &options, string &board) {
+    TurnWorkspace ws(f.getHeight(), f.getWidth());
+    BufferSource in(commands);
+    ostringstream os;
+    play(f, in, os, ws, options);
+    GameState over = {0, PHASE_NONE};
+    vector<unsigned char> buf;
+    writeCheckpoint(f, over, buf);
+    board.assign(buf.begin(), buf.end());
+    return os.str();
+}
+
+bool checkCheckpoints(const Field &field, const string &commands, const string &name, ostream &os) {
+    Field f(field);
+    GameState start = {0, PHASE_ROUND_START}, state;
+    vector<unsigned char> saved, again;
+    writeCheckpoint(f, start, saved);
+
+    Field g(1, 1);
+    for (size_t k = 0; k < saved.size(); k++) {
+        saved[k] ^= 0x10;
+        bool read = readCheckpoint(&saved[0], saved.size(), g, state);
+        saved[k] ^= 0x10;
+        if (read) {
+            os << name << ": byte " << k << " changed and still read" << endl;
+            return false;
+        }
+    }
+    if (readCheckpoint(&saved[0], saved.size() - 1, g, state) || !readCheckpoint(&saved[0], saved.size(), g, state)) {
+        os << name << ": cannot read the checkpoint back" << endl;
+        return false;
+    }
+    writeCheckpoint(g, state, again);
+    if (again != saved) {
+        os << name << ": the checkpoint read back is saved differently" << endl;
+        return false;
+    }
+
+    string board, resumedBoard;
+    string out = playCase(f, commands, PlayOptions(), board);
+    PlayOptions options;
+    options.resume = &state;
+    if (playCase(g, commands, options, resumedBoard) != out || resumedBoard != board) {
+        os << name << ": the game read back plays differently" << endl;
+        return false;
+    }
+
+    int cuts = 0;
+    const string prompt = "End this turn (y,n)?\n";
+    for (size_t cut = commands.find('\n'); cut != string::npos; cut = commands.find('\n', cut + 1)) {
+        // The first half, up to a prompt to end the turn
+        Field first(1, 1);
+        readCheckpoint(&saved[0], saved.size(), first, state);
+        GameState stopped = {0, PHASE_NONE};
+        PlayOptions head;
+        head.stopped = &stopped;
+        string headOut = playCase(first, commands.substr(0, cut + 1), head, resumedBoard);
+        if (stopped.phase == PHASE_NONE) continue;
+
+        // The second half reprints the board and the prompt it was saved at
+        Field second(1, 1);
+        GameState resumed;
+        vector<unsigned char> middle;
+        writeCheckpoint(first, stopped, middle);
+        if (!readCheckpoint(&middle[0], middle.size(), second, resumed)) {
+            os << name << ": cannot read the game cut after byte " << cut << endl;
+            return false;
+        }
+        PlayOptions tail;
+        tail.resume = &resumed;
+        string tailOut = playCase(second, commands.substr(cut + 1), tail, resumedBoard);
+        size_t reprinted = tailOut.find(prompt);
+        if (reprinted == string::npos || headOut + tailOut.substr(reprinted + prompt.size()) != out || resumedBoard != board) {
+            os << name << ": the game cut after byte " << cut << " plays differently" << endl;
+            return false;
+        }
+        cuts++;
+    }
+    os << name << ": " << saved.size() << " bytes, resumed at " << cuts << " prompts" << endl;
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef CHECKPOINT_H_INCLUDED
+#define CHECKPOINT_H_INCLUDED
+
+/**** Binary checkpoints of a game ****/
+#include <iostream>
+#include <string>
+#include <vector>
+#include "field.h"
+#include "engine.h"
+
+/* A checkpoint is one contiguous buffer, all integers little-endian:
+     "BFCP", format version (2 bytes), height, width, rounds (4 bytes each),
+     side to move (1 = player), turn phase, unit count (4 bytes),
+     the terrains row-major with 2 bits per square, four squares a byte,
+     then per unit: row, col, hp (4 bytes each), type, moved | attacked << 1,
+     and last the 64-bit FNV-1a hash of everything before it.
+   The side is implied by the phase; it is stored so that a reader
+   does not have to know the phases, and checked against it. */
+
+// Format version written, and the only one read
+const int CHECKPOINT_VERSION = 1;
+
+// Write the field and the state of the game into buf, replacing its content
+void writeCheckpoint(const Field &field, const GameState &state, std::vector<unsigned char> &buf);
+
+// Check a checkpoint and restore it: the field takes the size saved.
+// Return false, leaving field and state alone, if the buffer is not
+// a checkpoint of this version, is truncated or fails its checksum,
+// or describes a board which cannot be.
+bool readCheckpoint(const unsigned char *data, size_t size, Field &field, GameState &state);
+
+// Same as above with a file; return false if it cannot be written or read
+bool saveCheckpoint(const std::string &path, const Field &field, const GameState &state);
+bool loadCheckpoint(const std::string &path, Field &field, GameState &state);
+
+// Check the checkpoints on a case, the map in field followed by the commands:
+// every byte changed or a byte missing is rejected, a board saved
+// and read back is saved the same, and the game cut after any line
+// where it waits for the end of a turn, saved there and resumed on
+// another field prints the same and ends on the same board as in one go.
+// Print the result to os, the case called name there.
+bool checkCheckpoints(const Field &field, const std::string &commands, const std::string &name, std::ostream &os);
+
+#endif // CHECKPOINT_H_INCLUDED
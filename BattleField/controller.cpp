@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cstdlib>
+#include "controller.h"
+#include "algorithms.h"
+#include "engine.h"
+
+using namespace std;
+
+// Index of act in acts, or -1
+static int findAction(const vector<Action> &acts, Action act) {
+    for (size_t i = 0; i < acts.size(); i++)
+        if (acts[i] == act) return i;
+    return -1;
+}
+
+/** EnemyController **/
+
+EnemyController::EnemyController(TurnWorkspace &ws) :
+    ws(ws), side(false), current(nullptr), done(true) {
+}
+
+void EnemyController::beginTurn(const Field &field, bool s) {
+    side = s;
+    order.begin(field, s);
+    current = nullptr;
+    done = true;
+}
+
+// Look for the next unit which has not moved, row by row
+bool EnemyController::endTurn(const Field &field, const MarkPlane &) {
+    if (!done) return false;
+
+    for (Unit *unit = order.next(field); unit != nullptr; unit = order.next(field)) {
+        if (!unit->hasMoved()) {
+            current = unit;
+            done = false;
+            return false;
+        }
+    }
+    return true;
+}
+
+void EnemyController::selectUnit(const Field &, const MarkPlane &, int &row, int &col) {
+    row = current->getRow();
+    col = current->getCol();
+}
+
+// Move first, then attack if a player unit is next to the unit
+int EnemyController::selectAction(const Field &field, const Unit *, const vector<Action> &acts) {
+    if (!current->hasMoved()) {
+        if (chooseEnemyMove(field, current, ws, planRow, planCol)) return findAction(acts, MOVE);
+    } else {
+        Unit *target = chooseEnemyTarget(field, current, ws);
+        if (target != nullptr) {
+            planRow = target->getRow();
+            planCol = target->getCol();
+            return findAction(acts, ATTACK);
+        }
+    }
+    done = true;
+    return findAction(acts, SKIP);
+}
+
+void EnemyController::selectDestination(const Field &, const Unit *, const MarkPlane &,
+                                        int &row, int &col) {
+    row = planRow;
+    col = planCol;
+}
+
+void EnemyController::selectTarget(const Field &, const Unit *, const MarkPlane &,
+                                   int &row, int &col) {
+    row = planRow;
+    col = planCol;
+    done = true;
+}
+
+/** GreedyController **/
+
+void GreedyController::beginTurn(const Field &, bool s) {
+    side = s;
+    finished.clear();
+}
+
+bool GreedyController::endTurn(const Field &field, const MarkPlane &actionable) {
+    int row, col;
+    selectUnit(field, actionable, row, col);
+    return row == -1;
+}
+
+// The first actionable unit which has not given up
+// (the units are marked in row-major order)
+void GreedyController::selectUnit(const Field &field, const MarkPlane &actionable, int &row, int &col) {
+    row = col = -1;
+    for (size_t k = 0; k < actionable.count(); k++) {
+        int i = actionable.markedRow(k), j = actionable.markedCol(k);
+        if (find(finished.begin(), finished.end(), field.getUnit(i, j)) == finished.end()) {
+            row = i;
+            col = j;
+            return;
+        }
+    }
+}
+
+int GreedyController::selectAction(const Field &field, const Unit *u, const vector<Action> &acts) {
+    // Attack the weakest enemy in range
+    if (findAction(acts, ATTACK) != -1) {
+        if (attackable.numRows() != field.getHeight() || attackable.numCols() != field.getWidth())
+            attackable.resize(field.getHeight(), field.getWidth());
+        searchAttackable(field, u, attackable);
+        // Ties go to the first square in row-major order
+        int bestHp = 0;
+        for (size_t k = 0; k < attackable.count(); k++) {
+            int i = attackable.markedRow(k), j = attackable.markedCol(k);
+            const Unit *target = field.getUnit(i, j);
+            if (target == nullptr || target->getSide() == side) continue;
+            if (bestHp == 0 || target->getHp() < bestHp
+                || (target->getHp() == bestHp && (i < targetRow || (i == targetRow && j < targetCol)))) {
+                bestHp = target->getHp();
+                targetRow = i;
+                targetCol = j;
+            }
+        }
+        if (bestHp > 0) return findAction(acts, ATTACK);
+    }
+
+    // Otherwise get closer
+    if (findAction(acts, MOVE) != -1) return findAction(acts, MOVE);
+
+    finished.push_back(u);
+    return findAction(acts, SKIP);
+}
+
+// The reachable square closest to an enemy unit
+void GreedyController::selectDestination(const Field &field, const Unit *u, const MarkPlane &reachable,
+                                         int &row, int &col) {
+    field.getUnits(enemies);
+    enemies.erase(remove_if(enemies.begin(), enemies.end(), [this](const Unit *e) { return e->getSide() == side; }),
+                  enemies.end());
+
+    // Ties go to the first square in row-major order
+    row = u->getRow();
+    col = u->getCol();
+    int bestDist = -1;
+    for (size_t m = 0; m < reachable.count(); m++) {
+        int i = reachable.markedRow(m), j = reachable.markedCol(m);
+        int dist = -1;
+        for (size_t k = 0; k < enemies.size(); k++) {
+            int d = abs(enemies[k]->getRow() - i) + abs(enemies[k]->getCol() - j);
+            if (dist == -1 || d < dist) dist = d;
+        }
+        if (dist != -1 && (bestDist == -1 || dist < bestDist
+                           || (dist == bestDist && (i < row || (i == row && j < col))))) {
+            bestDist = dist;
+            row = i;
+            col = j;
+        }
+    }
+}
+
+void GreedyController::selectTarget(const Field &, const Unit *, const MarkPlane &,
+                                    int &row, int &col) {
+    row = targetRow;
+    col = targetCol;
+}
+
+/** RandomController **/
+
+RandomController::RandomController(unsigned seed) :
+    rng(seed) {
+}
+
+void RandomController::reseed(unsigned seed) {
+    rng.seed(seed);
+}
+
+// A number in [0, n)
+int RandomController::draw(int n) {
+    return uniform_int_distribution<int>(0, n - 1)(rng);
+}
+
+void RandomController::beginTurn(const Field &, bool) {
+}
+
+// End the turn one time in ten
+bool RandomController::endTurn(const Field &, const MarkPlane &) {
+    return draw(10) == 0;
+}
+
+// The units are marked in row-major order
+void RandomController::selectUnit(const Field &, const MarkPlane &actionable, int &row, int &col) {
+    size_t k = draw(actionable.count());
+    row = actionable.markedRow(k);
+    col = actionable.markedCol(k);
+}
+
+int RandomController::selectAction(const Field &, const Unit *, const vector<Action> &acts) {
+    return draw(acts.size());
+}
+
+void RandomController::selectDestination(const Field &, const Unit *, const MarkPlane &reachable,
+                                         int &row, int &col) {
+    size_t k = draw(reachable.count());
+    row = reachable.markedRow(k);
+    col = reachable.markedCol(k);
+}
+
+void RandomController::selectTarget(const Field &, const Unit *, const MarkPlane &attackable,
+                                    int &row, int &col) {
+    size_t k = draw(attackable.count());
+    row = attackable.markedRow(k);
+    col = attackable.markedCol(k);
+}
+
+bool parsePlayerPolicy(const string &name, PlayerPolicy &policy) {
+    if (name == "greedy")
+        policy = POLICY_GREEDY;
+    else if (name == "random")
+        policy = POLICY_RANDOM;
+    else
+        return false;
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef CONTROLLER_H_INCLUDED
+#define CONTROLLER_H_INCLUDED
+
+/**** Decision makers of a headless game ****/
+#include <random>
+#include <string>
+#include <vector>
+#include "NewGrid.h"
+#include "field.h"
+#include "actions.h"
+#include "workspace.h"
+
+/* Controls the units of one side.
+   During a turn the engine asks, until the controller ends the turn:
+   which unit acts, which action it takes and, for MOVE and ATTACK,
+   which square is the destination or the target.
+   Choices which break the rules end the turn of the side. */
+class Controller {
+public:
+    virtual ~Controller() {}
+
+    // Called at the start of every turn of the side
+    virtual void beginTurn(const Field &field, bool side) = 0;
+
+    // Return true to end the turn
+    // actionable marks the units which may still act
+    virtual bool endTurn(const Field &field, const MarkPlane &actionable) = 0;
+
+    // Choose an actionable unit
+    virtual void selectUnit(const Field &field, const MarkPlane &actionable, int &row, int &col) = 0;
+
+    // Choose one of acts, return its index
+    virtual int selectAction(const Field &field, const Unit *u, const std::vector<Action> &acts) = 0;
+
+    // Choose a marked square of reachable
+    virtual void selectDestination(const Field &field, const Unit *u, const MarkPlane &reachable,
+                                   int &row, int &col) = 0;
+
+    // Choose a marked square of attackable
+    virtual void selectTarget(const Field &field, const Unit *u, const MarkPlane &attackable,
+                              int &row, int &col) = 0;
+};
+
+/* The enemy logic of the game: every unit in row-major order
+   moves as close as possible to the player units
+   and attacks the first player unit next to it. */
+class EnemyController : public Controller {
+public:
+    explicit EnemyController(TurnWorkspace &ws);
+
+    void beginTurn(const Field &field, bool side);
+    bool endTurn(const Field &field, const MarkPlane &actionable);
+    void selectUnit(const Field &field, const MarkPlane &actionable, int &row, int &col);
+    int selectAction(const Field &field, const Unit *u, const std::vector<Action> &acts);
+    void selectDestination(const Field &field, const Unit *u, const MarkPlane &reachable,
+                           int &row, int &col);
+    void selectTarget(const Field &field, const Unit *u, const MarkPlane &attackable,
+                      int &row, int &col);
+
+private:
+    TurnWorkspace &ws;
+    bool side;
+    UnitCursor order; // units of the side, in row-major order
+    Unit *current; // the unit acting now
+    bool done;     // the current unit has finished
+    int planRow, planCol; // destination or target chosen by selectAction
+};
+
+/* Units act in row-major order: attack the weakest enemy in range,
+   otherwise walk towards the closest enemy and try again. */
+class GreedyController : public Controller {
+public:
+    void beginTurn(const Field &field, bool side);
+    bool endTurn(const Field &field, const MarkPlane &actionable);
+    void selectUnit(const Field &field, const MarkPlane &actionable, int &row, int &col);
+    int selectAction(const Field &field, const Unit *u, const std::vector<Action> &acts);
+    void selectDestination(const Field &field, const Unit *u, const MarkPlane &reachable,
+                           int &row, int &col);
+    void selectTarget(const Field &field, const Unit *u, const MarkPlane &attackable,
+                      int &row, int &col);
+
+private:
+    bool side;
+    std::vector<const Unit *> finished; // units which chose SKIP this turn
+    int targetRow, targetCol;           // best target found by selectAction
+    MarkPlane attackable;
+    std::vector<Unit *> enemies;
+};
+
+/* Every choice is drawn at random among the legal ones. */
+class RandomController : public Controller {
+public:
+    explicit RandomController(unsigned seed);
+
+    // Draw the choices of the next game from a new seed
+    void reseed(unsigned seed);
+
+    void beginTurn(const Field &field, bool side);
+    bool endTurn(const Field &field, const MarkPlane &actionable);
+    void selectUnit(const Field &field, const MarkPlane &actionable, int &row, int &col);
+    int selectAction(const Field &field, const Unit *u, const std::vector<Action> &acts);
+    void selectDestination(const Field &field, const Unit *u, const MarkPlane &reachable,
+                           int &row, int &col);
+    void selectTarget(const Field &field, const Unit *u, const MarkPlane &attackable,
+                      int &row, int &col);
+
+private:
+    std::mt19937 rng;
+
+    int draw(int n);
+};
+
+// Built-in player policies
+enum PlayerPolicy { POLICY_GREEDY, POLICY_RANDOM };
+
+// Parse "greedy" or "random", return false for other names
+bool parsePlayerPolicy(const std::string &name, PlayerPolicy &policy);
+
+#endif // CONTROLLER_H_INCLUDED
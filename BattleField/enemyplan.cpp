@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "enemyplan.h"
+#include "batch.h"
+#include "workspace.h"
+
+using namespace std;
+
+EnemyPlans::EnemyPlans() :
+    used(0), roomPts(0), owner(0), seen(0), replayed(0), evaluated(0) {
+}
+
+void EnemyPlans::clear() {
+    for (size_t s = 0; s < units.size(); s++) {
+        if (units[s] == nullptr) continue;
+        spare.push_back(slots[s]);
+        units[s] = nullptr;
+    }
+    used = 0;
+}
+
+static size_t hashUnit(const Unit *u) {
+    return size_t((unsigned long long)(uintptr_t(u) >> 4) * 0x9E3779B97F4A7C15ULL >> 32);
+}
+
+// The slot holding the plan of u, or the free slot where it goes
+size_t EnemyPlans::slotOf(const Unit *u) const {
+    size_t mask = units.size() - 1;
+    size_t s = hashUnit(u) & mask;
+    while (units[s] != nullptr && units[s] != u)
+        s = (s + 1) & mask;
+    return s;
+}
+
+// Free slot s, moving back the plans after it which would not be found any more
+void EnemyPlans::erase(size_t s) {
+    spare.push_back(slots[s]);
+    size_t mask = units.size() - 1;
+    for (size_t j = (s + 1) & mask; units[j] != nullptr; j = (j + 1) & mask) {
+        size_t home = hashUnit(units[j]) & mask;
+        // The plan stays if its home is in (s, j], cyclically
+        bool stays = s < j ? home > s && home <= j : home > s || home <= j;
+        if (stays) continue;
+        units[s] = units[j];
+        slots[s] = slots[j];
+        s = j;
+    }
+    units[s] = nullptr;
+    used--;
+}
+
+// Double the table, or make the first one
+void EnemyPlans::grow() {
+    vector<const Unit *> oldUnits(max(size_t(16), 2 * units.size()), nullptr);
+    vector<size_t> oldSlots(oldUnits.size());
+    units.swap(oldUnits);
+    slots.swap(oldSlots);
+    for (size_t k = 0; k < oldUnits.size(); k++) {
+        if (oldUnits[k] == nullptr) continue;
+        size_t s = slotOf(oldUnits[k]);
+        units[s] = oldUnits[k];
+        slots[s] = oldSlots[k];
+    }
+}
+
+// Forget the plans of another field, or of one reset since, e.g. by the
+// start of another game: their units may be gone
+void EnemyPlans::sync(const Field &field) {
+    if (owner != field.getId() || !field.getChangesSince(seen, changes)) {
+        clear();
+        owner = field.getId();
+    }
+    seen = field.getVersion();
+}
+
+// Check every change made since the plan was checked last
+bool EnemyPlans::stillValid(const Field &field, Plan &plan) {
+    if (!field.getChangesSince(plan.version, changes)) return false;
+
+    long long width = field.getWidth();
+    for (size_t c = 0; c < changes.size(); c++) {
+        int row = int(changes[c] / width);
+        int col = int(changes[c] % width);
+        int d = abs(row - plan.row) + abs(col - plan.col);
+        // The reachable squares may differ
+        if (d <= plan.pts) return false;
+        // Too far to matter for any distance
+        if (d - plan.pts > plan.maxDist) continue;
+
+        // A player unit here shortens the distances beyond it,
+        // an empty square may have been the nearest player unit before
+        const Unit *u = field.getUnit(row, col);
+        bool player = u != nullptr && u->getSide();
+        for (size_t k = 0; k < plan.cells.size(); k++) {
+            int dk = int(llabs(row - plan.cells[k] / width) + llabs(col - plan.cells[k] % width));
+            if (player ? dk < plan.dists[k] : dk == plan.dists[k]) return false;
+        }
+    }
+    plan.version = field.getVersion();
+    return true;
+}
+
+bool EnemyPlans::lookup(const Field &field, const Unit *u, bool &canMove, int &row, int &col) {
+    sync(field);
+
+    if (used == 0) return false;
+    size_t s = slotOf(u);
+    if (units[s] == nullptr) return false;
+    Plan &plan = plans[slots[s]];
+    if (plan.row != u->getRow() || plan.col != u->getCol() || plan.pts != u->getMovPoints()
+        || plan.ground != isGroundMover(u->getType()) || !stillValid(field, plan)) {
+        erase(s);
+        return false;
+    }
+
+    canMove = plan.canMove;
+    row = plan.moveRow;
+    col = plan.moveCol;
+    replayed++;
+    return true;
+}
+
+void EnemyPlans::store(const Field &field, const Unit *u, const MarkPlane &reachable,
+                       const vector<int> &dists, bool canMove, int row, int col) {
+    sync(field);
+
+    // Keep the table at most half full
+    if (units.size() < 2 * (used + 1)) grow();
+    size_t s = slotOf(u);
+    if (units[s] == nullptr) {
+        if (spare.empty()) {
+            spare.reserve(plans.size() + 1);
+            spare.push_back(plans.size());
+            plans.push_back(Plan());
+        }
+        units[s] = u;
+        slots[s] = spare.back();
+        spare.pop_back();
+        used++;
+    }
+    Plan &plan = plans[slots[s]];
+    plan.version = field.getVersion();
+    plan.row = u->getRow();
+    plan.col = u->getCol();
+    plan.pts = u->getMovPoints();
+    plan.ground = isGroundMover(u->getType());
+    plan.canMove = canMove;
+    plan.moveRow = row;
+    plan.moveCol = col;
+    // Room for the most squares any unit stored so far can reach,
+    // so that the lists never grow again once the game is warm
+    roomPts = max(roomPts, plan.pts);
+    size_t most = 2 * size_t(roomPts) * (roomPts + 1) + 1;
+    plan.cells.reserve(most);
+    plan.dists.reserve(most);
+    plan.cells.clear();
+    plan.dists.assign(dists.begin(), dists.end());
+    plan.maxDist = 0;
+    long long width = field.getWidth();
+    for (size_t k = 0; k < reachable.count(); k++) {
+        plan.cells.push_back(reachable.markedRow(k) * width + reachable.markedCol(k));
+        plan.maxDist = max(plan.maxDist, dists[k]);
+    }
+    evaluated++;
+}
+
+unsigned long long EnemyPlans::getReplayed() const {
+    return replayed;
+}
+
+unsigned long long EnemyPlans::getEvaluated() const {
+    return evaluated;
+}
@@ -0,0 +1,65 @@
+#ifndef ENEMYPLAN_H_INCLUDED
+#define ENEMYPLAN_H_INCLUDED
+
+/**** Remember the moves chosen by the enemy logic ****/
+#include <vector>
+#include "field.h"
+
+class MarkPlane;
+
+/* The move of an enemy unit only depends on the squares it can reach
+   and on the distance from each of them to the nearest player unit.
+   A plan keeps both, together with the move chosen from them,
+   and is replayed as long as the changes of the field leave them alone. */
+class EnemyPlans {
+public:
+    EnemyPlans();
+
+    // Find the remembered move of enemy unit u if it is still valid
+    bool lookup(const Field &field, const Unit *u, bool &canMove, int &row, int &col);
+    // Remember the move chosen for u, dists[k] being the distance from
+    // the k-th marked square of reachable to the nearest player unit
+    void store(const Field &field, const Unit *u, const MarkPlane &reachable,
+               const std::vector<int> &dists, bool canMove, int row, int col);
+
+    // Forget everything
+    void clear();
+
+    // Moves replayed and moves computed
+    unsigned long long getReplayed() const;
+    unsigned long long getEvaluated() const;
+
+private:
+    struct Plan {
+        unsigned long long version; // field version the plan is known to hold for
+        int row, col, pts;          // where the unit was and its movement points
+        bool ground;
+        bool canMove;
+        int moveRow, moveCol;
+        std::vector<long long> cells; // reachable squares, row * width + col
+        std::vector<int> dists; // distance to the nearest player unit of each
+        int maxDist;
+    };
+
+    void sync(const Field &field);
+    bool stillValid(const Field &field, Plan &plan);
+    size_t slotOf(const Unit *u) const;
+    void erase(size_t s);
+    void grow();
+
+    // Latest plan of each unit, by open addressing on the unit. A plan
+    // dropped goes back to the spare ones with the room of its lists,
+    // so the plans of a game played again do not touch the heap.
+    std::vector<const Unit *> units; // nullptr if the slot is free
+    std::vector<size_t> slots;       // plan of the unit of each slot
+    std::vector<Plan> plans;
+    std::vector<size_t> spare;       // plans not in use
+    size_t used;
+    int roomPts; // most movement points ever stored
+    std::vector<long long> changes;
+    unsigned long long owner; // id of the field
+    unsigned long long seen;  // version of owner already checked
+    unsigned long long replayed, evaluated;
+};
+
+#endif // ENEMYPLAN_H_INCLUDED
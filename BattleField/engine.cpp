@@ -1,22 +1,33 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
 #include <iomanip>
 #include <limits>
+#include <cassert>
 #include "engine.h"
 #include "terrain.h"
 #include "unit.h"
 #include "actions.h"
 #include "algorithms.h"
+#include "render.h"
+#include "output.h"
 
 using namespace std;
 
+// Cost of a square off the field, more than any unit can pay
+static const int OFF_FIELD_COST = numeric_limits<int>::max() / 2;
+
 // Forward declaration of auxiliary functions
-void printHLine(ostream &os, int n);
+void printHLine(ostream &os, int n, int indent);
+void showPlainField(PlaySession &session, ostream &os, const Field &field, const MarkPlane &follow);
+void showField(PlaySession &session, ostream &os, const Field &field, const MarkPlane &marks, dp_mode dp,
+               int focusRow = -1, int focusCol = -1);
 string getDpSymbol(dp_mode dp);
-Grid<int> getFieldCosts(const Field &field, Unit *u);
-bool performAction(Field &field, istream &is, ostream &os, Unit *u, Action act);
-bool performMove(ostream &os, istream &is, Field &field, Unit *u);
-bool performAttack(ostream &os, istream &is, Field &field, Unit *u);
-bool performEnemyAction(Field &field, Unit *u);
-int getPositionValue(const Field &field, int row, int col);
+bool performEnemyAction(Field &field, PlaySession &session, Unit *u, TurnWorkspace &ws);
+bool applyMove(Field &field, PlaySession &session, Unit *u, int trow, int tcol);
+bool applyAttack(Field &field, PlaySession &session, Unit *u, int trow, int tcol);
+int getPositionValue(int d);
+int nearestDistance(const vector<Unit *> &units, int row, int col);
 int distance(int row1, int col1, int row2, int col2);
 
 // load terrains and units into field
@@ -71,199 +82,712 @@ void loadMap(std::istream &is, Field &field) {
     is.ignore(numeric_limits<streamsize>::max(), '\n');
 }
 
+// Load a case, a map followed by the commands
+bool loadCase(const string &filename, Field &field, string &commands) {
+    ifstream ifs(filename);
+    if (!ifs) return false;
+    loadMap(ifs, field);
+    commands.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+    return true;
+}
+
 // Main loop for playing the game
 void play(Field &field, istream &is, ostream &os) {
-    while (is) {
-        Grid<bool> actionable(field.getHeight(), field.getWidth());
-        // 重置己方单位状态 //////////////////////////////////////////
-        for (int i = 0; i < field.getHeight(); i++)
-            for (int j = 0; j < field.getWidth(); j++) {
-                Unit *unit = field.getUnit(i, j);
-                if (unit != nullptr) {
-                    unit->setMoved(false);
-                    unit->setAttacked(false);
-                    if (unit->getSide() == true) actionable[i][j] = true; // Mark as actionable
-                }
+    TurnWorkspace ws(field.getHeight(), field.getWidth());
+    play(field, is, os, ws);
+}
+
+void play(Field &field, istream &is, ostream &os, TurnWorkspace &ws) {
+    StreamSource in(is);
+    play(field, in, os, ws);
+}
+
+PlayOptions::PlayOptions() :
+    maxRetries(DEFAULT_MAX_RETRIES), text(true), observer(nullptr), frames(nullptr), async(nullptr),
+    resume(nullptr), stopped(nullptr), telemetry(nullptr) {
+}
+
+/** State of an interactive game **/
+
+PlaySession::PlaySession(int maxRetries) :
+    observer(nullptr), frames(nullptr), telemetry(nullptr), maxRetries(maxRetries), retries(0) {
+    stats.status = PLAY_RUNNING;
+    stats.rounds = 0;
+    stats.commands = 0;
+    stats.invalid = 0;
+    stats.playerUnits = 0;
+    stats.enemyUnits = 0;
+}
+
+void PlaySession::accept() {
+    retries = 0;
+}
+
+// Count an invalid answer, return false once there are too many in a row
+bool PlaySession::reject() {
+    stats.invalid++;
+    retries++;
+    if (maxRetries > 0 && retries > maxRetries) {
+        stats.status = PLAY_TOO_MANY_RETRIES;
+        return false;
+    }
+    return true;
+}
+
+// Units left on the field
+void countUnits(const Field &field, PlayStats &stats) {
+    stats.playerUnits = stats.enemyUnits = 0;
+    field.forEachSquare([&stats](int, int, const Unit *unit, TerrainType) {
+        if (unit != nullptr && unit->getSide())
+            stats.playerUnits++;
+        else if (unit != nullptr)
+            stats.enemyUnits++;
+    });
+}
+
+// Describe how the game ended
+void printPlayStats(ostream &os, const PlayStats &stats) {
+    switch (stats.status) {
+    case PLAY_RUNNING:
+        os << "Game not finished";
+        break;
+    case PLAY_WON:
+        os << "Won";
+        break;
+    case PLAY_FAILED:
+        os << "Failed";
+        break;
+    case PLAY_END_OF_INPUT:
+        os << "Input ended before the game was over";
+        break;
+    case PLAY_BAD_INPUT:
+        os << "Malformed input";
+        break;
+    case PLAY_TOO_MANY_RETRIES:
+        os << "Too many invalid answers in a row";
+        break;
+    }
+    os << " after " << stats.rounds << " rounds: "
+       << stats.commands << " answers read, " << stats.invalid << " invalid, "
+       << stats.playerUnits << " player and " << stats.enemyUnits << " enemy units left" << endl;
+}
+
+// Feed a game with the answers read from in, all scratch memory is taken
+// from the workspace. Stop as soon as the input ends or is malformed.
+PlayStats play(Field &field, CommandSource &in, ostream &os, TurnWorkspace &ws, const PlayOptions &options) {
+    GameMachine game(field, os, ws, options);
+    while (!game.isOver()) {
+        // The prompt must be out before the game waits for its answer
+        if (options.async != nullptr) options.async->flush();
+        if (game.wantsChar()) {
+            char c;
+            if (in.readChar(c)) {
+                game.answerChar(c);
+                continue;
             }
+            if (options.stopped != nullptr) *options.stopped = game.getState();
+            game.stop(PLAY_END_OF_INPUT);
+        } else {
+            int x;
+            if (in.readInt(x)) {
+                game.answerInt(x);
+                continue;
+            }
+            if (options.stopped != nullptr) *options.stopped = game.getState();
+            game.stop(in.atEnd() ? PLAY_END_OF_INPUT : PLAY_BAD_INPUT);
+        }
+    }
+    return game.getStats();
+}
 
-        displayField(os, field); // 打印地图 //////////////////////////////////////////
+/** GameMachine **/
+
+// Without text everything goes to a stream with no buffer, which drops it
+GameMachine::GameMachine(Field &field, ostream &out, TurnWorkspace &ws, const PlayOptions &options) :
+    field(field), ws(ws), discard(nullptr), os(options.text ? out : discard),
+    session(options.maxRetries), step(STEP_ROUND), waiting(PROMPT_NONE),
+    answerC(0), given(0), unit(nullptr) {
+    ws.resize(field.getHeight(), field.getWidth());
+    session.observer = options.observer;
+    session.frames = options.frames;
+    session.telemetry = options.telemetry;
+    if (session.telemetry != nullptr) field.setTelemetry(session.telemetry);
+    if (session.observer != nullptr) session.observer->boardLoaded(field);
+    if (options.resume != nullptr && options.resume->phase != PHASE_NONE) {
+        // The round is under way: its turn was begun before the game was saved
+        session.stats.rounds = options.resume->rounds;
+        countUnits(field, session.stats);
+        if (options.resume->phase != PHASE_ROUND_START) ws.beginTurn();
+        if (session.telemetry != nullptr && options.resume->phase != PHASE_ROUND_START) {
+            // The units alive now, as the start of the round is gone
+            session.telemetry->beginRound(session.stats.rounds);
+            field.getUnits(ws.units);
+            for (size_t k = 0; k < ws.units.size(); k++)
+                session.telemetry->unitAlive(*ws.units[k]);
+        }
+        step = options.resume->phase == PHASE_PLAYER ? STEP_PLAYER : options.resume->phase == PHASE_ENEMY ? STEP_ENEMY : STEP_ROUND;
+    }
+    run();
+}
 
-        // Check if the game is over //////////////////////////////////////////
-        int playerCount = 0, enemyCount = 0;
-        for (int i = 0; i < field.getHeight(); i++)
-            for (int j = 0; j < field.getWidth(); j++) {
-                Unit *unit = field.getUnit(i, j);
-                if (unit != nullptr) {
-                    if (unit->getSide() == true)
-                        playerCount++;
-                    else
-                        enemyCount++;
-                }
+GameMachine::~GameMachine() {
+    if (session.telemetry != nullptr) field.setTelemetry(nullptr);
+}
+
+GamePrompt GameMachine::prompt() const {
+    return waiting;
+}
+
+bool GameMachine::wantsChar() const {
+    return waiting == PROMPT_END_TURN;
+}
+
+bool GameMachine::isOver() const {
+    return step == STEP_OVER;
+}
+
+const PlayStats &GameMachine::getStats() const {
+    return session.stats;
+}
+
+GameState GameMachine::getState() const {
+    GameState state;
+    state.rounds = session.stats.rounds;
+    state.phase = waiting == PROMPT_END_TURN ? PHASE_PLAYER : PHASE_NONE;
+    return state;
+}
+
+// An answer of the wrong kind is ignored
+void GameMachine::answerChar(char c) {
+    if (waiting != PROMPT_END_TURN) return;
+    session.stats.commands++;
+    answerC = c;
+    waiting = PROMPT_NONE;
+    run();
+}
+
+void GameMachine::answerInt(int x) {
+    if (waiting == PROMPT_NONE || waiting == PROMPT_END_TURN) return;
+    session.stats.commands++;
+    answers[given++] = x;
+    if (waiting != PROMPT_ACTION && given < 2) return; // a square needs a column too
+    waiting = PROMPT_NONE;
+    run();
+}
+
+void GameMachine::stop(PlayStatus status) {
+    if (step != STEP_OVER) finish(status);
+}
+
+void GameMachine::finish(PlayStatus status) {
+    session.stats.status = status;
+    step = STEP_OVER;
+    if (session.telemetry != nullptr) field.setTelemetry(nullptr);
+    waiting = PROMPT_NONE;
+    if (session.observer != nullptr) session.observer->gameOver(status, session.stats.rounds);
+}
+
+void GameMachine::ask(GamePrompt p, Step next) {
+    switch (p) {
+    case PROMPT_END_TURN:
+        os << "End this turn (y,n)?" << endl;
+        break;
+    case PROMPT_UNIT:
+        os << "Please select a unit:" << endl;
+        break;
+    case PROMPT_ACTION:
+        os << "Select your action:" << endl;
+        break;
+    case PROMPT_DESTINATION:
+        os << "Please enter your destination:" << endl;
+        break;
+    case PROMPT_TARGET:
+        os << "Please enter your target:" << endl;
+        break;
+    default:
+        break;
+    }
+    waiting = p;
+    step = next;
+    given = 0;
+}
+
+void GameMachine::retry(GamePrompt p, Step next) {
+    if (!session.reject())
+        finish(PLAY_TOO_MANY_RETRIES);
+    else
+        ask(p, next);
+}
+
+// The player's turn goes on unless the answer is y
+bool GameMachine::endTurnAnswered() {
+    if (answerC == 'y' || answerC == 'Y') {
+        step = STEP_ENEMY;
+        return true;
+    }
+    ask(PROMPT_UNIT, STEP_UNIT);
+    return false;
+}
+
+// Select a unit, then list its actions
+bool GameMachine::unitAnswered() {
+    int row = answers[0], col = answers[1];
+    MarkPlane &actionable = ws.actionable;
+    if (!actionable.inBounds(row, col) || field.getUnit(row, col) == nullptr) {
+        os << "No unit at (" << row << ", " << col << ")!" << endl;
+    } else if (field.getUnit(row, col)->getSide() == false) {
+        os << "Unit at (" << row << ", " << col << ") is an enemy!" << endl;
+    } else if (!actionable.isMarked(row, col)) {
+        os << "Unit at (" << row << ", " << col << ") is not actable!" << endl;
+    } else {
+        session.accept();
+        unit = field.getUnit(row, col);
+
+        vector<Action> &actionList = ws.actions;
+        getActions(unit, actionList);
+        for (int i = 0; i < int(actionList.size()); i++) {
+            switch (actionList[i]) {
+            case MOVE:
+                os << i + 1 << ".Move ";
+                break;
+            case ATTACK:
+                os << i + 1 << ".Attack ";
+                break;
+            case SKIP:
+                os << i + 1 << ".Skip ";
+                break;
             }
+        }
+        os << endl;
+        ask(PROMPT_ACTION, STEP_ACTION);
+        return false;
+    }
+    retry(PROMPT_UNIT, STEP_UNIT);
+    return false;
+}
+
+// Show where the action may go, or go on with the turn after SKIP
+bool GameMachine::actionAnswered() {
+    int act = answers[0];
+    vector<Action> &actionList = ws.actions;
+    if (act <= 0 || act > int(actionList.size())) {
+        os << "Invalid action!" << endl;
+        retry(PROMPT_ACTION, STEP_ACTION);
+        return false;
+    }
+    session.accept();
 
-        if (enemyCount == 0) {
-            os << "Won" << endl;
-            return; // Player wins
-        } else if (playerCount == 0) {
-            os << "Failed" << endl;
-            return; // Player loses
+    switch (actionList[act - 1]) {
+    case MOVE:
+        findReachable(field, unit, ws);
+        showField(session, os, field, ws.reachable, DP_MOVE, unit->getRow(), unit->getCol());
+        ask(PROMPT_DESTINATION, STEP_DESTINATION);
+        return false;
+    case ATTACK:
+        searchAttackable(field, unit, ws.attackable);
+        showField(session, os, field, ws.attackable, DP_ATTACK, unit->getRow(), unit->getCol());
+        ask(PROMPT_TARGET, STEP_TARGET);
+        return false;
+    default:
+        step = STEP_PLAYER;
+        return true;
+    }
+}
+
+bool GameMachine::destinationAnswered() {
+    int trow = answers[0], tcol = answers[1];
+    if (!ws.reachable.isMarked(trow, tcol)) {
+        // the target coordinate is not reachable
+        os << "Not a valid destination" << endl;
+        retry(PROMPT_DESTINATION, STEP_DESTINATION);
+        return false;
+    }
+    session.accept();
+    unit->setMoved(true); // Mark the unit as moved
+    applyMove(field, session, unit, trow, tcol);
+    step = STEP_PLAYER;
+    return true;
+}
+
+bool GameMachine::targetAnswered() {
+    int trow = answers[0], tcol = answers[1];
+    if (!ws.attackable.isMarked(trow, tcol)) {
+        os << "Not a valid target" << endl;
+        retry(PROMPT_TARGET, STEP_TARGET);
+        return false;
+    }
+    session.accept();
+    unit->setAttacked(true); // Mark the unit as attacked
+    applyAttack(field, session, unit, trow, tcol);
+    step = STEP_PLAYER;
+    return true;
+}
+
+// Main loop of the game, left at every prompt
+void GameMachine::run() {
+    MarkPlane &actionable = ws.actionable;
+    vector<Unit *> &all = ws.units;
+    while (true) {
+        switch (step) {
+        case STEP_ROUND: {
+            ws.beginTurn();
+            countUnits(field, session.stats);
+            if (session.telemetry != nullptr) session.telemetry->beginRound(session.stats.rounds);
+            // 重置己方单位状态 //////////////////////////////////////////
+            field.getUnits(all);
+            actionable.clear();
+            for (size_t k = 0; k < all.size(); k++) {
+                Unit *u = all[k];
+                u->setMoved(false);
+                u->setAttacked(false);
+                if (u->getSide()) actionable.mark(u->getRow(), u->getCol()); // Mark as actionable
+                if (session.telemetry != nullptr) session.telemetry->unitAlive(*u);
+            }
+
+            showPlainField(session, os, field, actionable); // 打印地图 //////////////////////////////////////////
+
+            // Check if the game is over //////////////////////////////////////////
+            if (session.stats.enemyUnits == 0) {
+                os << "Won" << endl;
+                ws.endTurn();
+                finish(PLAY_WON); // Player wins
+                return;
+            } else if (session.stats.playerUnits == 0) {
+                os << "Failed" << endl;
+                ws.endTurn();
+                finish(PLAY_FAILED); // Player loses
+                return;
+            }
+            step = STEP_PLAYER;
+            break;
         }
 
         // Player's turn ////////////////////////////////////////////////////////
-        while (true) {
+        case STEP_PLAYER: {
             // Check if there are any actable units
-            bool hasActableUnit = false;
-            for (int i = 0; i < field.getHeight(); i++) {
-                for (int j = 0; j < field.getWidth(); j++) {
-                    Unit *unit = field.getUnit(i, j);
-                    if (unit == nullptr || unit->getSide() == false) actionable[i][j] = false;
-                    if (unit != nullptr && unit->getSide() == true && (unit->hasMoved() && unit->hasAttacked())) {
-                        actionable[i][j] = false; // Mark as not actionable
-                    }
-                    if (unit != nullptr && unit->getSide() == true && (!unit->hasMoved() || !unit->hasAttacked())) {
-                        actionable[i][j] = true; // Mark as actionable
-                        hasActableUnit = true;
-                    }
-                }
+            field.getUnits(all);
+            actionable.clear();
+            for (size_t k = 0; k < all.size(); k++) {
+                Unit *u = all[k];
+                if (u->getSide() == true && (!u->hasMoved() || !u->hasAttacked()))
+                    actionable.mark(u->getRow(), u->getCol());
             }
+            bool hasActableUnit = actionable.count() > 0;
             if (!hasActableUnit) {
                 os << "No more actable units." << endl;
-                break; // exit the loop if no actable units
+                step = STEP_ENEMY;
+                break;
             }
 
-            // Display the field with actionable units
-            displayField(os, field, actionable, DP_ACTIONABLE);
+            // Display the field with actionable units,
+            // and ask if the player wants to skip their turn
+            showField(session, os, field, actionable, DP_ACTIONABLE);
+            ask(PROMPT_END_TURN, STEP_END_TURN);
+            return;
+        }
 
-            // Ask if the player wants to skip their turn
-            char skip_choice;
-            os << "End this turn (y,n)?" << endl;
-            is >> skip_choice;
-            if (skip_choice == 'y' || skip_choice == 'Y') {
-                break;
-            }
+        case STEP_END_TURN:
+            if (!endTurnAnswered()) return;
+            break;
+        case STEP_UNIT:
+            if (!unitAnswered()) return;
+            break;
+        case STEP_ACTION:
+            if (!actionAnswered()) return;
+            break;
+        case STEP_DESTINATION:
+            if (!destinationAnswered()) return;
+            break;
+        case STEP_TARGET:
+            if (!targetAnswered()) return;
+            break;
 
-            // select unit
-            Unit *u = nullptr;
-            int row, col;
-            while (true) {
-                os << "Please select a unit:" << endl;
-                is >> row >> col;
-                if (field.getUnit(row, col) == nullptr) {
-                    os << "No unit at (" << row << ", " << col << ")!" << endl;
-                } else if (field.getUnit(row, col)->getSide() == false) {
-                    os << "Unit at (" << row << ", " << col << ") is an enemy!" << endl;
-                } else if (!actionable[row][col]) {
-                    os << "Unit at (" << row << ", " << col << ") is not actable!" << endl;
-                } else {
-                    break; // valid unit selected
-                }
-            }
-            u = field.getUnit(row, col);
-
-            // select action
-            vector<Action> actionList = getActions(u);
-
-            int act;
-            for (int i = 0; i < actionList.size(); i++) {
-                switch (actionList[i]) {
-                case MOVE:
-                    os << i + 1 << ".Move ";
-                    break;
-                case ATTACK:
-                    os << i + 1 << ".Attack ";
-                    break;
-                case SKIP:
-                    os << i + 1 << ".Skip ";
-                    break;
-                }
-            }
-            os << endl;
-            while (true) {
-                os << "Select your action:" << endl;
-
-                is >> act;
-                if (act > 0 && act < actionList.size() + 1) break;
-                // else if invalid action
-                os << "Invalid action!" << endl;
-            }
-            Action selectedAction = actionList[act - 1];
+        // Enemy's turn ////////////////////////////////////////////////////////
+        case STEP_ENEMY:
+            if (session.observer != nullptr) session.observer->turnEnded(true, session.stats.rounds);
+            playEnemyTurn(field, session, ws);
+            if (session.observer != nullptr) session.observer->turnEnded(false, session.stats.rounds);
+
+            // FOREST's special effect ////////////////////////////////////////////////////////
+            healByForests(field, session.observer, session.telemetry);
+            ws.endTurn();
+            session.stats.rounds++;
+            step = STEP_ROUND;
+            break;
 
-            // perform action
-            // A function called performAction is defined below.
-            // You can use it or define your own version.
-            bool success = performAction(field, is, os, u, selectedAction);
+        case STEP_OVER:
+            return;
         }
+    }
+}
 
-        // Enemy's turn ////////////////////////////////////////////////////////
-        for (int i = 0; i < field.getHeight(); i++) {    // 遍历row，row小的单位先行动
-            for (int j = 0; j < field.getWidth(); j++) { // 遍历col，row相同时col小的单位先行动
-                Unit *unit = field.getUnit(i, j);
-                if (unit != nullptr && unit->getSide() == false) { // Enemy unit
-                    if (unit->hasMoved()) continue;
-                    // Perform actions fors the enemy unit
-                    performEnemyAction(field, unit);
-                }
+// Main loop of a headless game
+GameOutcome playHeadless(Field &field, Controller &player, Controller &enemy,
+                         TurnWorkspace &ws, int maxRounds) {
+    ws.resize(field.getHeight(), field.getWidth());
+    vector<Unit *> &all = ws.units;
+    GameOutcome res;
+    res.rounds = 0;
+    while (true) {
+        ws.beginTurn();
+        // Reset the units and check if the game is over
+        field.getUnits(all);
+        int playerCount = 0, enemyCount = 0;
+        for (size_t k = 0; k < all.size(); k++) {
+            all[k]->setMoved(false);
+            all[k]->setAttacked(false);
+            if (all[k]->getSide())
+                playerCount++;
+            else
+                enemyCount++;
+        }
+
+        if (enemyCount == 0 || playerCount == 0 || res.rounds >= maxRounds) {
+            res.winner = enemyCount == 0 ? 1 : playerCount == 0 ? 0 : -1;
+            ws.endTurn();
+            return res;
+        }
+
+        playSide(field, true, player, ws);
+        playSide(field, false, enemy, ws);
+        healByForests(field);
+        res.rounds++;
+        ws.endTurn();
+    }
+}
+
+// Ask the controller for actions until it ends the turn.
+// A choice which breaks the rules ends the turn as well,
+// and so does a controller which keeps skipping.
+void playSide(Field &field, bool side, Controller &ctrl, TurnWorkspace &ws) {
+    MarkPlane &actionable = ws.actionable;
+    vector<Unit *> &all = ws.units;
+    field.getUnits(all);
+    int budget = 4 * int(all.size()) + 4;
+
+    ctrl.beginTurn(field, side);
+    for (; budget > 0; budget--) {
+        // Mark the units which may still act
+        field.getUnits(all);
+        actionable.clear();
+        for (size_t k = 0; k < all.size(); k++) {
+            Unit *unit = all[k];
+            if (unit->getSide() == side && (!unit->hasMoved() || !unit->hasAttacked()))
+                actionable.mark(unit->getRow(), unit->getCol());
+        }
+        bool finished = actionable.count() == 0 || ctrl.endTurn(field, actionable);
+
+        int row = -1, col = -1;
+        if (!finished) ctrl.selectUnit(field, actionable, row, col);
+        Unit *u = actionable.isMarked(row, col) ? field.getUnit(row, col) : nullptr;
+        if (u == nullptr) return;
+
+        vector<Action> &actionList = ws.actions;
+        getActions(u, actionList);
+        int act = ctrl.selectAction(field, u, actionList);
+        if (act < 0 || act >= int(actionList.size())) return;
+
+        if (actionList[act] == MOVE) {
+            findReachable(field, u, ws);
+            int trow = -1, tcol = -1;
+            ctrl.selectDestination(field, u, ws.reachable, trow, tcol);
+            if (!ws.reachable.isMarked(trow, tcol)) return;
+            u->setMoved(true);
+            field.moveUnit(u->getRow(), u->getCol(), trow, tcol);
+        } else if (actionList[act] == ATTACK) {
+            searchAttackable(field, u, ws.attackable);
+            u->setAttacked(true);
+            if (ws.attackable.count() == 0) continue; // nothing in range, the attack is lost
+            int trow = -1, tcol = -1;
+            ctrl.selectTarget(field, u, ws.attackable, trow, tcol);
+            if (!ws.attackable.isMarked(trow, tcol)) return;
+            field.attackUnit(u, trow, tcol);
+        }
+    }
+}
+
+void getLegalActions(const Field &field, bool side, TurnWorkspace &ws, vector<UnitAction> &out) {
+    out.clear();
+    vector<Unit *> &all = ws.units;
+    field.getUnits(all);
+    for (size_t k = 0; k < all.size(); k++) {
+        Unit *u = all[k];
+        if (u->getSide() != side) continue;
+        UnitAction a;
+        a.row = u->getRow();
+        a.col = u->getCol();
+        if (!u->hasMoved()) {
+            findReachable(field, u, ws);
+            a.act = MOVE;
+            for (size_t i = 0; i < ws.reachable.count(); i++) {
+                a.trow = ws.reachable.markedRow(i);
+                a.tcol = ws.reachable.markedCol(i);
+                out.push_back(a);
+            }
+        }
+        if (!u->hasAttacked()) {
+            searchAttackable(field, u, ws.attackable);
+            a.act = ATTACK;
+            for (size_t i = 0; i < ws.attackable.count(); i++) {
+                a.trow = ws.attackable.markedRow(i);
+                a.tcol = ws.attackable.markedCol(i);
+                out.push_back(a);
             }
         }
+    }
+    // The searches mark in their own order
+    sort(out.begin(), out.end(), [](const UnitAction &x, const UnitAction &y) {
+        if (x.row != y.row) return x.row < y.row;
+        if (x.col != y.col) return x.col < y.col;
+        if (x.act != y.act) return x.act == MOVE;
+        return x.trow != y.trow ? x.trow < y.trow : x.tcol < y.tcol;
+    });
+}
+
+bool applyAction(Field &field, bool side, const UnitAction &a, TurnWorkspace &ws) {
+    if (!ws.actionable.inBounds(a.row, a.col)) return false;
+    Unit *u = field.getUnit(a.row, a.col);
+    if (u == nullptr || u->getSide() != side) return false;
+    if (a.act == MOVE && !u->hasMoved()) {
+        findReachable(field, u, ws);
+        if (!ws.reachable.isMarked(a.trow, a.tcol)) return false;
+        u->setMoved(true);
+        field.moveUnit(a.row, a.col, a.trow, a.tcol); // staying on its square is a move too
+        return true;
+    }
+    if (a.act == ATTACK && !u->hasAttacked()) {
+        searchAttackable(field, u, ws.attackable);
+        if (!ws.attackable.isMarked(a.trow, a.tcol)) return false;
+        u->setAttacked(true);
+        field.attackUnit(u, a.trow, a.tcol);
+        return true;
+    }
+    return false;
+}
+
+bool makeAction(Field &field, bool side, const UnitAction &a, TurnWorkspace &ws, FieldUndo &undo) {
+    field.recordUndo(undo);
+    if (ws.actionable.inBounds(a.row, a.col) && field.getUnit(a.row, a.col) != nullptr)
+        undo.saveUnit(field.getUnit(a.row, a.col)); // its flags change
+    bool done = applyAction(field, side, a, ws);
+    field.stopUndo();
+    return done;
+}
+
+void resetUnits(Field &field) {
+    field.forEachSquare([](int, int, Unit *u, TerrainType) {
+        if (u != nullptr) {
+            u->setMoved(false);
+            u->setAttacked(false);
+        }
+    });
+}
 
-        // FOREST's special effect ////////////////////////////////////////////////////////
-        for (int i = 0; i < field.getHeight(); i++) {
-            for (int j = 0; j < field.getWidth(); j++) {
-                if (field.getTerrain(i, j).getType() == FOREST) {
-                    for (int r = i - 2; r <= i + 2; r++) {
-                        for (int c = j - 2; c <= j + 2; c++) {
-                            if (actionable.inBounds(r, c) && field.getUnit(r, c) != nullptr)
-                                field.getUnit(r, c)->receiveDamage(-1); // Heal the unit
-                        }
-                    }
+void playEnemyTurn(Field &field, PlaySession &session, TurnWorkspace &ws) {
+    // row小的单位先行动，row相同时col小的单位先行动
+    ws.order.begin(field, false);
+    for (Unit *u = ws.order.next(field); u != nullptr; u = ws.order.next(field)) { // Enemy unit
+        if (u->hasMoved()) continue;
+        // Perform actions fors the enemy unit
+        performEnemyAction(field, session, u, ws);
+    }
+}
+
+// Every FOREST heals the units within two rows and two columns
+void healByForests(Field &field, GameObserver *observer, GameTelemetry *telemetry) {
+    int h = field.getHeight();
+    int w = field.getWidth();
+    // Healing moves nothing, so the squares may be visited while it goes on
+    field.forEachSquare([&](int i, int j, Unit *, TerrainType t) {
+        if (t != FOREST) return;
+        for (int r = i - 2; r <= i + 2; r++) {
+            for (int c = j - 2; c <= j + 2; c++) {
+                if (r >= 0 && r < h && c >= 0 && c < w && field.getUnit(r, c) != nullptr) {
+                    field.getUnit(r, c)->receiveDamage(-1); // Heal the unit
+                    if (observer != nullptr) observer->unitHealed(*field.getUnit(r, c), i, j);
+                    if (telemetry != nullptr) telemetry->healed(1);
                 }
             }
         }
-    }
+    });
 }
 
 // Display the field on the out stream os
-void displayField(ostream &os, const Field &field, const Grid<bool> &grd, dp_mode dp) {
-    int height = field.getHeight();
-    int width = field.getWidth();
-    string dp_symbol = getDpSymbol(dp);
+void displayField(ostream &os, const Field &field, const SquareMarks &grd, dp_mode dp) {
+    Viewport all = {0, 0, int(field.getHeight()), int(field.getWidth())};
+    displayWindow(os, field, all, grd, dp);
+}
+
+// Display the squares of the window, numbered as on the whole field
+void displayWindow(ostream &os, const Field &field, const Viewport &view, const SquareMarks &grd, dp_mode dp) {
+    if (!os) return; // nothing could be written anyway
+    int indent = rowLabelWidth(view);
 
     os << endl;
     // Print the x coordinates
-    os << "  ";
-    for (int i = 0; i < width; i++)
-        os << setw(3) << i << " ";
+    os << string(indent, ' ');
+    for (int j = 0; j < view.cols; j++)
+        os << setw(3) << view.left + j << " ";
     os << endl;
 
-    printHLine(os, width);
-    for (int i = 0; i < height; i++) {
-        os << setw(2) << i;
-        for (int j = 0; j < width; j++) {
-            os << '|';
-            const Unit *u = field.getUnit(i, j);
-            Terrain t = field.getTerrain(i, j);
-            string sym;
-            int width = 3;
-            if (grd.inBounds(i, j) && grd[i][j]) {
-                os << setw(1) << dp_symbol;
-                width -= 1;
-            }
-
-            if (u != nullptr)
-                sym += u->getSymbol();
-            else
-                sym += t.getSymbol();
-            os << setw(width) << sym;
+    printHLine(os, view.cols, indent);
+    string cell; // reused by every cell
+    for (int i = view.top; i < view.top + view.rows; i++) {
+        os << setw(indent) << i;
+        for (int j = view.left; j < view.left + view.cols; j++) {
+            formatCell(field, grd, dp, i, j, cell);
+            os << '|' << cell;
         }
         os << '|' << endl;
-        printHLine(os, width);
+        printHLine(os, view.cols, indent);
     }
     os << endl;
 }
 
+// Room for the row numbers of the window
+int rowLabelWidth(const Viewport &view) {
+    int width = 1;
+    for (int last = view.top + view.rows - 1; last >= 10; last /= 10)
+        width++;
+    return max(width, 2);
+}
+
+// Text of one cell of the board, between the bars
+void formatCell(const Field &field, const SquareMarks &grd, dp_mode dp, int row, int col, string &cell) {
+    const Unit *u = field.getUnit(row, col);
+    cell.clear();
+    size_t width = 3;
+    if (grd.isMarked(row, col)) {
+        cell += getDpSymbol(dp);
+        width -= 1;
+    }
+
+    string sym = u != nullptr ? u->getSymbol() : field.getTerrain(row, col).getSymbol();
+    if (sym.size() < width) cell.append(width - sym.size(), ' ');
+    cell += sym;
+}
+
+// Display the field of an interactive game without marks, through its renderer if any
+// A windowed renderer covers the marked squares of follow
+void showPlainField(PlaySession &session, ostream &os, const Field &field, const MarkPlane &follow) {
+    if (session.frames != nullptr)
+        session.frames->renderUnmarked(os, field, follow);
+    else
+        displayField(os, field);
+}
+
+// The same with the marked squares of a search, centered on the focus when there is one
+void showField(PlaySession &session, ostream &os, const Field &field, const MarkPlane &marks, dp_mode dp,
+               int focusRow, int focusCol) {
+    if (session.frames != nullptr)
+        session.frames->render(os, field, marks, dp, focusRow, focusCol);
+    else
+        displayField(os, field, marks, dp);
+}
+
 // Print the horizontal line
-void printHLine(ostream &os, int n) {
-    os << "  ";
+void printHLine(ostream &os, int n, int indent) {
+    os << string(indent, ' ');
     for (int i = 0; i < n; i++)
         os << "+---";
     os << "+" << endl;
@@ -274,182 +798,218 @@ string getDpSymbol(dp_mode dp) {
     if (dp == DP_MOVE) return ".";
     if (dp == DP_ATTACK) return "*";
     if (dp == DP_ACTIONABLE) return "+";
+    if (dp == DP_PREVIEW) return "!";
+    if (dp == DP_THREAT) return "x";
 
     return " ";
 }
 
-bool performAction(Field &field, istream &is, ostream &os, Unit *u, Action act) {
-    switch (act) {
-    case MOVE:
-        return performMove(os, is, field, u);
-        break;
-    case ATTACK:
-        return performAttack(os, is, field, u);
-        break;
-    case SKIP:
-        return true;
-        break;
-    default:
-        os << "(Action not implemented yet)" << endl;
-        return false;
-    }
+// Perform Enemy's action
+bool performEnemyAction(Field &field, PlaySession &session, Unit *u, TurnWorkspace &ws) {
+    // Move
+    int bestRow, bestCol;
+    bool canMove = chooseEnemyMove(field, u, ws, bestRow, bestCol);
+    u->setMoved(true);        // Mark the unit as moved
+    if (!canMove) return false; // No valid position to move
+    applyMove(field, session, u, bestRow, bestCol);
+
+    // Attack
+    Unit *targetToAttack = chooseEnemyTarget(field, u, ws);
+    if (targetToAttack != nullptr) applyAttack(field, session, u, targetToAttack->getRow(), targetToAttack->getCol());
+    u->setAttacked(true); // Mark the unit as attacked
+    return true;          // Successfully performed the enemy action
 }
 
-// Perform the move action
-bool performMove(ostream &os, istream &is, Field &field, Unit *u) {
-    // Display the reachable points
-    Grid<bool> grd =
-        searchReachable(getFieldCosts(field, u), u->getRow(), u->getCol(), u->getMovPoints());
+// Move u and tell the observer
+bool applyMove(Field &field, PlaySession &session, Unit *u, int trow, int tcol) {
+    int srow = u->getRow(), scol = u->getCol();
+    if (!field.moveUnit(srow, scol, trow, tcol)) return false;
+    if (session.observer != nullptr) session.observer->unitMoved(*u, srow, scol);
+    return true;
+}
 
-    displayField(os, field, grd, DP_MOVE);
+// Attack with u and tell the observer what the attack did
+bool applyAttack(Field &field, PlaySession &session, Unit *u, int trow, int tcol) {
+    if (session.observer == nullptr) return field.attackUnit(u, trow, tcol);
+    session.report.begin(field, u, trow, tcol);
+    bool done = field.attackUnit(u, trow, tcol);
+    session.report.finish(field);
+    session.observer->attackResolved(session.report);
+    return done;
+}
 
-    // Ask for the target coordinate
-    int trow, tcol;
-    while (true) {
-        os << "Please enter your destination:" << endl;
-        is >> trow >> tcol;
+void findReachable(const Field &field, Unit *u, TurnWorkspace &ws) {
+    if (ws.reach.lookup(field, u, ws.reachable)) return;
+    searchUnitReach(field, u, ws);
+    ws.reach.store(field, u, ws.reachable);
+}
 
-        if (grd.inBounds(trow, tcol) && grd[trow][tcol]) break;
-        // else if the target coordinate is not reachable
-        os << "Not a valid destination" << endl;
-    }
-    u->setMoved(true); // Mark the unit as moved
-    return field.moveUnit(u->getRow(), u->getCol(), trow, tcol);
-}
-
-// Perform the attack action
-bool performAttack(ostream &os, istream &is, Field &field, Unit *u) {
-    // Display the reachable points
-    Grid<bool> grd;
-    if (u->getType() == TANK)
-        grd = searchFarAttackable(field, u->getRow(), u->getCol());
-    else if (u->getType() == FLIGHTER)
-        grd = searchFlightAttackable(field, u->getRow(), u->getCol());
-    else
-        grd = searchCloseAttackable(field, u->getRow(), u->getCol());
+// Every step costs a point, so the squares within the movement points
+// of the unit are all the search may look at
+void searchUnitReach(const Field &field, Unit *u, TurnWorkspace &ws) {
+    int size = 2 * max(u->getMovPoints(), 0) + 1;
+    // The window only grows, so that the turns after the first allocate nothing
+    if (int(ws.costs.numRows()) < size) ws.costs = Grid<int>(size, size);
+    int half = int(ws.costs.numRows()) / 2;
+    int top = u->getRow() - half, left = u->getCol() - half;
+    getFieldCosts(field, u, top, left, ws.costs);
+    searchReachable(ws.costs, top, left, u->getRow(), u->getCol(), u->getMovPoints(), ws.reachable, ws.frontier);
+}
 
-    displayField(os, field, grd, DP_ATTACK);
+// Find the marked square of grd with the shortest path left in dists (-1 if unknown),
+// ties go to the first in row-major order. Return false if none is known.
+static bool closestByPath(const MarkPlane &grd, const vector<int> &dists, int width, int &bestRow, int &bestCol) {
+    int bestDist = -1;
+    for (size_t k = 0; k < grd.count(); k++) {
+        int i = grd.markedRow(k), j = grd.markedCol(k), d = dists[k];
+        if (d >= 0 && (bestDist < 0 || d < bestDist || (d == bestDist && i * width + j < bestRow * width + bestCol))) {
+            bestRow = i;
+            bestCol = j;
+            bestDist = d;
+        }
+    }
+    return bestDist >= 0;
+}
 
-    // Ask for the target coordinate
-    int trow, tcol;
-    while (true) {
-        os << "Please enter your target:" << endl;
-        is >> trow >> tcol;
+// Find the reachable square closest to the player units
+// Return false if there is no player unit left
+// The move is replayed from the last turn when nothing it depends on changed
+bool chooseEnemyMove(const Field &field, Unit *u, TurnWorkspace &ws, int &bestRow, int &bestCol) {
+    bool canMove;
+    // A plan only knows the squares around the unit, not the paths through the board
+    bool paths = ws.enemyMoves != ENEMY_MOVE_MANHATTAN;
+    if (!paths && ws.plans.lookup(field, u, canMove, bestRow, bestCol)) return canMove;
+
+    findReachable(field, u, ws);
+    const MarkPlane &grd = ws.reachable;
+    int width = field.getWidth();
 
-        if (grd.inBounds(trow, tcol) && grd[trow][tcol]) break;
-        // else if the target coordinate is not reachable
-        os << "Not a valid target" << endl;
+    if (ws.enemyMoves == ENEMY_MOVE_FLOW) {
+        const FlowField &flow = ws.flow.forUnit(field, u);
+        ws.dists.clear();
+        for (size_t k = 0; k < grd.count(); k++)
+            ws.dists.push_back(flow.distance(grd.markedRow(k), grd.markedCol(k)));
+        if (closestByPath(grd, ws.dists, width, bestRow, bestCol)) return true;
     }
-    u->setAttacked(true); // Mark the unit as attacked
-    return field.attackUnit(u, trow, tcol);
-}
 
-// Perform Enemy's action
-bool performEnemyAction(Field &field, Unit *u) {
-    // Move
-    Grid<bool> grd =
-        searchReachable(getFieldCosts(field, u), u->getRow(), u->getCol(), u->getMovPoints());
+    field.getUnits(ws.players);
+    ws.players.erase(remove_if(ws.players.begin(), ws.players.end(),
+                               [](const Unit *p) { return !p->getSide(); }),
+                     ws.players.end());
+
+    if (ws.enemyMoves == ENEMY_MOVE_PATHS && !ws.players.empty() &&
+        ws.paths.estimate(field, u, ws.players, grd, ws.dists) &&
+        closestByPath(grd, ws.dists, width, bestRow, bestCol))
+        return true;
 
     // Find the best position to move
+    // Ties go to the first square in row-major order
     int bestValue = -1;
-    int bestRow = -1, bestCol = -1;
-    for (int i = 0; i < grd.numRows(); i++) {
-        for (int j = 0; j < grd.numCols(); j++) {
-            if (grd[i][j]) {
-                int value = getPositionValue(field, i, j);
-                if (value > bestValue) { // If the position is valuable
-                    bestRow = i;
-                    bestCol = j;
-                    bestValue = value;
-                }
-            }
+    bestRow = -1;
+    bestCol = -1;
+    ws.dists.clear();
+    for (size_t k = 0; k < grd.count(); k++) {
+        int i = grd.markedRow(k), j = grd.markedCol(k);
+        int d = nearestDistance(ws.players, i, j);
+        int value = getPositionValue(d);
+        ws.dists.push_back(d);
+        if (value > bestValue || (value == bestValue && value != -1 && i * width + j < bestRow * width + bestCol)) {
+            bestRow = i;
+            bestCol = j;
+            bestValue = value;
         }
     }
-    u->setMoved(true);                 // Mark the unit as moved
-    if (bestValue == -1) return false; // No valid position to move
-    field.moveUnit(u->getRow(), u->getCol(), bestRow, bestCol);
+    if (!paths) ws.plans.store(field, u, grd, ws.dists, bestValue != -1, bestRow, bestCol);
+    return bestValue != -1;
+}
 
-    // Attack
-    Grid<bool> grd2 = searchCloseAttackable(field, u->getRow(), u->getCol());
-
-    Unit *targetToAttack = nullptr;
-    for (int i = 0; i < grd2.numRows(); i++) {
-        for (int j = 0; j < grd2.numCols(); j++) {
-            if (grd2[i][j] && field.getUnit(i, j) != nullptr) { // If the cell is reachable and has a unit
-                Unit *target = field.getUnit(i, j);
-                if (target->getSide() == true) { // If the target is an enemy
-                    targetToAttack = target;
-                    break;
-                }
-            }
-        }
-        if (targetToAttack != nullptr) break; // Found a target to attack
+// Find the first player unit next to the enemy unit
+Unit *chooseEnemyTarget(const Field &field, Unit *u, TurnWorkspace &ws) {
+    MarkPlane &grd = ws.attackable;
+    searchCloseAttackable(field, u->getRow(), u->getCol(), grd);
+
+    // The first one in row-major order
+    Unit *best = nullptr;
+    for (size_t k = 0; k < grd.count(); k++) {
+        Unit *target = field.getUnit(grd.markedRow(k), grd.markedCol(k));
+        if (target != nullptr && target->getSide() == true // If the cell has an enemy
+            && (best == nullptr || target->getRow() < best->getRow()
+                || (target->getRow() == best->getRow() && target->getCol() < best->getCol())))
+            best = target;
     }
-    if (targetToAttack != nullptr) field.attackUnit(u, targetToAttack->getRow(), targetToAttack->getCol());
-    u->setAttacked(true); // Mark the unit as attacked
-    return true;          // Successfully performed the enemy action
+    return best;
 }
 
 // Convert field to costs
 // The cost should depend on the terrain type and unit type
 Grid<int> getFieldCosts(const Field &field, Unit *u) {
-    int h = field.getHeight();
-    int w = field.getWidth();
-    Grid<int> costs(h, w);
-
-    for (int i = 0; i < h; i++)
-        for (int j = 0; j < w; j++) {
-            switch (u->getType()) {
-            case SOLDIER:
-            case TANK:
-            case HYDRAULISK:
-                if (u->getRow() == i && u->getCol() == j) { // 当前单位
-                    costs[i][j] = 0;
-                } else if (field.getUnit(i, j) == nullptr &&                  // 无单位
-                           (field.getTerrain(i, j).getType() == PLAIN         // 且是平原
-                            || field.getTerrain(i, j).getType() == FOREST)) { // 或者是森林
-                    costs[i][j] = 1;
-                } else { // 有单位或山或海
-                    costs[i][j] = 100;
-                }
-                break;
-            case BEE:
-            case FLIGHTER:
-                if (u->getRow() == i && u->getCol() == j) { // 当前单位
-                    costs[i][j] = 0;
-                } else if (field.getUnit(i, j) == nullptr &&                 // 无单位
-                           (field.getTerrain(i, j).getType() == PLAIN        // 且是平原
-                            || field.getTerrain(i, j).getType() == OCEAN)) { // 或者是海洋
-                    costs[i][j] = 1;
-                } else { // 有单位或山或森林
-                    costs[i][j] = 100;
-                }
-                break;
-            }
+    Grid<int> costs(field.getHeight(), field.getWidth());
+    getFieldCosts(field, u, costs);
+    return costs;
+}
+
+// Cost for u to enter the square
+static int squareCost(const Field &field, const Unit *u, int i, int j) {
+    switch (u->getType()) {
+    case SOLDIER:
+    case TANK:
+    case HYDRAULISK:
+        if (u->getRow() == i && u->getCol() == j) { // 当前单位
+            return 0;
+        } else if (field.getUnit(i, j) == nullptr &&                  // 无单位
+                   (field.getTerrain(i, j).getType() == PLAIN         // 且是平原
+                    || field.getTerrain(i, j).getType() == FOREST)) { // 或者是森林
+            return 1;
         }
+        return 100; // 有单位或山或海
+    case BEE:
+    case FLIGHTER:
+        if (u->getRow() == i && u->getCol() == j) { // 当前单位
+            return 0;
+        } else if (field.getUnit(i, j) == nullptr &&                 // 无单位
+                   (field.getTerrain(i, j).getType() == PLAIN        // 且是平原
+                    || field.getTerrain(i, j).getType() == OCEAN)) { // 或者是海洋
+            return 1;
+        }
+        return 100; // 有单位或山或森林
+    }
+    return 100;
+}
 
-    return costs;
+// Convert field to costs in a reused grid
+void getFieldCosts(const Field &field, Unit *u, Grid<int> &costs) {
+    assert(costs.numRows() == field.getHeight() && costs.numCols() == field.getWidth());
+    getFieldCosts(field, u, 0, 0, costs);
 }
 
-int getPositionValue(const Field &field, int row, int col) {
+// Convert a window of the field to costs
+void getFieldCosts(const Field &field, Unit *u, int top, int left, Grid<int> &costs) {
     int h = field.getHeight();
     int w = field.getWidth();
-
-    int min_distance = 999;
-    // 遍历所有格子
-    for (int i = 0; i < h; i++) {
-        for (int j = 0; j < w; j++) {
-            if (field.getUnit(i, j) != nullptr && field.getUnit(i, j)->getSide() == true) {
-                // 如果是己方单位，计算距离
-                int d = distance(row, col, i, j);
-                if (d < min_distance) {
-                    min_distance = d; // 更新最小距离
-                }
-            }
+    for (int i = 0; i < int(costs.numRows()); i++)
+        for (int j = 0; j < int(costs.numCols()); j++) {
+            int row = top + i, col = left + j;
+            bool inside = row >= 0 && row < h && col >= 0 && col < w;
+            costs[i][j] = inside ? squareCost(field, u, row, col) : OFF_FIELD_COST;
         }
+}
+
+// Value of a square for an enemy, from its distance to the nearest player unit:
+// the closer the better, -1 if there is no player unit (a huge distance)
+int getPositionValue(int d) {
+    if (d >= 999) return -1;
+    return 999 - d;
+}
+
+// Distance from (row, col) to the nearest of the units
+// A huge distance if there is none
+int nearestDistance(const vector<Unit *> &units, int row, int col) {
+    int min_distance = numeric_limits<int>::max() / 2;
+    for (size_t k = 0; k < units.size(); k++) {
+        int d = distance(row, col, units[k]->getRow(), units[k]->getCol());
+        if (d < min_distance) min_distance = d;
     }
-    if (min_distance == 999) return -1;
-    return 999 - min_distance;
+    return min_distance;
 }
 
 int distance(int row1, int col1, int row2, int col2) {
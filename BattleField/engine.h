@@ -3,20 +3,277 @@
 
 #include <iostream>
 #include "field.h"
+#include "workspace.h"
+#include "controller.h"
+#include "input.h"
+#include "events.h"
 
 // display mode used in function displayField
 enum dp_mode {
-  DP_DEFAULT, DP_MOVE, DP_ATTACK, DP_ACTIONABLE
+  DP_DEFAULT, DP_MOVE, DP_ATTACK, DP_ACTIONABLE,
+  DP_PREVIEW, // squares an attack would change, see markAttackOutcome
+  DP_THREAT   // squares a side could attack next round, see markThreats
 };
 
+class FrameRenderer;
+class AsyncOutput;
+
 // load terrains and units into field
 void loadMap(std::istream& is, Field& field);
+// Load a case as in data/*/*.in: the map into field, and the commands
+// which follow it. Return false if the file cannot be opened.
+bool loadCase(const std::string& filename, Field& field, std::string& commands);
 
 // Main loop for playing the game
 void play(Field& field, std::istream& is, std::ostream& os);
+// Same as above, but take all scratch memory from a workspace
+void play(Field& field, std::istream& is, std::ostream& os, TurnWorkspace& ws);
+// How an interactive game ended
+enum PlayStatus {
+  PLAY_RUNNING,          // not over yet
+  PLAY_WON,
+  PLAY_FAILED,
+  PLAY_END_OF_INPUT,     // the input ended first
+  PLAY_BAD_INPUT,        // an answer could not be read
+  PLAY_TOO_MANY_RETRIES  // a prompt kept getting invalid answers
+};
+
+// Status and statistics of an interactive game
+struct PlayStats {
+  PlayStatus status;
+  int rounds;      // rounds completed
+  int commands;    // answers read
+  int invalid;     // answers rejected by a prompt
+  int playerUnits; // units left at the start of the last round
+  int enemyUnits;
+};
+
+// Default cap on invalid answers in a row
+const int DEFAULT_MAX_RETRIES = 100;
+
+// Points of a round a game can be saved at and resumed from
+enum TurnPhase {
+  PHASE_NONE,        // none: the game is over, or in the middle of an action
+  PHASE_ROUND_START, // the units have not been reset for the round yet
+  PHASE_PLAYER,      // the player's turn, at the end turn prompt
+  PHASE_ENEMY        // the player's turn is over, the enemy acts next
+};
+
+// Where a game stands, besides the field
+struct GameState {
+  int rounds; // rounds completed
+  TurnPhase phase;
+};
+
+// How an interactive game starts and reports to the outside
+struct PlayOptions {
+  PlayOptions();
+
+  int maxRetries;           // cap on invalid answers in a row, no limit if <= 0
+  bool text;                // print the boards and the prompts
+  GameObserver* observer;   // told about every event, may be nullptr
+  FrameRenderer* frames;    // prints the boards, displayField if nullptr
+  AsyncOutput* async;       // flushed before every read, may be nullptr
+  const GameState* resume;  // go on from there instead of the first round, may be nullptr
+  GameState* stopped;       // where the game stood when the input ended, may be nullptr
+  GameTelemetry* telemetry; // counts every round, may be nullptr
+};
+
+// Same as above, but read the commands from any source.
+// The game stops as soon as the input ends or is malformed,
+// or when a prompt gets more than options.maxRetries invalid answers in a row.
+// This only feeds a GameMachine with the answers read from in.
+PlayStats play(Field& field, CommandSource& in, std::ostream& os, TurnWorkspace& ws,
+               const PlayOptions& options = PlayOptions());
+
+// Print the status and statistics of a game
+void printPlayStats(std::ostream& os, const PlayStats& stats);
+
+// State shared by the prompts of an interactive game
+class PlaySession {
+public:
+  explicit PlaySession(int maxRetries);
+
+  // A prompt got a valid answer
+  void accept();
+  // A prompt got an invalid answer, return false if there were too many
+  bool reject();
+
+  PlayStats stats;
+  GameObserver* observer; // may be nullptr
+  FrameRenderer* frames;  // may be nullptr
+  GameTelemetry* telemetry; // may be nullptr
+  AttackReport report;    // reused by every observed attack
+
+private:
+  int maxRetries;
+  int retries; // invalid answers in a row
+};
+
+// What an interactive game waits for
+enum GamePrompt {
+  PROMPT_NONE,        // nothing, the game is over
+  PROMPT_END_TURN,    // a character, y to end the turn
+  PROMPT_UNIT,        // a square: row, then column
+  PROMPT_ACTION,      // the number of an action
+  PROMPT_DESTINATION, // a square
+  PROMPT_TARGET       // a square
+};
+
+/* An interactive game which never reads anything itself.
+   It runs until it needs an answer, prints the prompt, and returns;
+   every answer given runs it again until the next prompt.
+   So a thread may drive any number of games, answering whichever
+   has input available. The output is the same as play() prints. */
+class GameMachine {
+public:
+  // Run the game up to its first prompt, from options.resume if set
+  GameMachine(Field& field, std::ostream& os, TurnWorkspace& ws,
+              const PlayOptions& options = PlayOptions());
+  // The field stops counting into the telemetry of the game
+  ~GameMachine();
+
+  // The prompt waiting for an answer
+  GamePrompt prompt() const;
+  // Check if the next answer is a character rather than an integer
+  bool wantsChar() const;
+  // Check if the game is over (won, failed or stopped)
+  bool isOver() const;
+
+  // Give the next answer; a square takes two integers, row first
+  void answerChar(char c);
+  void answerInt(int x);
+  // Stop the game because no more answers can be given
+  void stop(PlayStatus status);
+
+  const PlayStats& getStats() const;
+  // Where the game stands; PHASE_NONE unless it waits for the end turn prompt
+  GameState getState() const;
+
+private:
+  // Where the game stands
+  enum Step {
+    STEP_ROUND,      // start a round
+    STEP_PLAYER,     // look for actable units
+    STEP_END_TURN,   // answered the end turn prompt
+    STEP_UNIT,       // answered the unit prompt
+    STEP_ACTION,     // answered the action prompt
+    STEP_DESTINATION,
+    STEP_TARGET,
+    STEP_ENEMY,      // the player's turn is over
+    STEP_OVER
+  };
+
+  Field& field;
+  TurnWorkspace& ws;
+  std::ostream discard; // drops everything when there is no text
+  std::ostream& os;
+  PlaySession session;
+  Step step;
+  GamePrompt waiting;
+  char answerC;
+  int answers[2]; // integers of the answer
+  int given;      // integers given so far
+  Unit* unit;     // the unit acting
+
+  // Run until the next prompt, or the end of the game
+  void run();
+  // Print a prompt and wait for its answer
+  void ask(GamePrompt p, Step next);
+  // Handle the answers, return false to stay on the prompt
+  bool endTurnAnswered();
+  bool unitAnswered();
+  bool actionAnswered();
+  bool destinationAnswered();
+  bool targetAnswered();
+  // Count an invalid answer and ask again
+  void retry(GamePrompt p, Step next);
+  void finish(PlayStatus status);
+
+  GameMachine(const GameMachine&);
+  GameMachine& operator=(const GameMachine&);
+};
+
+// Count the units left into stats
+void countUnits(const Field& field, PlayStats& stats);
+
+// Result of a headless game
+struct GameOutcome {
+  int winner; // 1 if the player won, 0 if the enemy won, -1 if unfinished
+  int rounds; // rounds played
+};
+
+// Play a game without any I/O, every decision comes from the controllers.
+// Stop after maxRounds rounds if nobody has won by then.
+GameOutcome playHeadless(Field& field, Controller& player, Controller& enemy,
+                         TurnWorkspace& ws, int maxRounds);
+
+// Play the turn of one side with a controller
+void playSide(Field& field, bool side, Controller& ctrl, TurnWorkspace& ws);
+
+// One legal choice of a unit during its turn
+struct UnitAction {
+  Action act;     // MOVE or ATTACK
+  int row, col;   // the unit
+  int trow, tcol; // destination or target
+};
+
+// Collect every move and attack the units of side may still make,
+// in row-major order of the units, then of the squares.
+// SKIP changes nothing and is never listed.
+void getLegalActions(const Field& field, bool side, TurnWorkspace& ws, std::vector<UnitAction>& out);
+
+// Apply an action of a unit of side as the interactive game does.
+// Return false, and change nothing, if it is not legal.
+bool applyAction(Field& field, bool side, const UnitAction& a, TurnWorkspace& ws);
+// Same as above, recording into undo what changes, so that
+// field.undo(undo) takes the action back
+bool makeAction(Field& field, bool side, const UnitAction& a, TurnWorkspace& ws, FieldUndo& undo);
+
+// Start a round: every unit may move and attack again
+void resetUnits(Field& field);
+
+// The turn of the enemy logic: every enemy unit in row-major order
+void playEnemyTurn(Field& field, PlaySession& session, TurnWorkspace& ws);
+
+// Every FOREST heals the units within two rows and two columns
+void healByForests(Field& field, GameObserver* observer = nullptr, GameTelemetry* telemetry = nullptr);
+
+// Search the reachable squares of u into ws.reachable,
+// reusing the result of an earlier turn when nothing changed around u
+void findReachable(const Field& field, Unit* u, TurnWorkspace& ws);
+// Search the reachable squares of u into ws.reachable, without the cache,
+// from the costs of the squares around u only
+void searchUnitReach(const Field& field, Unit* u, TurnWorkspace& ws);
+
+// Decisions of the enemy logic
+// Find where enemy unit u moves, return false if no player unit is left
+bool chooseEnemyMove(const Field& field, Unit* u, TurnWorkspace& ws, int& row, int& col);
+// Find the player unit attacked by enemy unit u, or nullptr
+Unit* chooseEnemyTarget(const Field& field, Unit* u, TurnWorkspace& ws);
+
+// Convert field to movement costs of unit u
+Grid<int> getFieldCosts(const Field& field, Unit* u);
+void getFieldCosts(const Field& field, Unit* u, Grid<int>& costs);
+// Costs of the window of costs.numRows() x costs.numCols() squares starting
+// at (top, left), which may reach off the field: such squares cannot be entered
+void getFieldCosts(const Field& field, Unit* u, int top, int left, Grid<int>& costs);
 
 // Display the battle field
 void displayField(std::ostream& os, const Field& field,
-                  const Grid<bool>& grd = Grid<bool>(), dp_mode dp = DP_DEFAULT);
+                  const SquareMarks& grd = Grid<bool>(), dp_mode dp = DP_DEFAULT);
+// A window of the field
+struct Viewport {
+  int top, left;  // first square
+  int rows, cols; // size, within the field
+};
+
+// Display the squares of the window only, with their coordinates on the field
+void displayWindow(std::ostream& os, const Field& field, const Viewport& view,
+                   const SquareMarks& grd = Grid<bool>(), dp_mode dp = DP_DEFAULT);
+// Characters taken by the row numbers of displayWindow
+int rowLabelWidth(const Viewport& view);
+// Text of the cell (row, col) as displayField prints it between the bars
+void formatCell(const Field& field, const SquareMarks& grd, dp_mode dp, int row, int col, std::string& cell);
 
 #endif // ENGINE_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,294 @@
+#include <cstdlib>
+#include "events.h"
+#include "engine.h"
+
+using namespace std;
+
+/** AttackReport **/
+
+void AttackReport::begin(const Field &field, const Unit *u, int trow, int tcol) {
+    type = u->getType();
+    side = u->getSide();
+    row = u->getRow();
+    col = u->getCol();
+    targetRow = trow;
+    targetCol = tcol;
+    units.clear();
+    terrains.clear();
+    seen.clear();
+    before.clear();
+    ground.clear();
+
+    int h = field.getHeight();
+    int w = field.getWidth();
+    for (int i = trow - 2; i <= trow + 2; i++)
+        for (int j = tcol - 2; j <= tcol + 2; j++) {
+            if (abs(i - trow) + abs(j - tcol) > 2 || i < 0 || i >= h || j < 0 || j >= w) continue;
+            const Unit *v = field.getUnit(i, j);
+            if (v != nullptr) {
+                UnitChange c = {v->getType(), v->getSide(), i, j, i, j, v->getHp(), 0};
+                seen.push_back(v);
+                before.push_back(c);
+            }
+            TerrainType t = field.getTerrain(i, j).getType();
+            if (t == MOUNTAIN) {
+                TerrainChange c = {i, j, t, t};
+                ground.push_back(c);
+            }
+        }
+}
+
+// The attack creates no unit, so a unit found in the area after it
+// is one of the units seen before; the others have died
+void AttackReport::finish(const Field &field) {
+    int h = field.getHeight();
+    int w = field.getWidth();
+    for (int i = targetRow - 2; i <= targetRow + 2; i++)
+        for (int j = targetCol - 2; j <= targetCol + 2; j++) {
+            if (abs(i - targetRow) + abs(j - targetCol) > 2 || i < 0 || i >= h || j < 0 || j >= w) continue;
+            const Unit *v = field.getUnit(i, j);
+            if (v == nullptr) continue;
+            for (size_t k = 0; k < seen.size(); k++)
+                if (seen[k] == v) {
+                    before[k].newRow = i;
+                    before[k].newCol = j;
+                    before[k].hp = v->getHp();
+                    seen[k] = nullptr;
+                    break;
+                }
+        }
+
+    for (size_t k = 0; k < before.size(); k++) {
+        const UnitChange &c = before[k];
+        if (c.hp != c.hpBefore || c.newRow != c.row || c.newCol != c.col)
+            units.push_back(c);
+    }
+    for (size_t k = 0; k < ground.size(); k++) {
+        ground[k].after = field.getTerrain(ground[k].row, ground[k].col).getType();
+        if (ground[k].after != ground[k].before)
+            terrains.push_back(ground[k]);
+    }
+}
+
+/** JsonEventWriter **/
+
+// Letter of a terrain in the map files
+static char terrainLetter(TerrainType t) {
+    switch (t) {
+    case MOUNTAIN:
+        return 'M';
+    case OCEAN:
+        return 'O';
+    case FOREST:
+        return 'W';
+    default:
+        return '.';
+    }
+}
+
+static const char *statusName(int status) {
+    switch (status) {
+    case PLAY_WON:
+        return "won";
+    case PLAY_FAILED:
+        return "failed";
+    case PLAY_END_OF_INPUT:
+        return "end_of_input";
+    case PLAY_BAD_INPUT:
+        return "bad_input";
+    case PLAY_TOO_MANY_RETRIES:
+        return "too_many_retries";
+    default:
+        return "running";
+    }
+}
+
+JsonEventWriter::JsonEventWriter(ostream &os) :
+    os(os) {
+    buf.reserve(256);
+}
+
+void JsonEventWriter::put(const char *s) {
+    buf += s;
+}
+
+void JsonEventWriter::putInt(int x) {
+    char digits[12];
+    int n = 0;
+    unsigned v = x < 0 ? 0u - unsigned(x) : unsigned(x);
+    do {
+        digits[n++] = char('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    if (x < 0) buf += '-';
+    while (n > 0)
+        buf += digits[--n];
+}
+
+void JsonEventWriter::putSquare(int row, int col) {
+    buf += '[';
+    putInt(row);
+    buf += ',';
+    putInt(col);
+    buf += ']';
+}
+
+void JsonEventWriter::putUnit(UnitType type, bool side) {
+    static const char letters[] = "STBFH"; // same order as UnitType
+    buf += '"';
+    buf += side ? letters[type] : char(letters[type] - 'A' + 'a');
+    buf += '"';
+}
+
+void JsonEventWriter::emit() {
+    buf += '\n';
+    os.write(buf.data(), buf.size());
+    buf.clear();
+}
+
+void JsonEventWriter::boardLoaded(const Field &field) {
+    int h = field.getHeight();
+    int w = field.getWidth();
+    put("{\"ev\":\"board\",\"h\":");
+    putInt(h);
+    put(",\"w\":");
+    putInt(w);
+    put(",\"terrain\":[");
+    bool first = true;
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++) {
+            TerrainType t = field.getTerrain(i, j).getType();
+            if (t == PLAIN) continue;
+            if (!first) buf += ',';
+            first = false;
+            buf += '[';
+            putInt(i);
+            buf += ',';
+            putInt(j);
+            put(",\"");
+            buf += terrainLetter(t);
+            put("\"]");
+        }
+    put("],\"units\":[");
+    first = true;
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++) {
+            const Unit *u = field.getUnit(i, j);
+            if (u == nullptr) continue;
+            if (!first) buf += ',';
+            first = false;
+            buf += '[';
+            putInt(i);
+            buf += ',';
+            putInt(j);
+            buf += ',';
+            putUnit(u->getType(), u->getSide());
+            buf += ',';
+            putInt(u->getHp());
+            buf += ']';
+        }
+    put("]}");
+    emit();
+}
+
+void JsonEventWriter::unitMoved(const Unit &u, int fromRow, int fromCol) {
+    put("{\"ev\":\"move\",\"u\":");
+    putUnit(u.getType(), u.getSide());
+    put(",\"from\":");
+    putSquare(fromRow, fromCol);
+    put(",\"to\":");
+    putSquare(u.getRow(), u.getCol());
+    buf += '}';
+    emit();
+}
+
+// One line for the attack, then one for every unit which died of it
+void JsonEventWriter::attackResolved(const AttackReport &report) {
+    put("{\"ev\":\"attack\",\"u\":");
+    putUnit(report.type, report.side);
+    put(",\"from\":");
+    putSquare(report.row, report.col);
+    put(",\"at\":");
+    putSquare(report.targetRow, report.targetCol);
+    put(",\"hits\":[");
+    for (size_t k = 0; k < report.units.size(); k++) {
+        const UnitChange &c = report.units[k];
+        if (k > 0) buf += ',';
+        put("{\"u\":");
+        putUnit(c.type, c.side);
+        put(",\"at\":");
+        putSquare(c.row, c.col);
+        if (c.newRow != c.row || c.newCol != c.col) {
+            put(",\"to\":");
+            putSquare(c.newRow, c.newCol);
+        }
+        put(",\"dmg\":");
+        putInt(c.hpBefore - c.hp);
+        put(",\"hp\":");
+        putInt(c.hp);
+        buf += '}';
+    }
+    buf += ']';
+    if (!report.terrains.empty()) {
+        put(",\"terrain\":[");
+        for (size_t k = 0; k < report.terrains.size(); k++) {
+            const TerrainChange &c = report.terrains[k];
+            if (k > 0) buf += ',';
+            buf += '[';
+            putInt(c.row);
+            buf += ',';
+            putInt(c.col);
+            put(",\"");
+            buf += terrainLetter(c.after);
+            put("\"]");
+        }
+        buf += ']';
+    }
+    buf += '}';
+    emit();
+
+    for (size_t k = 0; k < report.units.size(); k++) {
+        const UnitChange &c = report.units[k];
+        if (c.hp > 0) continue;
+        put("{\"ev\":\"died\",\"u\":");
+        putUnit(c.type, c.side);
+        put(",\"at\":");
+        putSquare(c.newRow, c.newCol);
+        buf += '}';
+        emit();
+    }
+}
+
+void JsonEventWriter::unitHealed(const Unit &u, int forestRow, int forestCol) {
+    put("{\"ev\":\"heal\",\"u\":");
+    putUnit(u.getType(), u.getSide());
+    put(",\"at\":");
+    putSquare(u.getRow(), u.getCol());
+    put(",\"forest\":");
+    putSquare(forestRow, forestCol);
+    put(",\"hp\":");
+    putInt(u.getHp());
+    buf += '}';
+    emit();
+}
+
+// Consumers see whole turns, so the stream is flushed here
+void JsonEventWriter::turnEnded(bool side, int round) {
+    put("{\"ev\":\"turn_end\",\"side\":");
+    put(side ? "\"player\"" : "\"enemy\"");
+    put(",\"round\":");
+    putInt(round);
+    buf += '}';
+    emit();
+    os.flush();
+}
+
+void JsonEventWriter::gameOver(int status, int rounds) {
+    put("{\"ev\":\"result\",\"status\":\"");
+    put(statusName(status));
+    put("\",\"rounds\":");
+    putInt(rounds);
+    buf += '}';
+    emit();
+    os.flush();
+}
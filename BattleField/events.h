@@ -0,0 +1,103 @@
+#ifndef EVENTS_H_INCLUDED
+#define EVENTS_H_INCLUDED
+
+/**** Events of a game, for machine consumers ****/
+#include <iostream>
+#include <string>
+#include <vector>
+#include "field.h"
+
+// A unit touched by an attack
+struct UnitChange {
+    UnitType type;
+    bool side;
+    int row, col;       // square before the attack
+    int newRow, newCol; // square after it, differs if beaten back
+    int hpBefore;
+    int hp;             // 0 if the unit died
+};
+
+// A square whose terrain an attack changed (destroyed mountains)
+struct TerrainChange {
+    int row, col;
+    TerrainType before, after;
+};
+
+/* What one attack did. Every effect of an attack lies within
+   two squares of its target, so only that area is compared. */
+class AttackReport {
+public:
+    // Remember the area of the target before u attacks (trow, tcol)
+    void begin(const Field &field, const Unit *u, int trow, int tcol);
+    // Compare the area with what begin() remembered
+    void finish(const Field &field);
+
+    UnitType type; // the attacker
+    bool side;
+    int row, col;
+    int targetRow, targetCol;
+    std::vector<UnitChange> units;       // units hurt, healed or moved
+    std::vector<TerrainChange> terrains;
+
+private:
+    std::vector<const Unit *> seen; // units of the area, same order as before
+    std::vector<UnitChange> before;
+    std::vector<TerrainChange> ground;
+};
+
+/* Told about everything which happens during an interactive game.
+   Every method does nothing by default. */
+class GameObserver {
+public:
+    virtual ~GameObserver() {}
+
+    // The game starts on this field
+    virtual void boardLoaded(const Field &) {}
+    // u has just moved from (fromRow, fromCol)
+    virtual void unitMoved(const Unit &, int, int) {}
+    // An attack is over, dead units are already removed
+    virtual void attackResolved(const AttackReport &) {}
+    // A FOREST at (forestRow, forestCol) has just healed u
+    virtual void unitHealed(const Unit &, int, int) {}
+    // The turn of side (true for the player) in round is over
+    virtual void turnEnded(bool, int) {}
+    // The game is over, status is a PlayStatus
+    virtual void gameOver(int, int) {}
+};
+
+/* Writes every event as one compact JSON object per line:
+     {"ev":"board","h":8,"w":8,"terrain":[[r,c,"M"],...],"units":[[r,c,"S",hp],...]}
+     {"ev":"move","u":"S","from":[r,c],"to":[r,c]}
+     {"ev":"attack","u":"T","from":[r,c],"at":[r,c],
+      "hits":[{"u":"b","at":[r,c],"to":[r,c],"dmg":1,"hp":2}],"terrain":[[r,c,"."]]}
+     {"ev":"died","u":"b","at":[r,c]}
+     {"ev":"heal","u":"S","at":[r,c],"forest":[r,c],"hp":3}
+     {"ev":"turn_end","side":"player","round":0}
+     {"ev":"result","status":"won","rounds":4}
+   Units are written as on the board: the letter of the type,
+   upper case for the player and lower case for the enemy.
+   Every line is built in one buffer reused for the whole game. */
+class JsonEventWriter : public GameObserver {
+public:
+    explicit JsonEventWriter(std::ostream &os);
+
+    void boardLoaded(const Field &field);
+    void unitMoved(const Unit &u, int fromRow, int fromCol);
+    void attackResolved(const AttackReport &report);
+    void unitHealed(const Unit &u, int forestRow, int forestCol);
+    void turnEnded(bool side, int round);
+    void gameOver(int status, int rounds);
+
+private:
+    std::ostream &os;
+    std::string buf;
+
+    void put(const char *s);
+    void putInt(int x);
+    void putSquare(int row, int col);
+    void putUnit(UnitType type, bool side);
+    // Write the buffer as one line
+    void emit();
+};
+
+#endif // EVENTS_H_INCLUDED
@@ -1,126 +1,334 @@
 #include <cassert>
+#include <cstdlib>
+#include <algorithm>
+#include <utility>
+#include <atomic>
 #include "field.h"
 
+// Ids handed out to new fields
+static std::atomic<unsigned long long> fieldIds(1);
+
+static unsigned long long newFieldId() {
+    return fieldIds++;
+}
+
 // Constructor
 Field::Field(int h, int w) :
-    units(h, w), terrains(h, w) {
+    height(h), width(w), backing(DENSE_FIELD), units(h, w), terrains(h, w), tiles(nullptr), telemetry(nullptr), journal(nullptr),
+    id(newFieldId()), version(0), resetVersion(0) {
+}
+
+// Constructor with a chosen backing
+Field::Field(int h, int w, FieldBacking b) :
+    height(h), width(w), backing(b), tiles(nullptr), telemetry(nullptr), journal(nullptr), id(newFieldId()), version(0), resetVersion(0) {
+    if (backing == DENSE_FIELD) {
+        units = Grid<Unit *>(h, w);
+        terrains = Grid<Terrain>(h, w);
+    } else {
+        tiles = new TileStore(h, w);
+    }
+}
+
+// Copy constructor
+// Every unit is duplicated, the copy owns its units
+Field::Field(const Field &other) :
+    height(other.height), width(other.width), backing(other.backing), tiles(nullptr), telemetry(nullptr), journal(nullptr),
+    id(newFieldId()), version(0), resetVersion(0) {
+    if (backing == DENSE_FIELD) {
+        units = Grid<Unit *>(height, width);
+        terrains = other.terrains;
+    } else {
+        tiles = new TileStore(height, width);
+    }
+    copySquares(other);
+    logReset();
+}
+
+// Units are overwritten in place when the sizes agree,
+// so assigning between dense fields of the same size hardly allocates
+Field &Field::operator=(const Field &other) {
+    if (this == &other) return *this;
+    if (backing != DENSE_FIELD || other.backing != DENSE_FIELD
+        || height != other.height || width != other.width) {
+        Field copy(other);
+        std::swap(height, copy.height);
+        std::swap(width, copy.width);
+        std::swap(backing, copy.backing);
+        std::swap(units, copy.units);
+        std::swap(terrains, copy.terrains);
+        std::swap(tiles, copy.tiles);
+        std::swap(block, copy.block);
+        logReset();
+        return *this;
+    }
+
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++) {
+            terrains[i][j] = other.terrains[i][j];
+            Unit *src = other.units[i][j];
+            if (src == nullptr) {
+                releaseUnit(units[i][j]);
+                units[i][j] = nullptr;
+            } else if (units[i][j] == nullptr) {
+                units[i][j] = new Unit(*src);
+            } else {
+                *units[i][j] = *src;
+            }
+        }
+    logReset();
+    return *this;
 }
 
 // Destructor
 // Reclaim all the units
 Field::~Field() {
-    for (size_t i = 0; i < units.numRows(); i++)
-        for (size_t j = 0; j < units.numCols(); j++)
-            if (units[i][j] != nullptr)
-                delete units[i][j];
+    deleteUnits();
+    delete tiles;
+}
+
+void Field::copySquares(const Field &other) {
+    if (other.backing == DENSE_FIELD) {
+        for (int i = 0; i < height; i++)
+            for (int j = 0; j < width; j++) {
+                if (backing != DENSE_FIELD) placeTerrain(i, j, other.terrains[i][j].getType());
+                if (other.units[i][j] != nullptr)
+                    placeUnit(i, j, new Unit(*other.units[i][j]));
+            }
+        return;
+    }
+
+    // Only the stored tiles of a chunked field hold anything
+    other.tiles->forEachSquare([this](int row, int col, Unit *u, TerrainType t) {
+        placeTerrain(row, col, t);
+        if (u != nullptr) placeUnit(row, col, new Unit(*u));
+    });
+}
+
+void Field::deleteUnits() {
+    if (tiles == nullptr) {
+        for (int i = 0; i < height; i++)
+            for (int j = 0; j < width; j++)
+                if (units[i][j] != nullptr) releaseUnit(units[i][j]);
+        return;
+    }
+    std::vector<Unit *> all;
+    getUnits(all);
+    for (size_t k = 0; k < all.size(); k++)
+        releaseUnit(all[k]);
+}
+
+void Field::releaseUnit(Unit *u) {
+    if (!block.empty() && u >= &block.front() && u <= &block.back()) return;
+    if (journal != nullptr && u != nullptr)
+        journal->dead.push_back(u);
+    else
+        delete u;
+}
+
+bool Field::inBounds(int row, int col) const {
+    return row >= 0 && row < height && col >= 0 && col < width;
+}
+
+Unit *Field::unitAt(int row, int col) const {
+    if (tiles != nullptr) return tiles->getUnit(row, col);
+    return units[row][col];
+}
+
+void Field::placeUnit(int row, int col, Unit *u) {
+    if (journal != nullptr) {
+        FieldUndo::SquareChange c = {row, col, unitAt(row, col), terrainAt(row, col)};
+        journal->squares.push_back(c);
+    }
+    logChange(row, col);
+    if (tiles != nullptr)
+        tiles->setUnit(row, col, u);
+    else
+        units[row][col] = u;
+}
+
+TerrainType Field::terrainAt(int row, int col) const {
+    if (tiles != nullptr) return tiles->getTerrain(row, col);
+    return terrains[row][col].getType();
+}
+
+void Field::placeTerrain(int row, int col, TerrainType t) {
+    if (journal != nullptr) {
+        FieldUndo::SquareChange c = {row, col, unitAt(row, col), terrainAt(row, col)};
+        journal->squares.push_back(c);
+    }
+    logChange(row, col);
+    if (tiles != nullptr)
+        tiles->setTerrain(row, col, t);
+    else
+        terrains[row][col].setType(t);
+}
+
+void Field::logChange(int row, int col) {
+    if (changeLog.empty()) changeLog.resize(CHANGE_LOG_SIZE);
+    changeLog[version % CHANGE_LOG_SIZE] = (long long)row * width + col;
+    version++;
+}
+
+void Field::logReset() {
+    resetVersion = ++version;
+}
+
+unsigned long long Field::getId() const {
+    return id;
+}
+
+unsigned long long Field::getVersion() const {
+    return version;
+}
+
+bool Field::getChangesSince(unsigned long long v, std::vector<long long> &cells) const {
+    cells.clear();
+    if (v < resetVersion || version - v > (unsigned long long)CHANGE_LOG_SIZE) return false;
+    for (unsigned long long k = v; k < version; k++)
+        cells.push_back(changeLog[k % CHANGE_LOG_SIZE]);
+    return true;
 }
 
 // Get the height of the field
 size_t Field::getHeight() const {
-    return units.numRows();
+    return height;
 }
 
 // Get the width of the field
 size_t Field::getWidth() const {
-    return units.numCols();
+    return width;
+}
+
+FieldBacking Field::getBacking() const {
+    return backing;
+}
+
+// Approximate bytes used to store the squares
+size_t Field::getMemoryUsage() const {
+    if (tiles != nullptr) return sizeof(*this) + tiles->getMemoryUsage();
+    return sizeof(*this) + size_t(height) * width * (sizeof(Unit *) + sizeof(Terrain))
+         + size_t(height) * 2 * sizeof(std::vector<int>);
+}
+
+// Collect all units in row-major order
+void Field::getUnits(std::vector<Unit *> &out) const {
+    out.clear();
+    if (tiles == nullptr) {
+        for (int i = 0; i < height; i++)
+            for (int j = 0; j < width; j++)
+                if (units[i][j] != nullptr) out.push_back(units[i][j]);
+        return;
+    }
+
+    tiles->getUnits(out);
+    std::sort(out.begin(), out.end(), [](const Unit *a, const Unit *b) {
+        return a->getRow() != b->getRow() ? a->getRow() < b->getRow() : a->getCol() < b->getCol();
+    });
 }
 
 // Get the unit at row and col
 Unit *Field::getUnit(int row, int col) const {
-    assert(units.inBounds(row, col));
+    assert(inBounds(row, col));
 
-    return units[row][col];
+    return unitAt(row, col);
 }
 
 // Set the unit at row and col
 void Field::setUnit(int row, int col, UnitType unitType) {
-    assert(units.inBounds(row, col));
+    assert(inBounds(row, col));
 
-    if (units[row][col] != nullptr) {
-        delete units[row][col]; // Delete the existing unit
+    if (unitAt(row, col) != nullptr) {
+        releaseUnit(unitAt(row, col)); // Delete the existing unit
     }
     if (unitType == SOLDIER || unitType == TANK || unitType == FLIGHTER)
-        units[row][col] = new Unit(unitType, true, row, col); // Create a new unit
+        placeUnit(row, col, new Unit(unitType, true, row, col)); // Create a new unit
     else
-        units[row][col] = new Unit(unitType, false, row, col); // Create a new unit
+        placeUnit(row, col, new Unit(unitType, false, row, col)); // Create a new unit
 }
 
 // Get the terrain at row and col
 Terrain Field::getTerrain(int row, int col) const {
-    return terrains[row][col];
+    assert(inBounds(row, col));
+
+    Terrain t;
+    t.setType(terrainAt(row, col));
+    return t;
 }
 
 // Set the terrain at row and col
 void Field::setTerrain(int row, int col, TerrainType terrainType) {
-    assert(terrains.inBounds(row, col));
+    assert(inBounds(row, col));
 
-    terrains[row][col].setType(terrainType);
+    placeTerrain(row, col, terrainType);
 }
 
 bool Field::moveUnit(int srow, int scol, int trow, int tcol) {
-    assert(units.inBounds(srow, scol));
-    assert(units.inBounds(trow, tcol));
+    assert(inBounds(srow, scol));
+    assert(inBounds(trow, tcol));
 
-    if (units[trow][tcol] != nullptr) {
+    if (unitAt(trow, tcol) != nullptr) {
         // Target cell is already occupied
         return false;
     }
 
     // Move the unit from (srow, scol) to (trow, tcol)
-    Unit *unit = units[srow][scol];
-    assert(unit != nullptr);     // Ensure there is a unit to move
-    units[trow][tcol] = unit;    // Place the unit in the new position
-    units[srow][scol] = nullptr; // Clear the old position
-    unit->setCoord(trow, tcol);  // Update the unit's coordinates
+    Unit *unit = unitAt(srow, scol);
+    assert(unit != nullptr);         // Ensure there is a unit to move
+    if (journal != nullptr) journal->saveUnit(unit);
+    placeUnit(trow, tcol, unit);     // Place the unit in the new position
+    placeUnit(srow, scol, nullptr);  // Clear the old position
+    unit->setCoord(trow, tcol);      // Update the unit's coordinates
 
     return true;
 }
 
 bool Field::attackUnit(Unit *u, int trow, int tcol) {
-    assert(units.inBounds(trow, tcol));
+    assert(inBounds(trow, tcol));
     assert(u != nullptr);
 
     UnitType utype = u->getType();
-    Unit *target = units[trow][tcol];
+    Unit *target = unitAt(trow, tcol);
+    if (telemetry != nullptr) telemetry->attackBy(utype);
 
     switch (utype) {
     case SOLDIER:
     case BEE:
         if (target != nullptr) {
-            target->receiveDamage(u->getAttackPoints());
+            hurt(target, u->getAttackPoints());
         }
         break;
 
     case TANK:
-        if (target == nullptr && terrains[trow][tcol].getType() == MOUNTAIN) {
-            terrains[trow][tcol].setType(PLAIN); // TANK can destroy MOUNTAIN
+        if (target == nullptr && terrainAt(trow, tcol) == MOUNTAIN) {
+            placeTerrain(trow, tcol, PLAIN); // TANK can destroy MOUNTAIN
+            if (telemetry != nullptr) telemetry->mountainDestroyed();
         }
         if (target != nullptr) {
-            target->receiveDamage(u->getAttackPoints());
+            hurt(target, u->getAttackPoints());
             beatBack(u->getRow(), u->getCol(), target);
         }
         break;
     case FLIGHTER:
         if (target != nullptr) {
-            target->receiveDamage(u->getAttackPoints());
+            hurt(target, u->getAttackPoints());
         }
         // beat back four directions
-        if (units.inBounds(trow - 1, tcol) && units[trow - 1][tcol] != nullptr) {
-            beatBack(trow, tcol, units[trow - 1][tcol]);
+        if (inBounds(trow - 1, tcol) && unitAt(trow - 1, tcol) != nullptr) {
+            beatBack(trow, tcol, unitAt(trow - 1, tcol));
         }
-        if (units.inBounds(trow + 1, tcol) && units[trow + 1][tcol] != nullptr) {
-            beatBack(trow, tcol, units[trow + 1][tcol]);
+        if (inBounds(trow + 1, tcol) && unitAt(trow + 1, tcol) != nullptr) {
+            beatBack(trow, tcol, unitAt(trow + 1, tcol));
         }
-        if (units.inBounds(trow, tcol - 1) && units[trow][tcol - 1] != nullptr) {
-            beatBack(trow, tcol, units[trow][tcol - 1]);
+        if (inBounds(trow, tcol - 1) && unitAt(trow, tcol - 1) != nullptr) {
+            beatBack(trow, tcol, unitAt(trow, tcol - 1));
         }
-        if (units.inBounds(trow, tcol + 1) && units[trow][tcol + 1] != nullptr) {
-            beatBack(trow, tcol, units[trow][tcol + 1]);
+        if (inBounds(trow, tcol + 1) && unitAt(trow, tcol + 1) != nullptr) {
+            beatBack(trow, tcol, unitAt(trow, tcol + 1));
         }
         break;
     case HYDRAULISK:
         if (target != nullptr) {
-            target->receiveDamage(u->getAttackPoints());
+            hurt(target, u->getAttackPoints());
             beatBack(u->getRow(), u->getCol(), target);
         }
     default:
@@ -128,16 +336,127 @@ bool Field::attackUnit(Unit *u, int trow, int tcol) {
     }
 
     // 清除血量为0的单位
-    for (size_t i = 0; i < units.numRows(); i++) {
-        for (size_t j = 0; j < units.numCols(); j++) {
-            if (units[i][j] != nullptr && !units[i][j]->isAlive()) {
-                delete units[i][j];    // Delete the dead unit
-                units[i][j] = nullptr; // Clear the position
-            }
+    removeDead(trow, tcol);
+
+    return true;
+}
+
+void Field::setTelemetry(GameTelemetry *t) {
+    telemetry = t;
+}
+
+GameTelemetry *Field::getTelemetry() const {
+    return telemetry;
+}
+
+void Field::hurt(Unit *u, int points) {
+    if (telemetry != nullptr) telemetry->damaged(std::min(points, u->getHp()));
+    if (journal != nullptr) journal->saveUnit(u);
+    u->receiveDamage(points);
+}
+
+void Field::recordUndo(FieldUndo &undo) {
+    undo.clear();
+    journal = &undo;
+}
+
+void Field::stopUndo() {
+    journal = nullptr;
+}
+
+void Field::undo(FieldUndo &undo) {
+    assert(journal == nullptr);
+    for (size_t k = undo.squares.size(); k-- > 0;) {
+        const FieldUndo::SquareChange &c = undo.squares[k];
+        if (unitAt(c.row, c.col) != c.unit) placeUnit(c.row, c.col, c.unit);
+        if (terrainAt(c.row, c.col) != c.terrain) placeTerrain(c.row, c.col, c.terrain);
+    }
+    for (size_t k = undo.units.size(); k-- > 0;)
+        *undo.units[k] = undo.states[k];
+    // The units which died are on the field again
+    undo.dead.clear();
+    undo.clear();
+}
+
+/** FieldUndo **/
+
+FieldUndo::FieldUndo() {
+}
+
+FieldUndo::~FieldUndo() {
+    clear();
+}
+
+void FieldUndo::saveUnit(Unit *u) {
+    units.push_back(u);
+    states.push_back(*u);
+}
+
+void FieldUndo::clear() {
+    for (size_t k = 0; k < dead.size(); k++)
+        delete dead[k];
+    dead.clear();
+    squares.clear();
+    units.clear();
+    states.clear();
+}
+
+bool FieldUndo::empty() const {
+    return squares.empty() && units.empty();
+}
+
+void Field::restore(int h, int w, const std::vector<unsigned char> &terrain, std::vector<Unit> &restored) {
+    assert(terrain.size() == size_t(h) * w);
+    deleteUnits();
+    block.clear();
+    if (tiles != nullptr) {
+        delete tiles;
+        tiles = new TileStore(h, w);
+    } else if (h != height || w != width) {
+        units = Grid<Unit *>(h, w);
+        terrains = Grid<Terrain>(h, w);
+    } else {
+        for (int i = 0; i < h; i++)
+            for (int j = 0; j < w; j++)
+                units[i][j] = nullptr;
+    }
+    height = h;
+    width = w;
+
+    // Straight into the planes: the log only learns that everything changed
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++) {
+            TerrainType t = TerrainType(terrain[size_t(i) * w + j]);
+            if (tiles == nullptr)
+                terrains[i][j].setType(t);
+            else if (t != PLAIN)
+                tiles->setTerrain(i, j, t);
         }
+    block.swap(restored);
+    for (size_t k = 0; k < block.size(); k++) {
+        Unit *u = &block[k];
+        assert(inBounds(u->getRow(), u->getCol()) && unitAt(u->getRow(), u->getCol()) == nullptr);
+        if (tiles == nullptr)
+            units[u->getRow()][u->getCol()] = u;
+        else
+            tiles->setUnit(u->getRow(), u->getCol(), u);
     }
+    logReset();
+}
 
-    return true;
+// An attack only hurts units within two squares of its target:
+// the target, the units beaten back and the units they bump into
+void Field::removeDead(int row, int col) {
+    for (int i = row - 2; i <= row + 2; i++) {
+        for (int j = col - 2; j <= col + 2; j++) {
+            if (abs(i - row) + abs(j - col) > 2 || !inBounds(i, j)) continue;
+            Unit *u = unitAt(i, j);
+            if (u != nullptr && !u->isAlive()) {
+                releaseUnit(u);           // Delete the dead unit
+                placeUnit(i, j, nullptr); // Clear the position
+            }
+        }
+    }
 }
 
 void Field::beatBack(int srow, int scol, Unit *u) {
@@ -164,26 +483,29 @@ void Field::beatBack(int srow, int scol, Unit *u) {
     int newRow = trow + drow[direction];
     int newCol = tcol + dcol[direction];
 
-    if (!units.inBounds(newRow, newCol)) return; // Out of bounds
-    if (units[newRow][newCol] != nullptr) {
-        u->receiveDamage(1);                       // If the new position is occupied, the unit takes 1 damage
-        getUnit(newRow, newCol)->receiveDamage(1); // The unit in the new position also takes 1 damage
+    if (!inBounds(newRow, newCol)) return; // Out of bounds
+    if (unitAt(newRow, newCol) != nullptr) {
+        hurt(u, 1);                       // If the new position is occupied, the unit takes 1 damage
+        hurt(getUnit(newRow, newCol), 1); // The unit in the new position also takes 1 damage
+        if (telemetry != nullptr) telemetry->collided();
         return;
     }
 
-    TerrainType terrainType = terrains[newRow][newCol].getType(); // 获取击退后的地形类型
+    TerrainType terrainType = terrainAt(newRow, newCol); // 获取击退后的地形类型
     switch (terrainType) {
     case PLAIN:
         // Move the unit back to the next square in the direction of the attack
         moveUnit(trow, tcol, newRow, newCol); // Move the unit to the new position
         break;
     case MOUNTAIN:
-        u->receiveDamage(1);                     // If the terrain is MOUNTAIN, the unit takes 1 damage
-        terrains[newRow][newCol].setType(PLAIN); // MOUNTAIN becomes PLAIN
+        hurt(u, 1);                              // If the terrain is MOUNTAIN, the unit takes 1 damage
+        placeTerrain(newRow, newCol, PLAIN);     // MOUNTAIN becomes PLAIN
+        if (telemetry != nullptr) telemetry->mountainDestroyed();
         break;
     case OCEAN:
         if (u->getType() == SOLDIER || u->getType() == TANK || u->getType() == HYDRAULISK) {
-            u->receiveDamage(999); // get destroyed
+            if (telemetry != nullptr && u->isAlive()) telemetry->drowned();
+            hurt(u, 999); // get destroyed
         } else {
             moveUnit(trow, tcol, newRow, newCol); // Move the unit to the new position
         }
@@ -1,15 +1,67 @@
 #ifndef FIELD_H_INCLUDED
 #define FIELD_H_INCLUDED
 
+#include <vector>
 #include "NewGrid.h"
 #include "terrain.h"
 #include "unit.h"
+#include "tiles.h"
+#include "telemetry.h"
+
+// How the squares of a field are stored
+// The games and the searches work on both: they visit the units through
+// getUnits or forEachSquare, not square by square, and the planes they mark
+// (MarkPlane) keep the marks in a hash table on a huge field.
+enum FieldBacking { DENSE_FIELD,   // one grid per plane, memory grows with the area
+                    CHUNKED_FIELD, // tiles created on demand, memory grows with the content
+};
+
+// Changes remembered by a field
+const int CHANGE_LOG_SIZE = 1024;
+
+class Field;
+
+/* What a field changed while it recorded into this, to take it back:
+   the squares before every change, the units before every change
+   of their hp, square or flags, and the units which died, kept here
+   instead of deleted */
+class FieldUndo {
+public:
+    FieldUndo();
+    // Delete the units which died, if the changes were not taken back
+    ~FieldUndo();
+
+    // Remember u as it is now, before it changes
+    void saveUnit(Unit *u);
+    // Forget the changes, keeping them
+    void clear();
+    bool empty() const;
+
+private:
+    friend class Field;
+    struct SquareChange {
+        int row, col;
+        Unit *unit;
+        TerrainType terrain;
+    };
+    std::vector<SquareChange> squares;
+    std::vector<Unit *> units; // the units saved, same order as states
+    std::vector<Unit> states;
+    std::vector<Unit *> dead;
+
+    FieldUndo(const FieldUndo &);
+    FieldUndo &operator=(const FieldUndo &);
+};
 
 /* Battle field */
 class Field {
 public:
     // Constructor
     Field(int h, int w);
+    Field(int h, int w, FieldBacking backing);
+    // Copy the terrains and all units
+    Field(const Field &other);
+    Field &operator=(const Field &other);
     // Destructor
     ~Field();
 
@@ -17,6 +69,30 @@ public:
     size_t getHeight() const;
     size_t getWidth() const;
 
+    FieldBacking getBacking() const;
+    // Approximate bytes used to store the squares
+    size_t getMemoryUsage() const;
+
+    // Collect all units in row-major order of their positions
+    void getUnits(std::vector<Unit *> &out) const;
+    // Visit every square holding a unit or a terrain other than PLAIN:
+    // visit(row, col, unit, terrain), in row-major order on a dense field,
+    // tile by tile on a chunked one
+    template <typename Visit>
+    void forEachSquare(Visit visit) const;
+
+    // Identity of this field object, never shared by two fields
+    unsigned long long getId() const;
+    // Mutation version, grows whenever a unit or a terrain changes square
+    // (moves, deaths, new units, terrain changes, copies)
+    unsigned long long getVersion() const;
+    // Collect the squares (row * width + col, in 64 bits as a chunked field
+    // may have more squares than an int counts) changed after version v.
+    // Return false if they are no longer known, e.g. after an assignment
+    // or when more than CHANGE_LOG_SIZE changes happened since;
+    // then the caller must assume that every square changed.
+    bool getChangesSince(unsigned long long v, std::vector<long long> &cells) const;
+
     // Get the unit at row and col
     Unit *getUnit(int row, int col) const;
     // Set the unit at row and col
@@ -34,14 +110,79 @@ public:
     // Attack a unit at (trow, tcol) with the unit
     bool attackUnit(Unit *u, int trow, int tcol);
 
+    // Count what the attacks do into telemetry, none if nullptr.
+    // Copies of the field count nothing.
+    void setTelemetry(GameTelemetry *t);
+    GameTelemetry *getTelemetry() const;
+
+    // Record every change into undo, cleared first, until stopUndo()
+    void recordUndo(FieldUndo &undo);
+    void stopUndo();
+    // Take back the changes recorded in undo, latest first, and clear it.
+    // The field must not have changed since, but by changes taken back before.
+    void undo(FieldUndo &undo);
+
+    // Replace the whole content by h x w squares of the given terrains
+    // (row-major) and the units of block, on distinct squares inside.
+    // The field takes the block and keeps its units there
+    // instead of allocating each of them.
+    void restore(int h, int w, const std::vector<unsigned char> &terrain, std::vector<Unit> &block);
+
 private:
-    // Store the units
+    int height, width;
+    FieldBacking backing;
+    // Store the units (DENSE_FIELD)
     Grid<Unit *> units;
-    // Store the terrains
+    // Store the terrains (DENSE_FIELD)
     Grid<Terrain> terrains;
+    // Store both (CHUNKED_FIELD)
+    TileStore *tiles;
+    // Units restored at once, never reallocated
+    std::vector<Unit> block;
+    GameTelemetry *telemetry; // may be nullptr
+    FieldUndo *journal;       // records the changes if not nullptr
+
+    // Squares changed by the last CHANGE_LOG_SIZE versions, as a ring
+    std::vector<long long> changeLog;
+    unsigned long long id;
+    unsigned long long version;
+    unsigned long long resetVersion; // everything changed at this version
+
+    // Access the squares whatever the backing
+    bool inBounds(int row, int col) const;
+    Unit *unitAt(int row, int col) const;
+    void placeUnit(int row, int col, Unit *u);
+    TerrainType terrainAt(int row, int col) const;
+    void placeTerrain(int row, int col, TerrainType t);
+    // Record a change of the square
+    void logChange(int row, int col);
+    // Record that every square may have changed
+    void logReset();
 
+    // Copy all squares of another field, which must be empty here
+    void copySquares(const Field &other);
+    void deleteUnits();
+    // Delete a unit unless it lives in block, or keep it in the journal
+    void releaseUnit(Unit *u);
+
+    // Damage u by points, counting the hp it loses
+    void hurt(Unit *u, int points);
     // BeatBack
     void beatBack(int srow, int scol, Unit *u);
+    // Remove dead units around (row, col)
+    void removeDead(int row, int col);
 };
 
+template <typename Visit>
+void Field::forEachSquare(Visit visit) const {
+    if (tiles != nullptr) {
+        tiles->forEachSquare(visit);
+        return;
+    }
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++)
+            if (units[i][j] != nullptr || terrains[i][j].getType() != PLAIN)
+                visit(i, j, units[i][j], terrains[i][j].getType());
+}
+
 #endif // FIELD_H_INCLUDED
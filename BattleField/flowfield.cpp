@@ -0,0 +1,183 @@
+#include "flowfield.h"
+#include "batch.h"
+
+using namespace std;
+
+FlowField::FlowField(bool ground) :
+    ground(ground), height(0), width(0), fieldId(0), version(0), builds(0), repairs(0) {
+}
+
+unsigned long FlowField::getBuilds() const {
+    return builds;
+}
+
+unsigned long FlowField::getRepairs() const {
+    return repairs;
+}
+
+int FlowField::distance(int row, int col) const {
+    return dist[cellOf(row, col)];
+}
+
+// The planes have a closed border of one square all around,
+// so a search never checks that a neighbour is on the board
+size_t FlowField::cellOf(int row, int col) const {
+    return size_t(row + 1) * (width + 2) + col + 1;
+}
+
+bool FlowField::isOpen(const Field &field, int row, int col) const {
+    TerrainType t = field.getTerrain(row, col).getType();
+    return t == PLAIN || t == (ground ? FOREST : OCEAN);
+}
+
+bool FlowField::isSource(const Field &field, int row, int col) const {
+    const Unit *u = field.getUnit(row, col);
+    return u != nullptr && u->getSide();
+}
+
+void FlowField::build(const Field &field) {
+    height = field.getHeight();
+    width = field.getWidth();
+    size_t area = size_t(height + 2) * (width + 2);
+    open.assign(area, 0);
+    source.assign(area, 0);
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++)
+            open[cellOf(i, j)] = isOpen(field, i, j);
+    field.getUnits(units);
+    for (size_t k = 0; k < units.size(); k++)
+        if (units[k]->getSide()) source[cellOf(units[k]->getRow(), units[k]->getCol())] = 1;
+    search();
+    fieldId = field.getId();
+    version = field.getVersion();
+}
+
+void FlowField::search() {
+    dist.assign(open.size(), -1);
+    owner.assign(open.size(), -1);
+    queue.clear();
+    for (size_t cell = 0; cell < source.size(); cell++)
+        if (source[cell]) {
+            dist[cell] = 0;
+            owner[cell] = int(cell);
+            queue.push_back(int(cell));
+        }
+    spread();
+    builds++;
+}
+
+void FlowField::update(const Field &field) {
+    if (field.getId() != fieldId || int(field.getHeight()) != height || int(field.getWidth()) != width) {
+        build(field);
+        return;
+    }
+    if (field.getVersion() == version) return;
+    if (!field.getChangesSince(version, changes)) {
+        build(field);
+        return;
+    }
+    version = field.getVersion();
+
+    // New sources and squares which opened only make paths shorter: the search
+    // goes on from them. Sources which left are forgotten with the squares
+    // nearest to them, which are then reached from around. Only a square
+    // which closed needs a new search of the whole board.
+    bool closed = false;
+    queue.clear();
+    gone.clear();
+    for (size_t k = 0; k < changes.size(); k++) {
+        int row = int(changes[k] / width), col = int(changes[k] % width);
+        int cell = int(cellOf(row, col));
+        char nowOpen = isOpen(field, row, col), nowSource = isSource(field, row, col);
+        if (open[cell] && !nowOpen) closed = true;
+        if (source[cell] && !nowSource) gone.push_back(cell);
+        if ((nowOpen && !open[cell]) || (nowSource && !source[cell])) queue.push_back(cell);
+        open[cell] = nowOpen;
+        source[cell] = nowSource;
+    }
+    if (closed) {
+        search();
+        return;
+    }
+    if (queue.empty() && gone.empty()) return;
+
+    const int step[] = {-(width + 2), width + 2, -1, 1};
+    forget();
+    // A square which opened or was forgotten takes the distance of its best neighbour
+    for (size_t k = 0; k < queue.size(); k++) {
+        int cell = queue[k];
+        if (!open[cell] && !source[cell]) continue;
+        for (int d = 0; d < 4; d++) {
+            int next = cell + step[d], from = dist[next];
+            if (from >= 0 && (dist[cell] < 0 || from + 1 < dist[cell])) {
+                dist[cell] = from + 1;
+                owner[cell] = owner[next];
+            }
+        }
+    }
+    // Sources which came, or were forgotten with one which left
+    for (size_t k = 0; k < queue.size(); k++) {
+        int cell = queue[k];
+        if (source[cell] && dist[cell] != 0) {
+            dist[cell] = 0;
+            owner[cell] = cell;
+            queue.push_back(cell);
+        }
+    }
+    spread();
+    repairs++;
+}
+
+// Forget the distances of the squares nearest to the sources in gone.
+// Every such square got its distance from a neighbour with the same owner,
+// so they are found by following the owner from the source.
+// The forgotten squares go to queue.
+void FlowField::forget() {
+    const int step[] = {-(width + 2), width + 2, -1, 1};
+    for (size_t k = 0; k < gone.size(); k++) {
+        int s = gone[k];
+        if (owner[s] != s) continue; // forgotten with another one
+        dist[s] = -1;
+        owner[s] = -1;
+        queue.push_back(s);
+        for (size_t q = queue.size() - 1; q < queue.size(); q++) {
+            int cell = queue[q];
+            for (int d = 0; d < 4; d++) {
+                int next = cell + step[d];
+                if (owner[next] != s) continue;
+                dist[next] = -1;
+                owner[next] = -1;
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+// Give every open square next to a queued one a shorter distance if it can.
+// From the sources alone this is a plain breadth-first search; from squares
+// at different distances a square may be improved more than once.
+void FlowField::spread() {
+    const int step[] = {-(width + 2), width + 2, -1, 1};
+    for (size_t q = 0; q < queue.size(); q++) {
+        int cell = queue[q], d = dist[cell];
+        if (d < 0) continue;
+        for (int k = 0; k < 4; k++) {
+            int next = cell + step[k];
+            if (!open[next] || (dist[next] >= 0 && dist[next] <= d + 1)) continue;
+            dist[next] = d + 1;
+            owner[next] = owner[cell];
+            queue.push_back(next);
+        }
+    }
+    queue.clear();
+}
+
+EnemyFlow::EnemyFlow() :
+    groundFlow(true), flyingFlow(false) {
+}
+
+const FlowField &EnemyFlow::forUnit(const Field &field, const Unit *u) {
+    FlowField &flow = isGroundMover(u->getType()) ? groundFlow : flyingFlow;
+    flow.update(field);
+    return flow;
+}
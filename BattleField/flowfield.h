@@ -0,0 +1,72 @@
+#ifndef FLOWFIELD_H_INCLUDED
+#define FLOWFIELD_H_INCLUDED
+
+/**** Distances to the nearest player unit over the whole board ****/
+#include <vector>
+#include "field.h"
+
+/* Length of the shortest path from every square to the nearest player
+   unit, for one movement class: a breadth-first search from all player
+   units at once over the squares the class may cross. Units are not
+   obstacles, they move all the time; a player unit itself is reached
+   whatever its terrain, as it is attacked from the next square.
+   The distances are kept until a player unit moves, appears or dies,
+   or a square changes passability, and then only repaired around the
+   change: a player unit which leaves takes the squares nearest to it
+   along, and the search goes on from around them and from the squares
+   which opened. Only a square which closes searches the whole board. */
+class FlowField {
+public:
+    // For ground units (PLAIN and FOREST are open) or flying units (PLAIN and OCEAN)
+    explicit FlowField(bool ground);
+
+    // Bring the distances up to date with field
+    void update(const Field &field);
+
+    // Distance from (row, col) to the nearest player unit, -1 if none can be reached
+    int distance(int row, int col) const;
+
+    // Whole searches, and searches repaired around the changes
+    unsigned long getBuilds() const;
+    unsigned long getRepairs() const;
+
+private:
+    bool ground;
+    int height, width;
+    unsigned long long fieldId, version;
+    std::vector<char> open;
+    std::vector<char> source; // a player unit stands there
+    std::vector<int> dist;
+    std::vector<int> owner;   // square of the nearest source, -1 if none
+    unsigned long builds, repairs;
+    // Scratch memory
+    std::vector<long long> changes;
+    std::vector<int> queue;
+    std::vector<int> gone; // sources which left
+    std::vector<Unit *> units;
+
+    bool isOpen(const Field &field, int row, int col) const;
+    bool isSource(const Field &field, int row, int col) const;
+    size_t cellOf(int row, int col) const;
+    void build(const Field &field);
+    // Search the whole board again from the sources
+    void search();
+    void forget();
+    // Breadth-first search from the squares in queue
+    void spread();
+};
+
+/* The distance fields of both movement classes, each searched the first
+   time an enemy unit of the class asks after a change */
+class EnemyFlow {
+public:
+    EnemyFlow();
+
+    // The up to date field of the class of u
+    const FlowField &forUnit(const Field &field, const Unit *u);
+
+private:
+    FlowField groundFlow, flyingFlow;
+};
+
+#endif // FLOWFIELD_H_INCLUDED
@@ -0,0 +1,259 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <streambuf>
+#include "framehash.h"
+#include "engine.h"
+
+using namespace std;
+
+static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+static const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+/** FrameHasher **/
+
+FrameHasher::FrameHasher() :
+    hash(FNV_OFFSET), lines(0), blanks(0), open(false), frameLine(0), frames(0) {
+    line.reserve(256);
+}
+
+std::vector<FrameRecord> &FrameHasher::getRecords() {
+    return records;
+}
+
+int FrameHasher::getFrames() const {
+    return frames;
+}
+
+void FrameHasher::mix(const char *data, size_t size) {
+    unsigned long long h = hash;
+    for (size_t k = 0; k < size; k++) {
+        h ^= (unsigned char)data[k];
+        h *= FNV_PRIME;
+    }
+    hash = h;
+}
+
+void FrameHasher::feed(const char *data, size_t size) {
+    const char *end = data + size;
+    while (data < end) {
+        const char *nl = data;
+        while (nl < end && *nl != '\n') nl++;
+        line.append(data, nl);
+        if (nl == end) return;
+        endLine();
+        data = nl + 1;
+    }
+}
+
+void FrameHasher::finish() {
+    if (!line.empty()) endLine();
+    if (open) endFrame();
+}
+
+void FrameHasher::endLine() {
+    lines++;
+    size_t n = line.size();
+    while (n > 0 && (line[n - 1] == ' ' || line[n - 1] == '\t' || line[n - 1] == '\r')) n--;
+    if (n == 0) {
+        // Blank lines only count once something follows them
+        if (open) endFrame();
+        blanks++;
+        line.clear();
+        return;
+    }
+    if (!open) {
+        open = true;
+        frameLine = lines;
+        char gap[16];
+        int length = snprintf(gap, sizeof(gap), "%d\n", blanks);
+        mix(gap, length);
+        blanks = 0;
+    }
+    line.resize(n);
+    line += '\n';
+    mix(line.data(), line.size());
+    char last = line[n - 1];
+    line.clear();
+    if (last == '?' || last == ':') endFrame();
+}
+
+void FrameHasher::endFrame() {
+    FrameRecord r = {frameLine, hash};
+    records.push_back(r);
+    frames++;
+    open = false;
+}
+
+/** FrameHashOutput **/
+
+/* Bytes collect in a small put area, hashed whenever it is full or flushed */
+class FrameHashOutput::Buffer : public streambuf {
+public:
+    Buffer(FrameHashOutput &out) : out(out) {
+        setp(area, area + sizeof(area));
+    }
+
+    // Hash the put area
+    void drain() {
+        out.getHasher().feed(pbase(), size_t(pptr() - pbase()));
+        setp(area, area + sizeof(area));
+        out.writeRecords();
+    }
+
+protected:
+    int_type overflow(int_type c) {
+        drain();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() {
+        drain();
+        return 0;
+    }
+
+private:
+    FrameHashOutput &out;
+    char area[1 << 12];
+};
+
+FrameHashOutput::FrameHashOutput(ostream *manifest) :
+    manifest(manifest), finished(false) {
+    buffer.reset(new Buffer(*this));
+    os.reset(new ostream(buffer.get()));
+    if (manifest != nullptr) writeManifestHeader(*manifest);
+}
+
+FrameHashOutput::~FrameHashOutput() {
+    finish();
+}
+
+ostream &FrameHashOutput::stream() {
+    return *os;
+}
+
+FrameHasher &FrameHashOutput::getHasher() {
+    return hasher;
+}
+
+void FrameHashOutput::finish() {
+    if (finished) return;
+    finished = true;
+    buffer->drain();
+    hasher.finish();
+    writeRecords();
+    if (manifest != nullptr) {
+        writeManifestEnd(*manifest, hasher.getFrames());
+        manifest->flush();
+    }
+}
+
+// The frames done go to the manifest, and are forgotten there
+void FrameHashOutput::writeRecords() {
+    if (manifest == nullptr) return;
+    vector<FrameRecord> &records = hasher.getRecords();
+    for (size_t k = 0; k < records.size(); k++)
+        writeManifestRecord(*manifest, records[k]);
+    records.clear();
+}
+
+/** Manifests **/
+
+void writeManifestHeader(ostream &os) {
+    os << "BFHASH 1\n";
+}
+
+void writeManifestRecord(ostream &os, const FrameRecord &r) {
+    char text[48];
+    snprintf(text, sizeof(text), "%d %016llx\n", r.line, r.hash);
+    os << text;
+}
+
+void writeManifestEnd(ostream &os, int frames) {
+    os << "end " << frames << '\n';
+}
+
+bool readManifest(istream &is, vector<FrameRecord> &records) {
+    string magic, word;
+    int version = 0;
+    if (!(is >> magic >> version) || magic != "BFHASH" || version != 1) return false;
+    records.clear();
+    while (is >> word) {
+        if (word == "end") {
+            size_t frames = 0;
+            return bool(is >> frames) && frames == records.size();
+        }
+        FrameRecord r;
+        r.line = atoi(word.c_str());
+        if (!(is >> hex >> r.hash >> dec)) return false;
+        records.push_back(r);
+    }
+    return false;
+}
+
+void hashFrames(const string &text, vector<FrameRecord> &records) {
+    FrameHasher hasher;
+    hasher.feed(text.data(), text.size());
+    hasher.finish();
+    records.swap(hasher.getRecords());
+}
+
+bool writeManifestFile(const string &outputPath, const string &manifestPath, ostream &os) {
+    ifstream ifs(outputPath.c_str(), ios::binary);
+    ofstream ofs(manifestPath.c_str());
+    if (!ifs || !ofs) {
+        os << "Cannot convert the file: " << outputPath << endl;
+        return false;
+    }
+    string text((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    vector<FrameRecord> records;
+    hashFrames(text, records);
+    writeManifestHeader(ofs);
+    for (size_t k = 0; k < records.size(); k++)
+        writeManifestRecord(ofs, records[k]);
+    writeManifestEnd(ofs, int(records.size()));
+    os << outputPath << ": " << records.size() << " frames to " << manifestPath << endl;
+    return bool(ofs);
+}
+
+/** Verifying a game **/
+
+bool verifyHashes(const Field &field, const string &commands, const vector<FrameRecord> &expected,
+                  const string &name, ostream &os) {
+    Field f(field);
+    FrameHashOutput hashed;
+    TurnWorkspace ws(f.getHeight(), f.getWidth());
+    BufferSource in(commands);
+    play(f, in, hashed.stream(), ws);
+    hashed.finish();
+    const vector<FrameRecord> &got = hashed.getHasher().getRecords();
+    size_t k = 0;
+    while (k < got.size() && k < expected.size() && got[k].hash == expected[k].hash) k++;
+    if (k == got.size() && k == expected.size()) {
+        os << name << ": " << k << " frames match" << endl;
+        return true;
+    }
+
+    os << name << ": frame " << k + 1 << " differs";
+    if (k < expected.size()) os << ", expected at line " << expected[k].line;
+    if (k == got.size()) os << ", but the output ended after " << k << " frames";
+    os << endl;
+    if (k == got.size()) return false;
+    // The text of that frame, played again
+    int end = k + 1 < got.size() ? got[k + 1].line : got[k].line + 40;
+    Field again(field);
+    BufferSource replay(commands);
+    ostringstream played;
+    play(again, replay, played, ws);
+    istringstream text(played.str());
+    string line;
+    for (int n = 1; n < end && getline(text, line); n++)
+        if (n >= got[k].line) os << "  " << n << ": " << line << endl;
+    return false;
+}
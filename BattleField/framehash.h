@@ -0,0 +1,105 @@
+#ifndef FRAMEHASH_H_INCLUDED
+#define FRAMEHASH_H_INCLUDED
+
+/**** Hashes of the output of a game, frame by frame ****/
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "field.h"
+
+/* The output is cut into frames: a frame is a run of lines ended by
+   a blank line (a board, a message) or by a prompt, a line ending
+   in '?' or ':'. Lines are compared as the judger does: blanks at
+   their end and blank lines at the end of the output do not count.
+   The hash of a frame is a 64-bit FNV-1a rolled over every frame
+   before it, so the last hash stands for the whole output. */
+
+// A frame: its first line in the output (from 1), and its rolling hash
+struct FrameRecord {
+    int line;
+    unsigned long long hash;
+};
+
+/* Cuts text into frames and hashes them, fed any number of bytes at a time */
+class FrameHasher {
+public:
+    FrameHasher();
+
+    void feed(const char *data, size_t size);
+    // The text has ended: hash the last frame
+    void finish();
+
+    // Frames done and not taken yet
+    std::vector<FrameRecord> &getRecords();
+    // Frames done since the start
+    int getFrames() const;
+
+private:
+    std::string line;
+    unsigned long long hash;
+    int lines;     // lines ended so far
+    int blanks;    // blank lines since the last frame
+    bool open;     // a frame has started
+    int frameLine; // first line of that frame
+    int frames;
+    std::vector<FrameRecord> records;
+
+    void endLine();
+    void endFrame();
+    void mix(const char *data, size_t size);
+};
+
+/* A stream whose text is only hashed. Every frame done is written
+   to manifest, if not nullptr, as a line of the manifest format. */
+class FrameHashOutput {
+public:
+    explicit FrameHashOutput(std::ostream *manifest = nullptr);
+    // Hash what is left; the manifest gets its last line
+    ~FrameHashOutput();
+
+    std::ostream &stream();
+    // Hash what is left and end the text, once
+    void finish();
+    FrameHasher &getHasher();
+
+    class Buffer;
+
+private:
+    std::ostream *manifest;
+    FrameHasher hasher;
+    std::unique_ptr<Buffer> buffer;
+    std::unique_ptr<std::ostream> os;
+    bool finished;
+
+    void writeRecords();
+
+    FrameHashOutput(const FrameHashOutput &);
+    FrameHashOutput &operator=(const FrameHashOutput &);
+};
+
+/* A manifest is text:
+     BFHASH 1
+     one line per frame: its first line and its hash in 16 hex digits
+     end and the number of frames
+   Write and read them; reading fails unless the manifest is complete. */
+void writeManifestHeader(std::ostream &os);
+void writeManifestRecord(std::ostream &os, const FrameRecord &r);
+void writeManifestEnd(std::ostream &os, int frames);
+bool readManifest(std::istream &is, std::vector<FrameRecord> &records);
+
+// Hash a whole text at once
+void hashFrames(const std::string &text, std::vector<FrameRecord> &records);
+
+// Write the manifest of the expected output in outputPath to manifestPath,
+// and a line about it to os. Return false if a file cannot be opened.
+bool writeManifestFile(const std::string &outputPath, const std::string &manifestPath, std::ostream &os);
+
+// Play the commands on a copy of field hashing the output, and compare
+// with the frames expected, printing the result to os for the case name.
+// Only at the first frame which differs is the text played again,
+// and printed from that frame.
+bool verifyHashes(const Field &field, const std::string &commands, const std::vector<FrameRecord> &expected,
+                  const std::string &name, std::ostream &os);
+
+#endif // FRAMEHASH_H_INCLUDED
@@ -0,0 +1,290 @@
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <iterator>
+#include <thread>
+#include <vector>
+#include "input.h"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Read up to n bytes from descriptor fd
+// Return the number of bytes, 0 at the end and -1 on errors
+static long readFd(int fd, char *buf, size_t n) {
+    while (true) {
+#ifdef _WIN32
+        long got = _read(fd, buf, unsigned(n));
+#else
+        long got = read(fd, buf, n);
+#endif
+        if (got >= 0 || errno != EINTR) return got;
+    }
+}
+
+/** StreamSource **/
+
+StreamSource::StreamSource(istream &is) :
+    is(is) {
+}
+
+bool StreamSource::readInt(int &x) {
+    return bool(is >> x);
+}
+
+bool StreamSource::readChar(char &c) {
+    return bool(is >> c);
+}
+
+bool StreamSource::good() const {
+    return bool(is);
+}
+
+bool StreamSource::atEnd() const {
+    return is.eof();
+}
+
+/** ScanSource **/
+
+ScanSource::ScanSource() :
+    cur(nullptr), end(nullptr), failed(false), ended(false) {
+}
+
+bool ScanSource::good() const {
+    return !failed;
+}
+
+bool ScanSource::atEnd() const {
+    return ended;
+}
+
+bool ScanSource::skipBlanks() {
+    while (true) {
+        if (cur == end && !refill()) {
+            ended = true;
+            return false;
+        }
+        if (!isspace((unsigned char)*cur)) return true;
+        cur++;
+    }
+}
+
+// Same rules as `is >> x` in the "C" locale: an optional sign and digits.
+// Like the stream, a malformed number stores 0, an overflow stores the
+// nearest limit, and the end of input leaves x alone.
+bool ScanSource::readInt(int &x) {
+    if (failed) return false;
+    if (!skipBlanks()) {
+        failed = true;
+        return false;
+    }
+
+    bool negative = false;
+    if (*cur == '+' || *cur == '-') {
+        negative = *cur == '-';
+        cur++;
+    }
+
+    long long value = 0;
+    bool digits = false, overflow = false;
+    while (true) {
+        if (cur == end && !refill()) {
+            ended = true;
+            break;
+        }
+        char ch = *cur;
+        if (ch < '0' || ch > '9') break;
+        digits = true;
+        if (!overflow) {
+            value = value * 10 + (ch - '0');
+            overflow = value > -(long long)INT_MIN;
+        }
+        cur++;
+    }
+
+    if (!digits) {
+        x = 0;
+        failed = true;
+        return false;
+    }
+    if (negative) value = -value;
+    if (overflow || value > INT_MAX || value < INT_MIN) {
+        x = negative ? INT_MIN : INT_MAX;
+        failed = true;
+        return false;
+    }
+    x = int(value);
+    return true;
+}
+
+bool ScanSource::readChar(char &c) {
+    if (failed) return false;
+    if (!skipBlanks()) {
+        failed = true;
+        return false;
+    }
+    c = *cur++;
+    return true;
+}
+
+/** BufferSource **/
+
+BufferSource::BufferSource(istream &is) :
+    text(istreambuf_iterator<char>(is), istreambuf_iterator<char>()), mapped(nullptr), mappedSize(0) {
+    cur = text.data();
+    end = cur + text.size();
+}
+
+BufferSource::BufferSource(const string &text) :
+    text(text), mapped(nullptr), mappedSize(0) {
+    cur = this->text.data();
+    end = cur + this->text.size();
+}
+
+BufferSource::BufferSource(int fd) :
+    mapped(nullptr), mappedSize(0) {
+#ifndef _WIN32
+    // Map a regular file, starting where the descriptor stands
+    struct stat st;
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && pos >= 0 && st.st_size > pos) {
+        void *p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            mapped = p;
+            mappedSize = size_t(st.st_size);
+            cur = static_cast<const char *>(p) + pos;
+            end = static_cast<const char *>(p) + mappedSize;
+            return;
+        }
+    }
+#endif
+    // Otherwise read everything
+    char buf[1 << 16];
+    long got;
+    while ((got = readFd(fd, buf, sizeof(buf))) > 0)
+        text.append(buf, size_t(got));
+    cur = text.data();
+    end = cur + text.size();
+}
+
+BufferSource::~BufferSource() {
+#ifndef _WIN32
+    if (mapped != nullptr) munmap(mapped, mappedSize);
+#endif
+}
+
+// The whole input is one window
+bool BufferSource::refill() {
+    return false;
+}
+
+/** PrefetchSource **/
+
+// State shared with the reader thread, which may outlive the source
+struct PrefetchSource::Shared {
+    static const size_t SLOTS = 16;
+    static const size_t CHUNK = 1 << 16;
+
+    vector<char> data[SLOTS];
+    size_t length[SLOTS];
+    atomic<size_t> head; // next slot to scan, only written by the consumer
+    atomic<size_t> tail; // next slot to fill, only written by the reader
+    atomic<bool> done;   // the reader has finished
+    atomic<bool> stop;   // the consumer has gone
+    int fd;
+    thread reader;
+};
+
+// Wait a little longer at every call
+static void backOff(int &spins) {
+    if (spins < 64) {
+        spins++;
+        this_thread::yield();
+    } else {
+        this_thread::sleep_for(chrono::microseconds(100));
+    }
+}
+
+// Fill the free slots of the ring until the end of input
+static void prefetchLoop(shared_ptr<PrefetchSource::Shared> sh) {
+    typedef PrefetchSource::Shared Shared;
+    int spins = 0;
+    while (!sh->stop.load(memory_order_relaxed)) {
+        size_t t = sh->tail.load(memory_order_relaxed);
+        if (t - sh->head.load(memory_order_acquire) == Shared::SLOTS) {
+            backOff(spins); // the ring is full
+            continue;
+        }
+        spins = 0;
+        long got = readFd(sh->fd, sh->data[t % Shared::SLOTS].data(), Shared::CHUNK);
+        if (got <= 0) break;
+        sh->length[t % Shared::SLOTS] = size_t(got);
+        sh->tail.store(t + 1, memory_order_release);
+    }
+    sh->done.store(true, memory_order_release);
+}
+
+PrefetchSource::PrefetchSource(int fd) :
+    shared(new Shared), holding(false) {
+    for (size_t i = 0; i < Shared::SLOTS; i++)
+        shared->data[i].resize(Shared::CHUNK);
+    shared->head.store(0);
+    shared->tail.store(0);
+    shared->done.store(false);
+    shared->stop.store(false);
+    shared->fd = fd;
+    shared->reader = thread(prefetchLoop, shared);
+}
+
+// A reader blocked on a live pipe is left behind, it owns its state
+PrefetchSource::~PrefetchSource() {
+    shared->stop.store(true);
+    if (shared->done.load())
+        shared->reader.join();
+    else
+        shared->reader.detach();
+}
+
+bool PrefetchSource::refill() {
+    Shared &sh = *shared;
+    size_t h = sh.head.load(memory_order_relaxed);
+    if (holding) {
+        // Give the scanned slot back to the reader
+        sh.head.store(++h, memory_order_release);
+        holding = false;
+    }
+
+    int spins = 0;
+    while (true) {
+        if (h != sh.tail.load(memory_order_acquire)) {
+            cur = sh.data[h % Shared::SLOTS].data();
+            end = cur + sh.length[h % Shared::SLOTS];
+            holding = true;
+            return true;
+        }
+        if (sh.done.load(memory_order_acquire) && h == sh.tail.load(memory_order_acquire))
+            return false;
+        backOff(spins);
+    }
+}
+
+unique_ptr<CommandSource> openStdinSource() {
+#ifndef _WIN32
+    struct stat st;
+    if (fstat(0, &st) == 0) {
+        if (S_ISREG(st.st_mode))
+            return unique_ptr<CommandSource>(new BufferSource(0));
+        if (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode))
+            return unique_ptr<CommandSource>(new PrefetchSource(0));
+    }
+#endif
+    return unique_ptr<CommandSource>(new StreamSource(cin));
+}
@@ -0,0 +1,118 @@
+#ifndef INPUT_H_INCLUDED
+#define INPUT_H_INCLUDED
+
+/**** Sources of the commands typed by the player ****/
+#include <iostream>
+#include <memory>
+#include <string>
+
+/* Answers to the prompts of the game: integers and single characters.
+   Reads behave like `is >> x`: leading blanks are skipped, and after a
+   failed read (end of input or a malformed integer) every later read fails. */
+class CommandSource {
+public:
+    virtual ~CommandSource() {}
+
+    // Read an integer, return false on failure
+    virtual bool readInt(int &x) = 0;
+    // Read the next non-blank character, return false at the end of input
+    virtual bool readChar(char &c) = 0;
+    // Check that no read has failed
+    virtual bool good() const = 0;
+    // Check if the input has ended
+    virtual bool atEnd() const = 0;
+};
+
+/* Reads through a std::istream */
+class StreamSource : public CommandSource {
+public:
+    explicit StreamSource(std::istream &is);
+
+    bool readInt(int &x);
+    bool readChar(char &c);
+    bool good() const;
+    bool atEnd() const;
+
+private:
+    std::istream &is;
+};
+
+/* Hand-written scanner over a window of bytes.
+   Subclasses provide the bytes, one window after another. */
+class ScanSource : public CommandSource {
+public:
+    ScanSource();
+
+    bool readInt(int &x);
+    bool readChar(char &c);
+    bool good() const;
+    bool atEnd() const;
+
+protected:
+    const char *cur; // next byte of the window
+    const char *end; // end of the window
+
+    // Make the next window of bytes available
+    // Return false at the end of input
+    virtual bool refill() = 0;
+
+private:
+    bool failed;
+    bool ended;
+
+    // Skip blanks, return false if the input ends first
+    bool skipBlanks();
+};
+
+/* Scans a whole input held in memory:
+   either read at once from a stream, or mapped from a file */
+class BufferSource : public ScanSource {
+public:
+    // Take the rest of the stream
+    explicit BufferSource(std::istream &is);
+    // Take a copy of text
+    explicit BufferSource(const std::string &text);
+    // Map the file behind descriptor fd (read it if it cannot be mapped)
+    explicit BufferSource(int fd);
+    ~BufferSource();
+
+protected:
+    bool refill();
+
+private:
+    std::string text;
+    void *mapped;
+    size_t mappedSize;
+
+    BufferSource(const BufferSource &);
+    BufferSource &operator=(const BufferSource &);
+};
+
+/* Scans chunks read ahead by a background thread from descriptor fd.
+   Chunks are handed over through a lock-free single-producer
+   single-consumer ring, so a slow pipe never blocks the game
+   while input is already available. */
+class PrefetchSource : public ScanSource {
+public:
+    explicit PrefetchSource(int fd);
+    ~PrefetchSource();
+
+    struct Shared;
+
+protected:
+    bool refill();
+
+private:
+    std::shared_ptr<Shared> shared;
+    bool holding; // the consumer holds a slot of the ring
+
+    PrefetchSource(const PrefetchSource &);
+    PrefetchSource &operator=(const PrefetchSource &);
+};
+
+// Open the fastest source for the standard input:
+// a mapped buffer for a file, a prefetching reader for a pipe,
+// and std::cin for a terminal
+std::unique_ptr<CommandSource> openStdinSource();
+
+#endif // INPUT_H_INCLUDED
@@ -1,21 +1,555 @@
 #include <iostream>
+#include <algorithm>
 #include <fstream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <memory>
 #include "field.h"
 #include "engine.h"
+#include "batch.h"
+#include "solver.h"
+#include "selfplay.h"
+#include "render.h"
+#include "output.h"
+#include "server.h"
+#include "scenario.h"
+#include "pathgraph.h"
+#include "checkpoint.h"
+#include "framehash.h"
+#include "perft.h"
+#include "preview.h"
+#include "threatmap.h"
 using namespace std;
 
-int main() {
-    Field f(8, 8);
+// Load a map file into field, return false if the file cannot be opened
+bool loadMapFile(const string &filename, Field &field) {
+    ifstream ifs(filename);
+    if (!ifs) {
+        cout << "Cannot open the file: " << filename << endl;
+        return false;
+    }
+    loadMap(ifs, field);
+    return true;
+}
+
+// BattleField --bench-reach map [height width [reps [threads]]]
+int benchReachMain(int argc, char *argv[]) {
+    int h = argc > 4 ? atoi(argv[3]) : 8;
+    int w = argc > 4 ? atoi(argv[4]) : 8;
+    int reps = argc > 5 ? atoi(argv[5]) : 1000;
+    int threads = argc > 6 ? atoi(argv[6]) : 1;
+
+    Field f(h, w);
+    if (!loadMapFile(argv[2], f)) return 1;
+    benchReachable(f, cout, reps, threads);
+    return 0;
+}
+
+// BattleField --solve map [height width [threads [seconds]]]
+int solveMain(int argc, char *argv[]) {
+    int h = argc > 4 ? atoi(argv[3]) : 8;
+    int w = argc > 4 ? atoi(argv[4]) : 8;
+    int threads = argc > 5 ? atoi(argv[5]) : 1;
+    double seconds = argc > 6 ? atof(argv[6]) : 10;
+
+    Field f(h, w);
+    if (!loadMapFile(argv[2], f)) return 1;
+    printSolveResult(cout, f, solveTurn(f, threads, seconds));
+    return 0;
+}
+
+// BattleField --bench-sparse map height width [reps]
+// Load a map into a chunked field, which may be far larger than memory
+// would allow as a dense grid, time the batched reachability on it
+// and play a short headless game on it.
+// Small maps are loaded densely as well and both results are compared.
+// Return 1 if they differ or a square is out of the range of its unit.
+int benchSparseMain(int argc, char *argv[]) {
+    typedef chrono::steady_clock Clock;
+    if (argc < 5) {
+        cout << "Usage: BattleField --bench-sparse map height width [reps]" << endl;
+        return 1;
+    }
+    int h = atoi(argv[3]);
+    int w = atoi(argv[4]);
+    int reps = argc > 5 ? max(atoi(argv[5]), 1) : 10;
+
+    Field f(h, w, CHUNKED_FIELD);
+    if (!loadMapFile(argv[2], f)) return 1;
+    vector<Unit *> all;
+    f.getUnits(all);
+    double denseBytes = double(h) * w * (sizeof(Unit *) + sizeof(Terrain));
+    cout << h << "x" << w << " field, " << all.size() << " units, "
+         << f.getMemoryUsage() / 1024 << " KiB chunked, "
+         << size_t(denseBytes / 1024) << " KiB dense" << endl;
+
+    const bool checkDense = double(h) * w <= 4096.0 * 4096.0;
+    Field *dense = nullptr;
+    if (checkDense) {
+        dense = new Field(h, w);
+        loadMapFile(argv[2], *dense);
+    }
+
+    vector<UnitReach> reach, expected;
+    bool ok = true;
+    for (int side = 0; side < 2; side++) {
+        Clock::time_point t0 = Clock::now();
+        for (int r = 0; r < reps; r++)
+            searchReachableAll(f, side, reach);
+        Clock::time_point t1 = Clock::now();
+
+        // Every square must be within the movement points of its unit
+        size_t cells = 0, wrong = 0;
+        for (size_t k = 0; k < reach.size(); k++) {
+            const Unit *u = reach[k].unit;
+            cells += reach[k].cells.size();
+            for (size_t c = 0; c < reach[k].cells.size(); c++) {
+                long long row = reach[k].cells[c] / w, col = reach[k].cells[c] % w;
+                if (reach[k].cells[c] < 0 || llabs(row - u->getRow()) + llabs(col - u->getCol()) > u->getMovPoints())
+                    wrong++;
+            }
+        }
+        cout << (side ? "player" : "enemy") << ": " << reach.size() << " units, "
+             << cells << " reachable squares, "
+             << chrono::duration<double, milli>(t1 - t0).count() / reps << " ms";
+        if (wrong > 0) cout << ", " << wrong << " squares OUT OF RANGE";
+        ok = ok && wrong == 0;
+
+        if (dense != nullptr) {
+            searchReachableAll(*dense, side, expected);
+            bool same = expected.size() == reach.size();
+            for (size_t k = 0; same && k < reach.size(); k++)
+                same = expected[k].cells == reach[k].cells;
+            cout << (same ? ", same as dense" : ", DIFFERENT from dense");
+            ok = ok && same;
+        }
+        cout << endl;
+    }
+
+    // A headless game goes the same way on both
+    const int rounds = 20;
+    TurnWorkspace ws(h, w);
+    EnemyController enemy(ws);
+    GreedyController greedy;
+    Clock::time_point t0 = Clock::now();
+    GameOutcome res = playHeadless(f, greedy, enemy, ws, rounds);
+    Clock::time_point t1 = Clock::now();
+    f.getUnits(all);
+    cout << "game: " << res.rounds << " rounds, " << all.size() << " units left, "
+         << chrono::duration<double, milli>(t1 - t0).count() << " ms";
+    if (dense != nullptr) {
+        TurnWorkspace dws(h, w);
+        EnemyController denseEnemy(dws);
+        GreedyController denseGreedy;
+        GameOutcome expected = playHeadless(*dense, denseGreedy, denseEnemy, dws, rounds);
+        vector<Unit *> left;
+        dense->getUnits(left);
+        bool same = expected.rounds == res.rounds && expected.winner == res.winner && left.size() == all.size();
+        for (size_t k = 0; same && k < all.size(); k++)
+            same = left[k]->getRow() == all[k]->getRow() && left[k]->getCol() == all[k]->getCol()
+                && left[k]->getHp() == all[k]->getHp();
+        cout << (same ? ", same as dense" : ", DIFFERENT from dense");
+        ok = ok && same;
+    }
+    cout << endl;
+    delete dense;
+    return ok ? 0 : 1;
+}
+
+// BattleField --selfplay greedy|random games threads height width map...
+// Play headless games on every map and report win rates
+int selfPlayMain(int argc, char *argv[]) {
+    PlayerPolicy policy;
+    if (argc < 7 || !parsePlayerPolicy(argv[2], policy)) {
+        cout << "Usage: BattleField --selfplay greedy|random games threads height width map..." << endl;
+        return 1;
+    }
+    long long games = atoll(argv[3]);
+    int threads = atoi(argv[4]);
+    int h = atoi(argv[5]);
+    int w = atoi(argv[6]);
+    const int maxRounds = 200;
+
+    for (int i = 7; i < argc; i++) {
+        Field f(h, w);
+        if (!loadMapFile(argv[i], f)) return 1;
+        printSelfPlayStats(cout, argv[i], runSelfPlay(f, policy, games, threads, maxRounds, 1));
+    }
+    return 0;
+}
+
+// BattleField --serve address workers sessions height width map...
+// Serve games on every map until that many sessions are over (0: forever)
+int serveMain(int argc, char *argv[]) {
+    if (argc < 8) {
+        cout << "Usage: BattleField --serve address workers sessions height width map..." << endl;
+        return 1;
+    }
+    MapCache maps(atoi(argv[5]), atoi(argv[6]));
+    for (int i = 7; i < argc; i++)
+        if (!maps.load(argv[i])) {
+            cout << "Cannot open the file: " << argv[i] << endl;
+            return 1;
+        }
+
+    ServerConfig config;
+    config.address = argv[2];
+    config.workers = atoi(argv[3]);
+    config.limit = strtoul(argv[4], nullptr, 10);
+    config.log = &cerr;
+    ServerStats stats;
+    if (!runServer(maps, config, stats)) {
+        cout << "Cannot listen on " << config.address << endl;
+        return 1;
+    }
+    printServerStats(cout, stats);
+    return 0;
+}
+
+// BattleField --client address map
+// Play a game of the server from the standard input
+int clientMain(int argc, char *argv[]) {
+    if (argc < 4) {
+        cout << "Usage: BattleField --client address map" << endl;
+        return 1;
+    }
+    if (!runClient(argv[2], argv[3])) {
+        cerr << "Cannot connect to " << argv[2] << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// BattleField --generate map commands [--size HxW] [--seed n] [--shape mixed|rays|forest|maze]
+//             [--terrain M,O,W] [--cluster n] [--units S,T,B,F,H] [--rounds n] [--actions n]
+// Write a generated map and answers for play() on it.
+// --terrain gives the shares of mountains, oceans and forests, e.g. 0.1,0.05,0.05
+int generateMain(int argc, char *argv[]) {
+    if (argc < 4) {
+        cout << "Usage: BattleField --generate map commands [--size HxW] [--seed n] "
+             << "[--shape mixed|rays|forest|maze] [--terrain M,O,W] [--cluster n] "
+             << "[--units S,T,B,F,H] [--rounds n] [--actions n]" << endl;
+        return 1;
+    }
+    ScenarioParams params;
+    for (int i = 4; i + 1 < argc; i += 2) {
+        string opt = argv[i], value = argv[i + 1];
+        bool ok = true;
+        if (opt == "--size") {
+            ok = sscanf(value.c_str(), "%dx%d", &params.height, &params.width) == 2;
+        } else if (opt == "--seed") {
+            params.seed = unsigned(strtoul(value.c_str(), nullptr, 10));
+        } else if (opt == "--shape") {
+            ok = parseScenarioShape(value, params.shape);
+        } else if (opt == "--terrain") {
+            ok = sscanf(value.c_str(), "%lf,%lf,%lf", &params.mountains, &params.oceans, &params.forests) == 3;
+        } else if (opt == "--cluster") {
+            params.clustering = atoi(value.c_str());
+        } else if (opt == "--units") {
+            int *u = params.units;
+            ok = sscanf(value.c_str(), "%d,%d,%d,%d,%d", &u[0], &u[1], &u[2], &u[3], &u[4]) == UNIT_TYPES;
+        } else if (opt == "--rounds") {
+            params.rounds = atoi(value.c_str());
+        } else if (opt == "--actions") {
+            params.actions = atoi(value.c_str());
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            cout << "Bad option: " << opt << " " << value << endl;
+            return 1;
+        }
+    }
 
+    Scenario scenario;
+    generateScenario(params, scenario);
+    ofstream map(argv[2]), commands(argv[3]);
+    if (!map || !commands) {
+        cout << "Cannot write the files: " << argv[2] << " " << argv[3] << endl;
+        return 1;
+    }
+    writeScenarioMap(map, scenario);
+    writeScenarioCommands(commands, scenario, params);
+    cout << scenario.height << "x" << scenario.width << " map with " << scenario.units.size()
+         << " units written to " << argv[2] << ", commands to " << argv[3] << endl;
+    return 0;
+}
+
+// BattleField --bench-paths map height width [queries]
+// Time the hierarchical path search of the enemies on a map
+int benchPathsMain(int argc, char *argv[]) {
+    if (argc < 5) {
+        cout << "Usage: BattleField --bench-paths map height width [queries]" << endl;
+        return 1;
+    }
+    Field f(atoi(argv[3]), atoi(argv[4]));
+    if (!loadMapFile(argv[2], f)) return 1;
+    return benchPaths(f, cout, argc > 5 ? atoi(argv[5]) : 1000, 1) ? 0 : 1;
+}
+
+// BattleField --perft map height width depth [threads [player|enemy]]
+// Count the sequences of legal actions of a side, by first action
+int perftMain(int argc, char *argv[]) {
+    if (argc < 6) {
+        cout << "Usage: BattleField --perft map height width depth [threads [player|enemy]]" << endl;
+        return 1;
+    }
+    Field f(atoi(argv[3]), atoi(argv[4]));
+    if (!loadMapFile(argv[2], f)) return 1;
+    int threads = argc > 6 ? atoi(argv[6]) : 1;
+    bool side = argc > 7 ? string(argv[7]) != "enemy" : true;
+    printPerftResult(cout, perft(f, side, atoi(argv[5]), threads));
+    return 0;
+}
+
+// BattleField --bench-preview map height width [reps]
+// Preview every attack on a map, checked against the attacks played
+int benchPreviewMain(int argc, char *argv[]) {
+    if (argc < 5) {
+        cout << "Usage: BattleField --bench-preview map height width [reps]" << endl;
+        return 1;
+    }
+    Field f(atoi(argv[3]), atoi(argv[4]));
+    if (!loadMapFile(argv[2], f)) return 1;
+    return benchPreview(f, cout, argc > 5 ? atoi(argv[5]) : 1000) ? 0 : 1;
+}
+
+// BattleField --bench-threat map height width [steps [seed]]
+// Keep the threat planes of a map up to date through random actions
+int benchThreatMain(int argc, char *argv[]) {
+    if (argc < 5) {
+        cout << "Usage: BattleField --bench-threat map height width [steps [seed]]" << endl;
+        return 1;
+    }
+    Field f(atoi(argv[3]), atoi(argv[4]));
+    if (!loadMapFile(argv[2], f)) return 1;
+    return benchThreats(f, cout, argc > 5 ? atoi(argv[5]) : 1000, argc > 6 ? unsigned(atoi(argv[6])) : 1) ? 0 : 1;
+}
+
+// BattleField --check-checkpoints case...
+// Check the checkpoints on cases such as data/*/*.in
+int checkCheckpointsMain(int argc, char *argv[]) {
+    bool ok = true;
+    for (int i = 2; i < argc; i++) {
+        Field f(8, 8);
+        string commands;
+        if (!loadCase(argv[i], f, commands)) {
+            cout << "Cannot open the file: " << argv[i] << endl;
+            ok = false;
+            continue;
+        }
+        ok = checkCheckpoints(f, commands, argv[i], cout) && ok;
+    }
+    return ok ? 0 : 1;
+}
+
+// Replace the suffix of a file name, or add one
+static string withSuffix(const string &filename, const string &from, const string &to) {
+    if (filename.size() >= from.size() && filename.compare(filename.size() - from.size(), from.size(), from) == 0)
+        return filename.substr(0, filename.size() - from.size()) + to;
+    return filename + to;
+}
+
+// BattleField --hash-manifest output...
+// Write the frame hashes of every expected output x.out to x.hash
+int hashManifestMain(int argc, char *argv[]) {
+    for (int i = 2; i < argc; i++)
+        if (!writeManifestFile(argv[i], withSuffix(argv[i], ".out", ".hash"), cout)) return 1;
+    return 0;
+}
+
+// BattleField --verify-hashes case...
+// Verify cases such as data/*/*.in against their manifests x.hash
+int verifyHashesMain(int argc, char *argv[]) {
+    auto start = chrono::steady_clock::now();
+    int failed = 0;
+    for (int i = 2; i < argc; i++) {
+        string manifestPath = withSuffix(argv[i], ".in", ".hash");
+        ifstream mis(manifestPath.c_str());
+        vector<FrameRecord> expected;
+        Field f(8, 8);
+        string commands;
+        if (!mis || !readManifest(mis, expected)) {
+            cout << argv[i] << ": no complete manifest " << manifestPath << endl;
+            failed++;
+        } else if (!loadCase(argv[i], f, commands)) {
+            cout << "Cannot open the file: " << argv[i] << endl;
+            failed++;
+        } else if (!verifyHashes(f, commands, expected, argv[i], cout)) {
+            failed++;
+        }
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << argc - 2 - failed << " of " << argc - 2 << " cases match, "
+         << ms / max(argc - 2, 1) << " ms per case" << endl;
+    return failed == 0 ? 0 : 1;
+}
+
+// Modes of the program other than playing a game, by their first argument
+struct Mode {
+    const char *name;
+    int minArgs; // argc needed, shorter command lines play a game
+    int (*run)(int argc, char *argv[]);
+};
+
+static const Mode MODES[] = {
+    {"--bench-reach",       3, benchReachMain},
+    {"--solve",             3, solveMain},
+    {"--selfplay",          2, selfPlayMain},
+    {"--bench-sparse",      3, benchSparseMain},
+    {"--serve",             2, serveMain},
+    {"--client",            2, clientMain},
+    {"--generate",          2, generateMain},
+    {"--bench-paths",       2, benchPathsMain},
+    {"--check-checkpoints", 2, checkCheckpointsMain},
+    {"--perft",             2, perftMain},
+    {"--bench-preview",     2, benchPreviewMain},
+    {"--bench-threat",      2, benchThreatMain},
+    {"--hash-manifest",     2, hashManifestMain},
+    {"--verify-hashes",     2, verifyHashesMain},
+};
+
+int main(int argc, char *argv[]) {
+    for (size_t k = 0; k < sizeof(MODES) / sizeof(MODES[0]); k++)
+        if (argc >= MODES[k].minArgs && string(argv[1]) == MODES[k].name)
+            return MODES[k].run(argc, argv);
+
+    // BattleField [--play map HxW] [--max-retries n] [--output text|json|hash] [--frames full|delta|ansi] [--keyframe n]
+    //             [--viewport ROWSxCOLS] [--writer stream|thread] [--enemy manhattan|paths|flow]
+    //             [--resume checkpoint] [--save checkpoint] [--telemetry file] [--telemetry-format csv|binary]
+    // json replaces the boards and prompts by one JSON event per line,
+    // hash by the manifest of the text, one hash per frame as it is done,
+    // delta and ansi only print the cells changed since the last board,
+    // a viewport only prints a window of the board and a minimap,
+    // thread writes the output in the background, flushed at every prompt
+    // paths and flow move the enemies along the terrain instead of as the crow flies
+    // play plays a map of the given size, e.g. one of --generate, instead of the demo map
+    // resume goes on with a saved game instead of the demo map, and save saves
+    // the game if the input ends while it waits for the end of a turn
+    // telemetry writes statistics of every round to the file when the game ends
+    PlayOptions options;
+    string resumePath, savePath, telemetryPath;
+    bool telemetryCsv = true;
+    GameState resumed, stopped = {0, PHASE_NONE};
+    bool json = false, hashed = false, writerThread = false;
+    EnemyMoveMode enemyMoves = ENEMY_MOVE_MANHATTAN;
+    FrameMode frameMode = FRAME_FULL;
+    int keyframeInterval = DEFAULT_KEYFRAME_INTERVAL;
+    int viewRows = 0, viewCols = 0;
     string filename = "../demo/map.txt";
+    int mapRows = 8, mapCols = 8;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string opt = argv[i], value = argv[i + 1];
+        if (opt == "--play") {
+            if (i + 2 >= argc || sscanf(argv[i + 2], "%dx%d", &mapRows, &mapCols) != 2 || mapRows <= 0 || mapCols <= 0) {
+                cout << "Usage: BattleField --play map HxW [options] < commands" << endl;
+                return 1;
+            }
+            filename = value;
+            i++;
+        } else if (opt == "--max-retries") {
+            options.maxRetries = atoi(value.c_str());
+        } else if (opt == "--output") {
+            json = value == "json";
+            hashed = value == "hash";
+        } else if (opt == "--enemy") {
+            if (value == "paths") enemyMoves = ENEMY_MOVE_PATHS;
+            if (value == "flow") enemyMoves = ENEMY_MOVE_FLOW;
+        } else if (opt == "--writer") {
+            writerThread = value == "thread";
+        } else if (opt == "--frames") {
+            parseFrameMode(value, frameMode);
+        } else if (opt == "--keyframe") {
+            keyframeInterval = atoi(value.c_str());
+        } else if (opt == "--viewport") {
+            sscanf(value.c_str(), "%dx%d", &viewRows, &viewCols);
+        } else if (opt == "--resume") {
+            resumePath = value;
+        } else if (opt == "--save") {
+            savePath = value;
+        } else if (opt == "--telemetry") {
+            telemetryPath = value;
+        } else if (opt == "--telemetry-format") {
+            telemetryCsv = value != "binary";
+        }
+    }
+
+    Field f(mapRows, mapCols);
     ifstream ifs;
-    ifs.open(filename);
-    if (!ifs) {
-        cout << "Cannot open the file: " << filename << endl;
-        assert(false);
+    if (!resumePath.empty()) {
+        if (!loadCheckpoint(resumePath, f, resumed)) {
+            cout << "Cannot resume from the file: " << resumePath << endl;
+            return 1;
+        }
+        options.resume = &resumed;
+    } else {
+        ifs.open(filename);
+        if (!ifs) {
+            cout << "Cannot open the file: " << filename << endl;
+            return 1;
+        }
+        loadMap(ifs, f);
+    }
+    if (!savePath.empty()) options.stopped = &stopped;
+    unique_ptr<GameTelemetry> telemetry;
+    if (!telemetryPath.empty()) {
+        telemetry.reset(new GameTelemetry());
+        options.telemetry = telemetry.get();
+    }
+    FrameRenderer frames(frameMode, keyframeInterval);
+    if (viewRows > 0 && viewCols > 0) frames.setViewport(viewRows, viewCols);
+    if (frameMode != FRAME_FULL || (viewRows > 0 && viewCols > 0)) options.frames = &frames;
+
+    unique_ptr<AsyncOutput> async;
+    ostream *out = &cout;
+    if (writerThread) {
+        cout.flush();
+        async.reset(new AsyncOutput(1));
+        out = &async->stream();
+        options.async = async.get();
+    }
+    unique_ptr<GameObserver> events;
+    if (json) {
+        events.reset(new JsonEventWriter(*out));
+        options.observer = events.get();
+        options.text = false;
+    }
+    unique_ptr<FrameHashOutput> hashOut;
+    if (hashed) {
+        hashOut.reset(new FrameHashOutput(out));
+        out = &hashOut->stream();
+    }
+
+    TurnWorkspace ws(f.getHeight(), f.getWidth());
+    ws.enemyMoves = enemyMoves;
+    unique_ptr<CommandSource> in = openStdinSource();
+    PlayStats stats = play(f, *in, *out, ws, options);
+    if (hashOut) hashOut->finish();
+    if (async) async->drain();
+    if (telemetry) {
+        ofstream tos(telemetryPath.c_str(), ios::binary);
+        if (telemetryCsv)
+            telemetry->writeCsv(tos);
+        else
+            telemetry->writeBinary(tos);
+        if (!tos) cerr << "Cannot write the telemetry to the file: " << telemetryPath << endl;
+    }
+    if (stopped.phase != PHASE_NONE) {
+        if (!saveCheckpoint(savePath, f, stopped)) {
+            cerr << "Cannot save the game to the file: " << savePath << endl;
+            return 1;
+        }
+        cerr << "Game saved after " << stopped.rounds << " rounds to " << savePath << endl;
+        return 0;
+    }
+    if (stats.status != PLAY_WON && stats.status != PLAY_FAILED) {
+        cout.flush();
+        printPlayStats(cerr, stats);
+        return 1;
     }
-    loadMap(ifs, f);
-    play(f, cin, cout);
     ifs.close();
 
     return 0;
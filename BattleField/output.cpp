@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "output.h"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+struct Block {
+    vector<char> data;
+    size_t length;
+};
+
+// Write n bytes to fd, return false on errors
+bool writeFd(int fd, const char *p, size_t n) {
+    while (n > 0) {
+#ifdef _WIN32
+        long done = _write(fd, p, unsigned(n));
+#else
+        long done = write(fd, p, n);
+#endif
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return false;
+        p += done;
+        n -= size_t(done);
+    }
+    return true;
+}
+
+} // namespace
+
+// State shared with the writer thread
+// Every block is in exactly one place: the producer, the full ring,
+// the writer or the free ring. Both rings can hold all the blocks.
+// The rings need no lock; the mutex only lets an idle side sleep
+// until the other one has pushed something.
+struct AsyncOutput::Shared {
+    static const size_t SLOTS = 64;
+
+    Block *full[SLOTS];           // handed over, to be written
+    atomic<size_t> fullHead;      // next block to write, only written by the writer
+    atomic<size_t> fullTail;      // next free slot, only written by the producer
+    Block *spare[SLOTS];          // written, to be reused
+    atomic<size_t> freeHead;      // only written by the producer
+    atomic<size_t> freeTail;      // only written by the writer
+    vector<unique_ptr<Block>> blocks; // all blocks, only touched by the producer
+    atomic<bool> stop;
+    atomic<bool> failed;
+    atomic<unsigned long long> written;
+    int fd;
+    thread writer;
+    mutex lock;
+    condition_variable work; // the writer waits for full blocks or stop
+    condition_variable room; // the producer waits for written blocks
+
+    // Wake the side waiting on cv, after a ring or stop changed.
+    // Taking the lock orders the change before the wait checks it.
+    void wake(condition_variable &cv) {
+        { lock_guard<mutex> l(lock); }
+        cv.notify_one();
+    }
+};
+
+// Write the blocks of the full ring until stopped
+static void writeLoop(AsyncOutput::Shared *sh) {
+    typedef AsyncOutput::Shared Shared;
+    while (true) {
+        size_t h = sh->fullHead.load(memory_order_relaxed);
+        if (h == sh->fullTail.load(memory_order_acquire)) {
+            unique_lock<mutex> l(sh->lock);
+            sh->work.wait(l, [sh, h] {
+                return h != sh->fullTail.load(memory_order_acquire) || sh->stop.load(memory_order_acquire);
+            });
+            // Nothing is pushed after stop
+            if (h == sh->fullTail.load(memory_order_acquire)) break;
+            continue;
+        }
+        Block *b = sh->full[h % Shared::SLOTS];
+        if (!sh->failed.load(memory_order_relaxed)) {
+            if (writeFd(sh->fd, b->data.data(), b->length))
+                sh->written.fetch_add(b->length, memory_order_relaxed);
+            else
+                sh->failed.store(true);
+        }
+        size_t t = sh->freeTail.load(memory_order_relaxed);
+        sh->spare[t % Shared::SLOTS] = b;
+        sh->freeTail.store(t + 1, memory_order_release);
+        sh->fullHead.store(h + 1, memory_order_release);
+        sh->wake(sh->room);
+    }
+}
+
+/* The put area of the stream is the current block */
+class AsyncOutput::Buffer : public streambuf {
+public:
+    Buffer(Shared &sh, size_t blockSize, size_t maxBlocks) :
+        handovers(0), sh(sh), blockSize(max(blockSize, size_t(1))), maxBlocks(maxBlocks), current(nullptr) {
+        current = take();
+        setp(current->data.data(), current->data.data() + current->data.size());
+    }
+
+    // Give the current block to the writer if it holds anything
+    // Return false if nothing was handed over
+    bool handOver() {
+        if (pptr() == pbase()) return false;
+        current->length = size_t(pptr() - pbase());
+        size_t t = sh.fullTail.load(memory_order_relaxed);
+        sh.full[t % Shared::SLOTS] = current;
+        sh.fullTail.store(t + 1, memory_order_release);
+        sh.wake(sh.work);
+        handovers++;
+
+        current = take();
+        setp(current->data.data(), current->data.data() + current->data.size());
+        return true;
+    }
+
+    unsigned long handovers;
+
+protected:
+    int_type overflow(int_type c) {
+        handOver();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+private:
+    Shared &sh;
+    size_t blockSize;
+    size_t maxBlocks;
+    Block *current;
+
+    // A written block, a new one while the pool may grow, or wait for the writer
+    Block *take() {
+        while (true) {
+            size_t h = sh.freeHead.load(memory_order_relaxed);
+            if (h != sh.freeTail.load(memory_order_acquire)) {
+                Block *b = sh.spare[h % Shared::SLOTS];
+                sh.freeHead.store(h + 1, memory_order_release);
+                return b;
+            }
+            if (sh.blocks.size() < maxBlocks) {
+                sh.blocks.push_back(unique_ptr<Block>(new Block));
+                sh.blocks.back()->data.resize(blockSize);
+                sh.blocks.back()->length = 0;
+                return sh.blocks.back().get();
+            }
+            unique_lock<mutex> l(sh.lock);
+            sh.room.wait(l, [this] {
+                return sh.freeHead.load(memory_order_relaxed) != sh.freeTail.load(memory_order_acquire);
+            });
+        }
+    }
+};
+
+AsyncOutput::AsyncOutput(int fd, size_t blockSize, size_t maxBlocks) :
+    shared(new Shared) {
+    shared->fullHead.store(0);
+    shared->fullTail.store(0);
+    shared->freeHead.store(0);
+    shared->freeTail.store(0);
+    shared->stop.store(false);
+    shared->failed.store(false);
+    shared->written.store(0);
+    shared->fd = fd;
+    // One block is always held by the producer
+    maxBlocks = min(max(maxBlocks, size_t(2)), size_t(Shared::SLOTS));
+    buffer.reset(new Buffer(*shared, blockSize, maxBlocks));
+    os.reset(new ostream(buffer.get()));
+    shared->writer = thread(writeLoop, shared.get());
+}
+
+AsyncOutput::~AsyncOutput() {
+    flush();
+    shared->stop.store(true, memory_order_release);
+    shared->wake(shared->work);
+    shared->writer.join();
+}
+
+ostream &AsyncOutput::stream() {
+    return *os;
+}
+
+void AsyncOutput::flush() {
+    buffer->handOver();
+}
+
+void AsyncOutput::drain() {
+    flush();
+    Shared *sh = shared.get();
+    unique_lock<mutex> l(sh->lock);
+    sh->room.wait(l, [sh] {
+        return sh->fullHead.load(memory_order_acquire) == sh->fullTail.load(memory_order_relaxed);
+    });
+}
+
+unsigned long AsyncOutput::getHandovers() const {
+    return buffer->handovers;
+}
+
+unsigned long long AsyncOutput::getBytesWritten() const {
+    return shared->written.load();
+}
+
+bool AsyncOutput::good() const {
+    return !shared->failed.load();
+}
@@ -0,0 +1,50 @@
+#ifndef OUTPUT_H_INCLUDED
+#define OUTPUT_H_INCLUDED
+
+/**** Output written by a background thread ****/
+#include <iostream>
+#include <memory>
+#include <streambuf>
+
+/* A stream whose bytes are written to descriptor fd by a writer thread.
+   The game formats into fixed blocks taken from a pool; a full block,
+   or the current one at every flush(), is handed to the writer through
+   a bounded lock-free single-producer single-consumer ring, and comes
+   back to the pool through a second ring once written.
+   A side with nothing to do sleeps until the other one pushes a block.
+   std::flush and std::endl do not hand anything over: only flush() does,
+   so the game calls it when it waits for input. The bytes written are
+   exactly the bytes put into stream(), in the same order. */
+class AsyncOutput {
+public:
+    // blocks of blockSize bytes, at most maxBlocks of them in use
+    explicit AsyncOutput(int fd, size_t blockSize = 1 << 16, size_t maxBlocks = 8);
+    // Write everything left, then stop the writer
+    ~AsyncOutput();
+
+    std::ostream &stream();
+
+    // Hand the bytes put so far to the writer, without waiting for them
+    void flush();
+    // Wait until every byte handed over is written
+    void drain();
+
+    // Blocks handed over, and bytes written so far
+    unsigned long getHandovers() const;
+    unsigned long long getBytesWritten() const;
+    // Check that no write has failed
+    bool good() const;
+
+    struct Shared;
+    class Buffer;
+
+private:
+    std::shared_ptr<Shared> shared;
+    std::unique_ptr<Buffer> buffer;
+    std::unique_ptr<std::ostream> os;
+
+    AsyncOutput(const AsyncOutput &);
+    AsyncOutput &operator=(const AsyncOutput &);
+};
+
+#endif // OUTPUT_H_INCLUDED
@@ -0,0 +1,917 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include "pathgraph.h"
+#include "batch.h"
+#include "workspace.h"
+
+using namespace std;
+
+// Nodes of a cluster: at most 8 portals on each side
+static const int MAX_NODES = 64;
+// Regions of a cluster: at most one square in two
+static const int MAX_REGIONS = CLUSTER_SIZE * CLUSTER_SIZE / 2;
+static const unsigned char NO_REGION = 255;
+// Clusters around the regions of the way which the portal search may cross
+static const int CORRIDOR_RING = 1;
+// Goals tried by a path search
+static const int MAX_GOALS = 4;
+// Region searches kept, for as many sets of goal regions
+static const int KEPT_SEARCHES = 8;
+// Weight of the steps in the estimates of the region search: the low bits
+// hold the distance to the straight line between the ends, to break ties
+static const int TIE = 4096;
+static const int INF = 1 << 30;
+
+
+// Order of the open lists, shortest estimate first.
+// Among equal estimates the node furthest from the start goes first,
+// otherwise the search spreads over the whole rectangle between the ends.
+static bool later(const SearchEntry &a, const SearchEntry &b) {
+    return a.f > b.f || (a.f == b.f && a.g < b.g);
+}
+
+PathHierarchy::PathHierarchy(bool ground) :
+    ground(ground), height(0), width(0), rows(0), cols(0),
+    fieldId(0), version(0), nodeCount(0), rebuilt(0), stamp(0), searches(0), componentsKnown(false) {
+}
+
+size_t PathHierarchy::getNodeCount() const {
+    return nodeCount;
+}
+
+unsigned long PathHierarchy::getRebuilt() const {
+    return rebuilt;
+}
+
+bool PathHierarchy::isOpen(const Field &field, int row, int col) const {
+    TerrainType t = field.getTerrain(row, col).getType();
+    return t == PLAIN || t == (ground ? FOREST : OCEAN);
+}
+
+bool PathHierarchy::passable(int cell) const {
+    return open[cell] != 0;
+}
+
+int PathHierarchy::clusterOf(int cell) const {
+    return (cell / width) / CLUSTER_SIZE * cols + (cell % width) / CLUSTER_SIZE;
+}
+
+int PathHierarchy::nodeOf(int cell) const {
+    const vector<Node> &nodes = clusters[clusterOf(cell)].nodes;
+    for (size_t i = 0; i < nodes.size(); i++)
+        if (nodes[i].cell == cell) return int(i);
+    return -1;
+}
+
+void PathHierarchy::build(const Field &field) {
+    height = field.getHeight();
+    width = field.getWidth();
+    rows = (height + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    cols = (width + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    open.assign(size_t(height) * width, 0);
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++)
+            open[size_t(i) * width + j] = isOpen(field, i, j);
+    regionOf.assign(open.size(), NO_REGION);
+
+    clusters.assign(size_t(rows) * cols, Cluster());
+    dropRegionSearches();
+    nodeCount = 0;
+    for (int c = 0; c < rows * cols; c++) {
+        findPortals(c);
+        nodeCount += clusters[c].nodes.size();
+    }
+    for (int c = 0; c < rows * cols; c++)
+        linkCluster(c);
+    findComponents();
+    rebuilt = 0;
+    fieldId = field.getId();
+    version = field.getVersion();
+}
+
+void PathHierarchy::update(const Field &field) {
+    if (field.getId() != fieldId || int(field.getHeight()) != height || int(field.getWidth()) != width) {
+        build(field);
+        return;
+    }
+    if (field.getVersion() == version) return;
+
+    // Clusters holding a square which opened or closed
+    vector<int> dirty;
+    if (field.getChangesSince(version, changes)) {
+        for (size_t k = 0; k < changes.size(); k++) {
+            int cell = int(changes[k]); // the graph is dense, its squares fit in an int
+            char now = isOpen(field, cell / width, cell % width);
+            if (now != open[cell]) {
+                open[cell] = now;
+                dirty.push_back(clusterOf(cell));
+            }
+        }
+    } else {
+        for (int i = 0; i < height; i++)
+            for (int j = 0; j < width; j++) {
+                int cell = i * width + j;
+                char now = isOpen(field, i, j);
+                if (now != open[cell]) {
+                    open[cell] = now;
+                    dirty.push_back(clusterOf(cell));
+                }
+            }
+    }
+    version = field.getVersion();
+    if (dirty.empty()) return;
+
+    // The portals of a cluster depend on both sides of its borders,
+    // the links on the portals of the neighbours
+    vector<int> found = dirty, linked;
+    for (size_t k = 0; k < dirty.size(); k++) {
+        int r = dirty[k] / cols, c = dirty[k] % cols;
+        if (r > 0) found.push_back(dirty[k] - cols);
+        if (r + 1 < rows) found.push_back(dirty[k] + cols);
+        if (c > 0) found.push_back(dirty[k] - 1);
+        if (c + 1 < cols) found.push_back(dirty[k] + 1);
+    }
+    sort(found.begin(), found.end());
+    found.erase(unique(found.begin(), found.end()), found.end());
+    linked = found;
+    for (size_t k = 0; k < found.size(); k++) {
+        int r = found[k] / cols, c = found[k] % cols;
+        if (r > 0) linked.push_back(found[k] - cols);
+        if (r + 1 < rows) linked.push_back(found[k] + cols);
+        if (c > 0) linked.push_back(found[k] - 1);
+        if (c + 1 < cols) linked.push_back(found[k] + 1);
+    }
+    sort(linked.begin(), linked.end());
+    linked.erase(unique(linked.begin(), linked.end()), linked.end());
+
+    for (size_t k = 0; k < found.size(); k++) {
+        nodeCount -= clusters[found[k]].nodes.size();
+        findPortals(found[k]);
+        nodeCount += clusters[found[k]].nodes.size();
+    }
+    for (size_t k = 0; k < linked.size(); k++)
+        linkCluster(linked[k]);
+    dropRegionSearches();
+    rebuilt += found.size();
+    // Labels of the other regions may be stale: found again when a search needs them
+    componentsKnown = false;
+}
+
+void PathHierarchy::findPortals(int c) {
+    Cluster &cl = clusters[c];
+    cl.nodes.clear();
+    cl.corridor = 0;
+    findRegions(c);
+    for (int side = 0; side < 4; side++)
+        addPortals(c, side);
+    measureCluster(c);
+}
+
+// Label the squares of cluster c connected to each other inside it
+void PathHierarchy::findRegions(int c) {
+    Cluster &cl = clusters[c];
+    int top = c / cols * CLUSTER_SIZE, left = c % cols * CLUSTER_SIZE;
+    int bottom = min(top + CLUSTER_SIZE, height), right = min(left + CLUSTER_SIZE, width);
+    for (int i = top; i < bottom; i++)
+        for (int j = left; j < right; j++)
+            regionOf[size_t(i) * width + j] = NO_REGION;
+
+    cl.regions.clear();
+    const int dr[] = {-1, 1, 0, 0};
+    const int dc[] = {0, 0, -1, 1};
+    for (int i = top; i < bottom; i++)
+        for (int j = left; j < right; j++) {
+            size_t cell = size_t(i) * width + j;
+            if (!open[cell] || regionOf[cell] != NO_REGION) continue;
+            unsigned char label = (unsigned char)cl.regions.size();
+            regionOf[cell] = label;
+            queue.assign(1, int(cell));
+            for (size_t q = 0; q < queue.size(); q++) {
+                int r = queue[q] / width, col = queue[q] % width;
+                for (int d = 0; d < 4; d++) {
+                    int nr = r + dr[d], nc = col + dc[d];
+                    if (nr < top || nr >= bottom || nc < left || nc >= right) continue;
+                    size_t next = size_t(nr) * width + nc;
+                    if (!open[next] || regionOf[next] != NO_REGION) continue;
+                    regionOf[next] = label;
+                    queue.push_back(int(next));
+                }
+            }
+            Region reg;
+            reg.firstLink = reg.lastLink = 0;
+            reg.component = -1;
+            reg.goal = 0;
+            cl.regions.push_back(reg);
+        }
+    assert(cl.regions.size() <= size_t(MAX_REGIONS));
+}
+
+// Portals on one side (north, south, west, east) of cluster c:
+// one in the middle of every open stretch, or one at each end of a long one.
+// The neighbour finds the same stretches from its side.
+void PathHierarchy::addPortals(int c, int side) {
+    int top = c / cols * CLUSTER_SIZE, left = c % cols * CLUSTER_SIZE;
+    int bottom = min(top + CLUSTER_SIZE, height) - 1, right = min(left + CLUSTER_SIZE, width) - 1;
+    int row = side == 0 ? top : side == 1 ? bottom : 0;
+    int col = side == 2 ? left : side == 3 ? right : 0;
+    int dr = side == 0 ? -1 : side == 1 ? 1 : 0;
+    int dc = side == 2 ? -1 : side == 3 ? 1 : 0;
+    bool alongRow = side < 2;
+    int first = alongRow ? left : top, last = alongRow ? right : bottom;
+    if (row + dr < 0 || row + dr >= height || col + dc < 0 || col + dc >= width) return;
+
+    vector<Node> &nodes = clusters[c].nodes;
+    int start = -1;
+    for (int k = first; k <= last + 1; k++) {
+        bool both = false;
+        if (k <= last) {
+            int r = alongRow ? row : k, cc = alongRow ? k : col;
+            both = open[size_t(r) * width + cc] && open[size_t(r + dr) * width + cc + dc];
+        }
+        if (both && start < 0) start = k;
+        if (both || start < 0) continue;
+        // Stretch [start, k - 1]
+        int ends[2] = {start, k - 1};
+        if (k - start < 6) ends[0] = ends[1] = (start + k - 1) / 2;
+        for (int e = 0; e < 2; e++) {
+            if (e == 1 && ends[1] == ends[0]) break;
+            int cell = alongRow ? row * width + ends[e] : ends[e] * width + col;
+            bool known = false;
+            for (size_t i = 0; i < nodes.size(); i++)
+                known = known || nodes[i].cell == cell;
+            if (known) continue;
+            Node n;
+            n.cell = cell;
+            n.row = cell / width;
+            n.col = cell % width;
+            n.region = regionOf[cell];
+            n.firstLink = n.lastLink = 0;
+            n.g = 0;
+            n.seen = 0;
+            n.parent = -1;
+            nodes.push_back(n);
+        }
+        start = -1;
+    }
+    assert(nodes.size() <= size_t(MAX_NODES));
+}
+
+// Link every portal to the portals next to it in the neighbour clusters,
+// and every region to the regions those portals belong to
+void PathHierarchy::linkCluster(int c) {
+    Cluster &cl = clusters[c];
+    cl.links.clear();
+    const int dr[] = {-1, 1, 0, 0};
+    const int dc[] = {0, 0, -1, 1};
+    for (size_t i = 0; i < cl.nodes.size(); i++) {
+        Node &n = cl.nodes[i];
+        n.firstLink = int(cl.links.size());
+        int r = n.cell / width, col = n.cell % width;
+        for (int d = 0; d < 4; d++) {
+            int nr = r + dr[d], nc = col + dc[d];
+            if (nr < 0 || nr >= height || nc < 0 || nc >= width) continue;
+            int cell = nr * width + nc;
+            int other = clusterOf(cell);
+            if (other == c) continue;
+            int k = nodeOf(cell);
+            if (k < 0) continue;
+            Link l;
+            l.node = other * MAX_NODES + k;
+            cl.links.push_back(l);
+        }
+        n.lastLink = int(cl.links.size());
+    }
+
+    cl.regionLinks.clear();
+    for (size_t r = 0; r < cl.regions.size(); r++) {
+        Region &reg = cl.regions[r];
+        reg.firstLink = int(cl.regionLinks.size());
+        for (size_t i = 0; i < cl.nodes.size(); i++) {
+            if (cl.nodes[i].region != int(r)) continue;
+            for (int l = cl.nodes[i].firstLink; l < cl.nodes[i].lastLink; l++) {
+                int other = cl.links[l].node / MAX_NODES;
+                int id = other * MAX_REGIONS + clusters[other].nodes[cl.links[l].node % MAX_NODES].region;
+                if (find(cl.regionLinks.begin() + reg.firstLink, cl.regionLinks.end(), id) == cl.regionLinks.end())
+                    cl.regionLinks.push_back(id);
+            }
+        }
+        reg.lastLink = int(cl.regionLinks.size());
+    }
+}
+
+// Distances between the portals of cluster c, inside the cluster.
+// A breadth-first search from every portal to those after it, one step
+// of the whole front at a time: every row of the cluster is a bit mask.
+void PathHierarchy::measureCluster(int c) {
+    static_assert(CLUSTER_SIZE <= 32, "a row of a cluster must fit in a mask");
+    Cluster &cl = clusters[c];
+    int k = int(cl.nodes.size());
+    cl.dist.assign(size_t(k) * k, -1);
+    int top = c / cols * CLUSTER_SIZE, left = c % cols * CLUSTER_SIZE;
+    int n = min(top + CLUSTER_SIZE, height) - top, m = min(left + CLUSTER_SIZE, width) - left;
+    uint32_t openRows[CLUSTER_SIZE];
+    for (int r = 0; r < n; r++) {
+        openRows[r] = 0;
+        for (int j = 0; j < m; j++)
+            if (open[size_t(top + r) * width + left + j]) openRows[r] |= uint32_t(1) << j;
+    }
+
+    uint32_t seen[CLUSTER_SIZE], front[CLUSTER_SIZE], next[CLUSTER_SIZE];
+    for (int i = 0; i < k; i++) {
+        cl.dist[size_t(i) * k + i] = 0;
+        for (int r = 0; r < n; r++)
+            seen[r] = front[r] = 0;
+        front[cl.nodes[i].row - top] = seen[cl.nodes[i].row - top] = uint32_t(1) << (cl.nodes[i].col - left);
+        int missing = k - i - 1; // portals after i not reached yet
+        bool moving = true;
+        for (int d = 1; missing > 0 && moving; d++) {
+            moving = false;
+            for (int r = 0; r < n; r++) {
+                uint32_t grow = front[r] | front[r] << 1 | front[r] >> 1;
+                if (r > 0) grow |= front[r - 1];
+                if (r + 1 < n) grow |= front[r + 1];
+                next[r] = grow & openRows[r] & ~seen[r];
+                moving = moving || next[r] != 0;
+            }
+            for (int r = 0; r < n; r++) {
+                front[r] = next[r];
+                seen[r] |= next[r];
+            }
+            for (int j = i + 1; j < k; j++) {
+                const Node &to = cl.nodes[j];
+                if (cl.dist[size_t(i) * k + j] < 0 && (front[to.row - top] >> (to.col - left) & 1)) {
+                    cl.dist[size_t(i) * k + j] = cl.dist[size_t(j) * k + i] = d;
+                    missing--;
+                }
+            }
+        }
+    }
+}
+
+void PathHierarchy::findComponents() {
+    for (size_t c = 0; c < clusters.size(); c++)
+        for (size_t r = 0; r < clusters[c].regions.size(); r++)
+            clusters[c].regions[r].component = -1;
+    int label = 0;
+    vector<int> &stack = queue;
+    for (size_t c = 0; c < clusters.size(); c++)
+        for (size_t r = 0; r < clusters[c].regions.size(); r++) {
+            if (clusters[c].regions[r].component >= 0) continue;
+            clusters[c].regions[r].component = label;
+            stack.assign(1, int(c) * MAX_REGIONS + int(r));
+            while (!stack.empty()) {
+                int id = stack.back();
+                stack.pop_back();
+                const Cluster &cl = clusters[id / MAX_REGIONS];
+                const Region &reg = cl.regions[id % MAX_REGIONS];
+                for (int l = reg.firstLink; l < reg.lastLink; l++) {
+                    int other = cl.regionLinks[l];
+                    Region &next = clusters[other / MAX_REGIONS].regions[other % MAX_REGIONS];
+                    if (next.component < 0) {
+                        next.component = label;
+                        stack.push_back(other);
+                    }
+                }
+            }
+            label++;
+        }
+    componentsKnown = true;
+}
+
+// Check if a start region may be connected to a goal region.
+// Labels are only trusted to tell regions apart when they are up to date.
+bool PathHierarchy::mayConnect() {
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t s = 0; s < starts.size(); s++) {
+            int a = clusters[starts[s] / MAX_REGIONS].regions[starts[s] % MAX_REGIONS].component;
+            for (size_t k = 0; k < goalPortals.size(); k++) {
+                const Cluster &gc = clusters[goalPortals[k].id / MAX_NODES];
+                int b = gc.regions[gc.nodes[goalPortals[k].id % MAX_NODES].region].component;
+                if (a < 0 || b < 0 || a == b) return true;
+            }
+        }
+        if (componentsKnown) return false;
+        findComponents();
+    }
+    return false;
+}
+
+// Breadth-first search inside the cluster; cell itself may be closed
+void PathHierarchy::searchCluster(int c, int cell) {
+    int top = c / cols * CLUSTER_SIZE, left = c % cols * CLUSTER_SIZE;
+    int bottom = min(top + CLUSTER_SIZE, height), right = min(left + CLUSTER_SIZE, width);
+    local.assign(CLUSTER_SIZE * CLUSTER_SIZE, -1);
+    queue.clear();
+    int s = (cell / width - top) * CLUSTER_SIZE + cell % width - left;
+    local[s] = 0;
+    queue.push_back(s);
+    const int dr[] = {-1, 1, 0, 0};
+    const int dc[] = {0, 0, -1, 1};
+    for (size_t q = 0; q < queue.size(); q++) {
+        int r = queue[q] / CLUSTER_SIZE, col = queue[q] % CLUSTER_SIZE;
+        for (int d = 0; d < 4; d++) {
+            int nr = r + dr[d], nc = col + dc[d];
+            if (nr < 0 || top + nr >= bottom || nc < 0 || left + nc >= right) continue;
+            int k = nr * CLUSTER_SIZE + nc;
+            if (local[k] >= 0 || !open[size_t(top + nr) * width + left + nc]) continue;
+            local[k] = local[queue[q]] + 1;
+            queue.push_back(k);
+        }
+    }
+}
+
+void PathHierarchy::dropRegionSearches() {
+    regionSearches.clear();
+    regionBase.clear();
+}
+
+int PathHierarchy::regionIndex(int id) const {
+    return regionBase[id / MAX_REGIONS] + id % MAX_REGIONS;
+}
+
+PathHierarchy::RegionSearch &PathHierarchy::searchFromGoals() {
+    if (regionBase.empty()) {
+        regionBase.assign(clusters.size() + 1, 0);
+        for (size_t c = 0; c < clusters.size(); c++)
+            regionBase[c + 1] = regionBase[c] + int(clusters[c].regions.size());
+    }
+    for (size_t k = 0; k < regionSearches.size(); k++)
+        if (regionSearches[k].goals == goalRegions) {
+            regionSearches[k].used = stamp;
+            return regionSearches[k];
+        }
+
+    // A new one takes the place of the one unused for the longest time
+    size_t slot = regionSearches.size();
+    if (slot < size_t(KEPT_SEARCHES)) {
+        regionSearches.push_back(RegionSearch());
+    } else {
+        slot = 0;
+        for (size_t k = 1; k < regionSearches.size(); k++)
+            if (regionSearches[k].used < regionSearches[slot].used) slot = k;
+    }
+    RegionSearch &rs = regionSearches[slot];
+    rs.goals = goalRegions;
+    rs.dist.assign(regionBase.back(), -1);
+    rs.done.assign(regionBase.back(), 0);
+    rs.open.clear();
+    for (size_t k = 0; k < goalRegions.size(); k++) {
+        rs.dist[regionIndex(goalRegions[k])] = 0;
+        SearchEntry e = {0, 0, goalRegions[k]};
+        rs.open.push_back(e);
+    }
+    rs.towards = -1;
+    rs.used = stamp;
+    return rs;
+}
+
+// A* towards the cluster of the starts. The estimates only change when
+// another cluster is searched for, and with them the order of the open list.
+void PathHierarchy::reachStart(RegionSearch &rs) {
+    for (size_t s = 0; s < starts.size(); s++)
+        if (rs.done[regionIndex(starts[s])]) return;
+
+    // Among the many ways of the same number of steps, the one closest
+    // to the straight line between the ends goes first
+    int sc = starts[0] / MAX_REGIONS, gc = rs.goals[0] / MAX_REGIONS;
+    int r0 = sc / cols, c0 = sc % cols;
+    int dr = gc / cols - r0, dc = gc % cols - c0;
+    auto estimate = [&](int c, int g) {
+        int h = abs(c / cols - r0) + abs(c % cols - c0);
+        int off = abs((c / cols - r0) * dc - (c % cols - c0) * dr);
+        return (g + h) * TIE + min(off, TIE - 1);
+    };
+    if (rs.towards != sc) {
+        for (size_t k = 0; k < rs.open.size(); k++)
+            rs.open[k].f = estimate(rs.open[k].id / MAX_REGIONS, rs.open[k].g);
+        make_heap(rs.open.begin(), rs.open.end(), later);
+        rs.towards = sc;
+    }
+
+    while (!rs.open.empty()) {
+        pop_heap(rs.open.begin(), rs.open.end(), later);
+        SearchEntry e = rs.open.back();
+        rs.open.pop_back();
+        int k = regionIndex(e.id);
+        if (rs.done[k] || rs.dist[k] != e.g) continue; // found shorter since
+        rs.done[k] = 1;
+        // A start is expanded as well: a later start goes on from there
+        const Cluster &cl = clusters[e.id / MAX_REGIONS];
+        const Region &reg = cl.regions[e.id % MAX_REGIONS];
+        for (int l = reg.firstLink; l < reg.lastLink; l++) {
+            int id = cl.regionLinks[l];
+            int &d = rs.dist[regionIndex(id)];
+            if (d >= 0 && d <= e.g + 1) continue;
+            d = e.g + 1;
+            SearchEntry n = {estimate(id / MAX_REGIONS, e.g + 1), e.g + 1, id};
+            rs.open.push_back(n);
+            push_heap(rs.open.begin(), rs.open.end(), later);
+        }
+        if (find(starts.begin(), starts.end(), e.id) != starts.end()) return;
+    }
+}
+
+bool PathHierarchy::findCorridor() {
+    RegionSearch &rs = searchFromGoals();
+    reachStart(rs);
+    int id = -1;
+    for (size_t s = 0; s < starts.size(); s++) {
+        int k = regionIndex(starts[s]);
+        if (rs.done[k] && (id < 0 || rs.dist[k] < rs.dist[regionIndex(id)])) id = starts[s];
+    }
+    if (id < 0) return false;
+
+    // The regions done know their shortest distances, so a way down them is a shortest one.
+    // Among the regions one step closer, the one closest to the straight line is taken.
+    int sc = id / MAX_REGIONS, gc = rs.goals[0] / MAX_REGIONS;
+    int r0 = sc / cols, c0 = sc % cols;
+    int dr = gc / cols - r0, dc = gc % cols - c0;
+    auto offset = [&](int c) { return abs((c / cols - r0) * dc - (c % cols - c0) * dr); };
+    while (true) {
+        int r = id / MAX_REGIONS / cols, c = id / MAX_REGIONS % cols;
+        for (int i = max(r - CORRIDOR_RING, 0); i <= min(r + CORRIDOR_RING, rows - 1); i++)
+            for (int j = max(c - CORRIDOR_RING, 0); j <= min(c + CORRIDOR_RING, cols - 1); j++)
+                clusters[i * cols + j].corridor = stamp;
+        int d = rs.dist[regionIndex(id)];
+        if (d == 0) break;
+        const Cluster &cl = clusters[id / MAX_REGIONS];
+        const Region &reg = cl.regions[id % MAX_REGIONS];
+        int next = -1;
+        for (int l = reg.firstLink; l < reg.lastLink; l++) {
+            int other = cl.regionLinks[l];
+            int k = regionIndex(other);
+            if (!rs.done[k] || rs.dist[k] != d - 1) continue;
+            if (next < 0 || offset(other / MAX_REGIONS) < offset(next / MAX_REGIONS)) next = other;
+        }
+        id = next;
+    }
+    return true;
+}
+
+void PathHierarchy::searchPortals(int start, bool narrow, int &best, int &bestNode, int &bestGoal) {
+    int goalRows[MAX_GOALS], goalCols[MAX_GOALS], count = int(goals.size());
+    for (int k = 0; k < count; k++) {
+        goalRows[k] = goals[k] / width;
+        goalCols[k] = goals[k] % width;
+    }
+    auto heuristic = [&](const Node &node) {
+        int h = INF;
+        for (int k = 0; k < count; k++)
+            h = min(h, abs(node.row - goalRows[k]) + abs(node.col - goalCols[k]));
+        return h;
+    };
+    searches++;
+    heap.clear();
+    auto relax = [&](int id, int g, int parent) {
+        Cluster &cl = clusters[id / MAX_NODES];
+        if (narrow && cl.corridor != stamp) return;
+        Node &node = cl.nodes[id % MAX_NODES];
+        if (node.seen == searches && node.g <= g) return;
+        node.seen = searches;
+        node.g = g;
+        node.parent = parent;
+        SearchEntry e = {g + heuristic(node), g, id};
+        heap.push_back(e);
+        push_heap(heap.begin(), heap.end(), later);
+    };
+    int sc = clusterOf(start);
+    int top = sc / cols * CLUSTER_SIZE, left = sc % cols * CLUSTER_SIZE;
+    searchCluster(sc, start);
+    for (size_t i = 0; i < clusters[sc].nodes.size(); i++) {
+        int cell = clusters[sc].nodes[i].cell;
+        int d = local[(cell / width - top) * CLUSTER_SIZE + cell % width - left];
+        if (d >= 0) relax(sc * MAX_NODES + int(i), d, -1);
+    }
+
+    while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), later);
+        SearchEntry e = heap.back();
+        heap.pop_back();
+        if (e.f >= best) break;
+        int c = e.id / MAX_NODES, i = e.id % MAX_NODES;
+        Cluster &cl = clusters[c];
+        if (cl.nodes[i].g != e.g) continue; // found shorter since
+
+        if (cl.regions[cl.nodes[i].region].goal == stamp)
+            for (size_t k = 0; k < goalPortals.size(); k++)
+                if (goalPortals[k].id == e.id && e.g + goalPortals[k].extra < best) {
+                    best = e.g + goalPortals[k].extra;
+                    bestNode = e.id;
+                    bestGoal = goalPortals[k].goal;
+                }
+        int size = int(cl.nodes.size());
+        for (int j = 0; j < size; j++) {
+            int d = cl.dist[size_t(i) * size + j];
+            if (j != i && d >= 0) relax(c * MAX_NODES + j, e.g + d, e.id);
+        }
+        for (int l = cl.nodes[i].firstLink; l < cl.nodes[i].lastLink; l++)
+            relax(cl.links[l].node, e.g + 1, e.id);
+    }
+}
+
+int PathHierarchy::findPath(int row, int col, const vector<int> &allGoals, vector<PathPoint> &path) {
+    path.clear();
+    if (allGoals.empty() || clusters.empty()) return -1;
+    int start = row * width + col;
+    int sc = clusterOf(start);
+    stamp++;
+
+    // The goals closest as the crow flies
+    goals.assign(allGoals.begin(), allGoals.end());
+    auto crow = [&](int cell) { return abs(cell / width - row) + abs(cell % width - col); };
+    size_t n = min(goals.size(), size_t(MAX_GOALS));
+    partial_sort(goals.begin(), goals.begin() + n, goals.end(),
+                 [&](int a, int b) { return crow(a) < crow(b); });
+    goals.resize(n);
+
+    // Portals from which each goal is reached inside its cluster
+    goalPortals.clear();
+    goalRegions.clear();
+    int best = INF, bestNode = -1, bestGoal = -1;
+    for (size_t k = 0; k < goals.size(); k++) {
+        int gc = clusterOf(goals[k]);
+        int top = gc / cols * CLUSTER_SIZE, left = gc % cols * CLUSTER_SIZE;
+        searchCluster(gc, goals[k]);
+        Cluster &cl = clusters[gc];
+        for (size_t i = 0; i < cl.nodes.size(); i++) {
+            int d = local[(cl.nodes[i].cell / width - top) * CLUSTER_SIZE + cl.nodes[i].cell % width - left];
+            if (d < 0) continue;
+            GoalPortal p = {gc * MAX_NODES + int(i), d, goals[k]};
+            goalPortals.push_back(p);
+            cl.regions[cl.nodes[i].region].goal = stamp;
+            goalRegions.push_back(gc * MAX_REGIONS + cl.nodes[i].region);
+        }
+        if (gc == sc) {
+            // Straight there inside the cluster
+            int d = local[(row - top) * CLUSTER_SIZE + col - left];
+            if (d >= 0 && d < best) {
+                best = d;
+                bestGoal = goals[k];
+            }
+        }
+    }
+
+    sort(goalRegions.begin(), goalRegions.end());
+    goalRegions.erase(unique(goalRegions.begin(), goalRegions.end()), goalRegions.end());
+
+    // Regions of the portals reached from the start
+    {
+        int top = sc / cols * CLUSTER_SIZE, left = sc % cols * CLUSTER_SIZE;
+        searchCluster(sc, start);
+        starts.clear();
+        const vector<Node> &nodes = clusters[sc].nodes;
+        for (size_t i = 0; i < nodes.size(); i++)
+            if (local[(nodes[i].cell / width - top) * CLUSTER_SIZE + nodes[i].cell % width - left] >= 0)
+                starts.push_back(sc * MAX_REGIONS + nodes[i].region);
+    }
+
+    if (!starts.empty() && !goalPortals.empty() && mayConnect()) {
+        int found = best;
+        bool narrow = findCorridor();
+        if (narrow) searchPortals(start, true, best, bestNode, bestGoal);
+        // The corridor always holds a path; search everywhere if it did not
+        if (bestNode < 0 && found == INF) searchPortals(start, false, best, bestNode, bestGoal);
+    }
+    if (best == INF) return -1;
+
+    for (int id = bestNode; id >= 0;) {
+        const Node &node = clusters[id / MAX_NODES].nodes[id % MAX_NODES];
+        PathPoint p = {node.cell, best - node.g};
+        path.push_back(p);
+        id = node.parent;
+    }
+    reverse(path.begin(), path.end());
+    PathPoint p = {bestGoal, 0};
+    path.push_back(p);
+    return best;
+}
+
+EnemyPaths::EnemyPaths() :
+    groundPaths(true), flyingPaths(false) {
+}
+
+PathHierarchy &EnemyPaths::forClass(bool ground) {
+    return ground ? groundPaths : flyingPaths;
+}
+
+bool EnemyPaths::estimate(const Field &field, const Unit *u, const vector<Unit *> &players,
+                          const MarkPlane &reachable, vector<int> &dists) {
+    int width = field.getWidth(), height = field.getHeight();
+    PathHierarchy &paths = forClass(isGroundMover(u->getType()));
+    paths.update(field);
+    goals.clear();
+    for (size_t k = 0; k < players.size(); k++)
+        goals.push_back(players[k]->getRow() * width + players[k]->getCol());
+    if (paths.findPath(u->getRow(), u->getCol(), goals, path) < 0) return false;
+
+    // Search the squares around the unit from the points of the path,
+    // starting from the length left at each of them
+    const int radius = 2 * CLUSTER_SIZE;
+    int top = max(u->getRow() - radius, 0), bottom = min(u->getRow() + radius, height - 1);
+    int left = max(u->getCol() - radius, 0), right = min(u->getCol() + radius, width - 1);
+    int wrows = bottom - top + 1, wcols = right - left + 1;
+    window.assign(size_t(wrows) * wcols, INF);
+    heap.clear();
+    for (size_t k = 0; k < path.size(); k++) {
+        int r = path[k].cell / width, c = path[k].cell % width;
+        if (r < top || r > bottom || c < left || c > right) continue;
+        int w = (r - top) * wcols + c - left;
+        if (path[k].left >= window[w]) continue;
+        window[w] = path[k].left;
+        SearchEntry e = {path[k].left, path[k].left, w};
+        heap.push_back(e);
+        push_heap(heap.begin(), heap.end(), later);
+    }
+    const int dr[] = {-1, 1, 0, 0};
+    const int dc[] = {0, 0, -1, 1};
+    while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), later);
+        SearchEntry e = heap.back();
+        heap.pop_back();
+        if (e.g != window[e.id]) continue;
+        int r = e.id / wcols, c = e.id % wcols;
+        for (int d = 0; d < 4; d++) {
+            int nr = r + dr[d], nc = c + dc[d];
+            if (nr < 0 || nr >= wrows || nc < 0 || nc >= wcols) continue;
+            if (!paths.passable((top + nr) * width + left + nc)) continue;
+            int w = nr * wcols + nc;
+            if (window[w] <= e.g + 1) continue;
+            window[w] = e.g + 1;
+            SearchEntry next = {e.g + 1, e.g + 1, w};
+            heap.push_back(next);
+            push_heap(heap.begin(), heap.end(), later);
+        }
+    }
+
+    dists.clear();
+    for (size_t k = 0; k < reachable.count(); k++) {
+        int r = reachable.markedRow(k), c = reachable.markedCol(k);
+        int d = r < top || r > bottom || c < left || c > right ? INF : window[(r - top) * wcols + c - left];
+        dists.push_back(d == INF ? -1 : d);
+    }
+    return true;
+}
+
+// Length of the shortest path over the open squares, or -1
+static int shortestPath(const PathHierarchy &paths, int height, int width, int from, int to) {
+    vector<int> dist(size_t(height) * width, -1);
+    vector<int> queue(1, from);
+    dist[from] = 0;
+    const int dr[] = {-1, 1, 0, 0};
+    const int dc[] = {0, 0, -1, 1};
+    for (size_t q = 0; q < queue.size(); q++) {
+        int r = queue[q] / width, c = queue[q] % width;
+        if (queue[q] == to) return dist[to];
+        for (int d = 0; d < 4; d++) {
+            int nr = r + dr[d], nc = c + dc[d];
+            if (nr < 0 || nr >= height || nc < 0 || nc >= width) continue;
+            int cell = nr * width + nc;
+            if (dist[cell] >= 0 || (!paths.passable(cell) && cell != to)) continue;
+            dist[cell] = dist[queue[q]] + 1;
+            queue.push_back(cell);
+        }
+    }
+    return -1;
+}
+
+// Number the sets of open squares connected to each other, -1 elsewhere
+static void labelComponents(const PathHierarchy &paths, int height, int width, vector<int> &label) {
+    label.assign(size_t(height) * width, -1);
+    vector<int> queue;
+    const int dr[] = {-1, 1, 0, 0};
+    const int dc[] = {0, 0, -1, 1};
+    int count = 0;
+    for (int cell = 0; cell < height * width; cell++) {
+        if (label[cell] >= 0 || !paths.passable(cell)) continue;
+        label[cell] = count;
+        queue.assign(1, cell);
+        for (size_t q = 0; q < queue.size(); q++) {
+            int r = queue[q] / width, c = queue[q] % width;
+            for (int d = 0; d < 4; d++) {
+                int nr = r + dr[d], nc = c + dc[d];
+                if (nr < 0 || nr >= height || nc < 0 || nc >= width) continue;
+                int next = nr * width + nc;
+                if (label[next] >= 0 || !paths.passable(next)) continue;
+                label[next] = count;
+                queue.push_back(next);
+            }
+        }
+        count++;
+    }
+}
+
+bool benchPaths(Field &field, ostream &os, int queries, unsigned seed) {
+    typedef chrono::steady_clock Clock;
+    int h = field.getHeight(), w = field.getWidth();
+    mt19937 rng(seed);
+    PathHierarchy paths(true);
+    Clock::time_point t0 = Clock::now();
+    paths.update(field);
+    Clock::time_point t1 = Clock::now();
+    os << h << "x" << w << " field: " << paths.getNodeCount() << " portals built in "
+       << chrono::duration<double, milli>(t1 - t0).count() << " ms" << endl;
+
+    // Pairs of open squares far apart
+    vector<int> from, to;
+    for (int tries = 0; int(from.size()) < queries && tries < 1000 * queries; tries++) {
+        int a = int(rng() % unsigned(h * w)), b = int(rng() % unsigned(h * w));
+        int far = abs(a / w - b / w) + abs(a % w - b % w);
+        if (paths.passable(a) && paths.passable(b) && 4 * far >= h + w) {
+            from.push_back(a);
+            to.push_back(b);
+        }
+    }
+    // A path must be found exactly when both ends are connected
+    vector<int> label;
+    labelComponents(paths, h, w, label);
+    int wrong = 0;
+
+    // Twice the same searches, too many goals for the kept region searches
+    vector<int> lengths(from.size());
+    vector<int> goal(1);
+    vector<PathPoint> path;
+    for (int pass = 0; pass < 2; pass++) {
+        double slowest = 0;
+        int found = 0;
+        t0 = Clock::now();
+        for (size_t k = 0; k < from.size(); k++) {
+            Clock::time_point q0 = Clock::now();
+            goal[0] = to[k];
+            lengths[k] = paths.findPath(from[k] / w, from[k] % w, goal, path);
+            slowest = max(slowest, chrono::duration<double, micro>(Clock::now() - q0).count());
+            found += lengths[k] >= 0;
+        }
+        t1 = Clock::now();
+        for (size_t k = 0; k < from.size(); k++)
+            wrong += (lengths[k] >= 0) != (label[from[k]] == label[to[k]]);
+        os << from.size() << (pass == 0 ? " long searches, " : " again, ") << found << " found, "
+           << chrono::duration<double, micro>(t1 - t0).count() / max(size_t(1), from.size())
+           << " us per search (max " << slowest << " us)" << endl;
+    }
+
+    // Every start towards the same goal, as the enemies of a turn go
+    // towards the same players: the search of the goal regions is kept
+    if (!from.empty()) {
+        int found = 0;
+        goal[0] = to[0];
+        t0 = Clock::now();
+        for (size_t k = 0; k < from.size(); k++) {
+            bool reached = paths.findPath(from[k] / w, from[k] % w, goal, path) >= 0;
+            found += reached;
+            wrong += reached != (label[from[k]] == label[to[0]]);
+        }
+        t1 = Clock::now();
+        os << from.size() << " searches towards one goal, " << found << " found, "
+           << chrono::duration<double, micro>(t1 - t0).count() / max(size_t(1), from.size())
+           << " us per search" << endl;
+    }
+    if (wrong > 0) os << wrong << " searches WRONG about whether the goal is reached" << endl;
+
+    // Compare a few with the shortest paths
+    long long sum = 0, shortest = 0;
+    for (size_t k = 0; k < from.size() && k < 5; k++) {
+        int best = shortestPath(paths, h, w, from[k], to[k]);
+        if (best < 0 || lengths[k] < 0) {
+            if ((best < 0) != (lengths[k] < 0)) os << "path " << k << " found by one search only" << endl;
+            continue;
+        }
+        sum += lengths[k];
+        shortest += best;
+    }
+    if (shortest > 0) os << "paths " << 100.0 * (sum - shortest) / shortest << "% longer than the shortest ones" << endl;
+
+    // Destroy mountains one at a time
+    vector<int> mountains;
+    for (int tries = 0; mountains.size() < 100 && tries < 100000; tries++) {
+        int a = int(rng() % unsigned(h * w));
+        if (field.getTerrain(a / w, a % w).getType() == MOUNTAIN) mountains.push_back(a);
+    }
+    unsigned long before = paths.getRebuilt();
+    t0 = Clock::now();
+    for (size_t k = 0; k < mountains.size(); k++) {
+        field.setTerrain(mountains[k] / w, mountains[k] % w, PLAIN);
+        paths.update(field);
+    }
+    t1 = Clock::now();
+    if (mountains.empty()) return wrong == 0;
+    os << mountains.size() << " mountains destroyed, "
+       << chrono::duration<double, micro>(t1 - t0).count() / mountains.size() << " us and "
+       << double(paths.getRebuilt() - before) / mountains.size() << " clusters per repair";
+
+    // The repaired graph must give the paths of a new one
+    PathHierarchy fresh(true);
+    fresh.update(field);
+    bool same = true;
+    for (size_t k = 0; k < from.size(); k++) {
+        goal[0] = to[k];
+        vector<PathPoint> other;
+        same = same && paths.findPath(from[k] / w, from[k] % w, goal, path) ==
+                           fresh.findPath(from[k] / w, from[k] % w, goal, other);
+    }
+    os << (same ? ", same paths as a new graph" : ", DIFFERENT paths from a new graph") << endl;
+    return wrong == 0 && same;
+}
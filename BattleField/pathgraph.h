@@ -0,0 +1,191 @@
+#ifndef PATHGRAPH_H_INCLUDED
+#define PATHGRAPH_H_INCLUDED
+
+/**** Hierarchical path search for the long-range moves of enemies ****/
+#include <iostream>
+#include <vector>
+#include "field.h"
+
+class MarkPlane;
+
+// How enemy units choose where to move
+enum EnemyMoveMode { ENEMY_MOVE_MANHATTAN, // closest to a player unit as the crow flies
+                     ENEMY_MOVE_PATHS,     // closest to a player unit along the terrain
+                     ENEMY_MOVE_FLOW,      // the same, read from one distance field per movement class
+};
+
+// Side of the square clusters of a PathHierarchy
+const int CLUSTER_SIZE = 16;
+
+// A square on a path and the length of the path left from there
+struct PathPoint {
+    int cell; // row * width + col
+    int left;
+};
+
+// Entry of the open list of a search: estimated length, length so far, node
+struct SearchEntry {
+    int f, g, id;
+};
+
+/* HPA*: the board is cut into CLUSTER_SIZE x CLUSTER_SIZE clusters.
+   Every stretch of open squares along the border of two clusters gets
+   one or two portals, and the squares of a cluster connected to each
+   other inside it form a region. A long path is searched in two steps:
+   first from region to region, which gives a corridor of clusters,
+   then on the portals of the corridor only. The distances between the
+   portals of a cluster are measured when its portals are found.
+   The region search runs backwards from the goals and is kept for the
+   last few sets of goal regions: a later search towards the same goals,
+   as those of the enemies of one turn, goes on with it only until its
+   own start is reached, and may find it reached already.
+   Only the terrain matters (units move all the time), so the graph is
+   kept from turn to turn; when squares change passability, e.g. a
+   mountain is destroyed, only the clusters around them are found again.
+   Paths are a few percent longer than the shortest ones. */
+class PathHierarchy {
+public:
+    // For ground units (PLAIN and FOREST are open) or flying units (PLAIN and OCEAN)
+    explicit PathHierarchy(bool ground);
+
+    // Bring the graph up to date with the terrain of field
+    void update(const Field &field);
+
+    // Search a path from (row, col) to the closest of goals (row * width + col).
+    // path gets the portals on the way and the goal, each with the length
+    // left from there, in the order they are passed.
+    // Return the length of the path, or -1 if no goal can be reached.
+    // Only the few goals closest as the crow flies are tried.
+    int findPath(int row, int col, const std::vector<int> &goals, std::vector<PathPoint> &path);
+
+    // Number of portals, and clusters found again since the graph was built
+    size_t getNodeCount() const;
+    unsigned long getRebuilt() const;
+
+    // Check if a unit of the class may cross the square (row * width + col)
+    bool passable(int cell) const;
+
+private:
+    struct Node {
+        int cell, row, col;
+        int region;              // of its cluster
+        int firstLink, lastLink; // links to the neighbour clusters
+        // State of the current search
+        int g;
+        unsigned seen;
+        int parent; // cluster * MAX_NODES + node, -1 from the start
+    };
+    struct Link {
+        int node; // cluster * MAX_NODES + node
+    };
+    struct Region {
+        int firstLink, lastLink; // into regionLinks of the cluster
+        int component;           // connected regions share it, -1 if not known
+        unsigned goal;           // stamp of the last search with a goal in it
+    };
+    struct Cluster {
+        std::vector<Node> nodes;
+        std::vector<int> dist; // between the nodes, -1 if not connected inside the cluster
+        std::vector<Link> links;
+        std::vector<Region> regions;
+        std::vector<int> regionLinks; // cluster * MAX_REGIONS + region
+        unsigned corridor;            // stamp of the last search which may cross it
+    };
+    // A portal from which a goal is reached inside its cluster
+    struct GoalPortal {
+        int id, extra, goal;
+    };
+    // A search of the regions backwards from some goal regions
+    struct RegionSearch {
+        std::vector<int> goals;  // cluster * MAX_REGIONS + region, sorted
+        std::vector<int> dist;   // steps to the goals by index of the region, -1 if not seen
+        std::vector<char> done;  // dist is the shortest
+        std::vector<SearchEntry> open;
+        int towards;             // cluster the open list is ordered for
+        unsigned used;           // stamp of the last path search
+    };
+
+    bool ground;
+    int height, width;
+    int rows, cols; // clusters
+    unsigned long long fieldId, version;
+    std::vector<char> open;
+    std::vector<unsigned char> regionOf; // region of every square in its cluster
+    std::vector<Cluster> clusters;
+    size_t nodeCount;
+    unsigned long rebuilt;
+    unsigned stamp;    // of the current path search
+    unsigned searches; // of the current portal search
+    bool componentsKnown;
+    std::vector<int> regionBase; // index of the first region of every cluster, empty if stale
+    std::vector<RegionSearch> regionSearches;
+    // Scratch memory
+    std::vector<long long> changes;
+    std::vector<int> local; // distances inside one cluster
+    std::vector<int> queue;
+    std::vector<int> goals;
+    std::vector<int> starts; // regions
+    std::vector<int> goalRegions;
+    std::vector<GoalPortal> goalPortals;
+    std::vector<SearchEntry> heap;
+
+    bool isOpen(const Field &field, int row, int col) const;
+    void build(const Field &field);
+    // Find the regions and the portals of a cluster
+    void findPortals(int c);
+    void findRegions(int c);
+    void addPortals(int c, int side);
+    // Link the portals and the regions of a cluster to those of the neighbours
+    void linkCluster(int c);
+    void measureCluster(int c);
+    // Distances from cell to every square of its cluster, into local
+    void searchCluster(int c, int cell);
+    // Label the connected regions, so that a search between two parts
+    // of the board which are not connected stops at once
+    void findComponents();
+    bool mayConnect();
+    // Forget the region searches, after regions changed
+    void dropRegionSearches();
+    int regionIndex(int id) const;
+    // The kept search from goalRegions, or a new one
+    RegionSearch &searchFromGoals();
+    // Go on with the search until a region of starts is done
+    void reachStart(RegionSearch &rs);
+    // Walk from the nearest start to the goal regions and mark the
+    // clusters around the way as the corridor of the search
+    bool findCorridor();
+    // A* on the portals, of the corridor only if narrow
+    void searchPortals(int start, bool narrow, int &best, int &bestNode, int &bestGoal);
+    int clusterOf(int cell) const;
+    int nodeOf(int cell) const;
+};
+
+/* The paths of both movement classes, and the scores of the squares
+   an enemy unit can reach */
+class EnemyPaths {
+public:
+    EnemyPaths();
+
+    // Estimate the length of the path from every marked square of reachable
+    // to the nearest player unit into dists (-1 if unknown).
+    // Return false if no player unit can be reached from where u stands.
+    bool estimate(const Field &field, const Unit *u, const std::vector<Unit *> &players,
+                  const MarkPlane &reachable, std::vector<int> &dists);
+
+    PathHierarchy &forClass(bool ground);
+
+private:
+    PathHierarchy groundPaths, flyingPaths;
+    std::vector<int> goals;
+    std::vector<PathPoint> path;
+    std::vector<int> window; // distances around the unit
+    std::vector<SearchEntry> heap;
+};
+
+// Time the build of the ground graph, long path searches, and repairs after
+// mountains of field are destroyed; compare some paths with the shortest ones.
+// Return false if a search is wrong about whether its goal is reached,
+// or if the repaired graph gives other paths than a new one.
+bool benchPaths(Field &field, std::ostream &os, int queries, unsigned seed);
+
+#endif // PATHGRAPH_H_INCLUDED
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include "perft.h"
+#include "workspace.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Prefixes wanted per thread before the split goes no deeper
+static const size_t TASKS_PER_THREAD = 8;
+
+// Sequences to count after a prefix, and the first action of the prefix
+struct PerftTask {
+    int first;
+    vector<UnitAction> prefix;
+};
+
+// A board of one thread, with an action list and an undo record per depth
+struct PerftBoard {
+    PerftBoard(const Field &f, bool side, int depth) :
+        field(f), side(side), ws(f.getHeight(), f.getWidth()),
+        lists(depth + 1), undos(depth + 1), levels(depth + 1, 0) {
+    }
+
+    Field field;
+    bool side;
+    TurnWorkspace ws;
+    vector<vector<UnitAction> > lists;
+    vector<FieldUndo> undos;
+    vector<long long> levels; // positions seen at every depth
+};
+
+// Count the sequences of `left` more actions after ply of them.
+// The last actions are counted, not made.
+static long long countFrom(PerftBoard &b, int ply, int left) {
+    b.levels[ply]++;
+    if (left == 0) return 1;
+    vector<UnitAction> &acts = b.lists[ply];
+    getLegalActions(b.field, b.side, b.ws, acts);
+    if (left == 1) {
+        b.levels[ply + 1] += acts.size();
+        return acts.size();
+    }
+    long long n = 0;
+    for (size_t k = 0; k < acts.size(); k++) {
+        makeAction(b.field, b.side, acts[k], b.ws, b.undos[ply]);
+        n += countFrom(b, ply + 1, left - 1);
+        b.field.undo(b.undos[ply]);
+    }
+    return n;
+}
+
+// Collect the prefixes of split actions as tasks
+static void collectTasks(PerftBoard &b, int ply, int split, int first,
+                         vector<UnitAction> &prefix, vector<PerftTask> &tasks) {
+    if (ply == split) {
+        PerftTask t;
+        t.first = first;
+        t.prefix = prefix;
+        tasks.push_back(t);
+        return;
+    }
+    b.levels[ply]++;
+    vector<UnitAction> &acts = b.lists[ply];
+    getLegalActions(b.field, b.side, b.ws, acts);
+    for (size_t k = 0; k < acts.size(); k++) {
+        prefix.push_back(acts[k]);
+        makeAction(b.field, b.side, acts[k], b.ws, b.undos[ply]);
+        collectTasks(b, ply + 1, split, ply == 0 ? int(k) : first, prefix, tasks);
+        b.field.undo(b.undos[ply]);
+        prefix.pop_back();
+    }
+}
+
+// Take tasks until none is left
+static void runTasks(PerftBoard &b, const vector<PerftTask> &tasks, int depth,
+                     atomic<size_t> &next, vector<long long> &counts) {
+    for (size_t t = next++; t < tasks.size(); t = next++) {
+        const vector<UnitAction> &prefix = tasks[t].prefix;
+        int split = int(prefix.size());
+        for (int k = 0; k < split; k++)
+            makeAction(b.field, b.side, prefix[k], b.ws, b.undos[k]);
+        counts[t] = countFrom(b, split, depth - split);
+        for (int k = split; k-- > 0;)
+            b.field.undo(b.undos[k]);
+    }
+}
+
+PerftResult perft(const Field &field, bool side, int depth, int threads) {
+    Clock::time_point start = Clock::now();
+    threads = max(threads, 1);
+    depth = max(depth, 0);
+    PerftResult res;
+    res.depth = depth;
+    res.tasks = 0;
+
+    PerftBoard root(field, side, depth);
+    if (depth == 0) {
+        res.sequences = countFrom(root, 0, 0);
+        res.levels = root.levels;
+        res.seconds = chrono::duration<double>(Clock::now() - start).count();
+        return res;
+    }
+
+    // Split deeper until every thread has enough prefixes
+    vector<PerftTask> tasks;
+    vector<UnitAction> prefix;
+    int split = 0;
+    do {
+        split++;
+        tasks.clear();
+        fill(root.levels.begin(), root.levels.end(), 0);
+        collectTasks(root, 0, split, -1, prefix, tasks);
+    } while (split < depth && tasks.size() < TASKS_PER_THREAD * threads && threads > 1);
+    const vector<UnitAction> &firsts = root.lists[0];
+
+    vector<long long> counts(tasks.size(), 0);
+    atomic<size_t> next(0);
+    vector<PerftBoard *> boards;
+    boards.push_back(&root);
+    for (int t = 1; t < threads; t++)
+        boards.push_back(new PerftBoard(field, side, depth));
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.push_back(thread(runTasks, ref(*boards[t]), cref(tasks), depth, ref(next), ref(counts)));
+    runTasks(root, tasks, depth, next, counts);
+    for (size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+
+    res.levels.assign(depth + 1, 0);
+    for (size_t t = 0; t < boards.size(); t++) {
+        for (int d = 0; d <= depth; d++)
+            res.levels[d] += boards[t]->levels[d];
+        if (t > 0) delete boards[t];
+    }
+    res.divide.resize(firsts.size());
+    for (size_t k = 0; k < firsts.size(); k++) {
+        res.divide[k].action = firsts[k];
+        res.divide[k].sequences = 0;
+    }
+    res.sequences = 0;
+    for (size_t t = 0; t < tasks.size(); t++) {
+        res.divide[tasks[t].first].sequences += counts[t];
+        res.sequences += counts[t];
+    }
+    res.tasks = int(tasks.size());
+    res.seconds = chrono::duration<double>(Clock::now() - start).count();
+    return res;
+}
+
+void printPerftResult(ostream &os, const PerftResult &res) {
+    for (size_t k = 0; k < res.divide.size(); k++) {
+        const UnitAction &a = res.divide[k].action;
+        os << (a.act == MOVE ? "move " : "attack ") << "(" << a.row << ", " << a.col << ") "
+           << (a.act == MOVE ? "to" : "at") << " (" << a.trow << ", " << a.tcol << "): "
+           << res.divide[k].sequences << endl;
+    }
+    for (int d = 1; d <= res.depth; d++)
+        os << "Depth " << d << ": " << res.levels[d] << " sequences" << endl;
+    long long positions = 0;
+    for (int d = 0; d <= res.depth; d++)
+        positions += res.levels[d];
+    os << "Sequences: " << res.sequences << " of " << res.depth << " actions, "
+       << res.tasks << " tasks, " << positions << " positions in " << res.seconds << " s ("
+       << (res.seconds > 0 ? positions / res.seconds : 0) << " positions/sec)" << endl;
+}
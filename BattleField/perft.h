@@ -0,0 +1,36 @@
+#ifndef PERFT_H_INCLUDED
+#define PERFT_H_INCLUDED
+
+/**** Counting the sequences of legal actions of a turn ****/
+#include <iostream>
+#include <vector>
+#include "field.h"
+#include "engine.h"
+
+// Sequences which start with one action
+struct PerftDivide {
+    UnitAction action;
+    long long sequences;
+};
+
+// Result of a count
+struct PerftResult {
+    int depth;
+    long long sequences;              // sequences of depth actions
+    std::vector<long long> levels;    // sequences of 0, 1, ..., depth actions
+    std::vector<PerftDivide> divide;  // by first action, as getLegalActions lists them
+    int tasks;                        // prefixes shared among the threads
+    double seconds;
+};
+
+// Count the sequences of depth actions the units of side can make
+// from the field as it stands, every move and attack of getLegalActions
+// being made and taken back on one board per thread.
+// The sequences are split at the first depth with enough prefixes
+// to keep `threads` threads busy, and the prefixes are shared among them.
+PerftResult perft(const Field &field, bool side, int depth, int threads);
+
+// Print the count by first action, by depth, and the speed
+void printPerftResult(std::ostream &os, const PerftResult &res);
+
+#endif // PERFT_H_INCLUDED
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <chrono>
+#include "preview.h"
+#include "algorithms.h"
+#include "engine.h"
+#include "workspace.h"
+
+using namespace std;
+
+AttackPreview::AttackPreview() :
+    window(1, 1) {
+}
+
+void AttackPreview::preview(const Field &field, const Unit *u, int trow, int tcol, AttackReport &report) {
+    // The squares within two rows and two columns of the target
+    int top = max(trow - 2, 0), left = max(tcol - 2, 0);
+    int h = min(trow + 2, int(field.getHeight()) - 1) - top + 1;
+    int w = min(tcol + 2, int(field.getWidth()) - 1) - left + 1;
+    terrain.resize(size_t(h) * w);
+    units.clear();
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++) {
+            terrain[size_t(i) * w + j] = (unsigned char)field.getTerrain(top + i, left + j).getType();
+            const Unit *v = field.getUnit(top + i, left + j);
+            if (v != nullptr) {
+                units.push_back(*v);
+                units.back().setCoord(i, j);
+            }
+        }
+    window.restore(h, w, terrain, units);
+
+    // The attacker may stand outside the window: only its square matters then
+    Unit a(*u);
+    a.setCoord(u->getRow() - top, u->getCol() - left);
+    report.begin(window, &a, trow - top, tcol - left);
+    window.attackUnit(&a, trow - top, tcol - left);
+    report.finish(window);
+
+    report.row = u->getRow();
+    report.col = u->getCol();
+    report.targetRow = trow;
+    report.targetCol = tcol;
+    for (size_t k = 0; k < report.units.size(); k++) {
+        UnitChange &c = report.units[k];
+        c.row += top;
+        c.col += left;
+        c.newRow += top;
+        c.newCol += left;
+    }
+    for (size_t k = 0; k < report.terrains.size(); k++) {
+        report.terrains[k].row += top;
+        report.terrains[k].col += left;
+    }
+}
+
+void previewAttack(const Field &field, const Unit *u, int trow, int tcol, AttackReport &report) {
+    AttackPreview p;
+    p.preview(field, u, trow, tcol, report);
+}
+
+void markAttackOutcome(const Field &field, const AttackReport &report, Grid<bool> &grd) {
+    grd = Grid<bool>(field.getHeight(), field.getWidth(), false);
+    for (size_t k = 0; k < report.units.size(); k++) {
+        const UnitChange &c = report.units[k];
+        grd[c.row][c.col] = true;
+        grd[c.newRow][c.newCol] = true;
+    }
+    for (size_t k = 0; k < report.terrains.size(); k++)
+        grd[report.terrains[k].row][report.terrains[k].col] = true;
+}
+
+static bool sameChanges(const AttackReport &x, const AttackReport &y) {
+    if (x.units.size() != y.units.size() || x.terrains.size() != y.terrains.size()) return false;
+    for (size_t k = 0; k < x.units.size(); k++) {
+        const UnitChange &a = x.units[k], &b = y.units[k];
+        if (a.type != b.type || a.side != b.side || a.row != b.row || a.col != b.col || a.newRow != b.newRow
+            || a.newCol != b.newCol || a.hpBefore != b.hpBefore || a.hp != b.hp)
+            return false;
+    }
+    for (size_t k = 0; k < x.terrains.size(); k++) {
+        const TerrainChange &a = x.terrains[k], &b = y.terrains[k];
+        if (a.row != b.row || a.col != b.col || a.before != b.before || a.after != b.after) return false;
+    }
+    return true;
+}
+
+bool benchPreview(const Field &field, ostream &os, int reps) {
+    typedef chrono::steady_clock Clock;
+    vector<Unit *> all;
+    field.getUnits(all);
+    MarkPlane attackable(field.getHeight(), field.getWidth());
+    vector<pair<const Unit *, int> > attacks; // attacker and target square
+    for (size_t k = 0; k < all.size(); k++) {
+        searchAttackable(field, all[k], attackable);
+        for (size_t i = 0; i < attackable.count(); i++)
+            attacks.push_back(make_pair(all[k], attackable.markedRow(i) * int(field.getWidth()) + attackable.markedCol(i)));
+    }
+
+    // Every preview against the attack played on a copy
+    AttackPreview p;
+    AttackReport predicted, played;
+    int wrong = 0;
+    for (size_t k = 0; k < attacks.size(); k++) {
+        const Unit *u = attacks[k].first;
+        int trow = attacks[k].second / field.getWidth(), tcol = attacks[k].second % field.getWidth();
+        p.preview(field, u, trow, tcol, predicted);
+        Field copy(field);
+        Unit *v = copy.getUnit(u->getRow(), u->getCol());
+        played.begin(copy, v, trow, tcol);
+        copy.attackUnit(v, trow, tcol);
+        played.finish(copy);
+        if (!sameChanges(predicted, played)) wrong++;
+    }
+
+    long long changes = 0;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < reps; r++)
+        for (size_t k = 0; k < attacks.size(); k++) {
+            int trow = attacks[k].second / field.getWidth(), tcol = attacks[k].second % field.getWidth();
+            p.preview(field, attacks[k].first, trow, tcol, predicted);
+            changes += predicted.units.size() + predicted.terrains.size();
+        }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    long long previews = (long long)reps * attacks.size();
+    // The board of the first attack which changes anything
+    for (size_t k = 0; k < attacks.size(); k++) {
+        int trow = attacks[k].second / field.getWidth(), tcol = attacks[k].second % field.getWidth();
+        p.preview(field, attacks[k].first, trow, tcol, predicted);
+        if (predicted.units.empty() && predicted.terrains.empty()) continue;
+        Grid<bool> grd;
+        markAttackOutcome(field, predicted, grd);
+        os << attacks[k].first->getSymbol() << " at (" << predicted.row << ", " << predicted.col
+           << ") attacking (" << trow << ", " << tcol << ") would change:" << endl;
+        displayField(os, field, grd, DP_PREVIEW);
+        break;
+    }
+    os << attacks.size() << " attacks of " << all.size() << " units, " << wrong << " previews differ from the attack played" << endl;
+    os << previews << " previews in " << seconds << " s ("
+       << (previews > 0 ? seconds * 1e9 / previews : 0) << " ns each), " << changes << " changes" << endl;
+    return wrong == 0;
+}
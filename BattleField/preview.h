@@ -0,0 +1,43 @@
+#ifndef PREVIEW_H_INCLUDED
+#define PREVIEW_H_INCLUDED
+
+/**** What an attack would do, without doing it ****/
+#include <iostream>
+#include <vector>
+#include "NewGrid.h"
+#include "field.h"
+#include "events.h"
+
+/* Plays an attack with Field::attackUnit on a copy of the squares
+   around its target only, as every effect of an attack lies within
+   two squares of it. The copy is a small field reused from one
+   preview to the next, whose units are restored in one block:
+   a preview allocates nothing once the copy has grown. */
+class AttackPreview {
+public:
+    AttackPreview();
+
+    // Fill report with what u attacking (trow, tcol) would change,
+    // in the squares of field; neither field nor u changes
+    void preview(const Field &field, const Unit *u, int trow, int tcol, AttackReport &report);
+
+private:
+    Field window;
+    std::vector<unsigned char> terrain;
+    std::vector<Unit> units;
+};
+
+// Same as above, with a preview made for the call
+void previewAttack(const Field &field, const Unit *u, int trow, int tcol, AttackReport &report);
+
+// Mark the squares an attack changes, for displayField with DP_PREVIEW:
+// the units hurt or moved, on the squares they leave and reach,
+// and the terrains changed. grd takes the size of field.
+void markAttackOutcome(const Field &field, const AttackReport &report, Grid<bool> &grd);
+
+// Preview every attack of every unit of the field, check that each
+// preview matches the attack played on a copy, and print the timings.
+// Return false if a preview differs.
+bool benchPreview(const Field &field, std::ostream &os, int reps);
+
+#endif // PREVIEW_H_INCLUDED
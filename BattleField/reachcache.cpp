@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "reachcache.h"
+#include "batch.h"
+#include "workspace.h"
+
+using namespace std;
+
+// Side of the square areas of the buckets
+static const int BUCKET_SIZE = 8;
+
+bool ReachCache::Key::operator==(const Key &other) const {
+    return unit == other.unit && row == other.row && col == other.col && ground == other.ground;
+}
+
+size_t ReachCache::hashKey(const Key &k) {
+    unsigned long long h = uintptr_t(k.unit) >> 4;
+    h = h * 31 + (unsigned int)k.row;
+    h = h * 31 + (unsigned int)k.col;
+    h = h * 2 + k.ground;
+    return size_t(h * 0x9E3779B97F4A7C15ULL >> 32);
+}
+
+ReachCache::ReachCache() :
+    used(0), owner(0), seen(0), maxPts(0), roomPts(0), hits(0), misses(0), invalidations(0) {
+}
+
+// The slot holding the entry of k, or the free slot where it goes
+size_t ReachCache::slotOf(const Key &k) const {
+    size_t mask = keys.size() - 1;
+    size_t s = hashKey(k) & mask;
+    while (keys[s].unit != nullptr && !(keys[s] == k))
+        s = (s + 1) & mask;
+    return s;
+}
+
+// Free slot s, moving back the keys after it which would not be found any more
+void ReachCache::erase(size_t s) {
+    spare.push_back(slots[s]);
+    size_t mask = keys.size() - 1;
+    for (size_t j = (s + 1) & mask; keys[j].unit != nullptr; j = (j + 1) & mask) {
+        size_t home = hashKey(keys[j]) & mask;
+        // The key stays if its home is in (s, j], cyclically
+        bool stays = s < j ? home > s && home <= j : home > s || home <= j;
+        if (stays) continue;
+        keys[s] = keys[j];
+        slots[s] = slots[j];
+        s = j;
+    }
+    keys[s].unit = nullptr;
+    used--;
+}
+
+// Double the table, or make the first one
+void ReachCache::grow() {
+    Key free;
+    free.unit = nullptr;
+    vector<Key> oldKeys(max(size_t(16), 2 * keys.size()), free);
+    vector<size_t> oldSlots(oldKeys.size());
+    keys.swap(oldKeys);
+    slots.swap(oldSlots);
+    for (size_t k = 0; k < oldKeys.size(); k++) {
+        if (oldKeys[k].unit == nullptr) continue;
+        size_t s = slotOf(oldKeys[k]);
+        keys[s] = oldKeys[k];
+        slots[s] = oldSlots[k];
+    }
+}
+
+ReachCache::Key ReachCache::makeKey(const Unit *u) const {
+    Key k;
+    k.unit = u;
+    k.row = u->getRow();
+    k.col = u->getCol();
+    k.ground = isGroundMover(u->getType());
+    return k;
+}
+
+long long ReachCache::bucketOf(int row, int col) const {
+    return ((long long)(row / BUCKET_SIZE) << 32) | (col / BUCKET_SIZE);
+}
+
+void ReachCache::clear() {
+    for (size_t s = 0; s < keys.size(); s++) {
+        if (keys[s].unit == nullptr) continue;
+        spare.push_back(slots[s]);
+        keys[s].unit = nullptr;
+    }
+    used = 0;
+    for (unordered_map<long long, vector<Key> >::iterator b = buckets.begin(); b != buckets.end(); ++b)
+        b->second.clear();
+    maxPts = 0;
+}
+
+void ReachCache::sync(const Field &field) {
+    if (owner != field.getId() || !field.getChangesSince(seen, changes)) {
+        invalidations += used;
+        clear();
+        owner = field.getId();
+        seen = field.getVersion();
+        return;
+    }
+    seen = field.getVersion();
+    if (used == 0) return;
+
+    long long width = field.getWidth();
+    for (size_t c = 0; c < changes.size(); c++) {
+        int row = int(changes[c] / width);
+        int col = int(changes[c] % width);
+        // Every bucket which may hold a position within maxPts
+        for (int br = max(0, row - maxPts) / BUCKET_SIZE; br <= (row + maxPts) / BUCKET_SIZE; br++) {
+            for (int bc = max(0, col - maxPts) / BUCKET_SIZE; bc <= (col + maxPts) / BUCKET_SIZE; bc++) {
+                unordered_map<long long, vector<Key> >::iterator b = buckets.find(((long long)br << 32) | bc);
+                if (b == buckets.end()) continue;
+                vector<Key> &near = b->second;
+                for (size_t k = 0; k < near.size();) {
+                    size_t s = slotOf(near[k]);
+                    bool stale = keys[s].unit == nullptr;
+                    if (!stale && abs(near[k].row - row) + abs(near[k].col - col) <= entries[slots[s]].pts) {
+                        erase(s);
+                        invalidations++;
+                        stale = true;
+                    }
+                    if (stale) {
+                        near[k] = near.back();
+                        near.pop_back();
+                    } else {
+                        k++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool ReachCache::lookup(const Field &field, const Unit *u, MarkPlane &reachable) {
+    sync(field);
+    size_t s = used == 0 ? 0 : slotOf(makeKey(u));
+    const Entry *e = used == 0 || keys[s].unit == nullptr ? nullptr : &entries[slots[s]];
+    if (e == nullptr || e->pts != u->getMovPoints()) {
+        misses++;
+        return false;
+    }
+
+    long long width = field.getWidth();
+    reachable.clear();
+    for (size_t k = 0; k < e->cells.size(); k++)
+        reachable.mark(int(e->cells[k] / width), int(e->cells[k] % width));
+    hits++;
+    return true;
+}
+
+void ReachCache::store(const Field &field, const Unit *u, const MarkPlane &reachable) {
+    sync(field);
+    Key key = makeKey(u);
+    // Keep the table at most half full
+    if (keys.size() < 2 * (used + 1)) grow();
+    size_t s = slotOf(key);
+    if (keys[s].unit == nullptr) {
+        if (spare.empty()) {
+            spare.reserve(entries.size() + 1);
+            spare.push_back(entries.size());
+            entries.push_back(Entry());
+        }
+        keys[s] = key;
+        slots[s] = spare.back();
+        spare.pop_back();
+        used++;
+        buckets[bucketOf(key.row, key.col)].push_back(key);
+    }
+
+    Entry &entry = entries[slots[s]];
+    entry.pts = u->getMovPoints();
+    maxPts = max(maxPts, entry.pts);
+    // Room for the most squares any unit stored so far can reach,
+    // so that the list never grows again once the game is warm
+    roomPts = max(roomPts, entry.pts);
+    entry.cells.reserve(2 * size_t(roomPts) * (roomPts + 1) + 1);
+    entry.cells.clear();
+    long long width = field.getWidth();
+    for (size_t k = 0; k < reachable.count(); k++)
+        entry.cells.push_back(reachable.markedRow(k) * width + reachable.markedCol(k));
+}
+
+unsigned long long ReachCache::getHits() const {
+    return hits;
+}
+
+unsigned long long ReachCache::getMisses() const {
+    return misses;
+}
+
+unsigned long long ReachCache::getInvalidations() const {
+    return invalidations;
+}
+
+size_t ReachCache::size() const {
+    return used;
+}
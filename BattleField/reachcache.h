@@ -0,0 +1,74 @@
+#ifndef REACHCACHE_H_INCLUDED
+#define REACHCACHE_H_INCLUDED
+
+/**** Remember reachable squares between turns ****/
+#include <unordered_map>
+#include <vector>
+#include "field.h"
+
+class MarkPlane;
+
+/* Reachable squares of units, keyed by unit, position and movement class.
+   A result only depends on the squares within the movement points of
+   the unit, so an entry is dropped only when the field reports a change
+   inside that radius. A unit which does not move and has nothing
+   happening around it is never searched again. */
+class ReachCache {
+public:
+    ReachCache();
+
+    // Fill reachable with the cached result for unit u
+    // Return false on a miss
+    bool lookup(const Field &field, const Unit *u, MarkPlane &reachable);
+    // Remember the result of a search for unit u
+    void store(const Field &field, const Unit *u, const MarkPlane &reachable);
+
+    // Forget everything
+    void clear();
+
+    unsigned long long getHits() const;
+    unsigned long long getMisses() const;
+    unsigned long long getInvalidations() const;
+    size_t size() const;
+
+private:
+    struct Key {
+        const Unit *unit;
+        int row, col;
+        bool ground;
+        bool operator==(const Key &other) const;
+    };
+    struct Entry {
+        int pts;                // movement points, i.e. the radius
+        std::vector<long long> cells; // row * width + col, in marking order
+    };
+
+    // Drop the entries touched by the changes of the field
+    void sync(const Field &field);
+    Key makeKey(const Unit *u) const;
+    long long bucketOf(int row, int col) const;
+    static size_t hashKey(const Key &k);
+    size_t slotOf(const Key &k) const;
+    void erase(size_t s);
+    void grow();
+
+    // Open addressing on the key. An entry dropped goes back to the spare
+    // ones with the room of its cells, and the buckets keep theirs when
+    // emptied, so a game played again does not touch the heap.
+    std::vector<Key> keys;        // unit nullptr if the slot is free
+    std::vector<size_t> slots;    // entry of the key of each slot
+    std::vector<Entry> entries;
+    std::vector<size_t> spare;    // entries not in use
+    size_t used;
+    // Keys by the area of their position, so a change only checks its neighbours
+    std::unordered_map<long long, std::vector<Key> > buckets;
+    std::vector<long long> changes;
+
+    unsigned long long owner; // id of the field
+    unsigned long long seen; // version of owner already applied
+    int maxPts;
+    int roomPts; // most movement points ever stored
+    unsigned long long hits, misses, invalidations;
+};
+
+#endif // REACHCACHE_H_INCLUDED
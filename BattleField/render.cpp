@@ -0,0 +1,297 @@
+#include <algorithm>
+#include "render.h"
+
+using namespace std;
+
+FrameRenderer::FrameRenderer(FrameMode mode, int keyframeInterval) :
+    mode(mode), interval(keyframeInterval), keyNeeded(true), sinceKey(0),
+    frames(0), keyframes(0), height(0), width(0),
+    viewRows(0), viewCols(0), margin(0), keyLines(0) {
+    window.top = window.left = window.rows = window.cols = 0;
+}
+
+void FrameRenderer::requestKeyframe() {
+    keyNeeded = true;
+}
+
+void FrameRenderer::setViewport(int rows, int cols, int m) {
+    viewRows = max(rows, 0);
+    viewCols = max(cols, 0);
+    margin = max(m, 0);
+    keyNeeded = true;
+}
+
+int FrameRenderer::getFrames() const {
+    return frames;
+}
+
+int FrameRenderer::getKeyframes() const {
+    return keyframes;
+}
+
+Viewport centerViewport(int h, int w, int row, int col, int rows, int cols) {
+    Viewport view;
+    view.rows = min(rows, h);
+    view.cols = min(cols, w);
+    view.top = min(max(row - view.rows / 2, 0), h - view.rows);
+    view.left = min(max(col - view.cols / 2, 0), w - view.cols);
+    return view;
+}
+
+Viewport FrameRenderer::chooseWindow(const Field &field, const Viewport &box, int focusRow, int focusCol) const {
+    int h = field.getHeight();
+    int w = field.getWidth();
+    if (viewRows == 0 || viewCols == 0) {
+        Viewport all = {0, 0, h, w};
+        return all;
+    }
+    if (focusRow >= 0 && focusCol >= 0)
+        return centerViewport(h, w, focusRow, focusCol, viewRows, viewCols);
+
+    if (box.rows == 0) {
+        // Nothing marked, keep the last window if it still fits
+        if (window.rows > 0 && window.top + window.rows <= h && window.left + window.cols <= w)
+            return window;
+        return centerViewport(h, w, 0, 0, viewRows, viewCols);
+    }
+
+    int top = box.top, bottom = box.top + box.rows - 1;
+    int left = box.left, right = box.left + box.cols - 1;
+    Viewport view = centerViewport(h, w, (top + bottom) / 2, (left + right) / 2, viewRows, viewCols);
+    // Shrink to the box and its margin when the box is small
+    int boxTop = max(top - margin, 0), boxBottom = min(bottom + margin, h - 1);
+    int boxLeft = max(left - margin, 0), boxRight = min(right + margin, w - 1);
+    if (boxBottom - boxTop + 1 <= view.rows && boxRight - boxLeft + 1 <= view.cols) {
+        view.top = boxTop;
+        view.left = boxLeft;
+        view.rows = boxBottom - boxTop + 1;
+        view.cols = boxRight - boxLeft + 1;
+    }
+    return view;
+}
+
+// Print the whole window and remember its cells
+void FrameRenderer::keyframe(ostream &os, const Field &field, const SquareMarks &grd, dp_mode dp) {
+    height = field.getHeight();
+    width = field.getWidth();
+    last.resize(size_t(window.rows) * window.cols);
+    for (int i = 0; i < window.rows; i++)
+        for (int j = 0; j < window.cols; j++)
+            formatCell(field, grd, dp, window.top + i, window.left + j, last[size_t(i) * window.cols + j]);
+
+    if (mode == FRAME_ANSI) os << "\x1b[H\x1b[2J"; // cursor home, clear the screen
+    displayWindow(os, field, window, grd, dp);
+    keyLines = 2 * window.rows + 4;
+    if (window.rows < height || window.cols < width)
+        keyLines += displayMinimap(os, field, window, viewRows, viewCols, minimap);
+    keyNeeded = false;
+    sinceKey = 0;
+    keyframes++;
+}
+
+// Bounding box of the cells of a box and of (row, col)
+static void growBox(Viewport &box, int row, int col) {
+    if (box.rows == 0) {
+        Viewport one = {row, col, 1, 1};
+        box = one;
+        return;
+    }
+    int top = min(box.top, row), left = min(box.left, col);
+    box.rows = max(box.top + box.rows, row + 1) - top;
+    box.cols = max(box.left + box.cols, col + 1) - left;
+    box.top = top;
+    box.left = left;
+}
+
+// Bounding box of the marked cells of a plane, no rows if there is none
+static Viewport boxOf(const MarkPlane &marks) {
+    Viewport box = {0, 0, 0, 0};
+    for (size_t k = 0; k < marks.count(); k++)
+        growBox(box, marks.markedRow(k), marks.markedCol(k));
+    return box;
+}
+
+void FrameRenderer::render(ostream &os, const Field &field, const MarkPlane &marks, dp_mode dp,
+                           int focusRow, int focusCol) {
+    renderFrame(os, field, marks, boxOf(marks), dp, focusRow, focusCol);
+}
+
+void FrameRenderer::renderUnmarked(ostream &os, const Field &field, const MarkPlane &follow) {
+    renderFrame(os, field, Grid<bool>(), boxOf(follow), DP_DEFAULT, -1, -1);
+}
+
+void FrameRenderer::renderFrame(ostream &os, const Field &field, const SquareMarks &grd, const Viewport &box,
+                                dp_mode dp, int focusRow, int focusCol) {
+    if (!os) return;
+    frames++;
+    sinceKey++;
+    Viewport view = chooseWindow(field, box, focusRow, focusCol);
+    bool moved = view.top != window.top || view.left != window.left
+              || view.rows != window.rows || view.cols != window.cols;
+    window = view;
+    if (mode == FRAME_FULL) {
+        displayWindow(os, field, window, grd, dp);
+        if (window.rows < int(field.getHeight()) || window.cols < int(field.getWidth()))
+            displayMinimap(os, field, window, viewRows, viewCols, minimap);
+        return;
+    }
+    if (keyNeeded || moved || int(field.getHeight()) != height || int(field.getWidth()) != width
+        || (interval > 0 && sinceKey >= interval)) {
+        keyframe(os, field, grd, dp);
+        return;
+    }
+
+    // Collect the updates, count them for the header of a delta
+    int indent = rowLabelWidth(window);
+    buf.clear();
+    int changes = 0;
+    for (int i = 0; i < window.rows; i++)
+        for (int j = 0; j < window.cols; j++) {
+            string &old = last[size_t(i) * window.cols + j];
+            formatCell(field, grd, dp, window.top + i, window.left + j, cell);
+            if (cell == old) continue;
+            if (mode == FRAME_ANSI && (cell.size() != 3 || old.size() != 3)) {
+                // A wider cell shifts the rest of the row, redraw everything
+                keyframe(os, field, grd, dp);
+                return;
+            }
+            old = cell;
+            changes++;
+            if (mode == FRAME_DELTA) {
+                buf += to_string(window.top + i);
+                buf += ' ';
+                buf += to_string(window.left + j);
+                buf += " |";
+                buf += cell;
+                buf += "|\n";
+            } else {
+                // Row i of the window is on line 4 + 2i of a keyframe,
+                // cell j starts right after the row numbers and j + 1 bars
+                buf += "\x1b[";
+                buf += to_string(4 + 2 * i);
+                buf += ';';
+                buf += to_string(indent + 2 + 4 * j);
+                buf += 'H';
+                buf += cell;
+            }
+        }
+
+    if (mode == FRAME_DELTA) {
+        os << "delta " << changes << '\n';
+        os.write(buf.data(), buf.size());
+    } else {
+        // Go back under the keyframe and clear the old prompts
+        buf += "\x1b[";
+        buf += to_string(keyLines + 1);
+        buf += ";1H\x1b[J";
+        os.write(buf.data(), buf.size());
+    }
+}
+
+int displayMinimap(ostream &os, const Field &field, const Viewport &view, int maxRows, int maxCols) {
+    MinimapCounts counts;
+    return displayMinimap(os, field, view, maxRows, maxCols, counts);
+}
+
+int displayMinimap(ostream &os, const Field &field, const Viewport &view, int maxRows, int maxCols,
+                   MinimapCounts &counts) {
+    int h = field.getHeight();
+    int w = field.getWidth();
+    maxRows = max(maxRows, 1);
+    maxCols = max(maxCols, 1);
+    int block = max((h + maxRows - 1) / maxRows, (w + maxCols - 1) / maxCols);
+    block = max(block, 1);
+    counts.update(field, block);
+    int rows = counts.getRows();
+    int cols = counts.getCols();
+
+    os << "Minimap of " << h << "x" << w << ", one character per " << block << "x" << block
+       << " squares, window at rows " << view.top << "-" << view.top + view.rows - 1
+       << ", columns " << view.left << "-" << view.left + view.cols - 1 << ":" << endl;
+    string line;
+    line = "+" + string(cols, '-') + "+";
+    os << line << endl;
+    for (int i = 0; i < rows; i++) {
+        line = "|";
+        for (int j = 0; j < cols; j++) {
+            int n = counts.count(i, j);
+            line += n == 0 ? ' ' : n == 1 ? '.' : n <= 3 ? ':' : n <= 9 ? '*' : '#';
+        }
+        line += '|';
+        os << line << endl;
+    }
+    os << "+" << string(cols, '-') << "+" << endl;
+    return rows + 3;
+}
+
+bool parseFrameMode(const string &name, FrameMode &mode) {
+    if (name == "full")
+        mode = FRAME_FULL;
+    else if (name == "delta")
+        mode = FRAME_DELTA;
+    else if (name == "ansi")
+        mode = FRAME_ANSI;
+    else
+        return false;
+    return true;
+}
+
+/** MinimapCounts **/
+
+MinimapCounts::MinimapCounts() :
+    height(0), width(0), block(0), rows(0), cols(0), owner(0), seen(0) {
+}
+
+int MinimapCounts::getRows() const {
+    return rows;
+}
+
+int MinimapCounts::getCols() const {
+    return cols;
+}
+
+int MinimapCounts::count(int i, int j) const {
+    return counts[size_t(i) * cols + j];
+}
+
+void MinimapCounts::add(long long square, int n) {
+    counts[size_t(square / width / block) * cols + square % width / block] += n;
+}
+
+void MinimapCounts::update(const Field &field, int b) {
+    int h = field.getHeight(), w = field.getWidth();
+    if (owner == field.getId() && h == height && w == width && b == block && field.getChangesSince(seen, changes)) {
+        seen = field.getVersion();
+        for (size_t k = 0; k < changes.size(); k++) {
+            long long square = changes[k];
+            bool now = field.getUnit(int(square / w), int(square % w)) != nullptr;
+            bool was = occupied.count(square) != 0;
+            if (now && !was) {
+                occupied.insert(square);
+                add(square, 1);
+            } else if (was && !now) {
+                occupied.erase(square);
+                add(square, -1);
+            }
+        }
+        return;
+    }
+
+    // Count everything again
+    owner = field.getId();
+    seen = field.getVersion();
+    height = h;
+    width = w;
+    block = max(b, 1);
+    rows = (h + block - 1) / block;
+    cols = (w + block - 1) / block;
+    counts.assign(size_t(rows) * cols, 0);
+    occupied.clear();
+    vector<Unit *> units;
+    field.getUnits(units);
+    for (size_t k = 0; k < units.size(); k++) {
+        long long square = (long long)units[k]->getRow() * w + units[k]->getCol();
+        occupied.insert(square);
+        add(square, 1);
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef RENDER_H_INCLUDED
+#define RENDER_H_INCLUDED
+
+/**** Incremental display of the board ****/
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "field.h"
+#include "engine.h"
+#include "workspace.h"
+
+// How a FrameRenderer prints the frames after a keyframe
+enum FrameMode { FRAME_FULL,  // every frame as displayField prints it
+                 FRAME_DELTA, // only the changed cells, as text updates
+                 FRAME_ANSI,  // only the changed cells, redrawn in place on a terminal
+};
+
+// Frames between two keyframes by default
+const int DEFAULT_KEYFRAME_INTERVAL = 50;
+
+/* Units per block of squares of a field, as the minimap shows them.
+   The counts follow the change log of the field, so bringing them up
+   to date costs the squares changed since, not the board; only
+   another field, a lost log or another block size counts them again. */
+class MinimapCounts {
+public:
+    MinimapCounts();
+
+    // Count the units of field by blocks of block x block squares
+    void update(const Field &field, int block);
+
+    int getRows() const;
+    int getCols() const;
+    // Units in the block (i, j)
+    int count(int i, int j) const;
+
+private:
+    int height, width, block, rows, cols;
+    unsigned long long owner; // id of the field
+    unsigned long long seen;  // version of owner already counted
+    std::unordered_set<long long> occupied; // squares with a unit, row * width + col
+    std::vector<int> counts;
+    std::vector<long long> changes;
+
+    void add(long long square, int n);
+};
+
+/* Prints successive boards, remembering the last one printed.
+   A keyframe is the board as displayField prints it. Other frames are
+   either full boards (FRAME_FULL), or the cells which changed:
+     FRAME_DELTA:  a line "delta n", then n lines "row col |cell|"
+                   where cell is the text between the bars of the board;
+     FRAME_ANSI:   escape sequences which move the cursor to every changed
+                   cell and rewrite it, the screen is cleared at keyframes.
+   So the bytes of a frame grow with the changes, not with the board.
+
+   With a viewport, only a window of the board is printed, followed by
+   a minimap of the whole board at every keyframe. The window is centered
+   on the focus of the frame (e.g. the unit which moves), otherwise it
+   covers the marked squares plus a margin, otherwise it stays where it was.
+   A window which moves starts a keyframe. A frame costs the window,
+   the minimap and the marked squares, which come as a MarkPlane
+   so that they are never searched for on the board. */
+class FrameRenderer {
+public:
+    // A keyframe every keyframeInterval frames, or only on request if <= 0
+    explicit FrameRenderer(FrameMode mode, int keyframeInterval = DEFAULT_KEYFRAME_INTERVAL);
+
+    // Print the next frame
+    void render(std::ostream &os, const Field &field, const MarkPlane &marks, dp_mode dp,
+                int focusRow = -1, int focusCol = -1);
+    // Print the next frame without marks, the window covering
+    // the marked squares of follow (e.g. the units which may act)
+    void renderUnmarked(std::ostream &os, const Field &field, const MarkPlane &follow);
+
+    // Only print windows of at most rows x cols squares,
+    // keeping margin squares around the marked ones
+    void setViewport(int rows, int cols, int margin = 2);
+
+    // Make the next frame a keyframe
+    void requestKeyframe();
+
+    int getFrames() const;
+    int getKeyframes() const;
+
+private:
+    FrameMode mode;
+    int interval;
+    bool keyNeeded;
+    int sinceKey; // frames since the last keyframe
+    int frames, keyframes;
+    int height, width;
+    int viewRows, viewCols, margin; // viewRows == 0 if there is no viewport
+    Viewport window;                // window of the last frame
+    int keyLines;                   // lines printed by the last keyframe
+    std::vector<std::string> last;  // cells of the last window, row-major
+    std::string cell;
+    std::string buf;
+    MinimapCounts minimap;
+
+    // Print a frame, box being the bounding box of the marked squares
+    // (no rows if none is marked)
+    void renderFrame(std::ostream &os, const Field &field, const SquareMarks &grd, const Viewport &box,
+                     dp_mode dp, int focusRow, int focusCol);
+    // Pick the window of a frame
+    Viewport chooseWindow(const Field &field, const Viewport &box, int focusRow, int focusCol) const;
+    void keyframe(std::ostream &os, const Field &field, const SquareMarks &grd, dp_mode dp);
+};
+
+// Window of at most rows x cols squares of an h x w field,
+// centered on (row, col) as far as the field allows
+Viewport centerViewport(int h, int w, int row, int col, int rows, int cols);
+
+// Print the number of units on the field, one character per block of squares:
+// ' ' for none, then '.', ':', '*' and '#' for 10 units or more.
+// The blocks are as small as possible within maxRows x maxCols characters.
+// Return the number of lines printed.
+int displayMinimap(std::ostream &os, const Field &field, const Viewport &view, int maxRows, int maxCols);
+// Same as above, with counts kept from one minimap to the next
+int displayMinimap(std::ostream &os, const Field &field, const Viewport &view, int maxRows, int maxCols,
+                   MinimapCounts &counts);
+
+// Parse "full", "delta" or "ansi", return false for other names
+bool parseFrameMode(const std::string &name, FrameMode &mode);
+
+#endif // RENDER_H_INCLUDED
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <random>
+#include "scenario.h"
+#include "batch.h"
+#include "engine.h"
+
+using namespace std;
+
+// Letters of the map format
+static const char TERRAIN_LETTERS[] = {'.', 'M', 'O', 'W'};
+static const char UNIT_LETTERS[] = {'S', 'T', 'B', 'F', 'H'};
+
+ScenarioParams::ScenarioParams() :
+    height(8), width(8), seed(1), shape(SHAPE_MIXED),
+    mountains(0.1), oceans(0.05), forests(0.05), clustering(0),
+    rounds(10), actions(4) {
+    // Same units as the demo map
+    units[SOLDIER] = 2;
+    units[TANK] = 1;
+    units[BEE] = 2;
+    units[FLIGHTER] = 1;
+    units[HYDRAULISK] = 1;
+}
+
+// Draws which do not depend on the standard library,
+// so a seed gives the same scenario everywhere
+static int draw(mt19937 &rng, int n) {
+    return int(rng() % unsigned(n));
+}
+
+// Paint patches of terrain t over PLAIN squares until `want` squares are painted.
+// A patch is a random walk of `size` steps, so the larger the size,
+// the larger and fewer the patches.
+static void paintPatches(int h, int w, TerrainType t, long long want, long long size,
+                         mt19937 &rng, vector<TerrainType> &terrain) {
+    const int dr[] = {-1, 1, 0, 0};
+    const int dc[] = {0, 0, -1, 1};
+    long long steps = 8 * (long long)terrain.size(); // gives up on a full board
+    while (want > 0 && steps > 0) {
+        int r = draw(rng, h), c = draw(rng, w);
+        for (long long n = 0; n < size && want > 0 && steps > 0; n++, steps--) {
+            TerrainType &square = terrain[size_t(r) * w + c];
+            if (square == PLAIN) {
+                square = t;
+                want--;
+            }
+            int d = draw(rng, 4);
+            r = min(max(r + dr[d], 0), h - 1);
+            c = min(max(c + dc[d], 0), w - 1);
+        }
+    }
+}
+
+// Patches of each terrain covering its share of the board
+static void randomTerrain(const ScenarioParams &p, double forests, mt19937 &rng, vector<TerrainType> &terrain) {
+    long long size = 1LL << (2 * min(max(p.clustering, 0), 15));
+    double area = double(terrain.size());
+    paintPatches(p.height, p.width, MOUNTAIN, (long long)(p.mountains * area), size, rng, terrain);
+    paintPatches(p.height, p.width, OCEAN, (long long)(p.oceans * area), size, rng, terrain);
+    paintPatches(p.height, p.width, FOREST, (long long)(forests * area), size, rng, terrain);
+}
+
+// Every third row is a wall of mountains with one gap
+static void rayTerrain(int h, int w, mt19937 &rng, vector<TerrainType> &terrain) {
+    for (int i = 2; i < h; i += 3) {
+        for (int j = 0; j < w; j++)
+            terrain[size_t(i) * w + j] = MOUNTAIN;
+        terrain[size_t(i) * w + draw(rng, w)] = PLAIN;
+    }
+}
+
+// Carve a maze out of mountains with a randomized depth-first search.
+// Rooms are the squares of even row and column, corridors join them.
+static void mazeTerrain(int h, int w, mt19937 &rng, vector<TerrainType> &terrain) {
+    fill(terrain.begin(), terrain.end(), MOUNTAIN);
+    int rows = (h + 1) / 2, cols = (w + 1) / 2;
+    vector<bool> visited(size_t(rows) * cols, false);
+    vector<int> stack;
+    stack.push_back(0);
+    visited[0] = true;
+    terrain[0] = PLAIN;
+    const int dr[] = {-1, 1, 0, 0};
+    const int dc[] = {0, 0, -1, 1};
+    while (!stack.empty()) {
+        int cell = stack.back();
+        int r = cell / cols, c = cell % cols;
+        int next[4], n = 0;
+        for (int d = 0; d < 4; d++) {
+            int nr = r + dr[d], nc = c + dc[d];
+            if (nr >= 0 && nr < rows && nc >= 0 && nc < cols && !visited[size_t(nr) * cols + nc])
+                next[n++] = d;
+        }
+        if (n == 0) {
+            stack.pop_back();
+            continue;
+        }
+        int d = next[draw(rng, n)];
+        int nr = r + dr[d], nc = c + dc[d];
+        visited[size_t(nr) * cols + nc] = true;
+        terrain[size_t(2 * r + dr[d]) * w + 2 * c + dc[d]] = PLAIN;
+        terrain[size_t(2 * nr) * w + 2 * nc] = PLAIN;
+        stack.push_back(nr * cols + nc);
+    }
+}
+
+// Check if a unit of type t may stand on terrain
+static bool canStand(UnitType t, TerrainType terrain) {
+    if (terrain == PLAIN) return true;
+    return isGroundMover(t) ? terrain == FOREST : terrain == OCEAN;
+}
+
+// Find a free square for a unit of type t, or return -1
+static int findSquare(const Scenario &s, const vector<bool> &occupied, UnitType t, mt19937 &rng) {
+    int area = s.height * s.width;
+    for (int tries = 0; tries < 32; tries++) {
+        int k = draw(rng, area);
+        if (!occupied[k] && canStand(t, s.terrain[k])) return k;
+    }
+    // Crowded board, scan from a random square
+    int start = draw(rng, area);
+    for (int n = 0; n < area; n++) {
+        int k = (start + n) % area;
+        if (!occupied[k] && canStand(t, s.terrain[k])) return k;
+    }
+    return -1;
+}
+
+static void placeUnit(Scenario &s, vector<bool> &occupied, int k, UnitType t) {
+    ScenarioUnit u;
+    u.row = k / s.width;
+    u.col = k % s.width;
+    u.type = t;
+    s.units.push_back(u);
+    occupied[k] = true;
+}
+
+void generateScenario(const ScenarioParams &p, Scenario &s) {
+    mt19937 rng(p.seed);
+    s.height = max(p.height, 1);
+    s.width = max(p.width, 1);
+    s.terrain.assign(size_t(s.height) * s.width, PLAIN);
+    s.units.clear();
+
+    switch (p.shape) {
+    case SHAPE_MIXED:
+        randomTerrain(p, p.forests, rng, s.terrain);
+        break;
+    case SHAPE_FORESTS:
+        // All but a tenth of the squares left by mountains and oceans
+        randomTerrain(p, max(0.9 - p.mountains - p.oceans, 0.0), rng, s.terrain);
+        break;
+    case SHAPE_RAYS:
+        rayTerrain(s.height, s.width, rng, s.terrain);
+        break;
+    case SHAPE_MAZE:
+        mazeTerrain(s.height, s.width, rng, s.terrain);
+        break;
+    }
+
+    vector<bool> occupied(s.terrain.size(), false);
+    for (int t = 0; t < UNIT_TYPES; t++) {
+        UnitType type = UnitType(t);
+        for (int n = 0; n < p.units[t]; n++) {
+            int k = -1;
+            if (p.shape == SHAPE_RAYS && type == TANK) {
+                // At either end of an open row, facing along it
+                int row = draw(rng, s.height);
+                if (row % 3 != 2) k = row * s.width + (n % 2 == 0 ? 0 : s.width - 1);
+                if (k >= 0 && occupied[k]) k = -1;
+            }
+            if (k < 0) k = findSquare(s, occupied, type, rng);
+            if (k < 0) break;
+            placeUnit(s, occupied, k, type);
+        }
+    }
+}
+
+void writeScenarioMap(ostream &os, const Scenario &s) {
+    size_t terrains = s.terrain.size() - count(s.terrain.begin(), s.terrain.end(), PLAIN);
+    os << terrains << " " << s.units.size() << "\n";
+    for (int i = 0; i < s.height; i++)
+        for (int j = 0; j < s.width; j++) {
+            TerrainType t = s.terrain[size_t(i) * s.width + j];
+            if (t != PLAIN) os << i << " " << j << " " << TERRAIN_LETTERS[t] << "\n";
+        }
+    for (size_t k = 0; k < s.units.size(); k++)
+        os << s.units[k].row << " " << s.units[k].col << " " << UNIT_LETTERS[s.units[k].type] << "\n";
+}
+
+void writeScenarioCommands(ostream &os, const Scenario &s, const ScenarioParams &p) {
+    if (p.actions <= 0) {
+        for (int r = 0; r < p.rounds; r++)
+            os << "y\n";
+        return;
+    }
+
+    Field field(s.height, s.width);
+    for (int i = 0; i < s.height; i++)
+        for (int j = 0; j < s.width; j++)
+            if (s.terrain[size_t(i) * s.width + j] != PLAIN)
+                field.setTerrain(i, j, s.terrain[size_t(i) * s.width + j]);
+    for (size_t k = 0; k < s.units.size(); k++)
+        field.setUnit(s.units[k].row, s.units[k].col, s.units[k].type);
+
+    mt19937 rng(p.seed + 1); // not the draws of the map
+    TurnWorkspace ws(s.height, s.width);
+    PlaySession session(0);
+    vector<UnitAction> legal;
+    vector<Unit *> &all = ws.players;
+    for (int r = 0; r < p.rounds; r++) {
+        resetUnits(field);
+        countUnits(field, session.stats);
+        if (session.stats.playerUnits == 0 || session.stats.enemyUnits == 0) break;
+
+        for (int n = 0; n < p.actions; n++) {
+            getLegalActions(field, true, ws, legal);
+            if (legal.empty()) break;
+            const UnitAction &a = legal[draw(rng, int(legal.size()))];
+            // MOVE comes first in the list of actions while the unit has not moved
+            int choice = a.act == MOVE || field.getUnit(a.row, a.col)->hasMoved() ? 1 : 2;
+            os << "n\n" << a.row << " " << a.col << "\n" << choice << "\n" << a.trow << " " << a.tcol << "\n";
+            applyAction(field, true, a, ws);
+        }
+
+        // The prompt only comes while a unit may still act
+        field.getUnits(all);
+        for (size_t k = 0; k < all.size(); k++)
+            if (all[k]->getSide() && (!all[k]->hasMoved() || !all[k]->hasAttacked())) {
+                os << "y\n";
+                break;
+            }
+        playEnemyTurn(field, session, ws);
+        healByForests(field);
+    }
+}
+
+bool parseScenarioShape(const string &name, ScenarioShape &shape) {
+    if (name == "mixed")
+        shape = SHAPE_MIXED;
+    else if (name == "rays")
+        shape = SHAPE_RAYS;
+    else if (name == "forest")
+        shape = SHAPE_FORESTS;
+    else if (name == "maze")
+        shape = SHAPE_MAZE;
+    else
+        return false;
+    return true;
+}
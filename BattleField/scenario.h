@@ -0,0 +1,61 @@
+#ifndef SCENARIO_H_INCLUDED
+#define SCENARIO_H_INCLUDED
+
+/**** Generated maps and command scripts for stress tests ****/
+#include <iostream>
+#include <string>
+#include <vector>
+#include "terrain.h"
+#include "unit.h"
+
+// Layout of the terrain of a generated map
+enum ScenarioShape { SHAPE_MIXED,   // random terrains in the given shares
+                     SHAPE_RAYS,    // long open rows between mountain walls, tanks at their ends
+                     SHAPE_FORESTS, // mostly forest, so every round heals almost every unit
+                     SHAPE_MAZE,    // one-square corridors between mountains
+};
+
+/* What to generate. The same parameters always give the same scenario. */
+struct ScenarioParams {
+    ScenarioParams();
+
+    int height, width;
+    unsigned seed;
+    ScenarioShape shape;
+    double mountains, oceans, forests; // shares of the squares (SHAPE_MIXED, SHAPE_FORESTS)
+    int clustering;                    // patches of about 4^clustering squares, 0 for single squares
+    int units[UNIT_TYPES];             // units per UnitType; the type decides the side
+    int rounds;                        // rounds answered by the command script
+    int actions;                       // random player actions per round, 0 only ends turns
+};
+
+// A unit of a generated map
+struct ScenarioUnit {
+    int row, col;
+    UnitType type;
+};
+
+// A generated map
+struct Scenario {
+    int height, width;
+    std::vector<TerrainType> terrain; // row-major
+    std::vector<ScenarioUnit> units;  // in the order they were placed
+};
+
+// Generate the terrain, then place the units on free squares they can stand on.
+// Fewer units are placed if the board runs out of such squares.
+void generateScenario(const ScenarioParams &params, Scenario &scenario);
+
+// Write the scenario in the format read by loadMap
+void writeScenarioMap(std::ostream &os, const Scenario &scenario);
+
+// Write answers for play() on the scenario: every round, `actions` legal
+// moves or attacks drawn at random, then the end of the turn.
+// The game is played alongside to keep the answers legal, so this costs
+// as much as playing it; with no actions the script is only "y" lines.
+void writeScenarioCommands(std::ostream &os, const Scenario &scenario, const ScenarioParams &params);
+
+// Parse "mixed", "rays", "forest" or "maze", return false for other names
+bool parseScenarioShape(const std::string &name, ScenarioShape &shape);
+
+#endif // SCENARIO_H_INCLUDED
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "selfplay.h"
+#include "engine.h"
+#include "workspace.h"
+
+using namespace std;
+
+// Games taken from the shared counter at a time
+static const long long CHUNK = 64;
+
+static void clearStats(SelfPlayStats &st) {
+    st.games = st.won = st.lost = st.unfinished = st.rounds = 0;
+    st.minRounds = st.maxRounds = 0;
+    st.reachHits = st.reachMisses = 0;
+    st.plansReplayed = st.plansEvaluated = 0;
+    st.steadyAllocs = 0;
+    st.seconds = 0;
+}
+
+static void addGame(SelfPlayStats &st, const GameOutcome &res) {
+    if (st.games == 0 || res.rounds < st.minRounds) st.minRounds = res.rounds;
+    if (st.games == 0 || res.rounds > st.maxRounds) st.maxRounds = res.rounds;
+    st.games++;
+    st.rounds += res.rounds;
+    if (res.winner == 1)
+        st.won++;
+    else if (res.winner == 0)
+        st.lost++;
+    else
+        st.unfinished++;
+}
+
+static void mergeStats(SelfPlayStats &st, const SelfPlayStats &other) {
+    st.reachHits += other.reachHits;
+    st.reachMisses += other.reachMisses;
+    st.plansReplayed += other.plansReplayed;
+    st.plansEvaluated += other.plansEvaluated;
+    st.steadyAllocs = max(st.steadyAllocs, other.steadyAllocs);
+    if (other.games == 0) return;
+    if (st.games == 0 || other.minRounds < st.minRounds) st.minRounds = other.minRounds;
+    if (st.games == 0 || other.maxRounds > st.maxRounds) st.maxRounds = other.maxRounds;
+    st.games += other.games;
+    st.won += other.won;
+    st.lost += other.lost;
+    st.unfinished += other.unfinished;
+    st.rounds += other.rounds;
+}
+
+// Play games until the counter runs out
+// The board, the workspace and the controllers are reused by every game
+static void selfPlayWorker(const Field &start, PlayerPolicy policy, long long games,
+                           int maxRounds, unsigned seed, atomic<long long> &next,
+                           SelfPlayStats &st) {
+    Field field(start);
+    TurnWorkspace ws(field.getHeight(), field.getWidth());
+    EnemyController enemy(ws);
+    GreedyController greedy;
+    RandomController random(seed);
+    Controller &player = policy == POLICY_GREEDY ? static_cast<Controller &>(greedy) : random;
+
+    while (true) {
+        long long first = next.fetch_add(CHUNK);
+        if (first >= games) break;
+        long long last = min(games, first + CHUNK);
+        for (long long k = first; k < last; k++) {
+            field = start;
+            random.reseed(seed + unsigned(k));
+            addGame(st, playHeadless(field, player, enemy, ws, maxRounds));
+            // The caches fill up through the first game
+            if (st.games == 1) ws.startSteadyState();
+        }
+    }
+    st.reachHits = ws.reach.getHits();
+    st.reachMisses = ws.reach.getMisses();
+    st.plansReplayed = ws.plans.getReplayed();
+    st.plansEvaluated = ws.plans.getEvaluated();
+    st.steadyAllocs = ws.getSteadyAllocs();
+}
+
+SelfPlayStats runSelfPlay(const Field &start, PlayerPolicy policy, long long games,
+                          int threads, int maxRounds, unsigned seed) {
+    typedef chrono::steady_clock Clock;
+    Clock::time_point t0 = Clock::now();
+
+    int workers = max(1, threads);
+    atomic<long long> next(0);
+    vector<SelfPlayStats> part(workers);
+    for (int t = 0; t < workers; t++)
+        clearStats(part[t]);
+
+    if (workers == 1) {
+        selfPlayWorker(start, policy, games, maxRounds, seed, next, part[0]);
+    } else {
+        vector<thread> pool;
+        for (int t = 0; t < workers; t++)
+            pool.push_back(thread(selfPlayWorker, cref(start), policy, games, maxRounds, seed,
+                                  ref(next), ref(part[t])));
+        for (size_t t = 0; t < pool.size(); t++)
+            pool[t].join();
+    }
+
+    SelfPlayStats st;
+    clearStats(st);
+    for (int t = 0; t < workers; t++)
+        mergeStats(st, part[t]);
+    st.seconds = chrono::duration<double>(Clock::now() - t0).count();
+    return st;
+}
+
+void printSelfPlayStats(ostream &os, const string &name, const SelfPlayStats &st) {
+    double games = st.games > 0 ? double(st.games) : 1;
+    os << name << ": " << st.games << " games, "
+       << "won " << 100.0 * st.won / games << "%, "
+       << "lost " << 100.0 * st.lost / games << "%, "
+       << "unfinished " << 100.0 * st.unfinished / games << "%, "
+       << "rounds avg " << st.rounds / games
+       << " min " << st.minRounds << " max " << st.maxRounds << ", "
+       << (st.seconds > 0 ? st.rounds / st.seconds : 0) << " rounds/s, "
+       << "reach cache " << st.reachHits << " hits " << st.reachMisses << " misses, "
+       << "enemy moves " << st.plansReplayed << " replayed " << st.plansEvaluated << " evaluated";
+    if (allocCountingEnabled()) os << ", " << st.steadyAllocs << " allocations in a steady turn";
+    os << endl;
+}
@@ -0,0 +1,35 @@
+#ifndef SELFPLAY_H_INCLUDED
+#define SELFPLAY_H_INCLUDED
+
+/**** Headless games for balance testing ****/
+#include <iostream>
+#include <string>
+#include "field.h"
+#include "controller.h"
+
+// Results of many games on one map
+struct SelfPlayStats {
+    long long games;
+    long long won;        // by the player
+    long long lost;
+    long long unfinished; // stopped after the round limit
+    long long rounds;     // sum over all games
+    int minRounds, maxRounds;
+    unsigned long long reachHits, reachMisses; // reachability cache
+    unsigned long long plansReplayed, plansEvaluated; // enemy moves
+    unsigned long steadyAllocs; // most heap allocations of a turn after the first game of a thread
+    double seconds;
+};
+
+// Play games from the start position with the built-in enemy logic
+// against a player policy, spread over `threads` threads.
+// Game k of a random policy is seeded with seed + k,
+// so the results do not depend on the number of threads.
+SelfPlayStats runSelfPlay(const Field &start, PlayerPolicy policy, long long games,
+                          int threads, int maxRounds, unsigned seed);
+
+// Print win rate, game lengths and speed,
+// and the allocations of the turns if they are counted
+void printSelfPlayStats(std::ostream &os, const std::string &name, const SelfPlayStats &st);
+
+#endif // SELFPLAY_H_INCLUDED
@@ -0,0 +1,534 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <streambuf>
+#include <thread>
+#include "server.h"
+#include "engine.h"
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/** MapCache **/
+
+MapCache::MapCache(int h, int w) :
+    height(h), width(w) {
+}
+
+bool MapCache::load(const string &name) {
+    ifstream ifs(name);
+    if (!ifs) return false;
+    shared_ptr<Field> field(new Field(height, width));
+    loadMap(ifs, *field);
+    lock_guard<mutex> guard(lock);
+    maps[name] = field;
+    return true;
+}
+
+shared_ptr<const Field> MapCache::find(const string &name) const {
+    lock_guard<mutex> guard(lock);
+    map<string, shared_ptr<const Field>>::const_iterator it = maps.find(name);
+    return it == maps.end() ? shared_ptr<const Field>() : it->second;
+}
+
+void printServerStats(ostream &os, const ServerStats &stats) {
+    os << stats.sessions << " sessions: " << stats.won << " won, " << stats.failed << " failed, "
+       << stats.stopped << " stopped; " << stats.answers << " answers, ";
+    if (stats.answers > 0)
+        os << stats.busySeconds * 1e6 / stats.answers << " us per answer (max " << stats.maxLatencyUs << " us), ";
+    os << stats.bytesIn << " bytes in, " << stats.bytesOut << " bytes out" << endl;
+}
+
+#ifdef __linux__
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+/* Appends everything written to a string */
+class StringOutBuf : public streambuf {
+public:
+    explicit StringOutBuf(string &s) :
+        s(s) {
+    }
+
+protected:
+    int_type overflow(int_type c) {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) s += traits_type::to_char_type(c);
+        return traits_type::not_eof(c);
+    }
+
+    streamsize xsputn(const char *p, streamsize n) {
+        s.append(p, size_t(n));
+        return n;
+    }
+
+private:
+    string &s;
+};
+
+// Result of scanning an answer in the bytes received so far
+enum Scan { SCAN_DONE, SCAN_MORE, SCAN_MALFORMED };
+
+bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// The next non-blank character, like `is >> c`
+Scan scanChar(const string &in, size_t &pos, char &c) {
+    size_t p = pos;
+    while (p < in.size() && isBlank(in[p]))
+        p++;
+    if (p == in.size()) return SCAN_MORE;
+    c = in[p];
+    pos = p + 1;
+    return SCAN_DONE;
+}
+
+// The next integer, like `is >> x`: a number is only complete
+// once something follows it, or once the input has ended
+Scan scanInt(const string &in, size_t &pos, bool ended, int &x) {
+    size_t p = pos;
+    while (p < in.size() && isBlank(in[p]))
+        p++;
+    if (p == in.size()) return SCAN_MORE;
+
+    bool negative = false;
+    if (in[p] == '+' || in[p] == '-') negative = in[p++] == '-';
+    long long value = 0;
+    bool digits = false;
+    for (; p < in.size() && in[p] >= '0' && in[p] <= '9'; p++) {
+        digits = true;
+        value = value * 10 + (in[p] - '0');
+        if (value > -(long long)INT_MIN) return SCAN_MALFORMED;
+    }
+    if (p == in.size() && !ended) return SCAN_MORE;
+    if (!digits) return SCAN_MALFORMED;
+    if (negative) value = -value;
+    if (value > INT_MAX) return SCAN_MALFORMED;
+    x = int(value);
+    pos = p;
+    return SCAN_DONE;
+}
+
+/* One connection and its game */
+struct Session {
+    Session(int fd, unsigned long id) :
+        fd(fd), id(id), inPos(0), inEnded(false), outPos(0), buf(out), os(&buf),
+        closing(false), polledOut(false), answers(0), bytesIn(0), bytesOut(0),
+        busy(0), maxLatency(0), start(Clock::now()) {
+    }
+
+    int fd;
+    unsigned long id;
+    string in;   // received, not answered yet from inPos
+    size_t inPos;
+    bool inEnded;
+    string out;  // to send from outPos
+    size_t outPos;
+    StringOutBuf buf;
+    ostream os;
+    string map;
+    unique_ptr<Field> field;
+    TurnWorkspace ws;
+    unique_ptr<GameMachine> game;
+    bool closing;   // close once the output is sent
+    bool polledOut; // waiting to be writable
+    unsigned long long answers, bytesIn, bytesOut;
+    double busy, maxLatency; // seconds
+    Clock::time_point start;
+};
+
+/* Everything shared by the workers */
+struct Server {
+    Server(const MapCache &maps, const ServerConfig &config, ServerStats &stats) :
+        maps(maps), config(config), stats(stats), listenFd(-1) {
+        stop.store(false);
+        nextId.store(0);
+        finished.store(0);
+    }
+
+    const MapCache &maps;
+    const ServerConfig &config;
+    ServerStats &stats;
+    mutex statsLock;
+    int listenFd;
+    atomic<bool> stop;
+    atomic<unsigned long> nextId;
+    atomic<unsigned long> finished;
+};
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Fill a socket address, return its length or 0 if the address is invalid
+socklen_t makeAddress(const string &address, sockaddr_storage &sa) {
+    memset(&sa, 0, sizeof(sa));
+    if (address.compare(0, 4, "tcp:") == 0) {
+        sockaddr_in *a = reinterpret_cast<sockaddr_in *>(&sa);
+        a->sin_family = AF_INET;
+        a->sin_port = htons((unsigned short)atoi(address.c_str() + 4));
+        a->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return sizeof(sockaddr_in);
+    }
+    sockaddr_un *a = reinterpret_cast<sockaddr_un *>(&sa);
+    if (address.empty() || address.size() >= sizeof(a->sun_path)) return 0;
+    a->sun_family = AF_UNIX;
+    memcpy(a->sun_path, address.data(), address.size());
+    return sizeof(sockaddr_un);
+}
+
+int listenOn(const string &address) {
+    sockaddr_storage sa;
+    socklen_t len = makeAddress(address, sa);
+    if (len == 0) return -1;
+    int fd = socket(sa.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (sa.ss_family == AF_INET) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    } else {
+        // Only a socket left behind by an earlier server is removed,
+        // never a file which happens to have the name
+        struct stat st;
+        if (lstat(address.c_str(), &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                close(fd);
+                return -1;
+            }
+            unlink(address.c_str());
+        }
+    }
+    if (bind(fd, reinterpret_cast<sockaddr *>(&sa), len) != 0 || listen(fd, 128) != 0 || !setNonBlocking(fd)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connectTo(const string &address) {
+    sockaddr_storage sa;
+    socklen_t len = makeAddress(address, sa);
+    if (len == 0) return -1;
+    int fd = socket(sa.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&sa), len) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        long done = send(fd, p, n, MSG_NOSIGNAL);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return false;
+        p += done;
+        n -= size_t(done);
+    }
+    return true;
+}
+
+// Take the bytes available on the socket
+void receive(Session &s) {
+    char chunk[1 << 16];
+    while (!s.inEnded) {
+        long got = recv(s.fd, chunk, sizeof(chunk), 0);
+        if (got > 0) {
+            s.in.append(chunk, size_t(got));
+            s.bytesIn += got;
+        } else if (got < 0 && errno == EINTR) {
+            continue;
+        } else if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else {
+            s.inEnded = true; // closed by the client, or broken
+        }
+    }
+}
+
+// Start the game on the map named by the first line
+void openGame(const Server &server, Session &s) {
+    size_t nl = s.in.find('\n', s.inPos);
+    if (nl == string::npos && !s.inEnded) return;
+    size_t end = nl == string::npos ? s.in.size() : nl;
+    string name = s.in.substr(s.inPos, end - s.inPos);
+    while (!name.empty() && isBlank(name[name.size() - 1]))
+        name.erase(name.size() - 1);
+    s.inPos = nl == string::npos ? s.in.size() : nl + 1;
+
+    shared_ptr<const Field> start = server.maps.find(name);
+    if (!start) {
+        s.os << "Unknown map: " << name << endl;
+        s.closing = true;
+        return;
+    }
+    s.map = name;
+    s.field.reset(new Field(*start));
+    s.game.reset(new GameMachine(*s.field, s.os, s.ws));
+}
+
+// Answer the prompts with every complete answer received
+void advance(const Server &server, Session &s) {
+    if (!s.game && !s.closing) openGame(server, s);
+    while (s.game && !s.game->isOver()) {
+        Clock::time_point t0 = Clock::now();
+        Scan r;
+        if (s.game->wantsChar()) {
+            char c;
+            r = scanChar(s.in, s.inPos, c);
+            if (r == SCAN_DONE) s.game->answerChar(c);
+        } else {
+            int x;
+            r = scanInt(s.in, s.inPos, s.inEnded, x);
+            if (r == SCAN_DONE) s.game->answerInt(x);
+        }
+        if (r == SCAN_MORE) {
+            if (s.inEnded) s.game->stop(PLAY_END_OF_INPUT);
+            break;
+        }
+        if (r == SCAN_MALFORMED) {
+            s.game->stop(PLAY_BAD_INPUT);
+            break;
+        }
+        double latency = chrono::duration<double>(Clock::now() - t0).count();
+        s.answers++;
+        s.busy += latency;
+        s.maxLatency = max(s.maxLatency, latency);
+    }
+    if (s.game && s.game->isOver()) s.closing = true;
+    if (s.inEnded && !s.game) s.closing = true;
+
+    s.in.erase(0, s.inPos);
+    s.inPos = 0;
+}
+
+// Send what the socket takes, return false if it is broken
+bool transmit(Session &s) {
+    while (s.outPos < s.out.size()) {
+        long done = send(s.fd, s.out.data() + s.outPos, s.out.size() - s.outPos, MSG_NOSIGNAL);
+        if (done > 0) {
+            s.outPos += size_t(done);
+            s.bytesOut += done;
+        } else if (done < 0 && errno == EINTR) {
+            continue;
+        } else if (done < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    if (s.outPos == s.out.size()) {
+        s.out.clear();
+        s.outPos = 0;
+    }
+    return true;
+}
+
+// Log the session and add it to the totals
+void retire(Server &server, Session &s) {
+    PlayStatus status = s.game ? s.game->getStats().status : PLAY_BAD_INPUT;
+    double seconds = chrono::duration<double>(Clock::now() - s.start).count();
+    lock_guard<mutex> guard(server.statsLock);
+    ServerStats &st = server.stats;
+    st.sessions++;
+    if (status == PLAY_WON)
+        st.won++;
+    else if (status == PLAY_FAILED)
+        st.failed++;
+    else
+        st.stopped++;
+    st.answers += s.answers;
+    st.bytesIn += s.bytesIn;
+    st.bytesOut += s.bytesOut;
+    st.busySeconds += s.busy;
+    st.maxLatencyUs = max(st.maxLatencyUs, s.maxLatency * 1e6);
+
+    if (server.config.log != nullptr) {
+        ostream &log = *server.config.log;
+        log << "session " << s.id << " (" << (s.map.empty() ? "no map" : s.map) << "): ";
+        if (s.game)
+            printPlayStats(log, s.game->getStats());
+        else
+            log << "no game" << endl;
+        log << "session " << s.id << ": " << s.answers << " answers in " << seconds << " s, ";
+        if (s.answers > 0)
+            log << s.busy * 1e6 / s.answers << " us per answer (max " << s.maxLatency * 1e6 << " us), ";
+        log << s.bytesIn << " bytes in, " << s.bytesOut << " bytes out" << endl;
+    }
+}
+
+// Accept every pending connection into this worker's epoll set
+void acceptAll(Server &server, int ep, vector<Session *> &sessions) {
+    while (true) {
+        int fd = accept(server.listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return; // EAGAIN: taken by another worker, or none left
+        }
+        if (!setNonBlocking(fd)) {
+            close(fd);
+            continue;
+        }
+        Session *s = new Session(fd, server.nextId++);
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = s;
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            delete s;
+            continue;
+        }
+        sessions.push_back(s);
+    }
+}
+
+// Serve a session after an event, return false once it is over
+bool serve(Server &server, int ep, Session &s) {
+    receive(s);
+    advance(server, s);
+    if (!transmit(s)) return false;
+    if (s.closing && s.out.empty()) return false;
+
+    // Only wait for what can move the session on
+    bool wantOut = !s.out.empty();
+    if (wantOut != s.polledOut || s.inEnded) {
+        epoll_event ev;
+        ev.events = 0;
+        if (!s.inEnded) ev.events |= EPOLLIN | EPOLLRDHUP;
+        if (wantOut) ev.events |= EPOLLOUT;
+        ev.data.ptr = &s;
+        epoll_ctl(ep, EPOLL_CTL_MOD, s.fd, &ev);
+        s.polledOut = wantOut;
+    }
+    return true;
+}
+
+void workerLoop(Server *server) {
+    int ep = epoll_create1(0);
+    if (ep < 0) return;
+    epoll_event ev;
+    ev.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+    ev.events |= EPOLLEXCLUSIVE; // wake one worker per connection
+#endif
+    ev.data.ptr = nullptr;
+    epoll_ctl(ep, EPOLL_CTL_ADD, server->listenFd, &ev);
+
+    vector<Session *> sessions;
+    epoll_event events[64];
+    while (!server->stop.load()) {
+        int n = epoll_wait(ep, events, 64, 100);
+        for (int k = 0; k < n; k++) {
+            Session *s = static_cast<Session *>(events[k].data.ptr);
+            if (s == nullptr) {
+                acceptAll(*server, ep, sessions);
+                continue;
+            }
+            if (serve(*server, ep, *s)) continue;
+
+            epoll_ctl(ep, EPOLL_CTL_DEL, s->fd, nullptr);
+            close(s->fd);
+            retire(*server, *s);
+            sessions.erase(find(sessions.begin(), sessions.end(), s));
+            delete s;
+            unsigned long done = ++server->finished;
+            if (server->config.limit > 0 && done >= server->config.limit) server->stop.store(true);
+        }
+    }
+
+    for (size_t k = 0; k < sessions.size(); k++) {
+        close(sessions[k]->fd);
+        delete sessions[k];
+    }
+    close(ep);
+}
+
+} // namespace
+
+bool runServer(const MapCache &maps, const ServerConfig &config, ServerStats &stats) {
+    memset(&stats, 0, sizeof(stats));
+    Server server(maps, config, stats);
+    server.listenFd = listenOn(config.address);
+    if (server.listenFd < 0) return false;
+
+    vector<thread> workers;
+    for (int i = 0; i < max(config.workers, 1); i++)
+        workers.push_back(thread(workerLoop, &server));
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    close(server.listenFd);
+    if (config.address.compare(0, 4, "tcp:") != 0) unlink(config.address.c_str());
+    return true;
+}
+
+bool runClient(const string &address, const string &map) {
+    int fd = connectTo(address);
+    if (fd < 0) return false;
+    string first = map + "\n";
+    sendAll(fd, first.data(), first.size());
+
+    pollfd fds[2];
+    fds[0].fd = 0; // standard input
+    fds[0].events = POLLIN;
+    fds[1].fd = fd;
+    fds[1].events = POLLIN;
+    char chunk[1 << 16];
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents != 0) {
+            long got = recv(fd, chunk, sizeof(chunk), 0);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break; // the game is over
+            cout.write(chunk, got);
+            cout.flush();
+        }
+        if (fds[0].revents != 0) {
+            long got = read(0, chunk, sizeof(chunk));
+            if (got > 0) {
+                sendAll(fd, chunk, size_t(got));
+            } else if (got == 0 || errno != EINTR) {
+                shutdown(fd, SHUT_WR); // no more answers
+                fds[0].fd = -1;
+            }
+        }
+    }
+    close(fd);
+    return true;
+}
+
+#else
+
+// Sockets and epoll are only used on Linux
+bool runServer(const MapCache &, const ServerConfig &, ServerStats &stats) {
+    memset(&stats, 0, sizeof(stats));
+    return false;
+}
+
+bool runClient(const string &, const string &) {
+    return false;
+}
+
+#endif
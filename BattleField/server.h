@@ -0,0 +1,67 @@
+#ifndef SERVER_H_INCLUDED
+#define SERVER_H_INCLUDED
+
+/**** Many interactive games served over local sockets ****/
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "field.h"
+
+/* Maps parsed once and shared by every game.
+   A game starts on a copy of the cached field. */
+class MapCache {
+public:
+    MapCache(int h, int w);
+
+    // Parse the map file, return false if it cannot be opened
+    bool load(const std::string &name);
+    // The parsed map, or nullptr if it was never loaded
+    std::shared_ptr<const Field> find(const std::string &name) const;
+
+private:
+    int height, width;
+    mutable std::mutex lock;
+    std::map<std::string, std::shared_ptr<const Field>> maps;
+};
+
+// Totals of the finished sessions of a server
+struct ServerStats {
+    unsigned long sessions;
+    unsigned long won, failed, stopped; // stopped: input ended or was rejected
+    unsigned long long answers;
+    unsigned long long bytesIn, bytesOut;
+    double busySeconds;   // spent by the games on answers
+    double maxLatencyUs;  // slowest answer
+};
+
+/* Settings of a server.
+   address is the path of a Unix domain socket, or "tcp:PORT"
+   for a TCP port on 127.0.0.1. */
+struct ServerConfig {
+    std::string address;
+    int workers;          // threads, each with its own epoll loop
+    unsigned long limit;  // stop after this many sessions, never if 0
+    std::ostream *log;    // one line per finished session, may be nullptr
+};
+
+/* Serve games until config.limit sessions are over.
+   A client first sends the name of a cached map on a line of its own,
+   then the answers to the prompts exactly as the console game reads them;
+   it receives what the console game prints.
+   Connections are shared by a fixed pool of workers; every worker
+   waits for its sockets with epoll and never blocks on one of them.
+   Return false if the address cannot be listened on. */
+bool runServer(const MapCache &maps, const ServerConfig &config, ServerStats &stats);
+
+// Print the totals of a server
+void printServerStats(std::ostream &os, const ServerStats &stats);
+
+/* The client stub: send the map name, then copy the standard input to the
+   server and the answers of the server to the standard output, until the
+   server closes the connection. Return false if it cannot connect. */
+bool runClient(const std::string &address, const std::string &map);
+
+#endif // SERVER_H_INCLUDED
@@ -0,0 +1,1064 @@
+#include <cassert>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "solver.h"
+#include "algorithms.h"
+#include "engine.h"
+#include "workspace.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Entries kept by one worker before its table is cleared
+static const size_t TABLE_LIMIT = 1 << 22;
+
+// Remembered value of a position
+struct TableEntry {
+    int value;
+    bool exact;     // otherwise value is only an upper bound
+    UnitAction best;
+};
+
+// A position waiting to be searched
+struct SolverTask {
+    SolverTask(const Field &f) :
+        board(f) {
+    }
+
+    Field board;
+    int gained;                   // enemy HP removed before this position
+    vector<UnitAction> prefix;    // actions leading to this position
+    int depth;
+};
+
+// State shared by all workers
+struct SolverShared {
+    Clock::time_point start;
+    double timeLimit;
+    atomic<bool> stop;
+    atomic<int> pending;          // tasks queued or running
+    atomic<int> bestValue;
+    mutex bestLock;
+    vector<UnitAction> bestLine;
+    int splitDepth;
+};
+
+// An action worth trying from a position, with the enemy HP it removes
+struct Candidate {
+    UnitAction act;
+    int gain;
+};
+
+// An attack a pending unit may make
+struct Strike {
+    int from;                     // where the attacker stands
+    int target;
+    int squares[9];               // what the attack may change
+    int hits[9];                  // most damage it does to a unit there
+    char drowns[9];               // if it may beat a ground unit there into the ocean
+    int count;
+    int pushes[4];                // squares it may beat a unit back from
+    int dirs[4];                  // and the direction, as the order of step
+    int pushCount;
+};
+
+// Units of a position, gathered in one scan of the board,
+// and where the pending units may still get to
+struct Position {
+    int enemyHp;                  // sum of hit points of enemy units
+    int maxHp;                    // of an enemy unit
+    int pushers;                  // pending units which may still beat units back
+    vector<const Unit *> enemies;
+    vector<int> pending;          // squares of the player units which still have to act
+    vector<int> units;            // squares of all the units
+    vector<int> hpAt;             // hit points of the unit on each square
+    // Squares [k * area, (k + 1) * area) of stands hold where pending unit k
+    // may stand for the rest of the turn, those of from where it may attack
+    // from, those of affects what its attack may change and those of damage
+    // the most its attack may do to a unit on each square
+    vector<char> stands, from, affects;
+    vector<int> damage;
+    // Masks of the pending units whose actions may make the unit on a square
+    // leave it, fell the mountain on it, or beat a unit back from it in each
+    // direction (4 per square)
+    vector<uint64_t> leaveBy, fallenBy, pushedBy;
+    vector<int> hits;             // most damage all the pending units may do to a unit on each square
+    vector<char> occupied;        // squares a unit may stand on at some time in the turn
+    vector<int> reach;            // how many pending units may stand on or change each square
+    vector<char> enemyAt;         // squares the enemy being checked may stand on
+    vector<uint64_t> enemyMask;   // per square, the enemies which may stand on it, as bits
+    int enemyWords;               // words of enemyMask per square
+    vector<char> walk;            // squares the unit being checked may attack from
+    vector<int> unitDamage;       // most damage the unit being checked may do to each enemy
+    vector<int> enemyDamage;      // and all the pending units together
+    vector<int> spots;
+    vector<Candidate> actions;    // worth trying from the position
+};
+
+// Per worker state
+struct SolverWorker {
+    ~SolverWorker() {
+        for (size_t k = 0; k < undos.size(); k++)
+            delete undos[k];
+    }
+
+    mutex lock;
+    deque<SolverTask *> tasks;
+    unordered_map<uint64_t, TableEntry> table;
+    TurnWorkspace ws;
+    vector<FieldUndo *> undos;    // the action played, per depth
+    deque<Position> positions;    // per depth, kept in place as it grows
+    vector<int> targets;
+    long long nodes;
+};
+
+// Undo record of a depth
+static FieldUndo &scratchUndo(SolverWorker &wk, int depth) {
+    while (wk.undos.size() <= size_t(depth))
+        wk.undos.push_back(new FieldUndo());
+    return *wk.undos[depth];
+}
+
+// Position record of a depth
+static Position &scratchPosition(SolverWorker &wk, int depth) {
+    while (wk.positions.size() <= size_t(depth))
+        wk.positions.push_back(Position());
+    return wk.positions[depth];
+}
+
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Hash of terrains, units, hit points and what the units have done
+static uint64_t hashField(const Field &f) {
+    int h = f.getHeight();
+    int w = f.getWidth();
+    uint64_t key = 0;
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++) {
+            uint64_t code = f.getTerrain(i, j).getType();
+            const Unit *u = f.getUnit(i, j);
+            if (u != nullptr)
+                code |= (uint64_t(u->getType() + 1) << 2) | (uint64_t(u->getSide()) << 5)
+                      | (uint64_t(u->hasMoved()) << 6) | (uint64_t(u->hasAttacked()) << 7)
+                      | (uint64_t(u->getHp()) << 8);
+            if (code != 0) key ^= mix((uint64_t(i * w + j) << 24) ^ code);
+        }
+    return key;
+}
+
+// Check if a player unit may still move or attack
+static bool isPending(const Unit *u) {
+    return u != nullptr && u->getSide() && (!u->hasMoved() || !u->hasAttacked());
+}
+
+// Check if the unit type beats units back
+static bool isPusher(UnitType t) {
+    return t == TANK || t == FLIGHTER;
+}
+
+static bool isFlying(UnitType t) {
+    return t == BEE || t == FLIGHTER;
+}
+
+// Step from q in direction d, or -1 off the field
+static int step(const Field &f, int q, int d) {
+    const int dr[] = {-1, 1, 0, 0};
+    const int dc[] = {0, 0, -1, 1};
+    int w = f.getWidth();
+    int r = q / w + dr[d], c = q % w + dc[d];
+    if (r < 0 || r >= int(f.getHeight()) || c < 0 || c >= w) return -1;
+    return r * w + c;
+}
+
+// Bit of pending unit k in the masks of the units which may cause a change.
+// Units past the width of a mask set all the bits.
+static uint64_t causeBit(size_t k) {
+    return k < 64 ? uint64_t(1) << k : ~uint64_t(0);
+}
+
+// Bit to leave out of the masks when looking at what happens before the
+// attack of pending unit self; -1 looks at the whole turn
+static uint64_t selfBit(int self) {
+    return self >= 0 && self < 64 ? uint64_t(1) << self : 0;
+}
+
+// Check if the unit on q may leave it before the attack of pending unit self:
+// walk away, be beaten back or die
+static bool mayLeave(const Position &p, int q, int self) {
+    if (p.leaveBy[q] & ~selfBit(self)) return true;
+    int own = self >= 0 ? p.damage[size_t(self) * p.hpAt.size() + q] : 0;
+    return p.hits[q] - own >= p.hpAt[q];
+}
+
+// Check if a unit stands on q until the attack of pending unit self
+static bool blocks(const Position &p, int q, int self) {
+    return p.hpAt[q] > 0 && !mayLeave(p, q, self);
+}
+
+// Check if a unit of type t may move onto q, or be beaten back onto it, before
+// the attack of self as far as the terrain goes. Mountains fall where the
+// attack of a pusher may change them.
+static bool mayStand(const Field &f, const Position &p, UnitType t, int q, int self) {
+    int w = f.getWidth();
+    switch (f.getTerrain(q / w, q % w).getType()) {
+    case PLAIN:
+        return true;
+    case MOUNTAIN:
+        return (p.fallenBy[q] & ~selfBit(self)) != 0;
+    case OCEAN:
+        return isFlying(t);
+    default:
+        return !isFlying(t);
+    }
+}
+
+// Add q to the squares s changes, where it does at most hit damage to a
+// unit, or drowns a ground unit beaten back in direction d if d >= 0
+static void addSquare(const Field &f, Strike &s, int q, int hit, int d) {
+    int w = f.getWidth();
+    int to = d < 0 ? -1 : step(f, q, d);
+    s.squares[s.count] = q;
+    s.hits[s.count] = hit;
+    s.drowns[s.count] = to >= 0 && f.getTerrain(to / w, to % w).getType() == OCEAN;
+    s.count++;
+}
+
+// Call visit(strike) for every attack pending unit k may make from one of
+// stands which may meet a unit, or a mountain for a tank
+template <typename Visit>
+static void forEachStrike(const Field &f, const Position &p, size_t k, const char *stands, Visit visit) {
+    int w = f.getWidth();
+    int area = f.getHeight() * w;
+    int own = p.pending[k];
+    const Unit *u = f.getUnit(own / w, own % w);
+    int atk = u->getAttackPoints();
+    Strike s;
+    for (int q = 0; q < area; q++) {
+        if (!stands[q]) continue;
+        s.from = q;
+        for (int d = 0; d < 4; d++) {
+            switch (u->getType()) {
+            case TANK: {
+                // The ray stops at the first terrain other than plain, or at
+                // a unit which stays: the others on its way may have left
+                for (int t = step(f, q, d); t >= 0; t = step(f, t, d)) {
+                    s.target = t;
+                    s.count = 0;
+                    // Damage, then a collision or a mountain
+                    addSquare(f, s, t, atk + 1, d);
+                    int beyond = step(f, t, d);
+                    if (beyond >= 0) addSquare(f, s, beyond, 1, -1);
+                    s.pushes[0] = t;
+                    s.dirs[0] = d;
+                    s.pushCount = 1;
+                    TerrainType type = f.getTerrain(t / w, t % w).getType();
+                    if (p.occupied[t] || type == MOUNTAIN) visit(s);
+                    if (type != PLAIN && !(type == MOUNTAIN && mayStand(f, p, u->getType(), t, int(k)))) break;
+                    if (t != own && blocks(p, t, int(k))) break;
+                }
+                break;
+            }
+            case FLIGHTER: {
+                int mid = step(f, q, d);
+                s.target = mid < 0 ? -1 : step(f, mid, d);
+                if (s.target < 0) break;
+                s.count = 0;
+                s.pushCount = 0;
+                addSquare(f, s, s.target, atk, -1);
+                bool meets = p.occupied[s.target];
+                for (int e = 0; e < 4; e++) {
+                    int n = step(f, s.target, e);
+                    if (n < 0) continue;
+                    meets = meets || p.occupied[n];
+                    addSquare(f, s, n, 1, e);
+                    s.pushes[s.pushCount] = n;
+                    s.dirs[s.pushCount++] = e;
+                    int beyond = step(f, n, e);
+                    if (beyond >= 0) addSquare(f, s, beyond, 1, -1);
+                }
+                if (meets) visit(s);
+                break;
+            }
+            default:
+                s.target = step(f, q, d);
+                if (s.target < 0) break;
+                s.count = 0;
+                addSquare(f, s, s.target, atk, -1);
+                s.pushCount = 0;
+                if (p.occupied[s.target]) visit(s);
+                break;
+            }
+        }
+    }
+}
+
+// Add to squares the ones a unit of type t standing on them may be beaten
+// onto before the attack of self, by a pusher other than pending unit k.
+// Return true if any was added.
+static bool spreadPushes(const Field &f, const Position &p, UnitType t, int k, int self, vector<int> &queue,
+                         char *squares) {
+    int area = f.getHeight() * f.getWidth();
+    uint64_t skip = selfBit(self) | selfBit(k);
+    queue.clear();
+    for (int q = 0; q < area; q++)
+        if (squares[q]) queue.push_back(q);
+    bool added = false;
+    for (size_t i = 0; i < queue.size(); i++)
+        for (int d = 0; d < 4; d++) {
+            if (!(p.pushedBy[queue[i] * 4 + d] & ~skip)) continue;
+            int n = step(f, queue[i], d);
+            if (n < 0 || squares[n] || blocks(p, n, self) || !mayStand(f, p, t, n, self)) continue;
+            squares[n] = 1;
+            added = true;
+        }
+    return added;
+}
+
+// Mark into stands the squares pending unit k may stand on before the attack
+// of self: it may be beaten back, walk, then be beaten back again. Every
+// other pending pusher beats a unit back at most once.
+static void markStands(const Field &f, const Position &p, size_t k, int self, vector<int> &queue, char *stands) {
+    int w = f.getWidth();
+    int area = f.getHeight() * w;
+    int own = p.pending[k];
+    const Unit *u = f.getUnit(own / w, own % w);
+    int pushes = p.pushers - (isPusher(u->getType()) && !u->hasAttacked());
+    fill(stands, stands + area, 0);
+    stands[own] = 1;
+    for (int i = 0; i < pushes; i++)
+        if (!spreadPushes(f, p, u->getType(), int(k), self, queue, stands)) break;
+
+    queue.clear();
+    for (int q = 0; q < area; q++)
+        if (stands[q]) queue.push_back(q);
+    int steps = u->hasMoved() ? 0 : u->getMovPoints();
+    size_t head = 0;
+    for (int s = 0; s < steps; s++) {
+        size_t end = queue.size();
+        for (; head < end; head++)
+            for (int d = 0; d < 4; d++) {
+                int n = step(f, queue[head], d);
+                if (n < 0 || stands[n] || blocks(p, n, self) || !mayStand(f, p, u->getType(), n, self)) continue;
+                stands[n] = 1;
+                queue.push_back(n);
+            }
+    }
+
+    for (int i = 0; i < pushes; i++)
+        if (!spreadPushes(f, p, u->getType(), int(k), self, queue, stands)) break;
+}
+
+// Gather the units of f and where the pending ones may stand and attack.
+// Which units may leave their squares, where units may be beaten back and
+// the mountains which may fall depend on each other, so they grow together
+// from the units which may walk until they settle. Each change remembers
+// the pending units which may cause it: an attack cannot count on what only
+// the same unit's attack may do.
+static void scanPosition(const Field &f, Position &p) {
+    int h = f.getHeight();
+    int w = f.getWidth();
+    int area = h * w;
+    p.enemyHp = 0;
+    p.maxHp = 0;
+    p.pushers = 0;
+    p.enemies.clear();
+    p.pending.clear();
+    p.units.clear();
+    p.hpAt.assign(area, 0);
+    for (int i = 0; i < h; i++)
+        for (int j = 0; j < w; j++) {
+            const Unit *u = f.getUnit(i, j);
+            if (u == nullptr) continue;
+            p.units.push_back(i * w + j);
+            p.hpAt[i * w + j] = u->getHp();
+            if (!u->getSide()) {
+                p.enemyHp += u->getHp();
+                p.maxHp = max(p.maxHp, u->getHp());
+                p.enemies.push_back(u);
+            } else if (isPending(u)) {
+                if (isPusher(u->getType()) && !u->hasAttacked()) p.pushers++;
+                p.pending.push_back(i * w + j);
+            }
+        }
+
+    size_t n = p.pending.size();
+    p.stands.resize(n * area);
+    p.from.resize(n * area);
+    p.affects.resize(n * area);
+    p.damage.assign(n * area, 0);
+    p.leaveBy.assign(area, 0);
+    p.fallenBy.assign(area, 0);
+    p.pushedBy.assign(area * 4, 0);
+    p.hits.assign(area, 0);
+    p.occupied.assign(area, 0);
+    for (size_t k = 0; k < p.units.size(); k++)
+        p.occupied[p.units[k]] = 1;
+    while (true) {
+        bool grown = false;
+        for (size_t k = 0; k < n; k++) {
+            int own = p.pending[k];
+            const Unit *u = f.getUnit(own / w, own % w);
+            char *from = &p.from[k * area];
+            char *affects = &p.affects[k * area];
+            int *damage = &p.damage[k * area];
+            char *stands = &p.stands[k * area];
+            markStands(f, p, k, -1, p.spots, stands);
+            // A unit walks away only once a square next to it is free
+            if (!(p.leaveBy[own] & causeBit(k)) && count(stands, stands + area, 1) > 1) {
+                p.leaveBy[own] |= causeBit(k);
+                grown = true;
+            }
+            fill(affects, affects + area, 0);
+            if (u->hasAttacked()) {
+                fill(from, from + area, 0);
+                continue;
+            }
+            markStands(f, p, k, int(k), p.spots, from);
+            forEachStrike(f, p, k, from, [&](const Strike &s) {
+                for (int i = 0; i < s.count; i++) {
+                    int q = s.squares[i];
+                    affects[q] = 1;
+                    if (s.hits[i] > damage[q]) {
+                        p.hits[q] += s.hits[i] - damage[q];
+                        damage[q] = s.hits[i];
+                        grown = grown || p.hpAt[q] > 0;
+                    }
+                }
+                for (int i = 0; i < s.pushCount; i++) {
+                    uint64_t &by = p.pushedBy[s.pushes[i] * 4 + s.dirs[i]];
+                    if ((by | causeBit(k)) == by) continue;
+                    by |= causeBit(k);
+                    grown = true;
+                }
+            });
+            if (!isPusher(u->getType())) continue;
+            for (int q = 0; q < area; q++) {
+                if (!affects[q] || f.getTerrain(q / w, q % w).getType() != MOUNTAIN) continue;
+                if ((p.fallenBy[q] | causeBit(k)) == p.fallenBy[q]) continue;
+                p.fallenBy[q] |= causeBit(k);
+                grown = true;
+            }
+        }
+        for (int q = 0; q < area; q++) {
+            bool now = p.occupied[q];
+            for (size_t k = 0; k < n && !now; k++)
+                now = p.stands[k * area + q];
+            for (int d = 0; d < 4 && !now; d++) {
+                int back = step(f, q, d ^ 1);
+                now = back >= 0 && p.pushedBy[back * 4 + d] != 0;
+            }
+            if (now && !p.occupied[q]) {
+                p.occupied[q] = 1;
+                grown = true;
+            }
+        }
+        // Units beaten off their squares: not into a unit which stays,
+        // a mountain which stands or a forest for a flying unit
+        for (size_t i = 0; i < p.units.size(); i++) {
+            int q = p.units[i];
+            const Unit *u = f.getUnit(q / w, q % w);
+            uint64_t by = p.leaveBy[q];
+            for (int d = 0; d < 4; d++) {
+                if (!p.pushedBy[q * 4 + d]) continue;
+                int to = step(f, q, d);
+                if (to < 0 || blocks(p, to, -1)) continue;
+                if (mayStand(f, p, u->getType(), to, -1) || f.getTerrain(to / w, to % w).getType() == OCEAN)
+                    by |= p.pushedBy[q * 4 + d];
+            }
+            if (by == p.leaveBy[q]) continue;
+            p.leaveBy[q] = by;
+            grown = true;
+        }
+        if (!grown) break;
+    }
+
+    p.reach.assign(area, 0);
+    for (size_t k = 0; k < n; k++)
+        for (int q = 0; q < area; q++)
+            if (p.stands[k * area + q] || p.affects[k * area + q]) p.reach[q]++;
+}
+
+// Check if a pending unit other than pending unit k may stand on or change (row, col)
+static bool othersReach(const Field &f, const Position &p, size_t k, int row, int col) {
+    int area = f.getHeight() * f.getWidth();
+    int q = row * f.getWidth() + col;
+    return p.reach[q] > int(p.stands[k * area + q] || p.affects[k * area + q]);
+}
+
+// Check if an attack on (row, col), which only changes squares within
+// distance 2 of it, may matter to a pending unit other than pending unit k
+static bool othersReachNear(const Field &f, const Position &p, size_t k, int row, int col) {
+    for (int i = max(row - 2, 0); i <= min(row + 2, int(f.getHeight()) - 1); i++) {
+        int span = 2 - abs(i - row);
+        for (int j = max(col - span, 0); j <= min(col + span, int(f.getWidth()) - 1); j++)
+            if (othersReach(f, p, k, i, j)) return true;
+    }
+    return false;
+}
+
+// Check if nothing pending unit k may still do matters to the other pending units
+static bool isolated(const Field &f, const Position &p, size_t k) {
+    int area = f.getHeight() * f.getWidth();
+    for (int q = 0; q < area; q++)
+        if ((p.stands[k * area + q] || p.affects[k * area + q]) && p.reach[q] > 1) return false;
+    return true;
+}
+
+// Check if no two pending units may meet: the bound is then exact, as
+// each removes what its best attack does on the board as it is
+static bool apart(const Position &p) {
+    for (size_t q = 0; q < p.reach.size(); q++)
+        if (p.reach[q] > 1) return false;
+    return true;
+}
+
+// Sum of hit points of enemy units within distance 2 of (row, col),
+// the only ones an attack on (row, col) can hurt
+static int enemyHpNear(const Field &f, int row, int col) {
+    int hp = 0;
+    for (int i = max(row - 2, 0); i <= min(row + 2, int(f.getHeight()) - 1); i++) {
+        int span = 2 - abs(i - row);
+        for (int j = max(col - span, 0); j <= min(col + span, int(f.getWidth()) - 1); j++) {
+            const Unit *e = f.getUnit(i, j);
+            if (e != nullptr && !e->getSide()) hp += e->getHp();
+        }
+    }
+    return hp;
+}
+
+// Mark into p.enemyMask the squares each enemy may stand on when pending unit k attacks
+static void markEnemies(const Field &f, Position &p, size_t k) {
+    int w = f.getWidth();
+    int area = f.getHeight() * w;
+    p.enemyWords = (int(p.enemies.size()) + 63) / 64;
+    p.enemyMask.assign(size_t(area) * p.enemyWords, 0);
+    for (size_t e = 0; e < p.enemies.size(); e++) {
+        const Unit *enemy = p.enemies[e];
+        int home = enemy->getRow() * w + enemy->getCol();
+        uint64_t bit = uint64_t(1) << (e % 64);
+        if (!mayLeave(p, home, int(k))) {
+            p.enemyMask[home * p.enemyWords + e / 64] |= bit;
+            continue;
+        }
+        p.enemyAt.assign(area, 0);
+        p.enemyAt[home] = 1;
+        for (int round = 0; round < p.pushers; round++)
+            if (!spreadPushes(f, p, enemy->getType(), -1, int(k), p.spots, &p.enemyAt[0])) break;
+        for (int q = 0; q < area; q++)
+            if (p.enemyAt[q]) p.enemyMask[q * p.enemyWords + e / 64] |= bit;
+    }
+}
+
+// Enemy HP strike s may remove while the enemies may stand where p says:
+// each enemy which may be on a square of s loses at most what s does there.
+// Keep in p.unitDamage the most damage the strikes checked do to each enemy.
+static int strikeBound(Position &p, const Strike &s) {
+    int value = 0;
+    for (int word = 0; word < p.enemyWords; word++) {
+        uint64_t met = 0;
+        for (int i = 0; i < s.count; i++)
+            met |= p.enemyMask[s.squares[i] * p.enemyWords + word];
+        for (; met != 0; met &= met - 1) {
+            int b = __builtin_ctzll(met);
+            const Unit *e = p.enemies[word * 64 + b];
+            int hit = 0;
+            for (int i = 0; i < s.count; i++) {
+                if (!((p.enemyMask[s.squares[i] * p.enemyWords + word] >> b) & 1)) continue;
+                hit = max(hit, s.drowns[i] && !isFlying(e->getType()) ? e->getHp() : s.hits[i]);
+            }
+            value += min(hit, e->getHp());
+            p.unitDamage[word * 64 + b] = max(p.unitDamage[word * 64 + b], hit);
+        }
+    }
+    return value;
+}
+
+// Mark into p.walk the squares pending unit k may attack from while the
+// squares no other pending unit may change stay as they are
+static void markWalk(const Field &f, Position &p, size_t k) {
+    int w = f.getWidth();
+    int area = f.getHeight() * w;
+    int own = p.pending[k];
+    const Unit *u = f.getUnit(own / w, own % w);
+    const char *from = &p.from[k * area];
+    p.walk.assign(area, 0);
+    p.spots.clear();
+    // Where the others may beat it to, and where it is
+    for (int q = 0; q < area; q++)
+        if (q == own || (from[q] && othersReach(f, p, k, q / w, q % w))) {
+            p.walk[q] = 1;
+            p.spots.push_back(q);
+        }
+    int steps = u->hasMoved() ? 0 : u->getMovPoints();
+    size_t head = 0;
+    for (int s = 0; s < steps; s++) {
+        size_t end = p.spots.size();
+        for (; head < end; head++)
+            for (int d = 0; d < 4; d++) {
+                int n = step(f, p.spots[head], d);
+                if (n < 0 || p.walk[n] || !from[n]) continue;
+                bool changed = othersReach(f, p, k, n / w, n % w);
+                if (!changed && (f.getUnit(n / w, n % w) != nullptr
+                                 || f.getTerrain(n / w, n % w).getType() == MOUNTAIN)) continue;
+                p.walk[n] = 1;
+                p.spots.push_back(n);
+            }
+    }
+}
+
+// Enemy HP strike s of pending unit k removes, if no other pending unit may
+// change what it meets: it is played on f then undone. Otherwise -1.
+static int exactGain(Field &f, const Position &p, size_t k, const Strike &s, FieldUndo &undo) {
+    int w = f.getWidth();
+    int own = p.pending[k];
+    Unit *u = f.getUnit(own / w, own % w);
+    if (!p.walk[s.from]) return othersReach(f, p, k, s.from / w, s.from % w) ? -1 : 0;
+    for (int i = 0; i < s.count; i++)
+        if (othersReach(f, p, k, s.squares[i] / w, s.squares[i] % w)) return -1;
+    if (u->getType() == TANK)
+        for (int t = step(f, s.from, s.dirs[0]); t != s.target; t = step(f, t, s.dirs[0])) {
+            if (othersReach(f, p, k, t / w, t % w)) return -1;
+            // Stopped on the way
+            if (t != own && f.getUnit(t / w, t % w) != nullptr) return 0;
+            if (f.getTerrain(t / w, t % w).getType() != PLAIN) return 0;
+        }
+
+    int tr = s.target / w, tc = s.target % w;
+    int before = enemyHpNear(f, tr, tc);
+    f.recordUndo(undo);
+    if (s.from != own) f.moveUnit(own / w, own % w, s.from / w, s.from % w);
+    f.attackUnit(u, tr, tc);
+    f.stopUndo();
+    int gain = before - enemyHpNear(f, tr, tc);
+    f.undo(undo);
+    return gain;
+}
+
+// Upper bound of the enemy HP the pending units can still remove.
+// An attack removes at most what its kind of attack can do to the enemies
+// which may stand on the squares it changes; one no other pending unit may
+// meddle with removes what it does now. No enemy loses more than its hit
+// points, or than the best attacks of all the pending units do to it.
+static int optimistic(Field &f, Position &p, FieldUndo &undo) {
+    int w = f.getWidth();
+    int area = f.getHeight() * w;
+    size_t n = p.pending.size();
+    int bound = 0;
+    p.enemyDamage.assign(p.enemies.size(), 0);
+    for (size_t k = 0; k < n; k++) {
+        const Unit *u = f.getUnit(p.pending[k] / w, p.pending[k] % w);
+        if (u->hasAttacked()) continue;
+        int most;
+        switch (u->getType()) {
+        case TANK:
+            // damage, then a collision or a drowning
+            most = max(u->getAttackPoints() + 2, p.maxHp);
+            break;
+        case FLIGHTER:
+            // damage, then four units beaten back
+            most = u->getAttackPoints() + 4 * max(2, p.maxHp);
+            break;
+        default:
+            most = u->getAttackPoints();
+            break;
+        }
+        int best = 0;
+        p.unitDamage.assign(p.enemies.size(), 0);
+        markEnemies(f, p, k);
+        markWalk(f, p, k);
+        forEachStrike(f, p, k, &p.from[k * area], [&](const Strike &s) {
+            int hp = min(strikeBound(p, s), most);
+            if (hp <= best) return;
+            int exact = exactGain(f, p, k, s, undo);
+            best = max(best, exact < 0 ? hp : min(hp, exact));
+        });
+        bound += best;
+        for (size_t e = 0; e < p.enemies.size(); e++)
+            p.enemyDamage[e] += p.unitDamage[e];
+    }
+    int lost = 0;
+    for (size_t e = 0; e < p.enemies.size(); e++)
+        lost += min(p.enemyDamage[e], p.enemies[e]->getHp());
+    return min(bound, lost);
+}
+
+// Check if an enemy of the position stands within distance dist of (row, col)
+static bool nearEnemy(const Position &p, int row, int col, int dist) {
+    for (size_t k = 0; k < p.enemies.size(); k++)
+        if (abs(p.enemies[k]->getRow() - row) + abs(p.enemies[k]->getCol() - col) <= dist) return true;
+    return false;
+}
+
+// Check if the unit may hurt an enemy by attacking from (row, col):
+// an attack only changes squares within distance 2 of its target
+static bool mayHurtFrom(const Position &p, const Unit *u, int row, int col) {
+    switch (u->getType()) {
+    case TANK:
+        return true; // a ray may reach far
+    case FLIGHTER:
+        return nearEnemy(p, row, col, 4);
+    default:
+        return nearEnemy(p, row, col, 3);
+    }
+}
+
+// Check if attacking (trow, tcol) can change anything
+static bool attackHasEffect(const Field &f, const Unit *u, int trow, int tcol) {
+    if (f.getUnit(trow, tcol) != nullptr) return true;
+    if (u->getType() == TANK) return f.getTerrain(trow, tcol).getType() == MOUNTAIN;
+    if (u->getType() == FLIGHTER) {
+        int drow[] = {-1, 1, 0, 0};
+        int dcol[] = {0, 0, -1, 1};
+        for (int d = 0; d < 4; d++) {
+            int r = trow + drow[d], c = tcol + dcol[d];
+            if (r >= 0 && r < int(f.getHeight()) && c >= 0 && c < int(f.getWidth())
+                && f.getUnit(r, c) != nullptr)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Squares the unit can move to, excluding its own
+static void moveTargets(TurnWorkspace &ws, const Field &f, Unit *u, vector<int> &out) {
+    int w = f.getWidth();
+    searchUnitReach(f, u, ws);
+    out.clear();
+    for (size_t k = 0; k < ws.reachable.count(); k++) {
+        int r = ws.reachable.markedRow(k), c = ws.reachable.markedCol(k);
+        if (r != u->getRow() || c != u->getCol()) out.push_back(r * w + c);
+    }
+}
+
+// Squares worth attacking
+static void attackTargets(TurnWorkspace &ws, const Field &f, Unit *u, vector<int> &out) {
+    int w = f.getWidth();
+    searchAttackable(f, u, ws.attackable);
+    out.clear();
+    for (size_t k = 0; k < ws.attackable.count(); k++) {
+        int r = ws.attackable.markedRow(k), c = ws.attackable.markedCol(k);
+        if (attackHasEffect(f, u, r, c)) out.push_back(r * w + c);
+    }
+}
+
+static UnitAction unitAction(Action act, int row, int col, int trow, int tcol) {
+    UnitAction a;
+    a.act = act;
+    a.row = row;
+    a.col = col;
+    a.trow = trow;
+    a.tcol = tcol;
+    return a;
+}
+
+// Play a on f, recording into undo what changes
+static void playAction(Field &f, const UnitAction &a, FieldUndo &undo) {
+    Unit *u = f.getUnit(a.row, a.col);
+    assert(isPending(u));
+    f.recordUndo(undo);
+    undo.saveUnit(u);
+    if (a.act == MOVE) {
+        u->setMoved(true);
+        f.moveUnit(a.row, a.col, a.trow, a.tcol);
+    } else {
+        u->setAttacked(true);
+        f.attackUnit(u, a.trow, a.tcol);
+    }
+    f.stopUndo();
+}
+
+// Add to pos.actions the actions of pending unit k worth trying.
+// Actions which cannot matter are left out: a move or an attack which
+// removes no enemy HP is only tried if another pending unit may meet what
+// it changes, or if the unit may still hurt an enemy after it.
+static void collectActions(SolverWorker &wk, Field &f, Position &pos, FieldUndo &undo, size_t k) {
+    int w = f.getWidth();
+    int row = pos.pending[k] / w, col = pos.pending[k] % w;
+    Unit *u = f.getUnit(row, col);
+    vector<int> &targets = wk.targets;
+    bool alone = isolated(f, pos, k);
+    Candidate c;
+
+    if (!u->hasAttacked()) {
+        attackTargets(wk.ws, f, u, targets);
+        for (size_t t = 0; t < targets.size(); t++) {
+            int tr = targets[t] / w, tc = targets[t] % w;
+            // Otherwise only the enemy HP it removes counts
+            bool useful = othersReachNear(f, pos, k, tr, tc) || (!u->hasMoved() && !alone);
+            if (!useful && !nearEnemy(pos, tr, tc, 2)) continue;
+            c.act = unitAction(ATTACK, row, col, tr, tc);
+            int before = enemyHpNear(f, tr, tc);
+            playAction(f, c.act, undo);
+            c.gain = before - enemyHpNear(f, tr, tc);
+            f.undo(undo);
+            if (useful || c.gain > 0) pos.actions.push_back(c);
+        }
+    }
+
+    if (!u->hasMoved()) {
+        moveTargets(wk.ws, f, u, targets);
+        bool src = othersReach(f, pos, k, row, col);
+        for (size_t m = 0; m < targets.size(); m++) {
+            int mr = targets[m] / w, mc = targets[m] % w;
+            bool useful = src || othersReach(f, pos, k, mr, mc);
+            if (!useful && (u->hasAttacked() || (alone && !mayHurtFrom(pos, u, mr, mc)))) continue;
+            c.act = unitAction(MOVE, row, col, mr, mc);
+            c.gain = 0;
+            pos.actions.push_back(c);
+        }
+    }
+}
+
+// Gather the actions worth trying from pos, the ones removing most enemy HP first
+static void collectActions(SolverWorker &wk, Field &f, Position &pos, FieldUndo &undo) {
+    pos.actions.clear();
+    for (size_t k = 0; k < pos.pending.size(); k++)
+        collectActions(wk, f, pos, undo, k);
+    stable_sort(pos.actions.begin(), pos.actions.end(), [](const Candidate &x, const Candidate &y) {
+        return x.gain > y.gain;
+    });
+}
+
+static void countNode(SolverShared &sh, SolverWorker &wk) {
+    if (++wk.nodes % 4096 != 0) return;
+    double elapsed = chrono::duration<double>(Clock::now() - sh.start).count();
+    if (elapsed > sh.timeLimit) sh.stop = true;
+}
+
+// Best enemy HP the pending units can remove from f.
+// If the result is not greater than need, it is only an upper bound.
+static int search(SolverShared &sh, SolverWorker &wk, Field &f, int depth, int need) {
+    countNode(sh, wk);
+    if (sh.stop) return 0;
+
+    // Positions met again, often in another order of the same actions
+    uint64_t key = hashField(f);
+    unordered_map<uint64_t, TableEntry>::const_iterator it = wk.table.find(key);
+    bool known = it != wk.table.end();
+    if (known && (it->second.exact || it->second.value <= need)) return it->second.value;
+
+    Position &pos = scratchPosition(wk, depth);
+    FieldUndo &undo = scratchUndo(wk, depth);
+    scanPosition(f, pos);
+    int ub = optimistic(f, pos, undo);
+    if (ub <= 0 || ub <= need) {
+        // Only a bound, kept for the next time
+        if (wk.table.size() >= TABLE_LIMIT) {
+            wk.table.clear();
+            known = false;
+        }
+        TableEntry &e = wk.table[key];
+        if (!known || ub < e.value) {
+            e.value = ub;
+            e.exact = false;
+            e.best = unitAction(SKIP, -1, -1, -1, -1);
+        }
+        return ub;
+    }
+
+    // Pending units which cannot meet each other remove what the bound
+    // says, so only a line reaching it is worth following
+    int aim = need;
+    if (apart(pos)) aim = max(need, ub - 1);
+
+    // Ending the turn is always possible
+    int best = 0;
+    UnitAction bestAction = unitAction(SKIP, -1, -1, -1, -1);
+    collectActions(wk, f, pos, undo);
+    for (size_t k = 0; k < pos.actions.size() && !sh.stop && best < ub; k++) {
+        const Candidate &c = pos.actions[k];
+        playAction(f, c.act, undo);
+        int v = c.gain + search(sh, wk, f, depth + 1, max(aim, best) - c.gain);
+        f.undo(undo);
+        if (v > best) {
+            best = v;
+            bestAction = c.act;
+        }
+    }
+    if (sh.stop) return best;
+
+    if (wk.table.size() >= TABLE_LIMIT) wk.table.clear();
+    TableEntry &e = wk.table[key];
+    if (!e.exact || best > aim) {
+        e.value = best;
+        e.exact = best > aim;
+        e.best = bestAction;
+    }
+    return best;
+}
+
+// Play a found action on f
+static void applyFound(Field &f, const UnitAction &a) {
+    Unit *u = f.getUnit(a.row, a.col);
+    assert(isPending(u));
+    if (a.act == MOVE) {
+        u->setMoved(true);
+        f.moveUnit(a.row, a.col, a.trow, a.tcol);
+    } else {
+        u->setAttacked(true);
+        f.attackUnit(u, a.trow, a.tcol);
+    }
+}
+
+// Follow the remembered best actions from f
+static void readLine(SolverWorker &wk, Field f, vector<UnitAction> &line) {
+    while (true) {
+        unordered_map<uint64_t, TableEntry>::const_iterator it = wk.table.find(hashField(f));
+        if (it == wk.table.end() || !it->second.exact || it->second.best.act == SKIP) return;
+        applyFound(f, it->second.best);
+        line.push_back(it->second.best);
+    }
+}
+
+static void pushTask(SolverShared &sh, SolverWorker &wk, SolverTask *t) {
+    sh.pending++;
+    lock_guard<mutex> g(wk.lock);
+    wk.tasks.push_back(t);
+}
+
+// Take a task from our own deque, or steal the oldest task of another worker
+static SolverTask *takeTask(vector<SolverWorker *> &workers, size_t self) {
+    for (size_t k = 0; k < workers.size(); k++) {
+        SolverWorker &wk = *workers[(self + k) % workers.size()];
+        lock_guard<mutex> g(wk.lock);
+        if (wk.tasks.empty()) continue;
+        SolverTask *t;
+        if (k == 0) {
+            t = wk.tasks.back();
+            wk.tasks.pop_back();
+        } else {
+            t = wk.tasks.front();
+            wk.tasks.pop_front();
+        }
+        return t;
+    }
+    return nullptr;
+}
+
+static void runTask(SolverShared &sh, SolverWorker &wk, SolverTask *t) {
+    if (sh.stop) return;
+
+    // Shallow tasks are split, so idle workers have something to steal
+    if (t->depth < sh.splitDepth) {
+        countNode(sh, wk);
+        Position &pos = scratchPosition(wk, t->depth);
+        FieldUndo &undo = scratchUndo(wk, t->depth);
+        scanPosition(t->board, pos);
+        if (t->gained + optimistic(t->board, pos, undo) <= sh.bestValue) return;
+        collectActions(wk, t->board, pos, undo);
+        for (size_t k = 0; k < pos.actions.size(); k++) {
+            const Candidate &a = pos.actions[k];
+            playAction(t->board, a.act, undo);
+            SolverTask *c = new SolverTask(t->board);
+            c->gained = t->gained + a.gain;
+            c->prefix = t->prefix;
+            c->prefix.push_back(a.act);
+            c->depth = t->depth + 1;
+            pushTask(sh, wk, c);
+            t->board.undo(undo);
+        }
+        return;
+    }
+
+    int value = t->gained + search(sh, wk, t->board, t->depth, sh.bestValue - t->gained);
+    if (value <= sh.bestValue) return;
+
+    vector<UnitAction> line = t->prefix;
+    readLine(wk, t->board, line);
+    lock_guard<mutex> g(sh.bestLock);
+    if (value > sh.bestValue) {
+        sh.bestValue = value;
+        sh.bestLine = line;
+    }
+}
+
+static void workerLoop(SolverShared &sh, vector<SolverWorker *> &workers, size_t self) {
+    SolverWorker &wk = *workers[self];
+    while (sh.pending > 0) {
+        SolverTask *t = takeTask(workers, self);
+        if (t == nullptr) {
+            this_thread::yield();
+            continue;
+        }
+        runTask(sh, wk, t);
+        delete t;
+        sh.pending--;
+    }
+}
+
+// Search for the best player turn
+SolveResult solveTurn(const Field &field, int threads, double timeLimit) {
+    threads = max(threads, 1);
+
+    SolverShared sh;
+    sh.start = Clock::now();
+    sh.timeLimit = timeLimit;
+    sh.stop = false;
+    sh.pending = 0;
+    sh.bestValue = 0;
+    sh.splitDepth = threads > 1 ? 1 : 0;
+
+    vector<SolverWorker *> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(new SolverWorker());
+        workers[t]->ws.resize(field.getHeight(), field.getWidth());
+        workers[t]->nodes = 0;
+    }
+
+    // The turn starts with every player unit ready
+    SolverTask *root = new SolverTask(field);
+    resetUnits(root->board);
+    root->gained = 0;
+    root->depth = 0;
+    pushTask(sh, *workers[0], root);
+
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.push_back(thread(workerLoop, ref(sh), ref(workers), size_t(t)));
+    workerLoop(sh, workers, 0);
+    for (size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+
+    SolveResult res;
+    res.damage = sh.bestValue;
+    res.line = sh.bestLine;
+    res.nodes = 0;
+    for (int t = 0; t < threads; t++) {
+        res.nodes += workers[t]->nodes;
+        delete workers[t];
+    }
+    res.seconds = chrono::duration<double>(Clock::now() - sh.start).count();
+    res.complete = !sh.stop;
+    return res;
+}
+
+// Print the best line and the search statistics
+void printSolveResult(ostream &os, const Field &field, const SolveResult &res) {
+    Field f(field);
+    resetUnits(f);
+
+    for (size_t k = 0; k < res.line.size(); k++) {
+        const UnitAction &a = res.line[k];
+        os << k + 1 << ". " << f.getUnit(a.row, a.col)->getSymbol()
+           << " at (" << a.row << ", " << a.col << "): "
+           << (a.act == MOVE ? "move to" : "attack") << " (" << a.trow << ", " << a.tcol << ")" << endl;
+        applyFound(f, a);
+    }
+    os << "Enemy HP removed: " << res.damage << endl;
+    os << "Nodes: " << res.nodes << " in " << res.seconds << " s ("
+       << (res.seconds > 0 ? res.nodes / res.seconds : 0) << " nodes/sec)" << endl;
+    os << (res.complete ? "Search complete" : "Time limit reached, best line so far") << endl;
+}
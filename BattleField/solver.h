@@ -0,0 +1,28 @@
+#ifndef SOLVER_H_INCLUDED
+#define SOLVER_H_INCLUDED
+
+/**** Search for the best player turn ****/
+#include <iostream>
+#include <vector>
+#include "field.h"
+#include "engine.h"
+
+// Result of a search
+struct SolveResult {
+    int damage;                 // enemy HP removed by the best line
+    std::vector<UnitAction> line; // moves and attacks in the order they are performed
+    long long nodes;            // positions searched
+    double seconds;
+    bool complete;              // false if the time limit was hit
+};
+
+// Search all orders of the moves and attacks of the player units,
+// each unit moving at most once and attacking at most once in either order,
+// for the turn which removes the most enemy HP.
+// Subtrees are shared by `threads` workers which steal from each other.
+SolveResult solveTurn(const Field &field, int threads, double timeLimit);
+
+// Print the best line and the search statistics
+void printSolveResult(std::ostream &os, const Field &field, const SolveResult &res);
+
+#endif // SOLVER_H_INCLUDED
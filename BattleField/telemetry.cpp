@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cstring>
+#include "telemetry.h"
+
+using namespace std;
+
+static const char *const COLUMN_NAMES[] = {
+    "round", "player_units", "enemy_units", "player_hp", "enemy_hp",
+    "soldiers", "tanks", "bees", "flighters", "hydralisks",
+    "damage_by_soldiers", "damage_by_tanks", "damage_by_bees", "damage_by_flighters", "damage_by_hydralisks",
+    "collisions", "drowned", "mountains_destroyed", "hp_healed",
+};
+static_assert(sizeof(COLUMN_NAMES) / sizeof(COLUMN_NAMES[0]) == TELEMETRY_COLUMNS, "one name per column");
+
+const char *telemetryColumnName(int column) {
+    return COLUMN_NAMES[column];
+}
+
+GameTelemetry::GameTelemetry(int rounds) :
+    ring(size_t(max(rounds, 1)) * TELEMETRY_COLUMNS), capacity(max(rounds, 1)),
+    first(0), count(0), dropped(0), row(spare), attacker(SOLDIER) {
+    fill(spare, spare + TELEMETRY_COLUMNS, 0);
+}
+
+void GameTelemetry::beginRound(int round) {
+    if (count == capacity) {
+        first = (first + 1) % capacity;
+        dropped++;
+    } else {
+        count++;
+    }
+    row = &ring[size_t((first + count - 1) % capacity) * TELEMETRY_COLUMNS];
+    fill(row, row + TELEMETRY_COLUMNS, 0);
+    row[TM_ROUND] = round;
+}
+
+void GameTelemetry::unitAlive(const Unit &u) {
+    bool player = u.getSide();
+    row[player ? TM_PLAYER_UNITS : TM_ENEMY_UNITS]++;
+    row[player ? TM_PLAYER_HP : TM_ENEMY_HP] += u.getHp();
+    row[TM_UNITS + u.getType()]++;
+}
+
+void GameTelemetry::attackBy(UnitType type) {
+    attacker = type;
+}
+
+void GameTelemetry::damaged(int hp) {
+    row[TM_DAMAGE + attacker] += hp;
+}
+
+void GameTelemetry::collided() {
+    row[TM_COLLISIONS]++;
+}
+
+void GameTelemetry::drowned() {
+    row[TM_DROWNED]++;
+}
+
+void GameTelemetry::mountainDestroyed() {
+    row[TM_MOUNTAINS]++;
+}
+
+void GameTelemetry::healed(int hp) {
+    row[TM_HEALED] += hp;
+}
+
+int GameTelemetry::getRounds() const {
+    return count;
+}
+
+const int *GameTelemetry::getRow(int k) const {
+    return &ring[size_t((first + k) % capacity) * TELEMETRY_COLUMNS];
+}
+
+unsigned long GameTelemetry::getDropped() const {
+    return dropped;
+}
+
+void GameTelemetry::clear() {
+    first = 0;
+    count = 0;
+    dropped = 0;
+    row = spare;
+}
+
+void GameTelemetry::writeCsv(ostream &os) const {
+    for (int c = 0; c < TELEMETRY_COLUMNS; c++)
+        os << (c > 0 ? "," : "") << COLUMN_NAMES[c];
+    os << '\n';
+    for (int k = 0; k < count; k++) {
+        const int *r = getRow(k);
+        for (int c = 0; c < TELEMETRY_COLUMNS; c++) {
+            if (c > 0) os << ',';
+            os << r[c];
+        }
+        os << '\n';
+    }
+    os.flush();
+}
+
+static void putInt(string &buf, unsigned long x, int bytes) {
+    for (int k = 0; k < bytes; k++)
+        buf += char((x >> (8 * k)) & 0xff);
+}
+
+void GameTelemetry::writeBinary(ostream &os) const {
+    string buf("BFTM");
+    buf.reserve(16 + size_t(TELEMETRY_COLUMNS) * (32 + 4 * count));
+    putInt(buf, TELEMETRY_VERSION, 2);
+    putInt(buf, TELEMETRY_COLUMNS, 2);
+    putInt(buf, count, 4);
+    putInt(buf, dropped, 4);
+    for (int c = 0; c < TELEMETRY_COLUMNS; c++) {
+        size_t length = strlen(COLUMN_NAMES[c]);
+        putInt(buf, length, 1);
+        buf.append(COLUMN_NAMES[c], length);
+        for (int k = 0; k < count; k++)
+            putInt(buf, (unsigned)getRow(k)[c], 4);
+    }
+    os.write(buf.data(), buf.size());
+    os.flush();
+}
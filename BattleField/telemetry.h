@@ -0,0 +1,83 @@
+#ifndef TELEMETRY_H_INCLUDED
+#define TELEMETRY_H_INCLUDED
+
+/**** Statistics of every round of a game ****/
+#include <iostream>
+#include <vector>
+#include "unit.h"
+
+// What is counted each round, one column per counter
+enum TelemetryColumn {
+    TM_ROUND,
+    TM_PLAYER_UNITS,                     // alive when the round starts
+    TM_ENEMY_UNITS,
+    TM_PLAYER_HP,                        // their total hp
+    TM_ENEMY_HP,
+    TM_UNITS,                            // alive, one column per UnitType
+    TM_DAMAGE = TM_UNITS + UNIT_TYPES,   // hp lost to the attacks of each UnitType
+    TM_COLLISIONS = TM_DAMAGE + UNIT_TYPES, // units beaten back into another one
+    TM_DROWNED,                          // units beaten back into the ocean
+    TM_MOUNTAINS,                        // mountains destroyed
+    TM_HEALED,                           // hp healed by forests
+    TELEMETRY_COLUMNS
+};
+
+// Rounds kept by default
+const int DEFAULT_TELEMETRY_ROUNDS = 4096;
+
+// Version of the binary format written
+const int TELEMETRY_VERSION = 1;
+
+/* Counters of the last rounds of a game, kept in a ring of rows
+   allocated once: counting never allocates, and once the ring is
+   full every new round takes the place of the oldest one.
+   The field counts the attacks and the game the rest.
+   Events before the first round are not kept. */
+class GameTelemetry {
+public:
+    explicit GameTelemetry(int rounds = DEFAULT_TELEMETRY_ROUNDS);
+
+    // Start a row for round; the units alive are counted next
+    void beginRound(int round);
+    void unitAlive(const Unit &u);
+
+    // The attacks which follow are by units of the type
+    void attackBy(UnitType type);
+    // A unit lost hp to the current attack
+    void damaged(int hp);
+    void collided();
+    void drowned();
+    void mountainDestroyed();
+    // A forest healed a unit
+    void healed(int hp);
+
+    // Rows kept, oldest first, and rows lost when the ring was full
+    int getRounds() const;
+    const int *getRow(int k) const;
+    unsigned long getDropped() const;
+    // Forget every row
+    void clear();
+
+    // One line of column names, then one line per row
+    void writeCsv(std::ostream &os) const;
+    /* Little-endian, column after column:
+         "BFTM", version (2 bytes), columns (2 bytes), rows, rows dropped (4 bytes each),
+         then per column its name (length in 1 byte, then the letters)
+         and the value of every row (4 bytes each, signed) */
+    void writeBinary(std::ostream &os) const;
+
+private:
+    std::vector<int> ring;
+    int capacity;
+    int first; // oldest row kept
+    int count;
+    unsigned long dropped;
+    int *row;  // row of the current round
+    int spare[TELEMETRY_COLUMNS]; // takes the events before the first round
+    UnitType attacker;
+};
+
+// Name of a column in the exports
+const char *telemetryColumnName(int column);
+
+#endif // TELEMETRY_H_INCLUDED
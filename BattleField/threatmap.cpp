@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include "threatmap.h"
+#include "algorithms.h"
+#include "batch.h"
+#include "engine.h"
+
+using namespace std;
+
+// Side of the square areas of the buckets
+static const int BUCKET_SIZE = 8;
+
+ThreatMap::ThreatMap() :
+    height(0), width(0), owner(0), seen(0), maxPts(0), rebuilds(0), searches(0) {
+}
+
+long long ThreatMap::bucketOf(long long square) const {
+    return ((square / width / BUCKET_SIZE) << 32) | (square % width / BUCKET_SIZE);
+}
+
+void ThreatMap::clear() {
+    for (unordered_map<long long, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+        spare.push_back(vector<long long>());
+        spare.back().swap(it->second.cells);
+    }
+    entries.clear();
+    buckets.clear();
+    tanks.clear();
+    maxPts = 0;
+    owner = 0;
+}
+
+void ThreatMap::rebuild(const Field &field) {
+    clear();
+    rebuilds++;
+    owner = field.getId();
+    seen = field.getVersion();
+    if (height != int(field.getHeight()) || width != int(field.getWidth())) {
+        height = field.getHeight();
+        width = field.getWidth();
+        reached.resize(height, width);
+        attacked.resize(height, width);
+    }
+    planes[0] = Grid<int>(height, width, 0);
+    planes[1] = Grid<int>(height, width, 0);
+    vector<Unit *> all;
+    field.getUnits(all);
+    for (size_t k = 0; k < all.size(); k++)
+        add(field, (long long)all[k]->getRow() * width + all[k]->getCol());
+}
+
+void ThreatMap::update(const Field &field) {
+    if (owner != field.getId() || !field.getChangesSince(seen, changes)) {
+        rebuild(field);
+        return;
+    }
+    seen = field.getVersion();
+
+    // A unit may have come to a changed square, and every unit
+    // whose squares depend on one has to be searched again
+    redo.clear();
+    for (size_t c = 0; c < changes.size(); c++) {
+        int row = int(changes[c] / width), col = int(changes[c] % width);
+        redo.push_back(changes[c]);
+        for (int br = max(0, row - maxPts) / BUCKET_SIZE; br <= (row + maxPts) / BUCKET_SIZE; br++) {
+            for (int bc = max(0, col - maxPts) / BUCKET_SIZE; bc <= (col + maxPts) / BUCKET_SIZE; bc++) {
+                unordered_map<long long, vector<long long> >::iterator b = buckets.find(((long long)br << 32) | bc);
+                if (b == buckets.end()) continue;
+                vector<long long> &squares = b->second;
+                for (size_t k = 0; k < squares.size();) {
+                    long long s = squares[k];
+                    if (llabs(s / width - row) + llabs(s % width - col) <= entries[s].pts) {
+                        drop(s); // takes s out of squares
+                        redo.push_back(s);
+                    } else {
+                        k++;
+                    }
+                }
+            }
+        }
+        for (size_t k = 0; k < tanks.size();) {
+            const Entry &e = entries[tanks[k]];
+            if ((row >= e.top && row <= e.bottom) || (col >= e.left && col <= e.right)) {
+                redo.push_back(tanks[k]);
+                drop(tanks[k]);
+            } else {
+                k++;
+            }
+        }
+    }
+    for (size_t k = 0; k < redo.size(); k++)
+        if (entries.count(redo[k]) == 0 && field.getUnit(int(redo[k] / width), int(redo[k] % width)) != nullptr)
+            add(field, redo[k]);
+}
+
+void ThreatMap::add(const Field &field, long long square) {
+    int row = int(square / width), col = int(square % width);
+    const Unit *u = field.getUnit(row, col);
+    searches++;
+    Entry &e = entries[square];
+    if (!spare.empty()) {
+        e.cells.swap(spare.back());
+        spare.pop_back();
+    }
+    e.side = u->getSide();
+    e.lines = e.side && u->getType() == TANK;
+    e.pts = u->getMovPoints();
+    e.top = e.bottom = row;
+    e.left = e.right = col;
+    maxPts = max(maxPts, e.pts);
+
+    // Squares reached, one movement point per step as searchReachable spends them
+    bool ground = isGroundMover(u->getType());
+    reached.clear();
+    reached.mark(row, col);
+    frontier.assign(1, square);
+    for (int step = 0; step < e.pts && !frontier.empty(); step++) {
+        next.clear();
+        for (size_t k = 0; k < frontier.size(); k++) {
+            int r = int(frontier[k] / width), c = int(frontier[k] % width);
+            const int dr[] = {-1, 1, 0, 0};
+            const int dc[] = {0, 0, 1, -1};
+            for (int d = 0; d < 4; d++) {
+                int nr = r + dr[d], nc = c + dc[d];
+                if (!reached.inBounds(nr, nc) || reached.isMarked(nr, nc) || !isPassable(field, nr, nc, ground))
+                    continue;
+                reached.mark(nr, nc);
+                next.push_back((long long)nr * width + nc);
+            }
+        }
+        frontier.swap(next);
+    }
+
+    // Squares attacked from any of them
+    attacked.clear();
+    for (size_t k = 0; k < reached.count(); k++) {
+        int r = reached.markedRow(k), c = reached.markedCol(k);
+        e.top = min(e.top, r);
+        e.bottom = max(e.bottom, r);
+        e.left = min(e.left, c);
+        e.right = max(e.right, c);
+        const int dr[] = {-1, 1, 0, 0};
+        const int dc[] = {0, 0, 1, -1};
+        for (int d = 0; d < 4; d++) {
+            if (e.lines) {
+                // As searchFarAttackable, but the tank has left its square
+                for (int nr = r + dr[d], nc = c + dc[d]; attacked.inBounds(nr, nc); nr += dr[d], nc += dc[d]) {
+                    if (!attacked.isMarked(nr, nc)) attacked.mark(nr, nc);
+                    const Unit *v = field.getUnit(nr, nc);
+                    if (field.getTerrain(nr, nc).getType() != PLAIN || (v != nullptr && v != u)) break;
+                }
+            } else {
+                int reach = e.side && u->getType() == FLIGHTER ? 2 : 1;
+                int nr = r + reach * dr[d], nc = c + reach * dc[d];
+                if (attacked.inBounds(nr, nc) && !attacked.isMarked(nr, nc)) attacked.mark(nr, nc);
+            }
+        }
+    }
+
+    Grid<int> &plane = planes[e.side];
+    e.cells.clear();
+    for (size_t k = 0; k < attacked.count(); k++) {
+        int r = attacked.markedRow(k), c = attacked.markedCol(k);
+        plane[r][c]++;
+        e.cells.push_back((long long)r * width + c);
+    }
+    if (e.lines)
+        tanks.push_back(square);
+    else
+        buckets[bucketOf(square)].push_back(square);
+}
+
+void ThreatMap::drop(long long square) {
+    unordered_map<long long, Entry>::iterator it = entries.find(square);
+    Entry &e = it->second;
+    Grid<int> &plane = planes[e.side];
+    for (size_t k = 0; k < e.cells.size(); k++)
+        plane[int(e.cells[k] / width)][int(e.cells[k] % width)]--;
+    vector<long long> &list = e.lines ? tanks : buckets[bucketOf(square)];
+    *find(list.begin(), list.end(), square) = list.back();
+    list.pop_back();
+    spare.push_back(vector<long long>());
+    spare.back().swap(e.cells);
+    entries.erase(it);
+}
+
+int ThreatMap::threat(bool side, int row, int col) const {
+    return planes[side][row][col];
+}
+
+const Grid<int> &ThreatMap::plane(bool side) const {
+    return planes[side];
+}
+
+unsigned long long ThreatMap::getRebuilds() const {
+    return rebuilds;
+}
+
+unsigned long long ThreatMap::getSearches() const {
+    return searches;
+}
+
+size_t ThreatMap::size() const {
+    return entries.size();
+}
+
+void countThreats(const Field &field, bool side, Grid<int> &plane) {
+    int h = field.getHeight(), w = field.getWidth();
+    plane = Grid<int>(h, w, 0);
+    Field board(field);
+    vector<Unit *> all;
+    board.getUnits(all);
+    Grid<int> costs(h, w);
+    MarkPlane reachable(h, w), attackable(h, w), threatened(h, w);
+    vector<SearchSquare> unvisited;
+    for (size_t k = 0; k < all.size(); k++) {
+        Unit *u = all[k];
+        if (u->getSide() != side) continue;
+        int row = u->getRow(), col = u->getCol();
+        getFieldCosts(board, u, costs);
+        searchReachable(costs, row, col, u->getMovPoints(), reachable, unvisited);
+        threatened.clear();
+        for (size_t i = 0; i < reachable.count(); i++) {
+            board.moveUnit(row, col, reachable.markedRow(i), reachable.markedCol(i));
+            if (side)
+                searchAttackable(board, u, attackable);
+            else
+                searchCloseAttackable(board, u->getRow(), u->getCol(), attackable);
+            board.moveUnit(u->getRow(), u->getCol(), row, col);
+            for (size_t j = 0; j < attackable.count(); j++)
+                if (!threatened.isMarked(attackable.markedRow(j), attackable.markedCol(j)))
+                    threatened.mark(attackable.markedRow(j), attackable.markedCol(j));
+        }
+        for (size_t j = 0; j < threatened.count(); j++)
+            plane[threatened.markedRow(j)][threatened.markedCol(j)]++;
+    }
+}
+
+void markThreats(const ThreatMap &threats, bool side, Grid<bool> &grd) {
+    const Grid<int> &plane = threats.plane(side);
+    grd = Grid<bool>(plane.numRows(), plane.numCols(), false);
+    for (int i = 0; i < int(plane.numRows()); i++)
+        for (int j = 0; j < int(plane.numCols()); j++)
+            grd[i][j] = plane[i][j] > 0;
+}
+
+// Count the squares where the planes of the map differ from countThreats
+static int countDifferences(const Field &field, const ThreatMap &threats) {
+    int wrong = 0;
+    Grid<int> plane;
+    for (int side = 0; side < 2; side++) {
+        countThreats(field, side != 0, plane);
+        for (int i = 0; i < int(field.getHeight()); i++)
+            for (int j = 0; j < int(field.getWidth()); j++)
+                if (plane[i][j] != threats.threat(side != 0, i, j)) wrong++;
+    }
+    return wrong;
+}
+
+bool benchThreats(const Field &field, ostream &os, int steps, unsigned seed) {
+    typedef chrono::steady_clock Clock;
+    Field board(field);
+    int h = board.getHeight(), w = board.getWidth();
+    TurnWorkspace ws(h, w);
+    mt19937 rng(seed);
+    ThreatMap threats;
+
+    Clock::time_point start = Clock::now();
+    threats.update(board);
+    double rebuild = chrono::duration<double>(Clock::now() - start).count();
+    int checks = 1, wrong = countDifferences(board, threats);
+
+    // A random unit moves or attacks at every step, turns aside
+    double updating = 0;
+    int played = 0, every = max(1, steps / 8);
+    vector<Unit *> all;
+    for (int s = 1; s <= steps; s++) {
+        board.getUnits(all);
+        if (all.empty()) break;
+        Unit *u = all[rng() % all.size()];
+        u->setMoved(false);
+        u->setAttacked(false);
+        UnitAction a;
+        a.row = u->getRow();
+        a.col = u->getCol();
+        const MarkPlane *targets = &ws.reachable;
+        if (rng() % 2 == 0) {
+            a.act = MOVE;
+            findReachable(board, u, ws);
+        } else {
+            a.act = ATTACK;
+            searchAttackable(board, u, ws.attackable);
+            targets = &ws.attackable;
+        }
+        if (targets->count() == 0) continue;
+        size_t t = rng() % targets->count();
+        a.trow = targets->markedRow(t);
+        a.tcol = targets->markedCol(t);
+        if (applyAction(board, u->getSide(), a, ws)) played++;
+
+        start = Clock::now();
+        threats.update(board);
+        updating += chrono::duration<double>(Clock::now() - start).count();
+        if (s % every == 0 || s == steps) {
+            wrong += countDifferences(board, threats);
+            checks++;
+        }
+    }
+
+    // Every square of both planes
+    long long total = 0;
+    start = Clock::now();
+    for (int side = 0; side < 2; side++)
+        for (int i = 0; i < h; i++)
+            for (int j = 0; j < w; j++)
+                total += threats.threat(side != 0, i, j);
+    double reading = chrono::duration<double>(Clock::now() - start).count();
+
+    if (w <= 32) {
+        Grid<bool> grd;
+        markThreats(threats, false, grd);
+        os << "Squares the enemies could attack next round:" << endl;
+        displayField(os, board, grd, DP_THREAT);
+    }
+    os << threats.size() << " units, " << checks << " checks, " << wrong << " squares differ from countThreats" << endl;
+    os << "Rebuild: " << rebuild * 1e3 << " ms, " << played << " actions: " << updating * 1e3 << " ms ("
+       << (played > 0 ? updating * 1e6 / played : 0) << " us each), "
+       << threats.getSearches() << " units searched" << endl;
+    os << 2LL * h * w << " squares read in " << reading * 1e3 << " ms ("
+       << (h * w > 0 ? reading * 1e9 / (2.0 * h * w) : 0) << " ns each), " << total << " threats" << endl;
+    return wrong == 0;
+}
@@ -0,0 +1,88 @@
+#ifndef THREATMAP_H_INCLUDED
+#define THREATMAP_H_INCLUDED
+
+/**** Squares each side could attack next round ****/
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+#include "NewGrid.h"
+#include "field.h"
+#include "workspace.h"
+
+/* For each side, how many of its units could attack every square
+   after a move: the squares a unit reaches, expanded by its attack.
+   Enemies attack as chooseEnemyTarget does (the adjacent squares),
+   players as searchAttackable does for their type.
+   The planes follow the field through its change log, as ReachCache
+   does: a unit is searched again only when a change falls within its
+   movement points, or for a player tank, in a row or column its shots
+   may cross. Reading a square is a lookup in the plane. */
+class ThreatMap {
+public:
+    ThreatMap();
+
+    // Bring the planes up to date with the field
+    void update(const Field &field);
+
+    // Units of side which could attack (row, col) next round,
+    // as of the last update
+    int threat(bool side, int row, int col) const;
+    const Grid<int> &plane(bool side) const;
+
+    // Forget everything, the next update searches every unit
+    void clear();
+
+    unsigned long long getRebuilds() const;
+    unsigned long long getSearches() const; // units searched, rebuilds included
+    size_t size() const;                    // units known
+
+private:
+    struct Entry {
+        bool side;
+        bool lines;                     // a player tank, whose shots go along lines
+        int pts;                        // movement points, i.e. the radius
+        int top, bottom, left, right;   // squares reached
+        std::vector<long long> cells;   // squares it could attack, row * width + col
+    };
+
+    void rebuild(const Field &field);
+    // Search the unit on the square and count its squares
+    void add(const Field &field, long long square);
+    // Take the unit of the square out of the planes
+    void drop(long long square);
+    long long bucketOf(long long square) const;
+
+    Grid<int> planes[2]; // enemy, player
+    std::unordered_map<long long, Entry> entries; // by square of the unit
+    // Squares of the entries by area, so a change only checks its neighbours
+    std::unordered_map<long long, std::vector<long long> > buckets;
+    std::vector<long long> tanks; // squares of the entries with lines
+    std::vector<std::vector<long long> > spare; // cell lists of dropped entries
+
+    // Scratch memory of the searches
+    MarkPlane reached;
+    MarkPlane attacked;
+    std::vector<long long> frontier, next;
+    std::vector<long long> changes, redo;
+
+    int height, width;
+    unsigned long long owner; // id of the field
+    unsigned long long seen;  // version of owner already applied
+    int maxPts;
+    unsigned long long rebuilds, searches;
+};
+
+// Count the same planes from scratch, with getFieldCosts, searchReachable and
+// the attack searches of every unit moved on a copy of the field
+void countThreats(const Field &field, bool side, Grid<int> &plane);
+
+// Mark the squares which units of side could attack next round,
+// for displayField with DP_THREAT. grd takes the size of the planes.
+void markThreats(const ThreatMap &threats, bool side, Grid<bool> &grd);
+
+// Play random legal actions on a copy of field, keeping a threat map
+// up to date, check it against countThreats and print the timings.
+// Return false if a square differs.
+bool benchThreats(const Field &field, std::ostream &os, int steps, unsigned seed);
+
+#endif // THREATMAP_H_INCLUDED
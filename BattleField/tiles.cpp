@@ -0,0 +1,112 @@
+#include <cassert>
+#include <cstring>
+#include "tiles.h"
+
+using namespace std;
+
+TileStore::TileStore(int h, int w) :
+    height(h), width(w) {
+}
+
+// Copy the tiles, the units are shared with the other store
+TileStore::TileStore(const TileStore &other) :
+    height(other.height), width(other.width) {
+    for (unordered_map<long long, Tile *>::const_iterator it = other.tiles.begin(); it != other.tiles.end(); ++it)
+        tiles[it->first] = new Tile(*it->second);
+}
+
+TileStore::~TileStore() {
+    for (unordered_map<long long, Tile *>::iterator it = tiles.begin(); it != tiles.end(); ++it)
+        delete it->second;
+}
+
+long long TileStore::tileKey(int row, int col) const {
+    return ((long long)(row / TILE_SIZE) << 32) | (col / TILE_SIZE);
+}
+
+const TileStore::Tile *TileStore::findTile(int row, int col) const {
+    unordered_map<long long, Tile *>::const_iterator it = tiles.find(tileKey(row, col));
+    return it == tiles.end() ? nullptr : it->second;
+}
+
+// Get the tile of (row, col), create it on first use
+TileStore::Tile *TileStore::getTile(int row, int col) {
+    Tile *&t = tiles[tileKey(row, col)];
+    if (t == nullptr) {
+        t = new Tile;
+        memset(t->units, 0, sizeof(t->units));
+        memset(t->terrains, PLAIN, sizeof(t->terrains));
+        t->used = 0;
+    }
+    return t;
+}
+
+// Drop the tile of (row, col) if nothing is left on it
+void TileStore::release(int row, int col) {
+    unordered_map<long long, Tile *>::iterator it = tiles.find(tileKey(row, col));
+    if (it != tiles.end() && it->second->used == 0) {
+        delete it->second;
+        tiles.erase(it);
+    }
+}
+
+Unit *TileStore::getUnit(int row, int col) const {
+    assert(row >= 0 && row < height && col >= 0 && col < width);
+
+    const Tile *t = findTile(row, col);
+    if (t == nullptr) return nullptr;
+    return t->units[(row % TILE_SIZE) * TILE_SIZE + col % TILE_SIZE];
+}
+
+void TileStore::setUnit(int row, int col, Unit *u) {
+    assert(row >= 0 && row < height && col >= 0 && col < width);
+
+    // Clearing a square of an implicit tile changes nothing
+    if (u == nullptr && findTile(row, col) == nullptr) return;
+
+    Tile *t = getTile(row, col);
+    int k = (row % TILE_SIZE) * TILE_SIZE + col % TILE_SIZE;
+    bool before = t->units[k] != nullptr || t->terrains[k] != PLAIN;
+    t->units[k] = u;
+    bool after = t->units[k] != nullptr || t->terrains[k] != PLAIN;
+    t->used += int(after) - int(before);
+    if (t->used == 0) release(row, col);
+}
+
+TerrainType TileStore::getTerrain(int row, int col) const {
+    assert(row >= 0 && row < height && col >= 0 && col < width);
+
+    const Tile *t = findTile(row, col);
+    if (t == nullptr) return PLAIN;
+    return TerrainType(t->terrains[(row % TILE_SIZE) * TILE_SIZE + col % TILE_SIZE]);
+}
+
+void TileStore::setTerrain(int row, int col, TerrainType type) {
+    assert(row >= 0 && row < height && col >= 0 && col < width);
+
+    if (type == PLAIN && findTile(row, col) == nullptr) return;
+
+    Tile *t = getTile(row, col);
+    int k = (row % TILE_SIZE) * TILE_SIZE + col % TILE_SIZE;
+    bool before = t->units[k] != nullptr || t->terrains[k] != PLAIN;
+    t->terrains[k] = (unsigned char)type;
+    bool after = t->units[k] != nullptr || t->terrains[k] != PLAIN;
+    t->used += int(after) - int(before);
+    if (t->used == 0) release(row, col);
+}
+
+size_t TileStore::getTileCount() const {
+    return tiles.size();
+}
+
+size_t TileStore::getMemoryUsage() const {
+    return sizeof(*this) + tiles.size() * (sizeof(Tile) + 2 * sizeof(void *) + sizeof(long long))
+         + tiles.bucket_count() * sizeof(void *);
+}
+
+void TileStore::getUnits(vector<Unit *> &out) const {
+    for (unordered_map<long long, Tile *>::const_iterator it = tiles.begin(); it != tiles.end(); ++it)
+        for (int k = 0; k < TILE_SIZE * TILE_SIZE; k++)
+            if (it->second->units[k] != nullptr)
+                out.push_back(it->second->units[k]);
+}
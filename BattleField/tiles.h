@@ -0,0 +1,71 @@
+#ifndef TILES_H_INCLUDED
+#define TILES_H_INCLUDED
+
+/**** Sparse storage of a huge battle field ****/
+#include <unordered_map>
+#include <vector>
+#include "terrain.h"
+#include "unit.h"
+
+// Side of a square tile
+const int TILE_SIZE = 16;
+
+/* The board is cut into TILE_SIZE x TILE_SIZE tiles kept in a hash map.
+   A tile holding only empty PLAIN squares is not stored at all:
+   it is created on the first write and released when it becomes empty again.
+   The store does not own the units. */
+class TileStore {
+public:
+    TileStore(int h, int w);
+    TileStore(const TileStore &other);
+    ~TileStore();
+
+    Unit *getUnit(int row, int col) const;
+    void setUnit(int row, int col, Unit *u);
+
+    TerrainType getTerrain(int row, int col) const;
+    void setTerrain(int row, int col, TerrainType t);
+
+    // Number of stored tiles
+    size_t getTileCount() const;
+    // Approximate bytes used by the tiles
+    size_t getMemoryUsage() const;
+
+    // Collect all units, in no particular order
+    void getUnits(std::vector<Unit *> &out) const;
+
+    // Visit every square that is not empty PLAIN: visit(row, col, unit, terrain)
+    template <typename Visit>
+    void forEachSquare(Visit visit) const;
+
+private:
+    struct Tile {
+        Unit *units[TILE_SIZE * TILE_SIZE];
+        unsigned char terrains[TILE_SIZE * TILE_SIZE];
+        int used; // squares holding a unit or a terrain other than PLAIN
+    };
+
+    TileStore &operator=(const TileStore &);
+
+    long long tileKey(int row, int col) const;
+    const Tile *findTile(int row, int col) const;
+    Tile *getTile(int row, int col);
+    void release(int row, int col);
+
+    int height, width;
+    std::unordered_map<long long, Tile *> tiles;
+};
+
+template <typename Visit>
+void TileStore::forEachSquare(Visit visit) const {
+    for (std::unordered_map<long long, Tile *>::const_iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        int top = int(it->first >> 32) * TILE_SIZE;
+        int left = int(it->first & 0xffffffff) * TILE_SIZE;
+        const Tile *t = it->second;
+        for (int k = 0; k < TILE_SIZE * TILE_SIZE; k++)
+            if (t->units[k] != nullptr || t->terrains[k] != PLAIN)
+                visit(top + k / TILE_SIZE, left + k % TILE_SIZE, t->units[k], TerrainType(t->terrains[k]));
+    }
+}
+
+#endif // TILES_H_INCLUDED
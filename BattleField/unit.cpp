@@ -7,7 +7,7 @@ using namespace std;
 
 // Constructor
 Unit::Unit(UnitType t, bool sd, int row, int col) :
-    type(t), side(sd), urow(row), ucol(col) {
+    type(t), side(sd), moved(false), attacked(false), urow(row), ucol(col) {
     switch (type) {
     case SOLDIER:
         hp = 2;
@@ -129,6 +129,11 @@ bool Unit::isAlive() const {
     return hp > 0;
 }
 
+// Get the remaining hit points
+int Unit::getHp() const {
+    return hp;
+}
+
 // Get the unit type
 UnitType Unit::getType() const {
     return type;
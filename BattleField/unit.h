@@ -11,6 +11,9 @@ enum UnitType { SOLDIER,
                 HYDRAULISK,
 };
 
+// Number of unit types
+const int UNIT_TYPES = HYDRAULISK + 1;
+
 /* Class for units */
 class Unit {
 public:
@@ -44,6 +47,9 @@ public:
     // Check if the unit is alive
     bool isAlive() const;
 
+    // Get the remaining hit points
+    int getHp() const;
+
     // Get the unit type
     UnitType getType() const;
 
@@ -0,0 +1,293 @@
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <functional>
+#include "workspace.h"
+
+using namespace std;
+
+/** Allocation counting **/
+
+#ifdef BF_COUNT_ALLOCS
+// Per thread, as each thread plays its turns in its own workspace
+static thread_local unsigned long allocCount = 0;
+
+// Replace the global allocation functions to count every heap allocation
+void *operator new(size_t n) {
+    allocCount++;
+    void *p = malloc(n == 0 ? 1 : n);
+    if (p == nullptr) throw bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t n) {
+    return operator new(n);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+#endif
+
+unsigned long heapAllocations() {
+#ifdef BF_COUNT_ALLOCS
+    return allocCount;
+#else
+    return 0;
+#endif
+}
+
+bool allocCountingEnabled() {
+#ifdef BF_COUNT_ALLOCS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/** MarkPlane **/
+
+MarkPlane::MarkPlane() :
+    rows(0), cols(0), sparse(false), cells(), table(), slots(), marked() {
+}
+
+MarkPlane::MarkPlane(int h, int w) :
+    rows(0), cols(0), sparse(false), cells(), table(), slots(), marked() {
+    resize(h, w);
+}
+
+void MarkPlane::resize(int h, int w) {
+    if (h == rows && w == cols) {
+        clear();
+        return;
+    }
+    rows = h;
+    cols = w;
+    sparse = size_t(h) * w > MAX_DENSE_MARKS;
+    cells = sparse ? Grid<bool>() : Grid<bool>(h, w, false);
+    table.clear();
+    slots.clear();
+    marked.clear();
+}
+
+void MarkPlane::reserve(size_t n) {
+    marked.reserve(n);
+    if (!sparse) return;
+    slots.reserve(n);
+    size_t size = 16;
+    while (size < 2 * n)
+        size *= 2;
+    if (table.size() < size) growTable(size);
+}
+
+// Only the marked cells are reset
+void MarkPlane::clear() {
+    if (sparse) {
+        for (size_t i = 0; i < slots.size(); i++)
+            table[slots[i]] = -1;
+        slots.clear();
+    } else {
+        for (size_t i = 0; i < marked.size(); i++)
+            cells[marked[i] / cols][marked[i] % cols] = false;
+    }
+    marked.clear();
+}
+
+// The slot holding cell, or the free slot where it goes
+size_t MarkPlane::slotOf(long long cell) const {
+    size_t mask = table.size() - 1;
+    size_t s = size_t((unsigned long long)cell * 0x9E3779B97F4A7C15ULL >> 32) & mask;
+    while (table[s] != -1 && table[s] != cell)
+        s = (s + 1) & mask;
+    return s;
+}
+
+// Rehash the marked cells into a table of the given size, a power of two
+void MarkPlane::growTable(size_t size) {
+    table.assign(size, -1);
+    for (size_t i = 0; i < marked.size(); i++) {
+        slots[i] = slotOf(marked[i]);
+        table[slots[i]] = marked[i];
+    }
+}
+
+void MarkPlane::mark(int row, int col) {
+    assert(inBounds(row, col));
+
+    long long cell = (long long)row * cols + col;
+    if (!sparse) {
+        if (cells[row][col]) return;
+        cells[row][col] = true;
+        marked.push_back(cell);
+        return;
+    }
+
+    // Keep the table at most half full
+    if (table.size() < 2 * (marked.size() + 1)) growTable(max(size_t(16), 2 * table.size()));
+    size_t s = slotOf(cell);
+    if (table[s] == cell) return;
+    table[s] = cell;
+    slots.push_back(s);
+    marked.push_back(cell);
+}
+
+bool MarkPlane::isMarked(int row, int col) const {
+    if (!inBounds(row, col)) return false;
+    if (!sparse) return cells[row][col];
+    return !table.empty() && table[slotOf((long long)row * cols + col)] != -1;
+}
+
+bool MarkPlane::inBounds(int row, int col) const {
+    return row >= 0 && row < rows && col >= 0 && col < cols;
+}
+
+size_t MarkPlane::numRows() const {
+    return rows;
+}
+
+size_t MarkPlane::numCols() const {
+    return cols;
+}
+
+size_t MarkPlane::count() const {
+    return marked.size();
+}
+
+int MarkPlane::markedRow(size_t i) const {
+    return int(marked[i] / cols);
+}
+
+int MarkPlane::markedCol(size_t i) const {
+    return int(marked[i] % cols);
+}
+
+const Grid<bool> &MarkPlane::grid() const {
+    return cells;
+}
+
+/** SquareMarks **/
+
+SquareMarks::SquareMarks(const Grid<bool> &grid) :
+    grid(&grid), plane(nullptr) {
+}
+
+SquareMarks::SquareMarks(const MarkPlane &plane) :
+    grid(nullptr), plane(&plane) {
+}
+
+bool SquareMarks::isMarked(int row, int col) const {
+    if (plane != nullptr) return plane->isMarked(row, col);
+    return grid->inBounds(row, col) && (*grid)[row][col];
+}
+
+/** UnitCursor **/
+
+UnitCursor::UnitCursor() :
+    side(false), cursor(-1), seen(0) {
+}
+
+void UnitCursor::begin(const Field &field, bool s) {
+    side = s;
+    cursor = -1;
+    seen = field.getVersion();
+    pending.clear();
+    addUnits(field);
+}
+
+void UnitCursor::addUnits(const Field &field) {
+    long long width = field.getWidth();
+    field.getUnits(units);
+    for (size_t k = 0; k < units.size(); k++) {
+        long long cell = units[k]->getRow() * width + units[k]->getCol();
+        if (units[k]->getSide() == side && cell > cursor) {
+            pending.push_back(cell);
+            push_heap(pending.begin(), pending.end(), greater<long long>());
+        }
+    }
+}
+
+Unit *UnitCursor::next(const Field &field) {
+    long long width = field.getWidth();
+    // Units which came to a square ahead since the last call are met there
+    if (field.getChangesSince(seen, changes)) {
+        for (size_t k = 0; k < changes.size(); k++) {
+            Unit *u = changes[k] > cursor ? field.getUnit(int(changes[k] / width), int(changes[k] % width)) : nullptr;
+            if (u != nullptr && u->getSide() == side) {
+                pending.push_back(changes[k]);
+                push_heap(pending.begin(), pending.end(), greater<long long>());
+            }
+        }
+    } else {
+        addUnits(field);
+    }
+    seen = field.getVersion();
+
+    while (!pending.empty()) {
+        long long cell = pending.front();
+        pop_heap(pending.begin(), pending.end(), greater<long long>());
+        pending.pop_back();
+        if (cell <= cursor) continue; // met already
+        cursor = cell;
+        Unit *u = field.getUnit(int(cell / width), int(cell % width));
+        if (u != nullptr && u->getSide() == side) return u;
+    }
+    return nullptr;
+}
+
+/** TurnWorkspace **/
+
+TurnWorkspace::TurnWorkspace() :
+    enemyMoves(ENEMY_MOVE_MANHATTAN), turns(0), turnStart(0), lastTurnAllocs(0), steadyAllocs(0) {
+}
+
+TurnWorkspace::TurnWorkspace(int h, int w) :
+    enemyMoves(ENEMY_MOVE_MANHATTAN), turns(0), turnStart(0), lastTurnAllocs(0), steadyAllocs(0) {
+    resize(h, w);
+}
+
+// Reserve everything a turn may need
+void TurnWorkspace::resize(int h, int w) {
+    // Movement and attack ranges are small, so is the scratch they need
+    size_t scratch = min(size_t(h) * w, size_t(256));
+    actionable.resize(h, w);
+    actionable.reserve(scratch);
+    reachable.resize(h, w);
+    reachable.reserve(scratch);
+    attackable.resize(h, w);
+    attackable.reserve(scratch);
+    actions.reserve(3);
+    frontier.reserve(scratch);
+}
+
+void TurnWorkspace::beginTurn() {
+    turnStart = heapAllocations();
+}
+
+void TurnWorkspace::endTurn() {
+    lastTurnAllocs = heapAllocations() - turnStart;
+    // The first turn warms up the containers
+    if (turns > 0 && lastTurnAllocs > steadyAllocs)
+        steadyAllocs = lastTurnAllocs;
+    turns++;
+}
+
+int TurnWorkspace::getTurns() const {
+    return turns;
+}
+
+unsigned long TurnWorkspace::getLastTurnAllocs() const {
+    return lastTurnAllocs;
+}
+
+unsigned long TurnWorkspace::getSteadyAllocs() const {
+    return steadyAllocs;
+}
+
+void TurnWorkspace::startSteadyState() {
+    steadyAllocs = 0;
+}
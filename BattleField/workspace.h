@@ -0,0 +1,164 @@
+#ifndef WORKSPACE_H_INCLUDED
+#define WORKSPACE_H_INCLUDED
+
+/**** Scratch memory reused across turns ****/
+#include <vector>
+#include "NewGrid.h"
+#include "actions.h"
+#include "reachcache.h"
+#include "enemyplan.h"
+#include "pathgraph.h"
+#include "flowfield.h"
+
+// Data structure for storing squares during path finding
+struct SearchSquare {
+    SearchSquare(int r, int c, int p) :
+        row(r), col(c), pts(p) {
+    }
+
+    int row;
+    int col;
+    int pts;
+};
+
+/* A plane of flags which remembers the marked cells,
+   so that clearing it only touches what was marked.
+   A plane of more than MAX_DENSE_MARKS cells, e.g. of a huge chunked field,
+   keeps its marked cells in a hash table instead of a grid: its memory
+   follows the marks, not the area, and grid() is empty. */
+class MarkPlane {
+public:
+    MarkPlane();
+    MarkPlane(int h, int w);
+
+    static const size_t MAX_DENSE_MARKS = size_t(1) << 24;
+
+    // Resize the plane, all cells become unmarked
+    void resize(int h, int w);
+
+    // Reserve room for n marked cells
+    void reserve(size_t n);
+
+    // Unmark every marked cell
+    void clear();
+
+    void mark(int row, int col);
+    bool isMarked(int row, int col) const;
+    bool inBounds(int row, int col) const;
+
+    size_t numRows() const;
+    size_t numCols() const;
+
+    // Number of marked cells
+    size_t count() const;
+    // The i-th marked cell, in marking order
+    int markedRow(size_t i) const;
+    int markedCol(size_t i) const;
+
+    // View the plane as a grid, empty if the plane is sparse
+    const Grid<bool> &grid() const;
+
+private:
+    int rows, cols;
+    bool sparse;
+    Grid<bool> cells;              // flags of a dense plane
+    std::vector<long long> table;  // marked cells of a sparse plane, open addressing, -1 if free
+    std::vector<size_t> slots;     // slot in table of every marked cell
+    std::vector<long long> marked; // row * cols + col
+
+    size_t slotOf(long long cell) const;
+    void growTable(size_t size);
+};
+
+/* The marks shown on a board, from a grid or from a MarkPlane */
+class SquareMarks {
+public:
+    SquareMarks(const Grid<bool> &grid);
+    SquareMarks(const MarkPlane &plane);
+
+    bool isMarked(int row, int col) const;
+
+private:
+    const Grid<bool> *grid;
+    const MarkPlane *plane;
+};
+
+/* The units of one side in the order a scan of the board, row after row,
+   meets them while they act: a unit which moves, or is beaten back, to a
+   square after the one of the unit acting is met again there. Only the
+   squares of the units are visited, the changes come from the field's log. */
+class UnitCursor {
+public:
+    UnitCursor();
+
+    // Start before the first square
+    void begin(const Field &field, bool side);
+    // The unit of the side on the next square holding one, nullptr at the end
+    Unit *next(const Field &field);
+
+private:
+    bool side;
+    long long cursor; // row * width + col of the last square met
+    unsigned long long seen;
+    std::vector<long long> pending; // squares ahead, as a heap, smallest first
+    std::vector<long long> changes;
+    std::vector<Unit *> units;
+
+    // Add the squares of the units of the side after the cursor
+    void addUnits(const Field &field);
+};
+
+/* All temporary containers used by one turn of the game.
+   Sized once per map and reused, so a turn in the steady state
+   does not touch the heap. */
+class TurnWorkspace {
+public:
+    TurnWorkspace();
+    TurnWorkspace(int h, int w);
+
+    // Size the workspace for a map of h x w
+    void resize(int h, int w);
+
+    // Allocation accounting
+    void beginTurn();
+    void endTurn();
+    int getTurns() const;
+    // Heap allocations during the last finished turn
+    unsigned long getLastTurnAllocs() const;
+    // Maximal heap allocations of a turn, excluding the first one
+    unsigned long getSteadyAllocs() const;
+    // Only count the turns from the next one on as steady, the ones so
+    // far having warmed up the containers, e.g. through a whole game
+    void startSteadyState();
+
+    MarkPlane actionable;      // units which may still act, in row-major order
+    Grid<int> costs;           // around the unit searched, see findReachable
+    MarkPlane reachable;
+    MarkPlane attackable;
+    std::vector<Action> actions;
+    std::vector<SearchSquare> frontier;
+    std::vector<Unit *> units; // unit lists of the headless game
+    ReachCache reach;          // reachable squares kept between turns
+    EnemyPlans plans;          // enemy moves kept between turns
+    std::vector<Unit *> players;
+    std::vector<int> dists;
+    EnemyMoveMode enemyMoves;  // ENEMY_MOVE_MANHATTAN unless set
+    EnemyPaths paths;          // portal graphs kept between turns (ENEMY_MOVE_PATHS)
+    EnemyFlow flow;            // distance fields kept between turns (ENEMY_MOVE_FLOW)
+    UnitCursor order;          // enemy units of playEnemyTurn
+
+private:
+    int turns;
+    unsigned long turnStart;
+    unsigned long lastTurnAllocs;
+    unsigned long steadyAllocs;
+};
+
+// Number of heap allocations made by the calling thread
+// Always 0 unless built with BF_COUNT_ALLOCS
+unsigned long heapAllocations();
+
+// Check if heap allocations are counted
+bool allocCountingEnabled();
+
+#endif // WORKSPACE_H_INCLUDED
@@ -0,0 +1,216 @@
+import argparse
+import glob
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+from judger import TASKS
+
+# Self-checks of the engine, run through the modes of the program.
+# Each check returns True if it passed.
+
+
+def get_thisdir():
+    return os.path.dirname(os.path.abspath(__file__))
+
+
+def compile_program(thisdir, workdir, name='BattleField', flags=()):
+    srcs = [os.path.join(thisdir, 'BattleField', src) for src in TASKS[-1][1]]
+    exe_path = os.path.join(workdir, name)
+    subprocess.run(
+        ['g++', '-Wall', '-Wextra', '-Wno-return-type', '-pedantic', '-std=c++11', '-O2'] + list(flags)
+        + srcs + ['-o', exe_path, '-pthread'],
+        check=True
+    )
+    return exe_path
+
+
+def run(args):
+    print('$ ' + ' '.join([os.path.basename(args[0])] + [os.path.relpath(a) if os.path.exists(a) else a for a in args[1:]]))
+    return subprocess.run(args).returncode == 0
+
+
+def all_cases(thisdir):
+    return sorted(glob.glob(os.path.join(thisdir, 'data', '*', '*.in')))
+
+
+def check_checkpoints(exe, thisdir, workdir):
+    return run([exe, '--check-checkpoints'] + all_cases(thisdir))
+
+
+def check_hashes(exe, thisdir, workdir):
+    # Tasks 1 and 2 expect the output of earlier stages of the game
+    casedir = os.path.join(workdir, 'hashes')
+    os.makedirs(casedir)
+    cases = []
+    for task in ('3_task3', '4_task4', 'hidden_cases'):
+        for in_path in sorted(glob.glob(os.path.join(thisdir, 'data', task, '*.in'))):
+            base = os.path.join(casedir, task + '.' + os.path.basename(in_path)[:-len('.in')])
+            shutil.copy(in_path, base + '.in')
+            shutil.copy(in_path[:-len('.in')] + '.out', base + '.out')
+            cases.append(base)
+    return (run([exe, '--hash-manifest'] + [c + '.out' for c in cases])
+            and run([exe, '--verify-hashes'] + [c + '.in' for c in cases]))
+
+
+def shipped_maps(thisdir):
+    return [os.path.join(thisdir, 'maps', 'map1.txt'), os.path.join(thisdir, 'maps', 'map2.txt'),
+            os.path.join(thisdir, 'demo', 'map.txt')]
+
+
+def check_preview(exe, thisdir, workdir):
+    ok = True
+    for path in shipped_maps(thisdir):
+        ok = run([exe, '--bench-preview', path, '8', '8', '10']) and ok
+    return ok
+
+
+def check_threats(exe, thisdir, workdir):
+    ok = True
+    for path in shipped_maps(thisdir):
+        ok = run([exe, '--bench-threat', path, '8', '8', '200']) and ok
+    # Larger boards, with long open rows for the tanks
+    for shape in ('mixed', 'rays'):
+        path = os.path.join(workdir, shape + '.map')
+        ok = (run([exe, '--generate', path, os.path.join(workdir, shape + '.cmd'), '--size', '24x24',
+                   '--shape', shape, '--units', '20,20,20,20,20', '--rounds', '0'])
+              and run([exe, '--bench-threat', path, '24', '24', '200'])
+              and ok)
+    return ok
+
+
+def check_paths(exe, thisdir, workdir):
+    # Mazes have long ways around, where searches kept from goal to goal are tested
+    ok = True
+    for shape, seed in (('maze', '2'), ('mixed', '3')):
+        path = os.path.join(workdir, 'paths-' + shape + '.map')
+        ok = (run([exe, '--generate', path, os.path.join(workdir, 'paths-' + shape + '.cmd'), '--size', '512x512',
+                   '--shape', shape, '--seed', seed, '--rounds', '0'])
+              and run([exe, '--bench-paths', path, '512', '512', '300'])
+              and ok)
+    return ok
+
+
+def game_line(args):
+    print('$ ' + ' '.join([os.path.basename(args[0])] + [os.path.relpath(a) if os.path.exists(a) else a for a in args[1:]]))
+    res = subprocess.run(args, stdout=subprocess.PIPE, universal_newlines=True)
+    sys.stdout.write(res.stdout)
+    games = [line for line in res.stdout.splitlines() if line.startswith('game:')]
+    if res.returncode != 0 or not games:
+        return None
+    # Rounds and units left, not the time
+    return games[0].split(',')[:2]
+
+
+def check_sparse(exe, thisdir, workdir):
+    # Square ids of a 100000 x 100000 field do not fit in an int; the game
+    # there must go as on a small board holding the same squares
+    units = [(60001, 60001, 'M'), (60002, 60000, 'O'), (59999, 60003, 'W'),
+             (60000, 60000, 'S'), (60000, 60002, 'T'), (60003, 60001, 'B'),
+             (59990, 60000, 'S'), (60010, 60005, 'F'), (60005, 59990, 'H')]
+    games = []
+    for name, size, shift in (('sparse-huge', '100000', 0), ('sparse-small', '100', 59950)):
+        path = os.path.join(workdir, name + '.map')
+        with open(path, 'w') as f:
+            f.write('3 6\n')
+            for row, col, kind in units:
+                f.write('%d %d %s\n' % (row - shift, col - shift, kind))
+        games.append(game_line([exe, '--bench-sparse', path, size, size, '3']))
+    ok = games[0] is not None and games[0] == games[1]
+    if not ok:
+        print('The game on the huge field went differently')
+    # Small maps are compared with a dense field
+    for path in shipped_maps(thisdir):
+        ok = run([exe, '--bench-sparse', path, '8', '8', '3']) and ok
+    return ok
+
+
+def check_play(exe, thisdir, workdir):
+    # Generated scenarios of other sizes than the demo map are played from
+    # their commands, which are all valid answers on the right board
+    ok = True
+    for size, shape, seed in (('16x20', 'mixed', '4'), ('24x24', 'rays', '5'), ('9x31', 'maze', '6')):
+        path = os.path.join(workdir, 'play-' + shape + '.map')
+        commands = os.path.join(workdir, 'play-' + shape + '.cmd')
+        if not run([exe, '--generate', path, commands, '--size', size, '--shape', shape, '--seed', seed,
+                    '--rounds', '5']):
+            ok = False
+            continue
+        args = [exe, '--play', path, size]
+        print('$ ' + ' '.join([os.path.basename(args[0])] + [os.path.relpath(a) if os.path.exists(a) else a for a in args[1:]])
+              + ' < ' + os.path.relpath(commands))
+        with open(commands) as f:
+            res = subprocess.run(args, stdin=f, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                                 universal_newlines=True)
+        sys.stdout.write(res.stderr)
+        # A game not over when the input ends reports what it read
+        if res.returncode != 0 and not (res.stderr.startswith('Input ended') and ' 0 invalid' in res.stderr):
+            print('The commands were not played on the map')
+            ok = False
+    return ok
+
+
+def check_allocs(exe, thisdir, workdir):
+    # Once a game has warmed the workspace up, a turn must not touch the heap.
+    # Greedy games go the same way every time, so every turn after the first
+    # game is a steady one.
+    counting = compile_program(thisdir, workdir, 'BattleField-allocs', ['-DBF_COUNT_ALLOCS'])
+    path = os.path.join(workdir, 'allocs.map')
+    maps = [(m, '8') for m in shipped_maps(thisdir)]
+    ok = run([exe, '--generate', path, os.path.join(workdir, 'allocs.cmd'), '--size', '24x24',
+              '--shape', 'mixed', '--units', '20,20,20,20,20', '--rounds', '0'])
+    maps.append((path, '24'))
+    for m, size in maps:
+        args = [counting, '--selfplay', 'greedy', '20', '1', size, size, m]
+        print('$ ' + ' '.join([os.path.basename(args[0])] + [os.path.relpath(a) if os.path.exists(a) else a for a in args[1:]]))
+        res = subprocess.run(args, stdout=subprocess.PIPE, universal_newlines=True)
+        sys.stdout.write(res.stdout)
+        if res.returncode != 0 or not res.stdout.rstrip().endswith(' 0 allocations in a steady turn'):
+            print('A steady turn allocated')
+            ok = False
+    return ok
+
+
+CHECKS = [
+    ('checkpoints', check_checkpoints),
+    ('hashes', check_hashes),
+    ('preview', check_preview),
+    ('threats', check_threats),
+    ('paths', check_paths),
+    ('sparse', check_sparse),
+    ('play', check_play),
+    ('allocs', check_allocs),
+]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    names = [n for n, _ in CHECKS]
+    parser.add_argument(
+        'checks', nargs='*', metavar='check',
+        help='checks to run, among ' + ', '.join(names) + ' (defaults to all)'
+    )
+    args = parser.parse_args()
+    for name in args.checks:
+        if name not in names:
+            parser.error(f'unknown check {name}')
+    thisdir = get_thisdir()
+    workdir = tempfile.mkdtemp()
+    exe = compile_program(thisdir, workdir)
+    failed = []
+    for name, check in CHECKS:
+        if args.checks and name not in args.checks:
+            continue
+        print(f'[{name}]')
+        if not check(exe, thisdir, workdir):
+            failed.append(name)
+    if failed:
+        print('FAILED: ' + ', '.join(failed))
+        sys.exit(1)
+    print('All checks passed')
+
+
+if __name__ == '__main__':
+    main()
@@ -7,11 +7,11 @@ import sys
 import tempfile
 
 TASKS = [
-    ('1_task1', ['actions.cpp', 'algorithms.cpp','engine.cpp','field.cpp','terrain.cpp','unit.cpp','main.cpp']),
-    ('2_task2', ['actions.cpp', 'algorithms.cpp','engine.cpp','field.cpp','terrain.cpp','unit.cpp','main.cpp']),
-    ('3_task3', ['actions.cpp', 'algorithms.cpp','engine.cpp','field.cpp','terrain.cpp','unit.cpp','main.cpp']),
-    ('4_task4', ['actions.cpp', 'algorithms.cpp','engine.cpp','field.cpp','terrain.cpp','unit.cpp','main.cpp']),
-    ('hidden_cases', ['actions.cpp', 'algorithms.cpp','engine.cpp','field.cpp','terrain.cpp','unit.cpp','main.cpp']),
+    ('1_task1', ['actions.cpp', 'algorithms.cpp','engine.cpp','field.cpp','terrain.cpp','unit.cpp','workspace.cpp','batch.cpp','solver.cpp','tiles.cpp','controller.cpp','selfplay.cpp','reachcache.cpp','enemyplan.cpp','input.cpp','events.cpp','render.cpp','output.cpp','server.cpp','bfapi.cpp','scenario.cpp','pathgraph.cpp','flowfield.cpp','checkpoint.cpp','telemetry.cpp','framehash.cpp','perft.cpp','preview.cpp','threatmap.cpp','main.cpp']),
+    ('2_task2', ['actions.cpp', 'algorithms.cpp','engine.cpp','field.cpp','terrain.cpp','unit.cpp','workspace.cpp','batch.cpp','solver.cpp','tiles.cpp','controller.cpp','selfplay.cpp','reachcache.cpp','enemyplan.cpp','input.cpp','events.cpp','render.cpp','output.cpp','server.cpp','bfapi.cpp','scenario.cpp','pathgraph.cpp','flowfield.cpp','checkpoint.cpp','telemetry.cpp','framehash.cpp','perft.cpp','preview.cpp','threatmap.cpp','main.cpp']),
+    ('3_task3', ['actions.cpp', 'algorithms.cpp','engine.cpp','field.cpp','terrain.cpp','unit.cpp','workspace.cpp','batch.cpp','solver.cpp','tiles.cpp','controller.cpp','selfplay.cpp','reachcache.cpp','enemyplan.cpp','input.cpp','events.cpp','render.cpp','output.cpp','server.cpp','bfapi.cpp','scenario.cpp','pathgraph.cpp','flowfield.cpp','checkpoint.cpp','telemetry.cpp','framehash.cpp','perft.cpp','preview.cpp','threatmap.cpp','main.cpp']),
+    ('4_task4', ['actions.cpp', 'algorithms.cpp','engine.cpp','field.cpp','terrain.cpp','unit.cpp','workspace.cpp','batch.cpp','solver.cpp','tiles.cpp','controller.cpp','selfplay.cpp','reachcache.cpp','enemyplan.cpp','input.cpp','events.cpp','render.cpp','output.cpp','server.cpp','bfapi.cpp','scenario.cpp','pathgraph.cpp','flowfield.cpp','checkpoint.cpp','telemetry.cpp','framehash.cpp','perft.cpp','preview.cpp','threatmap.cpp','main.cpp']),
+    ('hidden_cases', ['actions.cpp', 'algorithms.cpp','engine.cpp','field.cpp','terrain.cpp','unit.cpp','workspace.cpp','batch.cpp','solver.cpp','tiles.cpp','controller.cpp','selfplay.cpp','reachcache.cpp','enemyplan.cpp','input.cpp','events.cpp','render.cpp','output.cpp','server.cpp','bfapi.cpp','scenario.cpp','pathgraph.cpp','flowfield.cpp','checkpoint.cpp','telemetry.cpp','framehash.cpp','perft.cpp','preview.cpp','threatmap.cpp','main.cpp']),
 ]
 TASK_NAMES = [n for n, _ in TASKS]
 TASK_NAME_TO_I = {n: i for i, n in enumerate(TASK_NAMES)}